@@ -0,0 +1,176 @@
+#include "conx_physics_internal.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Contact tests per second for the batched narrowphase against the
+// one-pair-at-a-time path it replaced. Pairs are sphere/sphere and
+// sphere/box candidates in sorted order, the way a broadphase hands them
+// over, about half of them touching. Usage: narrowphase_benchmark [pairs]
+// (the default stays in cache like a typical step's pair list).
+
+#define DEFAULT_PAIR_COUNT 16384
+#define TOTAL_TESTS 20000000
+
+static float random_range(float min, float max) {
+  return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+// Previous path: a square root per pair, hit or not
+
+static bool check_sphere_collision(Vec3 pos1, float r1, Vec3 pos2, float r2, Vec3 *normal, float *depth) {
+  Vec3 diff = vec3_subtract(pos1, pos2);
+  float distance = vec3_length(diff);
+  if (distance < (r1 + r2)) {
+    *normal = vec3_normalize(diff);
+    *depth = r1 + r2 - distance;
+    return true;
+  }
+  return false;
+}
+
+static bool check_sphere_box_collision(Vec3 sphere_pos, float radius, Vec3 box_pos, Vec3 half_extents,
+                                       Vec3 *normal, float *depth) {
+  Vec3 closest = {
+    fmaxf(box_pos.x - half_extents.x, fminf(sphere_pos.x, box_pos.x + half_extents.x)),
+    fmaxf(box_pos.y - half_extents.y, fminf(sphere_pos.y, box_pos.y + half_extents.y)),
+    fmaxf(box_pos.z - half_extents.z, fminf(sphere_pos.z, box_pos.z + half_extents.z))
+  };
+
+  Vec3 diff = vec3_subtract(sphere_pos, closest);
+  float distance = vec3_length(diff);
+
+  if (distance < radius) {
+    *normal = distance > 0 ? vec3_normalize(diff) : vec3_create(0, 1, 0);
+    *depth = radius - distance;
+    return true;
+  }
+  return false;
+}
+
+static void pairwise_narrowphase(const ConXBodyStreams *s, const ConXCollisionShape *shapes,
+                                 const ConXBodyPair *pairs, int count, ConXContactResult *contacts) {
+  for (int p = 0; p < count; p++) {
+    int a = pairs[p].a;
+    int b = pairs[p].b;
+    Vec3 position_a = vec3_create(s->position_x[a], s->position_y[a], s->position_z[a]);
+    Vec3 position_b = vec3_create(s->position_x[b], s->position_y[b], s->position_z[b]);
+    ConXContactResult *c = &contacts[p];
+
+    if (shapes[a].type == CONX_SHAPE_SPHERE && shapes[b].type == CONX_SHAPE_SPHERE) {
+      c->hit = check_sphere_collision(position_a, shapes[a].radius, position_b, shapes[b].radius,
+                                      &c->normal, &c->depth);
+    } else if (shapes[a].type == CONX_SHAPE_SPHERE) {
+      c->hit = check_sphere_box_collision(position_a, shapes[a].radius, position_b,
+                                          shapes[b].half_extents, &c->normal, &c->depth);
+    } else {
+      c->hit = check_sphere_box_collision(position_b, shapes[b].radius, position_a,
+                                          shapes[a].half_extents, &c->normal, &c->depth);
+      c->normal = vec3_multiply(c->normal, -1.0f);
+    }
+  }
+}
+
+static int count_hits(const ConXContactResult *contacts, int count) {
+  int hits = 0;
+  for (int p = 0; p < count; p++) {
+    hits += contacts[p].hit;
+  }
+  return hits;
+}
+
+static double seconds_since(Uint64 start) {
+  return (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+int main(int argc, char *argv[]) {
+  int pair_count = argc > 1 ? atoi(argv[1]) : DEFAULT_PAIR_COUNT;
+  if (pair_count <= 0) pair_count = DEFAULT_PAIR_COUNT;
+  int body_count = pair_count * 2;
+  int repeats = TOTAL_TESTS / pair_count + 1;
+
+  ConXBodyStreams streams = {0};
+  streams.position_x = malloc(sizeof(float) * body_count);
+  streams.position_y = malloc(sizeof(float) * body_count);
+  streams.position_z = malloc(sizeof(float) * body_count);
+  ConXCollisionShape *shapes = malloc(sizeof(ConXCollisionShape) * body_count);
+  ConXBodyPair *pairs = malloc(sizeof(ConXBodyPair) * pair_count);
+  ConXContactResult *expected = malloc(sizeof(ConXContactResult) * pair_count);
+  ConXContactResult *contacts = malloc(sizeof(ConXContactResult) * pair_count);
+  if (!streams.position_x || !streams.position_y || !streams.position_z || !shapes || !pairs ||
+      !expected || !contacts) {
+    printf("Failed to allocate benchmark data\n");
+    return -1;
+  }
+
+  // Bodies 2p and 2p + 1 form pair p, one in eight of them with a box
+  srand(1234);
+  for (int p = 0; p < pair_count; p++) {
+    int a = p * 2;
+    int b = a + 1;
+    pairs[p].a = a;
+    pairs[p].b = b;
+
+    for (int i = a; i <= b; i++) {
+      shapes[i].type = CONX_SHAPE_SPHERE;
+      shapes[i].radius = 0.5f;
+    }
+    if (p % 8 == 0) {
+      int box = rand() % 2 ? a : b;
+      shapes[box].type = CONX_SHAPE_BOX;
+      shapes[box].half_extents = vec3_create(random_range(0.5f, 1.0f), random_range(0.5f, 1.0f),
+                                             random_range(0.5f, 1.0f));
+    }
+
+    streams.position_x[a] = random_range(-100.0f, 100.0f);
+    streams.position_y[a] = random_range(-100.0f, 100.0f);
+    streams.position_z[a] = random_range(-100.0f, 100.0f);
+    // Inside the overlapping bounds, where a broadphase would report it
+    streams.position_x[b] = streams.position_x[a] + random_range(-1.0f, 1.0f);
+    streams.position_y[b] = streams.position_y[a] + random_range(-1.0f, 1.0f);
+    streams.position_z[b] = streams.position_z[a] + random_range(-1.0f, 1.0f);
+  }
+
+  Uint64 start = SDL_GetPerformanceCounter();
+  for (int r = 0; r < repeats; r++) {
+    pairwise_narrowphase(&streams, shapes, pairs, pair_count, expected);
+  }
+  double pairwise_seconds = seconds_since(start);
+
+  start = SDL_GetPerformanceCounter();
+  for (int r = 0; r < repeats; r++) {
+    conx_narrowphase(&streams, shapes, pairs, 0, pair_count, contacts);
+  }
+  double batched_seconds = seconds_since(start);
+
+  // Squared compares may disagree with the old test within rounding of the
+  // contact distance, nowhere else
+  int mismatches = 0;
+  for (int p = 0; p < pair_count; p++) {
+    if (expected[p].hit != contacts[p].hit ||
+        (contacts[p].hit && fabsf(expected[p].depth - contacts[p].depth) > 1e-5f)) {
+      mismatches++;
+    }
+  }
+
+  int hits = count_hits(contacts, pair_count);
+  double tests = (double)pair_count * repeats;
+  double total_hits = (double)hits * repeats;
+  printf("%d pairs, %d hits, %d mismatches\n", pair_count, hits, mismatches);
+  printf("%10s %14s %14s\n", "path", "Mpairs/s", "Mhits/s");
+  printf("%10s %14.1f %14.1f\n", "pairwise", tests / pairwise_seconds * 1e-6,
+         total_hits / pairwise_seconds * 1e-6);
+  printf("%10s %14.1f %14.1f\n", "batched", tests / batched_seconds * 1e-6,
+         total_hits / batched_seconds * 1e-6);
+  printf("speedup %.2fx\n", pairwise_seconds / batched_seconds);
+
+  free(streams.position_x);
+  free(streams.position_y);
+  free(streams.position_z);
+  free(shapes);
+  free(pairs);
+  free(expected);
+  free(contacts);
+  return 0;
+}
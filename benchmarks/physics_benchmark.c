@@ -0,0 +1,89 @@
+#include "conx_physics.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+// Step-time curve for conx_physics_update. Bodies are spread at a fixed
+// density over a static floor so the contact count grows linearly with n.
+
+#define WARMUP_STEPS 10
+#define TIMED_STEPS 50
+
+static const int body_counts[] = {100, 500, 1000, 5000, 10000, 20000, 50000};
+
+static float random_range(float min, float max) {
+  return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+static ConXBroadphaseType broadphase = CONX_BROADPHASE_SAP;
+static int thread_count = 1;
+
+static double run_scene(int body_count) {
+  ConXPhysicsConfig config = conx_physics_config_create(body_count + 1);
+  config.broadphase = broadphase;
+  config.grid_cell_size = 1.0f;
+  config.thread_count = thread_count;
+
+  if (!conx_physics_init_with_config(&config)) {
+    printf("Failed to initialize physics with %d bodies\n", body_count);
+    return -1.0;
+  }
+
+  // About one body per 8 cubic units
+  float extent = cbrtf((float)body_count * 8.0f) * 0.5f;
+
+  int floor_id = conx_physics_create_body(vec3_create(0.0f, -extent - 1.0f, 0.0f), 1.0f);
+  conx_physics_set_body_static(floor_id, true);
+  conx_physics_add_box_shape(floor_id, vec3_create(extent + 1.0f, 1.0f, extent + 1.0f));
+
+  srand(1234);
+  for (int i = 0; i < body_count; i++) {
+    Vec3 position = vec3_create(random_range(-extent, extent),
+                                random_range(-extent, extent),
+                                random_range(-extent, extent));
+    int id = conx_physics_create_body(position, 1.0f);
+    conx_physics_add_sphere_shape(id, 0.5f);
+    conx_physics_set_body_velocity(id, vec3_create(random_range(-1.0f, 1.0f), 0.0f,
+                                                   random_range(-1.0f, 1.0f)));
+  }
+
+  for (int i = 0; i < WARMUP_STEPS; i++) {
+    conx_physics_update(1.0f / 60.0f);
+  }
+
+  Uint64 start = SDL_GetPerformanceCounter();
+  for (int i = 0; i < TIMED_STEPS; i++) {
+    conx_physics_update(1.0f / 60.0f);
+  }
+  Uint64 end = SDL_GetPerformanceCounter();
+
+  conx_physics_shutdown();
+  return (double)(end - start) * 1000.0 / (double)SDL_GetPerformanceFrequency() / TIMED_STEPS;
+}
+
+int main(int argc, char *argv[]) {
+  int max_bodies = argc > 1 ? atoi(argv[1]) : 50000;
+  const char *broadphase_name = argc > 2 ? argv[2] : "sap";
+  if (strcmp(broadphase_name, "grid") == 0) {
+    broadphase = CONX_BROADPHASE_GRID;
+  } else if (strcmp(broadphase_name, "bvh") == 0) {
+    broadphase = CONX_BROADPHASE_BVH;
+  } else {
+    broadphase_name = "sap";
+  }
+  thread_count = argc > 3 ? atoi(argv[3]) : 1;
+
+  printf("broadphase: %s, threads: %d\n", broadphase_name, thread_count);
+  printf("%10s %14s %14s\n", "bodies", "ms/step", "us/body");
+  for (size_t i = 0; i < sizeof(body_counts) / sizeof(body_counts[0]); i++) {
+    int n = body_counts[i];
+    if (n > max_bodies) break;
+
+    double ms = run_scene(n);
+    if (ms < 0.0) return -1;
+    printf("%10d %14.3f %14.3f\n", n, ms, ms * 1000.0 / n);
+  }
+  return 0;
+}
@@ -10,14 +10,22 @@ typedef struct {
   const char *window_title;
   bool fullscreen;
   bool vsync;
+  int tick_rate;      // fixed simulation steps per second, 0 = no fixed step
+  int max_substeps;   // most fixed steps run per frame before time is dropped
+  bool core_profile;  // GL 3.3 core context drawn with shaders, 2.1 if refused
 } ConXConfig;
 
 // Engine state
 typedef struct {
   bool running;
   double delta_time;
+  double fixed_delta_time;   // seconds per fixed step, 0 when disabled
+  double accumulator;        // seconds not yet simulated
+  int max_substeps;
+  float interpolation_alpha; // fraction of a fixed step between the last two states
   void *window;
   void *renderer;
+  void *gl_context;          // the 3D path's; the 2D renderer keeps its own
 } ConXEngine;
 
 // Engine lifecycle
@@ -30,5 +38,8 @@ ConXEngine *conx_get_engine(void);
 void conx_set_clear_color(float r, float g, float b, float a);
 void conx_clear_screen(void);
 void conx_swap_buffers(void);
+// Makes the engine's GL context current again after the 2D renderer ran
+// in its own. GL calls made outside the engine should come after this.
+void conx_make_current(void);
 
 #endif
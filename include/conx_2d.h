@@ -30,7 +30,9 @@ void conx_2d_shutdown(void);
 ConXTexture *conx_load_texture(const char *filepath);
 void conx_free_texture(ConXTexture *texture);
 
-// Drawing functions
+// Drawing functions. They record into the render queue (conx_render.h),
+// which draws them at conx_swap_buffers layer by layer, and within a layer
+// in call order.
 void conx_draw_rect(Vec2 position, Vec2 size, Vec4 color);
 void conx_draw_circle(Vec2 center, float radius, Vec4 color);
 void conx_draw_sprite(ConXSprite *sprite);
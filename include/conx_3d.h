@@ -3,6 +3,7 @@
 
 #include "conx_math.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 // 3D Camera
 typedef struct {
@@ -15,13 +16,46 @@ typedef struct {
   float far_plane;
 } ConXCamera;
 
-// 3D Mesh
+// How a mesh's vertices are stored. Each vertex starts with its position
+// as 3 floats; the normal and optional texture coordinates follow at byte
+// offsets, either as floats or as packed normalized integers.
+typedef enum {
+  CONX_VERTEX_NONE,    // not stored; texture coordinates only
+  CONX_VERTEX_FLOAT,   // 3 floats for normals, 2 for texture coordinates
+  CONX_VERTEX_SNORM8,  // normals: x, y, z and a pad byte, -127..127 for -1..1
+  CONX_VERTEX_UNORM16  // texture coordinates: 0..65535 across the range below
+} ConXVertexFormat;
+
 typedef struct {
-  float *vertices;
+  int stride;
+  int normal_offset;
+  int texcoord_offset;
+  ConXVertexFormat normal_format;
+  ConXVertexFormat texcoord_format;
+  // UNORM16 texture coordinates decode to bias + scale * value / 65535
+  float texcoord_bias[2];
+  float texcoord_scale[2];
+} ConXVertexLayout;
+
+// Tightly packed layout for the given formats, texture range 0..1
+ConXVertexLayout conx_vertex_layout(ConXVertexFormat normal, ConXVertexFormat texcoord);
+
+// 3D Mesh. Vertices are laid out as layout describes, indices are
+// triangles. VAO/VBO/EBO are the GPU copies, 0 until uploaded.
+// The bounding sphere is in mesh space; a radius of 0 means not computed.
+// Meshes loaded from a .cxmesh cache keep vertices and indices in the
+// mapped file, which conx_free_mesh unmaps instead of freeing them.
+typedef struct {
+  void *vertices;
   unsigned int *indices;
   int vertex_count;
   int index_count;
+  ConXVertexLayout layout;
   unsigned int VAO, VBO, EBO;
+  Vec3 bounds_center;
+  float bounds_radius;
+  void *mapping;
+  size_t mapping_size;
 } ConXMesh;
 
 // 3D Object
@@ -33,22 +67,125 @@ typedef struct {
   ConXMesh *mesh;
 } ConXObject3D;
 
-// 3D subsystem
+// Draw counts for one frame
+typedef struct {
+  int draw_calls; // GL draw calls issued
+  int instances;  // cubes and spheres submitted, one draw call each before batching
+  int triangles;  // triangles drawn, after sphere LOD selection
+  int state_changes; // GL state calls issued
+  int state_skipped; // redundant ones the state tracker dropped
+  int culled;        // cubes, spheres and objects dropped outside the view frustum
+  int occluded;      // ones inside it dropped behind occluders
+  int visible;       // ones that passed both tests and were drawn
+  int stream_waits;  // times the CPU waited for the GPU to free streamed memory
+} ConXRenderStats;
+
+// 3D subsystem. In a core profile context (ConXConfig.core_profile)
+// everything draws instanced through shaders that read the camera from a
+// per-frame uniform buffer. Where the context allows, instances and
+// uniforms stream through a persistently mapped ring of three frames.
 bool conx_3d_init(void);
 void conx_3d_shutdown(void);
+// Draws take the camera they were recorded under: a set_camera that
+// changes it first flushes what was queued with the old one. The retained
+// scene is drawn at the frame's first conx_3d_flush, under the camera then.
+// Edits through conx_3d_get_camera's pointer flush nothing and apply to
+// every queued draw.
 void conx_3d_set_camera(ConXCamera *camera);
 ConXCamera *conx_3d_get_camera(void);
+// Sets the viewport and camera aspect; the engine calls this on resize
+void conx_3d_resize(int width, int height);
+// Sorts and draws everything recorded into the render queue since the last
+// flush, 2D included, with cubes and spheres instanced per mesh. GL
+// bindings are back to defaults afterwards, so call it before other code
+// draws into the context directly.
+void conx_3d_flush(void);
+// Flushes and closes the frame's stats; conx_swap_buffers calls this
+void conx_3d_end_frame(void);
+// Stats of the last frame ended
+ConXRenderStats conx_3d_get_stats(void);
 
 // Mesh creation
 ConXMesh *conx_create_cube_mesh(void);
 ConXMesh *conx_create_sphere_mesh(int segments);
 void conx_free_mesh(ConXMesh *mesh);
+// Loads a Wavefront .obj or glTF 2.0 (.gltf, .glb) model as one mesh, with
+// every glTF mesh's triangles merged in mesh space (node transforms are not
+// applied). Vertices without normals get smoothed face normals. The result
+// is cached in a binary <path>.cxmesh beside the source, which later loads
+// map and upload without parsing, as long as the source keeps its size
+// and either its modification time or its contents. Without the source
+// the cache is used as is, and a .cxmesh path loads that file directly.
+// Returns NULL on failure.
+ConXMesh *conx_load_mesh(const char *path);
+// Imports the source without looking at or writing its cache
+ConXMesh *conx_import_mesh(const char *path);
+// Writes the mesh as the cache of source_path, at cache_path or by default
+// <source_path>.cxmesh, so conx_load_mesh picks it up while the source is
+// unchanged
+bool conx_mesh_write_cache(const ConXMesh *mesh, const char *source_path,
+                           const char *cache_path);
+// Re-encodes the vertices in another layout. Packing texture coordinates
+// as UNORM16 fits them to the mesh's own range, whatever bias and scale
+// the layout gives. GPU copies are dropped and uploaded again on the next
+// draw.
+bool conx_mesh_set_layout(ConXMesh *mesh, ConXVertexLayout layout);
+// Copies vertices and indices into GPU buffers. Meshes created after 3D
+// init are uploaded right away, others on their first draw.
+bool conx_upload_mesh(ConXMesh *mesh);
+// Recomputes the bounding sphere; call after changing a mesh's vertices
+void conx_mesh_update_bounds(ConXMesh *mesh);
 
-// 3D drawing functions
+// 3D drawing functions. They record into the render queue, where opaque
+// draws sort by mesh and front to back, and ones with alpha below 1 blend
+// back to front after them. Anything outside the camera's view frustum is
+// dropped before it reaches GL.
 void conx_draw_cube(Vec3 position, Vec3 size, Vec4 color);
 void conx_draw_sphere(Vec3 position, float radius, Vec4 color);
 void conx_draw_object_3d(ConXObject3D *object);
 
+// Occlusion culling, off by default. Occluders are rasterized into a
+// low-resolution depth buffer on the CPU each frame, and cubes, spheres
+// and objects entirely behind them are dropped like those outside the
+// frustum. Occluders are only depth, never drawn, so a simplified stand-in
+// for a large object works best; they count from the flush after they are
+// given until the end of the frame.
+void conx_3d_set_occlusion_culling(bool enabled);
+void conx_draw_occluder(const ConXObject3D *object);
+
+// Unit cube and unit-diameter sphere meshes shared with conx_draw_cube and
+// conx_draw_sphere. Owned by the 3D subsystem; NULL before conx_3d_init.
+ConXMesh *conx_3d_get_cube_mesh(void);
+ConXMesh *conx_3d_get_sphere_mesh(void);
+
+// Retained scene. Objects added here are drawn every frame until removed,
+// so static geometry crosses from scripts once and its transform is only
+// rebuilt when it changes. Drawing still costs per object each frame:
+// every live object is queued, sorted, culled and streamed as an instance
+// like an immediate draw. Objects using the shared meshes are batched with
+// conx_draw_cube and conx_draw_sphere (spheres keep their level of
+// detail); objects sharing any other mesh are instanced together.
+//
+// Handles stay valid until their object is removed and are never confused
+// with a later object (until the slot's generation counter wraps after
+// 2048 reuses). The scene keeps a copy of the object but only points at
+// its mesh, which must outlive it. Clearing the scene or shutting down 3D
+// ends every handle.
+int conx_scene_add(const ConXObject3D *object);
+void conx_scene_remove(int handle);
+bool conx_scene_is_valid(int handle);
+void conx_scene_clear(void);
+int conx_scene_count(void);
+// Read-only view of the object, or NULL for a stale handle
+const ConXObject3D *conx_scene_get(int handle);
+void conx_scene_set(int handle, const ConXObject3D *object);
+void conx_scene_set_position(int handle, Vec3 position);
+void conx_scene_set_transform(int handle, Vec3 position, Vec3 rotation, Vec3 scale);
+void conx_scene_set_color(int handle, Vec4 color);
+// Also uses the object as an occluder every frame, when occlusion culling
+// is on. Objects start as plain ones.
+void conx_scene_set_occluder(int handle, bool occluder);
+
 // Camera utilities
 ConXCamera conx_camera_create(Vec3 position, Vec3 target, float fov);
 void conx_camera_look_at(ConXCamera *camera, Vec3 position, Vec3 target, Vec3 up);
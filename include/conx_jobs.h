@@ -0,0 +1,24 @@
+#ifndef CONX_JOBS_H
+#define CONX_JOBS_H
+
+#include <stdbool.h>
+
+// Processes items [begin, end) of a parallel-for
+typedef void (*ConXJobFunction)(void *context, int begin, int end);
+
+// Fixed pool of worker threads. The thread calling conx_job_pool_parallel_for
+// works alongside the pool, so a pool of N threads starts N - 1 workers.
+typedef struct ConXJobPool ConXJobPool;
+
+// thread_count <= 0 uses one thread per CPU core
+ConXJobPool *conx_job_pool_create(int thread_count);
+void conx_job_pool_destroy(ConXJobPool *pool);
+int conx_job_pool_thread_count(const ConXJobPool *pool);
+
+// Splits [0, count) into batches of batch_size and returns once all have
+// run. Batches may run in any order on any thread. Runs inline when pool
+// is NULL, has one thread, or is already busy (nested or concurrent calls).
+void conx_job_pool_parallel_for(ConXJobPool *pool, int count, int batch_size,
+                                ConXJobFunction function, void *context);
+
+#endif
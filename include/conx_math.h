@@ -33,6 +33,7 @@ float vec3_dot(Vec3 a, Vec3 b);
 Vec3 vec3_cross(Vec3 a, Vec3 b);
 float vec3_length(Vec3 v);
 Vec3 vec3_normalize(Vec3 v);
+Vec3 vec3_lerp(Vec3 a, Vec3 b, float t);
 
 // Matrix operations
 Mat4 mat4_identity(void);
@@ -43,5 +44,6 @@ Mat4 mat4_scale(Mat4 m, Vec3 scale);
 Mat4 mat4_perspective(float fov, float aspect, float near, float far);
 Mat4 mat4_orthographic(float left, float right, float bottom, float top,
                        float near, float far);
+Mat4 mat4_look_at(Vec3 eye, Vec3 target, Vec3 up);
 
 #endif
@@ -0,0 +1,30 @@
+#ifndef CONX_MESHOPT_H
+#define CONX_MESHOPT_H
+
+#include "conx_3d.h"
+#include <stdbool.h>
+
+// Offline mesh optimization, run by the conx_meshopt tool before a model
+// is shipped as a .cxmesh. Each pass rewrites the mesh's arrays and drops
+// its GPU copies; the triangles drawn stay the same. They return false
+// only when out of memory, leaving the mesh as it was.
+
+// Vertices entering the post-transform cache model the passes use
+#define CONX_MESHOPT_CACHE_SIZE 32
+
+// Merges vertices whose stored bytes are identical
+bool conx_meshopt_weld(ConXMesh *mesh);
+// Reorders triangles so consecutive ones reuse recently transformed
+// vertices (Forsyth's linear-speed ordering), unless the order they are
+// in already misses the cache less
+bool conx_meshopt_vertex_cache(ConXMesh *mesh);
+// Renumbers vertices in the order the triangles first use them, so
+// fetches walk the vertex buffer forward; unused vertices are dropped.
+// Run after conx_meshopt_vertex_cache.
+bool conx_meshopt_vertex_fetch(ConXMesh *mesh);
+
+// Average cache misses per triangle for a FIFO cache of cache_size
+// vertices: 3 at worst, about 0.5 for a well ordered regular grid
+float conx_meshopt_acmr(const ConXMesh *mesh, int cache_size);
+
+#endif
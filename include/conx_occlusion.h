@@ -0,0 +1,47 @@
+#ifndef CONX_OCCLUSION_H
+#define CONX_OCCLUSION_H
+
+#include "conx_3d.h"
+#include "conx_math.h"
+#include <stdbool.h>
+
+// Software occlusion buffer. Occluder meshes are rasterized on the CPU
+// into a low-resolution depth buffer, a few bands of rows per thread, and
+// a pyramid of each 2x2 block's farthest depth is built over it. Bounds
+// are then tested against the coarsest level that still resolves them.
+// Nothing here touches GL, so it works without a context.
+//
+// A frame goes: begin with the camera matrices, add occluders, rasterize,
+// then test. More occluders may be added and rasterized after testing.
+typedef struct ConXOcclusionBuffer ConXOcclusionBuffer;
+
+// width is rounded up to a multiple of 4; thread_count <= 0 uses one
+// thread per CPU core
+ConXOcclusionBuffer *conx_occlusion_create(int width, int height, int thread_count);
+void conx_occlusion_destroy(ConXOcclusionBuffer *buffer);
+
+// Clears the depth and sets the camera occluders and tests project with
+void conx_occlusion_begin(ConXOcclusionBuffer *buffer, const Mat4 *view, const Mat4 *projection);
+// Transforms and clips the object's mesh triangles, both sides, ready to
+// rasterize. The mesh is only read during the call.
+void conx_occlusion_add_occluder(ConXOcclusionBuffer *buffer, const ConXObject3D *object);
+// Draws the occluders added since the last call and rebuilds the pyramid
+void conx_occlusion_rasterize(ConXOcclusionBuffer *buffer);
+
+// Conservative tests: false only when every pixel the box covers has an
+// occluder in front of all of it. Boxes crossing the near plane or off
+// screen are reported visible; leave those to the frustum test.
+bool conx_occlusion_box_visible(const ConXOcclusionBuffer *buffer, Vec3 center,
+                                Vec3 half_extents);
+// Tests the objects still marked in visible, in the stream form of
+// conx_frustum_cull (spherical takes the radius from extent[0]), clearing
+// the hidden ones. Returns how many stay visible.
+int conx_occlusion_cull(const ConXOcclusionBuffer *buffer, const float *const center[3],
+                        const float *const extent[3], bool spherical, int count,
+                        unsigned char *visible);
+
+// Full-resolution depth as 1 / view depth of the nearest occluder, 0
+// where there is none, rows bottom to top
+const float *conx_occlusion_get_depth(const ConXOcclusionBuffer *buffer, int *width, int *height);
+
+#endif
@@ -3,6 +3,11 @@
 
 #include "conx_math.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Body streams are padded to a multiple of this many lanes
+#define CONX_PHYSICS_SIMD_WIDTH 8
 
 // Forward declaration
 typedef struct ConXRigidBody ConXRigidBody;
@@ -10,7 +15,52 @@ typedef struct ConXRigidBody ConXRigidBody;
 // Collision callback
 typedef void (*ConXCollisionCallback)(int body1_id, int body2_id, Vec3 normal);
 
-// Physics body
+typedef enum {
+  CONX_CONTACT_BEGIN,     // first step the bodies touch
+  CONX_CONTACT_STAY,      // still touching
+  CONX_CONTACT_END        // touched last step, not any more
+} ConXContactState;
+
+// One entry of the per-step contact event buffer, sorted by body pair
+typedef struct {
+  int body1_id;
+  int body2_id;
+  Vec3 normal;            // points from body2 towards body1
+  float impulse;          // normal impulse applied this step, 0 for END
+  ConXContactState state;
+} ConXContactEvent;
+
+// Scene queries
+typedef struct {
+  Vec3 origin;
+  Vec3 direction;         // need not be normalized
+  float max_distance;
+} ConXRay;
+
+typedef struct {
+  int body_id;            // -1 if nothing was hit
+  float distance;
+  Vec3 point;
+  Vec3 normal;
+} ConXRayHit;
+
+typedef struct {
+  Vec3 center;
+  float radius;
+} ConXSphereQuery;
+
+typedef struct {
+  Vec3 point;
+  float max_distance;
+  int ignore_body;        // e.g. the asking body itself, -1 for none
+} ConXNearestQuery;
+
+typedef struct {
+  int body_id;            // -1 if no body is within max_distance
+  float distance;         // to the body's surface, 0 if the point is inside
+} ConXNearestHit;
+
+// Physics body view, filled on demand by conx_physics_get_body
 typedef struct ConXRigidBody {
   Vec3 position;
   Vec3 velocity;
@@ -18,6 +68,7 @@ typedef struct ConXRigidBody {
   float mass;
   float restitution;
   bool is_static;
+  bool is_sleeping;
   ConXCollisionCallback collision_callback;
 } ConXRigidBody;
 
@@ -35,29 +86,252 @@ typedef struct {
   };
 } ConXCollisionShape;
 
+// Broadphase algorithm
+typedef enum {
+  CONX_BROADPHASE_SAP,    // sweep-and-prune, good general default
+  CONX_BROADPHASE_GRID,   // uniform spatial hash, best for dense equal-sized bodies
+  CONX_BROADPHASE_BVH     // dynamic AABB tree, best for mixed sizes and large static geometry
+} ConXBroadphaseType;
+
+// Physics configuration
+typedef struct {
+  int max_bodies;         // initial capacity, the world grows past it as needed
+  ConXBroadphaseType broadphase;
+  float grid_cell_size;   // for CONX_BROADPHASE_GRID, ideally about one body diameter
+  int thread_count;       // narrowphase threads including the caller, 0 = one per CPU core
+  bool allow_sleep;
+  float sleep_velocity;   // bodies slower than this (m/s) count as resting
+  float sleep_time;       // seconds a whole island must rest before it sleeps
+  int solver_iterations;  // contact solver passes per step, more for taller stacks
+} ConXPhysicsConfig;
+
+// Broadphase state (internal)
+struct ConXBroadphase;
+struct ConXJobPool;
+struct ConXContactSolver;
+
+// Narrowphase result for one candidate pair
+typedef struct {
+  Vec3 normal;
+  float depth;
+  bool hit;
+} ConXContactResult;
+
+// Hot body state, one aligned float stream per component (structure of arrays)
+typedef struct {
+  float *position_x, *position_y, *position_z;
+  float *previous_x, *previous_y, *previous_z;   // positions before the last step
+  float *velocity_x, *velocity_y, *velocity_z;
+  float *acceleration_x, *acceleration_y, *acceleration_z;
+  float *mass;
+  uint32_t *integrate_mask;   // all bits set for bodies that integrate, 0 for static or sleeping
+} ConXBodyStreams;
+
+// Handle slot. Slots live in fixed-size chunks, so their addresses never
+// change; the body data they point at is kept packed.
+typedef struct {
+  int index;              // position in the body arrays, -1 when free
+  int generation;         // bumped every time the slot is freed
+  int next_free;
+} ConXBodySlot;
+
+// One saved step of a snapshot ring
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  size_t capacity;
+  uint32_t tick;
+  bool valid;
+} ConXSnapshotEntry;
+
+// The last capacity steps, tick t kept in entry t % capacity
+typedef struct {
+  ConXSnapshotEntry *entries;
+  int capacity;
+} ConXSnapshotRing;
+
 // Physics world
 typedef struct {
-  ConXRigidBody *bodies;
+  ConXBodyStreams streams;
+  float *restitution;
+  bool *is_static;
+  bool *is_sleeping;
+  float *rest_time;         // seconds spent below the sleep velocity
+  int *island_next;         // sleeping bodies: next body in the same island, circular
+  int *island_parent;       // union-find scratch for building islands
+  unsigned char *island_restless;
+  ConXCollisionCallback *collision_callbacks;
   ConXCollisionShape *shapes;
+  int *handles;             // handle of each packed body, -1 once destroyed
+  ConXBodySlot **slot_chunks;
+  int slot_chunk_count;
+  int slot_count;
+  int free_slot;
+  int removed_count;        // destroyed bodies still waiting to be compacted away
+  int first_removed;
   int body_count;
-  int max_bodies;
+  int max_bodies;           // current capacity
   Vec3 gravity;
+  bool allow_sleep;
+  float sleep_velocity;
+  float sleep_time;
+  int solver_iterations;
+  ConXRigidBody body_view;
+  struct ConXBroadphase *broadphase;
+  struct ConXContactSolver *solver;   // persistent contact manifolds
+  struct ConXJobPool *jobs;
+  ConXContactResult *contacts;   // one per broadphase pair, in pair order
+  int contact_capacity;
+  ConXContactEvent *contact_events;
+  int contact_event_count;
+  int contact_event_capacity;
 } ConXPhysicsWorld;
 
-// Physics API
+// Physics API. Worlds are independent of each other: every conx_world_*
+// function takes the world it works on, and conx_physics_* functions are
+// shorthands for the default world the engine and Lua scripts use.
+ConXPhysicsConfig conx_physics_config_create(int max_bodies);
+ConXPhysicsWorld *conx_world_create(const ConXPhysicsConfig *config);
+void conx_world_destroy(ConXPhysicsWorld *world);
+// For worlds embedded in other structs. Shut a world down before
+// initializing it again.
+bool conx_world_init(ConXPhysicsWorld *world, const ConXPhysicsConfig *config);
+void conx_world_shutdown(ConXPhysicsWorld *world);
+void conx_world_update(ConXPhysicsWorld *world, float dt);
+void conx_world_set_gravity(ConXPhysicsWorld *world, Vec3 gravity);
+
+// Step count worlds by dt, one world per job on the pool, or one after
+// another with a NULL pool. Each world may appear only once. With a pool,
+// every world's narrowphase runs inline on the job stepping it, ignoring
+// its own thread_count; with a NULL pool each world uses its own threads.
+void conx_physics_step_worlds(ConXPhysicsWorld *const *worlds, int count, float dt,
+                              struct ConXJobPool *jobs);
+
+// Bodies are referred to by handles. A handle stays valid until its body
+// is destroyed and is never confused with a later body in the same slot
+// (until the slot's generation counter wraps after 2048 reuses). Handles
+// are only meaningful to the world that created them.
+int conx_world_create_body(ConXPhysicsWorld *world, Vec3 position, float mass);
+// Takes effect at once for the API; the packed arrays are compacted at the
+// start of the next step. Contacts of the body end without END events.
+void conx_world_destroy_body(ConXPhysicsWorld *world, int body_id);
+bool conx_world_is_body_valid(ConXPhysicsWorld *world, int body_id);
+// Use this to move bodies (static ones in particular) so the broadphase sees it
+void conx_world_set_body_position(ConXPhysicsWorld *world, int body_id, Vec3 position);
+void conx_world_set_body_velocity(ConXPhysicsWorld *world, int body_id, Vec3 velocity);
+void conx_world_set_body_static(ConXPhysicsWorld *world, int body_id, bool is_static);
+void conx_world_set_body_restitution(ConXPhysicsWorld *world, int body_id, float restitution);
+void conx_world_apply_force(ConXPhysicsWorld *world, int body_id, Vec3 force);
+void conx_world_add_sphere_shape(ConXPhysicsWorld *world, int body_id, float radius);
+void conx_world_add_box_shape(ConXPhysicsWorld *world, int body_id, Vec3 half_extents);
+
+// Resting bodies sleep island by island: a group of touching bodies only
+// sleeps once all of them have rested for sleep_time. Sleeping bodies are
+// skipped by integration and the broadphase, and wake when an awake body
+// touches them or when they are changed through the setters above.
+bool conx_world_is_body_sleeping(ConXPhysicsWorld *world, int body_id);
+void conx_world_wake_body(ConXPhysicsWorld *world, int body_id);
+
+// Position blended between the previous and current step; alpha 0 is the
+// previous state, 1 the current one. Use the engine's interpolation_alpha
+// to render a fixed-step simulation smoothly.
+Vec3 conx_world_get_interpolated_position(ConXPhysicsWorld *world, int body_id, float alpha);
+
+// Snapshot of one body, valid until the next call. Use the setters to
+// change a body; writes to the view are not seen by the world.
+const ConXRigidBody* conx_world_get_body(ConXPhysicsWorld *world, int body_id);
+// Contact events of the last step. The buffer is reused and stays valid
+// until the next update. Contacts of sleeping bodies neither end nor stay;
+// they are reported again when the bodies wake.
+const ConXContactEvent *conx_world_get_contact_events(ConXPhysicsWorld *world, int *count);
+
+// Per-body callbacks are dispatched from the event buffer at the end of
+// the step, for every BEGIN and STAY event, in body-pair order
+void conx_world_set_collision_callback(ConXPhysicsWorld *world, int body_id,
+                                       ConXCollisionCallback callback);
+
+// Spatial queries. Writes the ids of bodies whose bounds overlap the box
+// and returns how many were written.
+int conx_world_query_aabb(ConXPhysicsWorld *world, Vec3 min, Vec3 max, int *body_ids,
+                          int max_results);
+
+// Batched queries against the exact shapes. Each call answers count
+// queries at once, split across the world's worker threads. Call them
+// between steps, not from collision callbacks.
+
+// Closest hit along each ray. Rays that start inside a body do not hit it.
+void conx_world_raycast_batch(ConXPhysicsWorld *world, const ConXRay *rays, int count,
+                              ConXRayHit *hits);
+
+// Bodies overlapping each sphere. Query i writes up to max_per_query ids to
+// body_ids[i * max_per_query] onward and its result count to counts[i].
+void conx_world_overlap_sphere_batch(ConXPhysicsWorld *world, const ConXSphereQuery *spheres,
+                                     int count, int max_per_query, int *body_ids, int *counts);
+
+// Closest body to each point, measured to the shape's surface
+void conx_world_nearest_batch(ConXPhysicsWorld *world, const ConXNearestQuery *queries, int count,
+                              ConXNearestHit *hits);
+
+// Snapshots for rollback and replays. A snapshot is one flat buffer with
+// the bodies, handle slots, gravity and the solver's warm-start cache; the
+// broadphase is rebuilt from it on restore. It is only meaningful to the
+// same build and process (collision callbacks are stored as pointers).
+// Restoring copies the sections back in place and allocates only when the
+// snapshot holds more bodies than the world ever has.
+size_t conx_world_snapshot_size(ConXPhysicsWorld *world);
+// Returns the bytes written, or 0 if capacity is too small
+size_t conx_world_save_snapshot(ConXPhysicsWorld *world, void *buffer, size_t capacity);
+bool conx_world_restore_snapshot(ConXPhysicsWorld *world, const void *buffer, size_t size);
+// XOR of snapshot against base into out (snapshot_size bytes), bytes past
+// the end of base taken as zero. Between nearby steps most of the result
+// is zero and compresses well; applying it to base again gives snapshot.
+void conx_physics_snapshot_delta(void *out, const void *base, size_t base_size,
+                                 const void *snapshot, size_t snapshot_size);
+
+bool conx_snapshot_ring_init(ConXSnapshotRing *ring, int capacity);
+void conx_snapshot_ring_free(ConXSnapshotRing *ring);
+bool conx_snapshot_ring_save(ConXSnapshotRing *ring, ConXPhysicsWorld *world, uint32_t tick);
+// False if tick is no longer (or never was) in the ring. Newer entries stay
+// until they are saved over while re-simulating.
+bool conx_snapshot_ring_restore(const ConXSnapshotRing *ring, ConXPhysicsWorld *world,
+                                uint32_t tick);
+const void *conx_snapshot_ring_get(const ConXSnapshotRing *ring, uint32_t tick, size_t *size);
+// Delta of tick against tick - 1, both must be in the ring. Returns the
+// bytes written, or 0.
+size_t conx_snapshot_ring_delta(const ConXSnapshotRing *ring, uint32_t tick,
+                                void *out, size_t capacity);
+
+// Default world
 bool conx_physics_init(int max_bodies);
+// Shuts down the previous default world, if any
+bool conx_physics_init_with_config(const ConXPhysicsConfig *config);
 void conx_physics_shutdown(void);
+ConXPhysicsWorld* conx_physics_get_world(void);
 void conx_physics_update(float dt);
 void conx_physics_set_gravity(Vec3 gravity);
-
 int conx_physics_create_body(Vec3 position, float mass);
+void conx_physics_destroy_body(int body_id);
+bool conx_physics_is_body_valid(int body_id);
+void conx_physics_set_body_position(int body_id, Vec3 position);
 void conx_physics_set_body_velocity(int body_id, Vec3 velocity);
 void conx_physics_set_body_static(int body_id, bool is_static);
+void conx_physics_set_body_restitution(int body_id, float restitution);
+void conx_physics_apply_force(int body_id, Vec3 force);
 void conx_physics_add_sphere_shape(int body_id, float radius);
 void conx_physics_add_box_shape(int body_id, Vec3 half_extents);
-
-ConXRigidBody* conx_physics_get_body(int body_id);
-ConXPhysicsWorld* conx_physics_get_world(void);
+bool conx_physics_is_body_sleeping(int body_id);
+void conx_physics_wake_body(int body_id);
+Vec3 conx_physics_get_interpolated_position(int body_id, float alpha);
+const ConXRigidBody* conx_physics_get_body(int body_id);
+const ConXContactEvent *conx_physics_get_contact_events(int *count);
 void conx_physics_set_collision_callback(int body_id, ConXCollisionCallback callback);
+int conx_physics_query_aabb(Vec3 min, Vec3 max, int *body_ids, int max_results);
+void conx_physics_raycast_batch(const ConXRay *rays, int count, ConXRayHit *hits);
+void conx_physics_overlap_sphere_batch(const ConXSphereQuery *spheres, int count,
+                                       int max_per_query, int *body_ids, int *counts);
+void conx_physics_nearest_batch(const ConXNearestQuery *queries, int count, ConXNearestHit *hits);
+size_t conx_physics_snapshot_size(void);
+size_t conx_physics_save_snapshot(void *buffer, size_t capacity);
+bool conx_physics_restore_snapshot(const void *buffer, size_t size);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,72 @@
+#ifndef CONX_RENDER_H
+#define CONX_RENDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Render queue. Draw calls record commands during the frame; at submit
+// they are sorted by a 64-bit key and replayed, so draws sharing a mesh or
+// texture run together and opaque geometry goes front to back. Resources
+// a command points at must stay alive until the frame is submitted.
+//
+// Key layout, most significant first:
+//   layer (8 bits) | pass (2 bits) | pass-defined order (54 bits)
+// Commands with equal keys replay in the order they were recorded.
+#define CONX_RENDER_PASS_OPAQUE_3D 0
+#define CONX_RENDER_PASS_TRANSLUCENT_3D 1
+#define CONX_RENDER_PASS_2D 2
+
+#define CONX_RENDER_LAYER_MIN (-128)
+#define CONX_RENDER_LAYER_MAX 127
+
+// Runs one recorded command; payload is the copy made when it was pushed
+typedef void (*ConXRenderCommandFn)(void *payload);
+
+// Called around each run of consecutive commands of the same pass, to set
+// up and put back the state they share. Either may be NULL.
+typedef struct {
+  void (*begin)(void);
+  void (*end)(void);
+} ConXRenderPass;
+
+typedef struct {
+  int commands;     // commands replayed by the last submit
+  int pass_changes; // runs of one pass, each costing a begin and an end
+} ConXRenderQueueStats;
+
+// Layer of the commands recorded from now on, clamped to the range above.
+// Lower layers draw first; the default is 0.
+void conx_render_set_layer(int layer);
+int conx_render_get_layer(void);
+
+// Key for the current layer: pass and the pass's own order bits, of which
+// only the low 54 are kept
+uint64_t conx_render_key(int pass, uint64_t order);
+
+// Small per-frame id for a mesh, texture or other resource, for sort keys.
+// Ids count up from 1 in first-use order; NULL is 0. Past 16 bits every
+// new resource shares the last id, which costs sorting quality only.
+#define CONX_RENDER_ID_BITS 16
+unsigned int conx_render_resource_id(const void *resource);
+
+// Sort bits for a view depth: monotonic, 24 bits, 0 at or behind the eye
+#define CONX_RENDER_DEPTH_BITS 24
+uint32_t conx_render_depth_bits(float depth);
+
+// Records a command and returns size bytes of payload for the caller to
+// fill, or NULL when out of memory
+void *conx_render_push(uint64_t key, const ConXRenderPass *pass, ConXRenderCommandFn execute,
+                       size_t size);
+
+// Sorts and replays everything recorded since the last submit.
+// conx_swap_buffers calls this through conx_3d_end_frame.
+void conx_render_submit(void);
+// Drops recorded commands without running them
+void conx_render_discard(void);
+void conx_render_shutdown(void);
+
+// Stats of the last submit that replayed anything
+ConXRenderQueueStats conx_render_get_stats(void);
+
+#endif
@@ -1,5 +1,6 @@
 #include "conx_2d.h"
 #include "conx.h"
+#include "conx_render.h"
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,7 +15,8 @@ void conx_2d_init(void) {
 }
 
 void conx_2d_shutdown(void) {
-  // 2D subsystem cleanup
+  // Queued draws may point at textures about to be freed
+  conx_render_discard();
 }
 
 ConXTexture *conx_load_texture(const char *filepath) {
@@ -56,9 +58,38 @@ void conx_free_texture(ConXTexture *texture) {
   }
 }
 
-void conx_draw_rect(Vec2 position, Vec2 size, Vec4 color) {
+// Render queue pass. SDL batches renderer calls, so they are pushed to GL
+// before the next pass draws over them.
+static void end_2d_pass(void) {
   ConXEngine *engine = conx_get_engine();
   if (!engine || !engine->renderer) return;
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+  SDL_RenderFlush((SDL_Renderer *)engine->renderer);
+#endif
+}
+
+static const ConXRenderPass pass_2d = {NULL, end_2d_pass};
+
+// 2D has no depth buffer, so within a layer draws keep their call order:
+// all share one key, and equal keys replay in the order they were recorded
+static void *queue_2d(ConXRenderCommandFn execute, size_t size) {
+  return conx_render_push(conx_render_key(CONX_RENDER_PASS_2D, 0), &pass_2d, execute, size);
+}
+
+typedef struct {
+  Vec2 position;
+  Vec2 size;
+  Vec4 color;
+} RectCommand;
+
+static void execute_rect(void *payload) {
+  const RectCommand *command = payload;
+  ConXEngine *engine = conx_get_engine();
+  if (!engine || !engine->renderer) return;
+
+  Vec2 position = command->position;
+  Vec2 size = command->size;
+  Vec4 color = command->color;
 
   SDL_Renderer *renderer = (SDL_Renderer *)engine->renderer;
   SDL_SetRenderDrawColor(renderer, (Uint8)(color.x * 255), (Uint8)(color.y * 255), 
@@ -68,10 +99,29 @@ void conx_draw_rect(Vec2 position, Vec2 size, Vec4 color) {
   SDL_RenderFillRect(renderer, &rect);
 }
 
-void conx_draw_circle(Vec2 center, float radius, Vec4 color) {
+void conx_draw_rect(Vec2 position, Vec2 size, Vec4 color) {
+  RectCommand *command = queue_2d(execute_rect, sizeof(RectCommand));
+  if (!command) return;
+  command->position = position;
+  command->size = size;
+  command->color = color;
+}
+
+typedef struct {
+  Vec2 center;
+  float radius;
+  Vec4 color;
+} CircleCommand;
+
+static void execute_circle(void *payload) {
+  const CircleCommand *command = payload;
   ConXEngine *engine = conx_get_engine();
   if (!engine || !engine->renderer) return;
 
+  Vec2 center = command->center;
+  float radius = command->radius;
+  Vec4 color = command->color;
+
   SDL_Renderer *renderer = (SDL_Renderer *)engine->renderer;
   SDL_SetRenderDrawColor(renderer, (Uint8)(color.x * 255), (Uint8)(color.y * 255), 
                         (Uint8)(color.z * 255), (Uint8)(color.w * 255));
@@ -89,9 +139,25 @@ void conx_draw_circle(Vec2 center, float radius, Vec4 color) {
   }
 }
 
-void conx_draw_texture(ConXTexture *texture, Vec2 position, Vec2 size) {
-  if (!texture || !texture->texture) return;
-  
+void conx_draw_circle(Vec2 center, float radius, Vec4 color) {
+  CircleCommand *command = queue_2d(execute_circle, sizeof(CircleCommand));
+  if (!command) return;
+  command->center = center;
+  command->radius = radius;
+  command->color = color;
+}
+
+typedef struct {
+  ConXTexture *texture;
+  Vec2 position;
+  Vec2 size;
+} TextureCommand;
+
+static void execute_texture(void *payload) {
+  const TextureCommand *command = payload;
+  ConXTexture *texture = command->texture;
+  Vec2 position = command->position;
+  Vec2 size = command->size;
   ConXEngine *engine = conx_get_engine();
   if (!engine || !engine->renderer) return;
 
@@ -100,33 +166,49 @@ void conx_draw_texture(ConXTexture *texture, Vec2 position, Vec2 size) {
   SDL_RenderCopy(renderer, texture->texture, NULL, &dest);
 }
 
+void conx_draw_texture(ConXTexture *texture, Vec2 position, Vec2 size) {
+  if (!texture || !texture->texture) return;
+
+  TextureCommand *command = queue_2d(execute_texture, sizeof(TextureCommand));
+  if (!command) return;
+  command->texture = texture;
+  command->position = position;
+  command->size = size;
+}
+
+static void execute_sprite(void *payload) {
+  const ConXSprite *sprite = payload;
+  ConXEngine *engine = conx_get_engine();
+  if (!engine || !engine->renderer) return;
+
+  Vec2 scaled_size = {sprite->size.x * sprite->scale.x, sprite->size.y * sprite->scale.y};
+  SDL_Renderer *renderer = (SDL_Renderer *)engine->renderer;
+  SDL_SetTextureColorMod(sprite->texture->texture, 
+                        (Uint8)(sprite->color.x * 255),
+                        (Uint8)(sprite->color.y * 255), 
+                        (Uint8)(sprite->color.z * 255));
+  SDL_SetTextureAlphaMod(sprite->texture->texture, (Uint8)(sprite->color.w * 255));
+  
+  SDL_Rect dest = {(int)sprite->position.x, (int)sprite->position.y, 
+                   (int)scaled_size.x, (int)scaled_size.y};
+  
+  if (sprite->rotation != 0.0f) {
+    SDL_Point center = {(int)(scaled_size.x / 2), (int)(scaled_size.y / 2)};
+    SDL_RenderCopyEx(renderer, sprite->texture->texture, NULL, &dest, 
+                     sprite->rotation * 180.0f / M_PI, &center, SDL_FLIP_NONE);
+  } else {
+    SDL_RenderCopy(renderer, sprite->texture->texture, NULL, &dest);
+  }
+}
+
 void conx_draw_sprite(ConXSprite *sprite) {
   if (!sprite) return;
   
-  Vec2 scaled_size = {sprite->size.x * sprite->scale.x, sprite->size.y * sprite->scale.y};
-  
   if (sprite->texture) {
-    ConXEngine *engine = conx_get_engine();
-    if (!engine || !engine->renderer) return;
-    
-    SDL_Renderer *renderer = (SDL_Renderer *)engine->renderer;
-    SDL_SetTextureColorMod(sprite->texture->texture, 
-                          (Uint8)(sprite->color.x * 255),
-                          (Uint8)(sprite->color.y * 255), 
-                          (Uint8)(sprite->color.z * 255));
-    SDL_SetTextureAlphaMod(sprite->texture->texture, (Uint8)(sprite->color.w * 255));
-    
-    SDL_Rect dest = {(int)sprite->position.x, (int)sprite->position.y, 
-                     (int)scaled_size.x, (int)scaled_size.y};
-    
-    if (sprite->rotation != 0.0f) {
-      SDL_Point center = {(int)(scaled_size.x / 2), (int)(scaled_size.y / 2)};
-      SDL_RenderCopyEx(renderer, sprite->texture->texture, NULL, &dest, 
-                       sprite->rotation * 180.0f / M_PI, &center, SDL_FLIP_NONE);
-    } else {
-      SDL_RenderCopy(renderer, sprite->texture->texture, NULL, &dest);
-    }
+    ConXSprite *command = queue_2d(execute_sprite, sizeof(ConXSprite));
+    if (command) *command = *sprite;
   } else {
+    Vec2 scaled_size = {sprite->size.x * sprite->scale.x, sprite->size.y * sprite->scale.y};
     conx_draw_rect(sprite->position, scaled_size, sprite->color);
   }
 }
@@ -1,14 +1,375 @@
-#include "conx_3d.h"
+#include "conx_3d_internal.h"
 #include "conx.h"
+#include "conx_frustum.h"
+#include "conx_mesh_import.h"
+#include "conx_occlusion.h"
+#include "conx_render.h"
+#include "conx_stream.h"
 #include <SDL2/SDL.h>
 #include <GL/gl.h>
-#include <GL/glu.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+
+#define PI 3.14159265358979f
+
+// Sphere tessellations, coarsest first. Each level is used while its
+// chord error stays under half a pixel.
+#define SPHERE_LOD_COUNT 5
+static const int sphere_lod_segments[SPHERE_LOD_COUNT] = {6, 10, 16, 24, 32};
+#define INITIAL_INSTANCE_CAPACITY 64
+// Instance attributes start past the locations some drivers alias to
+// gl_Vertex (0) and gl_Normal (2), which core profile meshes use for the
+// same two
+#define POSITION_ATTRIBUTE 0
+#define NORMAL_ATTRIBUTE 2
+#define INSTANCE_ATTRIBUTE_BASE 4
+#define INSTANCE_ATTRIBUTE_COUNT 4
+// Bytes of instances and uniforms a frame can stream before the ring grows
+#define STREAM_REGION_SIZE (256 * 1024)
+#define FRAME_UNIFORM_BINDING 0
+// Occlusion buffer width; its height follows the viewport's aspect
+#define OCCLUSION_WIDTH 256
+#define INITIAL_OCCLUDER_CAPACITY 16
+
+// What the 3D path last set on the context, so repeated settings can be
+// skipped. Unknown values never match: NaN color, CONX_GL_UNKNOWN names.
+#define CONX_GL_UNKNOWN 0xFFFFFFFFu
+
+typedef struct {
+  unsigned int matrix_version; // camera matrices loaded, 0 for none
+  float color[4];
+  GLuint program;
+  GLuint vertex_array;
+  GLuint array_buffer;
+  GLuint element_buffer;       // of vertex array 0, the others keep their own
+  int client_arrays;           // vertex and normal arrays of vertex array 0, -1 unknown
+  GLuint pointer_buffer;       // where those arrays were last pointed
+  const void *pointer_base;
+  bool touched;                // something was set since the last release
+} ConXGLState;
 
 static ConXCamera current_camera;
 static bool is_3d_initialized = false;
+// Whether this frame's flushes have queued the retained scene yet
+static bool scene_submitted = false;
+// Whether 3D commands were recorded since the queue was last submitted
+static bool commands_queued = false;
+// Batch the queue replay is filling, drawn once a command needs another
+static ConXInstanceBatch *pending_batch = NULL;
+static ConXGLState gl_state;
+
+// View and projection, rebuilt when the camera or viewport changes. The
+// camera is also compared against the copy they were built from, because
+// conx_3d_get_camera hands out a writable pointer.
+static Mat4 view_matrix;
+static Mat4 projection_matrix;
+static ConXCamera matrix_camera;
+static unsigned int matrix_version = 0;
+static bool camera_dirty = true;
+// Projected pixels per unit of radius at distance 1
+static float lod_pixel_scale = 1.0f;
+// World-space planes of the same matrices
+static ConXFrustum view_frustum;
+// One visibility flag per instance of the batch being culled
+static unsigned char *cull_mask = NULL;
+static int cull_mask_capacity = 0;
+static ConXInstanceBatch cube_batch;
+static ConXInstanceBatch sphere_batches[SPHERE_LOD_COUNT];
+// Largest projected radius in pixels each sphere level is drawn at
+static float sphere_lod_max_radius[SPHERE_LOD_COUNT];
+static int viewport_width = 800;
+static int viewport_height = 600;
+static GLuint instance_program = 0;
+// Instances, and in a core profile the frame uniforms, stream through this
+// when the context supports it
+static ConXStreamBuffer stream;
+// Camera the frame uniforms were last written for this frame, 0 for none,
+// and the stream buffer they are in
+static unsigned int uniforms_version = 0;
+static unsigned int uniforms_generation = 0;
+static ConXRenderStats frame_stats;
+static ConXRenderStats last_frame_stats;
+// Occluders given this frame, rasterized at each flush that has new ones
+// or a new camera. Tests use the buffer only while occlusion_ready.
+static bool occlusion_enabled = false;
+static ConXOcclusionBuffer *occlusion = NULL;
+static ConXObject3D *occluders = NULL;
+static int occluder_count = 0;
+static int occluder_capacity = 0;
+static int occluders_rasterized = 0;
+static unsigned int occlusion_matrix_version = 0;
+static bool occlusion_ready = false;
+
+static const char *instance_vertex_source =
+  "#version 120\n"
+  "attribute vec4 model_x;\n"
+  "attribute vec4 model_y;\n"
+  "attribute vec4 model_z;\n"
+  "attribute vec4 instance_color;\n"
+  "void main() {\n"
+  "  vec4 local = vec4(gl_Vertex.xyz, 1.0);\n"
+  "  vec4 world = vec4(dot(model_x, local), dot(model_y, local), dot(model_z, local), 1.0);\n"
+  "  gl_Position = gl_ModelViewProjectionMatrix * world;\n"
+  "  gl_FrontColor = instance_color;\n"
+  "}\n";
+
+static const char *instance_fragment_source =
+  "#version 120\n"
+  "void main() {\n"
+  "  gl_FragColor = gl_Color;\n"
+  "}\n";
+
+// The same for a core profile, which has no built-in matrices: the camera
+// comes from the frame's uniform block
+static const char *core_vertex_source =
+  "#version 330 core\n"
+  "layout(std140) uniform Frame {\n"
+  "  mat4 view_projection;\n"
+  "};\n"
+  "in vec3 position;\n"
+  "in vec4 model_x;\n"
+  "in vec4 model_y;\n"
+  "in vec4 model_z;\n"
+  "in vec4 instance_color;\n"
+  "out vec4 color;\n"
+  "void main() {\n"
+  "  vec4 local = vec4(position, 1.0);\n"
+  "  vec4 world = vec4(dot(model_x, local), dot(model_y, local), dot(model_z, local), 1.0);\n"
+  "  gl_Position = view_projection * world;\n"
+  "  color = instance_color;\n"
+  "}\n";
+
+static const char *core_fragment_source =
+  "#version 330 core\n"
+  "in vec4 color;\n"
+  "out vec4 fragment_color;\n"
+  "void main() {\n"
+  "  fragment_color = color;\n"
+  "}\n";
+
+static void create_instance_program(void) {
+  const char *attributes[INSTANCE_ATTRIBUTE_BASE + INSTANCE_ATTRIBUTE_COUNT] = {
+    NULL, NULL, NULL, NULL, "model_x", "model_y", "model_z", "instance_color"
+  };
+  if (!conx_gl.core_profile) {
+    instance_program = conx_gl_create_program(instance_vertex_source, instance_fragment_source,
+                                              attributes,
+                                              INSTANCE_ATTRIBUTE_BASE + INSTANCE_ATTRIBUTE_COUNT);
+    if (!instance_program) {
+      printf("Instanced drawing unavailable, batches draw one call per instance\n");
+    }
+    return;
+  }
+
+  attributes[POSITION_ATTRIBUTE] = "position";
+  instance_program = conx_gl_create_program(core_vertex_source, core_fragment_source, attributes,
+                                            INSTANCE_ATTRIBUTE_BASE + INSTANCE_ATTRIBUTE_COUNT);
+  if (!instance_program) {
+    printf("Core profile shaders unavailable, 3D drawing disabled\n");
+    return;
+  }
+  GLuint block = conx_gl.GetUniformBlockIndex(instance_program, "Frame");
+  if (block != GL_INVALID_INDEX) {
+    conx_gl.UniformBlockBinding(instance_program, block, FRAME_UNIFORM_BINDING);
+  }
+}
+
+// GL state tracking
+
+static void forget_gl_state(void) {
+  gl_state.matrix_version = 0;
+  for (int i = 0; i < 4; i++) {
+    gl_state.color[i] = NAN;
+  }
+  gl_state.program = CONX_GL_UNKNOWN;
+  gl_state.vertex_array = CONX_GL_UNKNOWN;
+  gl_state.array_buffer = CONX_GL_UNKNOWN;
+  gl_state.element_buffer = CONX_GL_UNKNOWN;
+  gl_state.client_arrays = -1;
+  gl_state.pointer_buffer = CONX_GL_UNKNOWN;
+  gl_state.pointer_base = NULL;
+  gl_state.touched = false;
+}
+
+static inline bool state_unchanged(bool same, int calls) {
+  if (same) {
+    frame_stats.state_skipped += calls;
+    return true;
+  }
+  frame_stats.state_changes += calls;
+  gl_state.touched = true;
+  return false;
+}
+
+static void set_color(const float color[4]) {
+  if (state_unchanged(memcmp(gl_state.color, color, sizeof(gl_state.color)) == 0, 1)) return;
+  glColor4fv(color);
+  memcpy(gl_state.color, color, sizeof(gl_state.color));
+}
+
+static void use_program(GLuint program) {
+  if (!conx_gl.has_shaders) return;
+  if (state_unchanged(gl_state.program == program, 1)) return;
+  conx_gl.UseProgram(program);
+  gl_state.program = program;
+}
+
+static void bind_vertex_array(GLuint vertex_array) {
+  if (!conx_gl.has_vertex_arrays) return;
+  if (state_unchanged(gl_state.vertex_array == vertex_array, 1)) return;
+  conx_gl.BindVertexArray(vertex_array);
+  gl_state.vertex_array = vertex_array;
+}
+
+static void bind_buffer(GLenum target, GLuint buffer) {
+  if (!conx_gl.has_buffers) return;
+  GLuint *bound = target == GL_ARRAY_BUFFER ? &gl_state.array_buffer : &gl_state.element_buffer;
+
+  // A vertex array other than 0 takes the index buffer binding as its own
+  if (target == GL_ELEMENT_ARRAY_BUFFER && gl_state.vertex_array != 0 &&
+      conx_gl.has_vertex_arrays) {
+    frame_stats.state_changes++;
+    gl_state.touched = true;
+    conx_gl.BindBuffer(target, buffer);
+    return;
+  }
+  if (state_unchanged(*bound == buffer, 1)) return;
+  conx_gl.BindBuffer(target, buffer);
+  *bound = buffer;
+}
+
+static void set_client_arrays(bool enabled) {
+  if (conx_gl.core_profile) return;
+  if (state_unchanged(gl_state.client_arrays == (int)enabled, 2)) return;
+  if (enabled) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+  } else {
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+  gl_state.client_arrays = enabled;
+}
+
+// Fixed-function normal arrays normalize signed bytes themselves
+static void point_vertex_arrays(const ConXVertexLayout *layout, const char *start) {
+  GLenum normal_type = layout->normal_format == CONX_VERTEX_SNORM8 ? GL_BYTE : GL_FLOAT;
+  glVertexPointer(3, GL_FLOAT, layout->stride, start);
+  glNormalPointer(normal_type, layout->stride, start + layout->normal_offset);
+}
+
+// Core profile shaders read them as generic attributes instead
+static void point_vertex_attributes(const ConXVertexLayout *layout) {
+  bool packed = layout->normal_format == CONX_VERTEX_SNORM8;
+  conx_gl.EnableVertexAttribArray(POSITION_ATTRIBUTE);
+  conx_gl.VertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, layout->stride, NULL);
+  conx_gl.EnableVertexAttribArray(NORMAL_ATTRIBUTE);
+  conx_gl.VertexAttribPointer(NORMAL_ATTRIBUTE, 3, packed ? GL_BYTE : GL_FLOAT, packed,
+                              layout->stride, (const void *)(size_t)layout->normal_offset);
+}
+
+// Position and normal from the bound array buffer (base NULL) or from
+// client memory. A buffer or base belongs to one mesh, so it stands for
+// the layout too.
+static void set_vertex_pointers(GLuint buffer, const void *base, const ConXVertexLayout *layout) {
+  bool same = gl_state.pointer_buffer == buffer && gl_state.pointer_base == base;
+  if (state_unchanged(same, 2)) return;
+
+  point_vertex_arrays(layout, base);
+  gl_state.pointer_buffer = buffer;
+  gl_state.pointer_base = base;
+}
+
+// Puts bindings back to their defaults and forgets the rest. The 2D
+// renderer shares this context and draws from client memory.
+static void release_gl_state(void) {
+  if (!gl_state.touched) {
+    forget_gl_state();
+    return;
+  }
+  use_program(0);
+  bind_vertex_array(0);
+  bind_buffer(GL_ARRAY_BUFFER, 0);
+  bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  set_client_arrays(false);
+  forget_gl_state();
+}
+
+// Deleting a bound object unbinds it
+static void forget_buffer(GLuint buffer) {
+  if (gl_state.array_buffer == buffer) gl_state.array_buffer = 0;
+  if (gl_state.element_buffer == buffer) gl_state.element_buffer = 0;
+  if (gl_state.pointer_buffer == buffer) gl_state.pointer_buffer = CONX_GL_UNKNOWN;
+}
+
+void conx_3d_batch_release(ConXInstanceBatch *batch) {
+  if (batch->buffer) {
+    conx_gl.DeleteBuffers(1, &batch->buffer);
+    forget_buffer(batch->buffer);
+  }
+  free(batch->instances);
+  for (int axis = 0; axis < 3; axis++) {
+    free(batch->center[axis]);
+    free(batch->extent[axis]);
+  }
+  memset(batch, 0, sizeof(*batch));
+}
+
+static void free_batch(ConXInstanceBatch *batch) {
+  ConXMesh *mesh = batch->mesh;
+  conx_3d_batch_release(batch);
+  conx_free_mesh(mesh);
+}
+
+// Camera matrices
+
+static void update_camera_matrices(void) {
+  if (!camera_dirty && memcmp(&matrix_camera, &current_camera, sizeof(ConXCamera)) == 0) return;
+
+  projection_matrix = mat4_perspective(current_camera.fov * PI / 180.0f, current_camera.aspect,
+                                       current_camera.near_plane, current_camera.far_plane);
+  view_matrix = mat4_look_at(current_camera.position, current_camera.target, current_camera.up);
+  lod_pixel_scale = projection_matrix.m[1][1] * (float)viewport_height * 0.5f;
+  conx_frustum_extract(&view_frustum, &view_matrix, &projection_matrix);
+  matrix_camera = current_camera;
+  camera_dirty = false;
+  // Never 0, which marks the loaded matrices unknown
+  if (++matrix_version == 0) matrix_version = 1;
+}
+
+static void setup_3d_projection(void) {
+  update_camera_matrices();
+  // Core profile draws bind the frame uniforms instead
+  if (conx_gl.core_profile) return;
+  if (state_unchanged(gl_state.matrix_version == matrix_version, 2)) return;
+
+  glMatrixMode(GL_PROJECTION);
+  glLoadMatrixf(&projection_matrix.m[0][0]);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadMatrixf(&view_matrix.m[0][0]);
+  gl_state.matrix_version = matrix_version;
+}
+
+// Distance in front of the camera along its view direction
+static float view_depth(Vec3 point) {
+  update_camera_matrices();
+  const float (*m)[4] = view_matrix.m;
+  return -(m[0][2] * point.x + m[1][2] * point.y + m[2][2] * point.z + m[3][2]);
+}
+
+void conx_3d_resize(int width, int height) {
+  if (width <= 0 || height <= 0) return;
+  viewport_width = width;
+  viewport_height = height;
+  current_camera.aspect = (float)width / (float)height;
+  camera_dirty = true;
+  if (is_3d_initialized) {
+    conx_make_current();
+    glViewport(0, 0, width, height);
+  }
+}
 
 bool conx_3d_init(void) {
   if (is_3d_initialized) return true;
@@ -21,9 +382,42 @@ bool conx_3d_init(void) {
   );
 
   // Enable depth testing
+  conx_make_current();
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
 
+  // A circle of radius r pixels cut into n segments is off by about
+  // r * pi^2 / (2 n^2) pixels at the chord midpoints
+  for (int i = 0; i < SPHERE_LOD_COUNT; i++) {
+    float segments = (float)sphere_lod_segments[i];
+    sphere_lod_max_radius[i] = segments * segments / (PI * PI);
+  }
+  ConXEngine *engine = conx_get_engine();
+  if (engine && engine->window) {
+    int width, height;
+    SDL_GetWindowSize((SDL_Window*)engine->window, &width, &height);
+    conx_3d_resize(width, height);
+  }
+  camera_dirty = true;
+  forget_gl_state();
+
+  conx_gl_load();
+  bool core_ready = conx_gl.has_instancing && conx_gl.has_uniform_buffers;
+  if (conx_gl.core_profile && !core_ready) {
+    printf("Core profile context lacks instancing or uniform buffers, 3D drawing disabled\n");
+  } else if (conx_gl.has_instancing) {
+    create_instance_program();
+  }
+  if (conx_gl.has_streaming && conx_stream_create(&stream, STREAM_REGION_SIZE)) {
+    printf("Streaming 3D data through a %s ring buffer\n",
+           stream.mapped ? "persistently mapped" : "mapped");
+  } else if (conx_gl.core_profile && instance_program) {
+    // Core profile draws need the stream for their uniforms
+    printf("Stream buffer unavailable, 3D drawing disabled\n");
+    conx_gl.DeleteProgram(instance_program);
+    instance_program = 0;
+  }
+  uniforms_version = 0;
   is_3d_initialized = true;
   printf("ConX 3D subsystem initialized\n");
   return true;
@@ -31,17 +425,37 @@ bool conx_3d_init(void) {
 
 void conx_3d_shutdown(void) {
   if (!is_3d_initialized) return;
-  
+
+  // Queued commands point into the batches freed below
+  conx_render_discard();
+  conx_make_current();
+  pending_batch = NULL;
+  // Scene objects may use the shared meshes freed below
+  conx_scene_shutdown();
+  free_batch(&cube_batch);
+  for (int i = 0; i < SPHERE_LOD_COUNT; i++) {
+    free_batch(&sphere_batches[i]);
+  }
+  if (instance_program) {
+    conx_gl.DeleteProgram(instance_program);
+    instance_program = 0;
+  }
+  conx_stream_destroy(&stream);
+  free(cull_mask);
+  cull_mask = NULL;
+  cull_mask_capacity = 0;
+  conx_occlusion_destroy(occlusion);
+  occlusion = NULL;
+  free(occluders);
+  occluders = NULL;
+  occluder_count = occluder_capacity = occluders_rasterized = 0;
+  occlusion_ready = false;
+  release_gl_state();
   glDisable(GL_DEPTH_TEST);
   is_3d_initialized = false;
   printf("ConX 3D subsystem shutdown\n");
 }
 
-void conx_3d_set_camera(ConXCamera *camera) {
-  if (!camera) return;
-  current_camera = *camera;
-}
-
 ConXCamera *conx_3d_get_camera(void) {
   return &current_camera;
 }
@@ -65,176 +479,872 @@ void conx_camera_look_at(ConXCamera *camera, Vec3 position, Vec3 target, Vec3 up
   camera->up = up;
 }
 
-static void setup_3d_projection(void) {
-  // Get current window size for aspect ratio
-  ConXEngine *engine = conx_get_engine();
-  if (engine && engine->window) {
-    int width, height;
-    SDL_GetWindowSize((SDL_Window*)engine->window, &width, &height);
-    current_camera.aspect = (float)width / (float)height;
+// Points the vertex arrays at the mesh and returns what glDrawElements
+// takes for indices: an offset into the index buffer, or the client copy
+// when there are no buffer objects.
+static bool bind_mesh(ConXMesh *mesh, const void **indices) {
+  if (!mesh->VBO && !conx_upload_mesh(mesh)) {
+    if (!mesh->vertices || !mesh->indices || conx_gl.core_profile) return false;
+    bind_vertex_array(0);
+    bind_buffer(GL_ARRAY_BUFFER, 0);
+    set_client_arrays(true);
+    set_vertex_pointers(0, mesh->vertices, &mesh->layout);
+    *indices = mesh->indices;
+    return true;
   }
-  
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPerspective(current_camera.fov, current_camera.aspect, 
-                 current_camera.near_plane, current_camera.far_plane);
-  
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
-  gluLookAt(current_camera.position.x, current_camera.position.y, current_camera.position.z,
-            current_camera.target.x, current_camera.target.y, current_camera.target.z,
-            current_camera.up.x, current_camera.up.y, current_camera.up.z);
+
+  *indices = NULL;
+  if (mesh->VAO) {
+    bind_vertex_array(mesh->VAO);
+    return true;
+  }
+
+  bind_vertex_array(0);
+  bind_buffer(GL_ARRAY_BUFFER, mesh->VBO);
+  bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+  set_client_arrays(true);
+  set_vertex_pointers(mesh->VBO, NULL, &mesh->layout);
+  return true;
+}
+
+static void draw_mesh(ConXMesh *mesh) {
+  const void *indices;
+  if (!bind_mesh(mesh, &indices)) return;
+  use_program(0);
+  glDrawElements(GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_INT, indices);
+  frame_stats.draw_calls++;
+  frame_stats.triangles += mesh->index_count / 3;
+}
+
+// Each array is swapped in as soon as it grows, so a failure part way
+// leaves some longer than capacity but none shorter
+static bool grow_batch(ConXInstanceBatch *batch) {
+  int capacity = batch->capacity ? batch->capacity * 2 : INITIAL_INSTANCE_CAPACITY;
+  ConXInstance *instances = realloc(batch->instances, sizeof(ConXInstance) * capacity);
+  if (!instances) return false;
+  batch->instances = instances;
+
+  int extents = batch->spherical ? 1 : 3;
+  for (int axis = 0; axis < 3; axis++) {
+    float *center = realloc(batch->center[axis], sizeof(float) * capacity);
+    if (!center) return false;
+    batch->center[axis] = center;
+    if (axis >= extents) continue;
+    float *extent = realloc(batch->extent[axis], sizeof(float) * capacity);
+    if (!extent) return false;
+    batch->extent[axis] = extent;
+  }
+  batch->capacity = capacity;
+  return true;
+}
+
+static ConXInstance *batch_push(ConXInstanceBatch *batch, Vec3 center, Vec3 extent) {
+  if (batch->count == batch->capacity && !grow_batch(batch)) {
+    printf("Failed to grow instance batch\n");
+    return NULL;
+  }
+
+  int index = batch->count++;
+  batch->center[0][index] = center.x;
+  batch->center[1][index] = center.y;
+  batch->center[2][index] = center.z;
+  batch->extent[0][index] = extent.x;
+  if (!batch->spherical) {
+    batch->extent[1][index] = extent.y;
+    batch->extent[2][index] = extent.z;
+  }
+  frame_stats.instances++;
+  return &batch->instances[index];
+}
+
+
+// Writes data to the stream, forgetting the old buffer if it had to grow:
+// deleting it unbound it, and GenBuffers may hand its name out again
+static bool stream_write(const void *data, size_t size, size_t alignment, size_t *offset) {
+  GLuint buffer = stream.buffer;
+  if (!conx_stream_write(&stream, data, size, alignment, offset)) return false;
+  if (stream.buffer != buffer) forget_buffer(buffer);
+  return true;
+}
+
+// Core profile shaders read the camera from the Frame block, written to
+// the stream once per frame and camera
+static bool bind_frame_uniforms(void) {
+  if (uniforms_version == matrix_version && uniforms_generation == stream.generation) return true;
+
+  Mat4 view_projection = mat4_multiply(view_matrix, projection_matrix);
+  size_t offset;
+  if (!stream_write(&view_projection, sizeof(Mat4), (size_t)conx_gl.uniform_buffer_alignment,
+                    &offset)) {
+    return false;
+  }
+  conx_gl.BindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, stream.buffer,
+                          (ptrdiff_t)offset, sizeof(Mat4));
+  frame_stats.state_changes++;
+  gl_state.touched = true;
+  uniforms_version = matrix_version;
+  uniforms_generation = stream.generation;
+  return true;
+}
+
+// Draws count instances of the mesh in one call. They stream through the
+// ring when there is one; otherwise buffer, which is created on first use,
+// is re-specified whole so the driver can hand out fresh memory instead of
+// waiting for last frame's draw.
+static void draw_instances(ConXMesh *mesh, const ConXInstance *instances, int count,
+                           GLuint *buffer) {
+  if (conx_gl.core_profile && !bind_frame_uniforms()) return;
+  const void *indices;
+  if (!bind_mesh(mesh, &indices)) return;
+
+  size_t size = sizeof(ConXInstance) * (size_t)count;
+  size_t offset = 0;
+  if (stream.buffer) {
+    if (!stream_write(instances, size, sizeof(float) * 4, &offset)) return;
+    // Growing the stream took the uniforms' buffer with it
+    if (conx_gl.core_profile && !bind_frame_uniforms()) return;
+    bind_buffer(GL_ARRAY_BUFFER, stream.buffer);
+  } else {
+    if (!buffer) return;
+    if (!*buffer) conx_gl.GenBuffers(1, buffer);
+    bind_buffer(GL_ARRAY_BUFFER, *buffer);
+    conx_gl.BufferData(GL_ARRAY_BUFFER, (ptrdiff_t)size, instances, GL_STREAM_DRAW);
+  }
+
+  for (int i = 0; i < INSTANCE_ATTRIBUTE_COUNT; i++) {
+    GLuint location = INSTANCE_ATTRIBUTE_BASE + i;
+    conx_gl.EnableVertexAttribArray(location);
+    conx_gl.VertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(ConXInstance),
+                                (const void *)(offset + i * 4 * sizeof(float)));
+    conx_gl.VertexAttribDivisor(location, 1);
+  }
+
+  use_program(instance_program);
+  conx_gl.DrawElementsInstanced(GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_INT, indices, count);
+  frame_stats.draw_calls++;
+  frame_stats.triangles += mesh->index_count / 3 * count;
+
+  for (int i = 0; i < INSTANCE_ATTRIBUTE_COUNT; i++) {
+    conx_gl.VertexAttribDivisor(INSTANCE_ATTRIBUTE_BASE + i, 0);
+    conx_gl.DisableVertexAttribArray(INSTANCE_ATTRIBUTE_BASE + i);
+  }
+}
+
+// Without instancing each instance becomes its own transform and draw
+static void draw_batch_each(ConXInstanceBatch *batch) {
+  for (int i = 0; i < batch->count; i++) {
+    const ConXInstance *instance = &batch->instances[i];
+    const float (*m)[4] = instance->model;
+    const GLfloat columns[16] = {
+      m[0][0], m[1][0], m[2][0], 0.0f,
+      m[0][1], m[1][1], m[2][1], 0.0f,
+      m[0][2], m[1][2], m[2][2], 0.0f,
+      m[0][3], m[1][3], m[2][3], 1.0f
+    };
+
+    glPushMatrix();
+    glMultMatrixf(columns);
+    set_color(instance->color);
+    draw_mesh(batch->mesh);
+    glPopMatrix();
+  }
+}
+
+// Drops the instances outside the view frustum, keeping the rest in
+// submission order. Returns false when none are left.
+static bool cull_batch(ConXInstanceBatch *batch) {
+  if (batch->count > cull_mask_capacity) {
+    unsigned char *mask = realloc(cull_mask, batch->capacity);
+    if (!mask) {
+      // Drawing everything is still correct
+      frame_stats.visible += batch->count;
+      return true;
+    }
+    cull_mask = mask;
+    cull_mask_capacity = batch->capacity;
+  }
+
+  int visible = conx_frustum_cull(&view_frustum, (const float *const *)batch->center,
+                                  (const float *const *)batch->extent, batch->spherical,
+                                  batch->count, cull_mask);
+  frame_stats.culled += batch->count - visible;
+  if (occlusion_ready && visible > 0) {
+    int unoccluded = conx_occlusion_cull(occlusion, (const float *const *)batch->center,
+                                         (const float *const *)batch->extent, batch->spherical,
+                                         batch->count, cull_mask);
+    frame_stats.occluded += visible - unoccluded;
+    visible = unoccluded;
+  }
+  frame_stats.visible += visible;
+  if (visible == batch->count) return true;
+
+  int kept = 0;
+  for (int i = 0; i < batch->count; i++) {
+    if (!cull_mask[i]) continue;
+    if (kept != i) batch->instances[kept] = batch->instances[i];
+    kept++;
+  }
+  batch->count = kept;
+  return kept > 0;
+}
+
+static void batch_flush(ConXInstanceBatch *batch) {
+  if (batch->count == 0 || !batch->mesh) return;
+  if (!cull_batch(batch)) {
+    batch->count = 0;
+    return;
+  }
+
+  if (instance_program && (batch->mesh->VBO || conx_upload_mesh(batch->mesh))) {
+    draw_instances(batch->mesh, batch->instances, batch->count, &batch->buffer);
+  } else if (!conx_gl.core_profile) {
+    draw_batch_each(batch);
+  }
+  batch->count = 0;
+}
+
+// Render queue passes. Instances replay into batches in key order, so a
+// batch collects one mesh's run of commands and is drawn when the run
+// ends; translucent runs are short, since they interleave by depth.
+
+static void flush_pending_batch(void) {
+  if (!pending_batch) return;
+  batch_flush(pending_batch);
+  pending_batch = NULL;
+}
+
+static void begin_opaque_pass(void) {
+  conx_make_current();
+  setup_3d_projection();
+}
+
+static void end_opaque_pass(void) {
+  flush_pending_batch();
+  release_gl_state();
+}
+
+// Blended back to front over the opaque pass, without hiding each other
+static void begin_translucent_pass(void) {
+  conx_make_current();
+  setup_3d_projection();
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glDepthMask(GL_FALSE);
+}
+
+static void end_translucent_pass(void) {
+  flush_pending_batch();
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+  release_gl_state();
+}
+
+static const ConXRenderPass opaque_pass = {begin_opaque_pass, end_opaque_pass};
+static const ConXRenderPass translucent_pass = {begin_translucent_pass, end_translucent_pass};
+
+// Opaque keys order by mesh, instances ahead of single objects so they
+// stay one batch, then near to far. Translucent ones go far to near, then
+// by mesh.
+static uint64_t queue_key(const void *mesh, Vec3 position, bool translucent, bool single) {
+  uint64_t id = conx_render_resource_id(mesh);
+  uint64_t depth = conx_render_depth_bits(view_depth(position));
+  if (translucent) {
+    uint64_t far_first = ((1u << CONX_RENDER_DEPTH_BITS) - 1) - depth;
+    return conx_render_key(CONX_RENDER_PASS_TRANSLUCENT_3D,
+                           far_first << 30 | id << (30 - CONX_RENDER_ID_BITS));
+  }
+  return conx_render_key(CONX_RENDER_PASS_OPAQUE_3D, id << 38 | (uint64_t)single << 37 |
+                                                         depth << (37 - CONX_RENDER_DEPTH_BITS));
+}
+
+typedef struct {
+  ConXInstanceBatch *batch;
+  Vec3 center;
+  Vec3 extent;
+  ConXInstance instance;
+} InstanceCommand;
+
+static void execute_instance(void *payload) {
+  InstanceCommand *command = payload;
+  if (pending_batch != command->batch) flush_pending_batch();
+  ConXInstance *instance = batch_push(command->batch, command->center, command->extent);
+  if (instance) *instance = command->instance;
+  pending_batch = command->batch;
+}
+
+void conx_3d_queue_instance(ConXInstanceBatch *batch, const ConXInstance *instance, Vec3 center,
+                            Vec3 extent) {
+  bool translucent = instance->color[3] < 1.0f;
+  const ConXRenderPass *pass = translucent ? &translucent_pass : &opaque_pass;
+  InstanceCommand *command = conx_render_push(queue_key(batch->mesh, center, translucent, false), pass,
+                                              execute_instance, sizeof(InstanceCommand));
+  if (!command) return;
+  commands_queued = true;
+  command->batch = batch;
+  command->center = center;
+  command->extent = extent;
+  command->instance = *instance;
+}
+
+static void queue_shape(ConXInstanceBatch *batch, Vec3 position, Vec3 scale, Vec4 color) {
+  ConXInstance instance = {
+    .model = {
+      {scale.x, 0.0f, 0.0f, position.x},
+      {0.0f, scale.y, 0.0f, position.y},
+      {0.0f, 0.0f, scale.z, position.z}
+    },
+    .color = {color.x, color.y, color.z, color.w}
+  };
+  // Both shared meshes span -0.5 to 0.5
+  Vec3 extent = vec3_create(fabsf(scale.x) * 0.5f, fabsf(scale.y) * 0.5f, fabsf(scale.z) * 0.5f);
+  conx_3d_queue_instance(batch, &instance, position, extent);
+}
+
+// Occlusion culling
+
+void conx_3d_set_occlusion_culling(bool enabled) {
+  occlusion_enabled = enabled;
+  if (enabled) return;
+
+  conx_occlusion_destroy(occlusion);
+  occlusion = NULL;
+  occluder_count = occluders_rasterized = 0;
+  occlusion_ready = false;
+}
+
+void conx_draw_occluder(const ConXObject3D *object) {
+  if (!is_3d_initialized || !occlusion_enabled || !object || !object->mesh) return;
+
+  if (occluder_count == occluder_capacity) {
+    int capacity = occluder_capacity ? occluder_capacity * 2 : INITIAL_OCCLUDER_CAPACITY;
+    ConXObject3D *grown = realloc(occluders, sizeof(ConXObject3D) * capacity);
+    if (!grown) return;
+    occluders = grown;
+    occluder_capacity = capacity;
+  }
+  occluders[occluder_count++] = *object;
+}
+
+// Brings the occlusion buffer up to date with the occluders and camera
+// before the queue replays. Occluders are rasterized on the CPU, so this
+// needs no GL state.
+static void prepare_occlusion(void) {
+  occlusion_ready = false;
+  if (!occlusion_enabled || occluder_count == 0) return;
+
+  update_camera_matrices();
+  int height = (int)lrintf((float)OCCLUSION_WIDTH * viewport_height / viewport_width);
+  if (height < 1) height = 1;
+  int width = 0, current_height = 0;
+  if (occlusion) conx_occlusion_get_depth(occlusion, &width, &current_height);
+  if (current_height != height) {
+    conx_occlusion_destroy(occlusion);
+    occlusion = conx_occlusion_create(OCCLUSION_WIDTH, height, 0);
+    if (!occlusion) return;
+    occlusion_matrix_version = 0;
+  }
+
+  if (occlusion_matrix_version != matrix_version) {
+    conx_occlusion_begin(occlusion, &view_matrix, &projection_matrix);
+    occlusion_matrix_version = matrix_version;
+    occluders_rasterized = 0;
+  }
+  if (occluders_rasterized < occluder_count) {
+    for (int i = occluders_rasterized; i < occluder_count; i++) {
+      conx_occlusion_add_occluder(occlusion, &occluders[i]);
+    }
+    conx_occlusion_rasterize(occlusion);
+    occluders_rasterized = occluder_count;
+  }
+  occlusion_ready = true;
+}
+
+// Replays everything recorded so far under the current camera
+static void submit_queue(void) {
+  prepare_occlusion();
+  conx_render_submit();
+  commands_queued = false;
+}
+
+void conx_3d_set_camera(ConXCamera *camera) {
+  if (!camera) return;
+  // Queued commands load the camera when they replay, so draws recorded
+  // under the old one are drawn before it changes
+  if (commands_queued && memcmp(camera, &current_camera, sizeof(ConXCamera)) != 0) {
+    submit_queue();
+  }
+  current_camera = *camera;
+  camera_dirty = true;
+}
+
+void conx_3d_flush(void) {
+  // The retained scene is queued with the first flush of each frame
+  if (is_3d_initialized && !scene_submitted) {
+    conx_scene_submit();
+    scene_submitted = true;
+  }
+  submit_queue();
+}
+
+void conx_3d_end_frame(void) {
+  conx_3d_flush();
+  if (stream.buffer) {
+    conx_make_current();
+    if (conx_stream_end_frame(&stream)) frame_stats.stream_waits++;
+  }
+  // The next frame writes another region
+  uniforms_version = 0;
+  scene_submitted = false;
+  occluder_count = occluders_rasterized = 0;
+  occlusion_matrix_version = 0;
+  occlusion_ready = false;
+  last_frame_stats = frame_stats;
+  memset(&frame_stats, 0, sizeof(frame_stats));
+}
+
+ConXRenderStats conx_3d_get_stats(void) {
+  return last_frame_stats;
+}
+
+ConXInstanceBatch *conx_3d_cube_batch(void) {
+  if (!cube_batch.mesh) {
+    cube_batch.mesh = conx_create_cube_mesh();
+    if (!cube_batch.mesh) return NULL;
+  }
+  return &cube_batch;
 }
 
 void conx_draw_cube(Vec3 position, Vec3 size, Vec4 color) {
   if (!is_3d_initialized) return;
 
-  setup_3d_projection();
-  
-  glPushMatrix();
-  glTranslatef(position.x, position.y, position.z);
-  glScalef(size.x, size.y, size.z);
-  glColor4f(color.x, color.y, color.z, color.w);
+  ConXInstanceBatch *batch = conx_3d_cube_batch();
+  if (batch) queue_shape(batch, position, size, color);
+}
 
-  // Draw cube using immediate mode (simple implementation)
-  glBegin(GL_QUADS);
-  
-  // Front face
-  glVertex3f(-0.5f, -0.5f,  0.5f);
-  glVertex3f( 0.5f, -0.5f,  0.5f);
-  glVertex3f( 0.5f,  0.5f,  0.5f);
-  glVertex3f(-0.5f,  0.5f,  0.5f);
-  
-  // Back face
-  glVertex3f(-0.5f, -0.5f, -0.5f);
-  glVertex3f(-0.5f,  0.5f, -0.5f);
-  glVertex3f( 0.5f,  0.5f, -0.5f);
-  glVertex3f( 0.5f, -0.5f, -0.5f);
-  
-  // Top face
-  glVertex3f(-0.5f,  0.5f, -0.5f);
-  glVertex3f(-0.5f,  0.5f,  0.5f);
-  glVertex3f( 0.5f,  0.5f,  0.5f);
-  glVertex3f( 0.5f,  0.5f, -0.5f);
-  
-  // Bottom face
-  glVertex3f(-0.5f, -0.5f, -0.5f);
-  glVertex3f( 0.5f, -0.5f, -0.5f);
-  glVertex3f( 0.5f, -0.5f,  0.5f);
-  glVertex3f(-0.5f, -0.5f,  0.5f);
-  
-  // Right face
-  glVertex3f( 0.5f, -0.5f, -0.5f);
-  glVertex3f( 0.5f,  0.5f, -0.5f);
-  glVertex3f( 0.5f,  0.5f,  0.5f);
-  glVertex3f( 0.5f, -0.5f,  0.5f);
-  
-  // Left face
-  glVertex3f(-0.5f, -0.5f, -0.5f);
-  glVertex3f(-0.5f, -0.5f,  0.5f);
-  glVertex3f(-0.5f,  0.5f,  0.5f);
-  glVertex3f(-0.5f,  0.5f, -0.5f);
-  
-  glEnd();
-  glPopMatrix();
+// Level for a sphere's radius on screen under the current camera. Spheres
+// containing the eye get the finest level.
+static int sphere_lod(Vec3 position, float radius) {
+  Vec3 offset = vec3_subtract(position, current_camera.position);
+  float distance = vec3_length(offset);
+  if (distance <= radius) return SPHERE_LOD_COUNT - 1;
+
+  update_camera_matrices();
+  float pixels = radius / distance * lod_pixel_scale;
+  for (int i = 0; i < SPHERE_LOD_COUNT - 1; i++) {
+    if (pixels <= sphere_lod_max_radius[i]) return i;
+  }
+  return SPHERE_LOD_COUNT - 1;
+}
+
+ConXInstanceBatch *conx_3d_sphere_batch(Vec3 center, float radius) {
+  ConXInstanceBatch *batch = &sphere_batches[sphere_lod(center, radius)];
+  if (!batch->mesh) {
+    batch->spherical = true;
+    batch->mesh = conx_create_sphere_mesh(sphere_lod_segments[batch - sphere_batches]);
+    if (!batch->mesh) return NULL;
+  }
+  return batch;
 }
 
 void conx_draw_sphere(Vec3 position, float radius, Vec4 color) {
   if (!is_3d_initialized) return;
 
-  setup_3d_projection();
-  
-  glPushMatrix();
-  glTranslatef(position.x, position.y, position.z);
-  glColor4f(color.x, color.y, color.z, color.w);
+  ConXInstanceBatch *batch = conx_3d_sphere_batch(position, radius);
+  if (!batch) return;
+  // The mesh has unit diameter
+  float diameter = radius * 2.0f;
+  queue_shape(batch, position, vec3_create(diameter, diameter, diameter), color);
+}
 
-  // Simple sphere using GLU
-  GLUquadric *quad = gluNewQuadric();
-  gluSphere(quad, radius, 16, 16);
-  gluDeleteQuadric(quad);
-  
-  glPopMatrix();
+ConXMesh *conx_3d_get_cube_mesh(void) {
+  if (!is_3d_initialized) return NULL;
+  ConXInstanceBatch *batch = conx_3d_cube_batch();
+  return batch ? batch->mesh : NULL;
+}
+
+ConXMesh *conx_3d_get_sphere_mesh(void) {
+  if (!is_3d_initialized) return NULL;
+  ConXInstanceBatch *batch = &sphere_batches[SPHERE_LOD_COUNT - 1];
+  if (!batch->mesh) {
+    batch->spherical = true;
+    batch->mesh = conx_create_sphere_mesh(sphere_lod_segments[SPHERE_LOD_COUNT - 1]);
+  }
+  return batch->mesh;
+}
+
+bool conx_3d_is_cube_mesh(const ConXMesh *mesh) {
+  return mesh && cube_batch.mesh == mesh;
+}
+
+bool conx_3d_is_sphere_mesh(const ConXMesh *mesh) {
+  for (int i = 0; mesh && i < SPHERE_LOD_COUNT; i++) {
+    if (sphere_batches[i].mesh == mesh) return true;
+  }
+  return false;
 }
 
 ConXMesh *conx_create_cube_mesh(void) {
-  ConXMesh *mesh = malloc(sizeof(ConXMesh));
+  ConXMesh *mesh = calloc(1, sizeof(ConXMesh));
   if (!mesh) return NULL;
 
-  // Cube vertices (position only for simplicity)
+  // Unit cube, four vertices per face so each face keeps its own normal
   float vertices[] = {
     // Front face
-    -0.5f, -0.5f,  0.5f,
-     0.5f, -0.5f,  0.5f,
-     0.5f,  0.5f,  0.5f,
-    -0.5f,  0.5f,  0.5f,
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+     0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
     // Back face
-    -0.5f, -0.5f, -0.5f,
-    -0.5f,  0.5f, -0.5f,
-     0.5f,  0.5f, -0.5f,
-     0.5f, -0.5f, -0.5f
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+     0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+    // Top face
+    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+    // Bottom face
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+    // Right face
+     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+    // Left face
+    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f
   };
 
-  unsigned int indices[] = {
-    0, 1, 2, 2, 3, 0,   // Front
-    4, 5, 6, 6, 7, 4,   // Back
-    5, 3, 2, 2, 6, 5,   // Top
-    4, 7, 1, 1, 0, 4,   // Bottom
-    7, 6, 2, 2, 1, 7,   // Right
-    4, 0, 3, 3, 5, 4    // Left
-  };
+  unsigned int indices[36];
+  for (int face = 0; face < 6; face++) {
+    unsigned int base = face * 4;
+    unsigned int *quad = &indices[face * 6];
+    quad[0] = base;
+    quad[1] = base + 1;
+    quad[2] = base + 2;
+    quad[3] = base + 2;
+    quad[4] = base + 3;
+    quad[5] = base;
+  }
 
-  mesh->vertex_count = 8;
+  mesh->vertex_count = 24;
   mesh->index_count = 36;
+  mesh->layout = conx_vertex_layout(CONX_VERTEX_FLOAT, CONX_VERTEX_NONE);
   
   mesh->vertices = malloc(sizeof(vertices));
   mesh->indices = malloc(sizeof(indices));
+  if (!mesh->vertices || !mesh->indices) {
+    conx_free_mesh(mesh);
+    return NULL;
+  }
   
   memcpy(mesh->vertices, vertices, sizeof(vertices));
   memcpy(mesh->indices, indices, sizeof(indices));
+  conx_mesh_update_bounds(mesh);
 
+  if (is_3d_initialized) conx_upload_mesh(mesh);
   return mesh;
 }
 
 ConXMesh *conx_create_sphere_mesh(int segments) {
-  // Simplified sphere mesh creation
-  ConXMesh *mesh = malloc(sizeof(ConXMesh));
+  if (segments < 3) segments = 3;
+
+  ConXMesh *mesh = calloc(1, sizeof(ConXMesh));
   if (!mesh) return NULL;
-  
-  // For simplicity, return a basic sphere representation
-  // In a full implementation, this would generate proper sphere geometry
-  mesh->vertex_count = segments * segments;
-  mesh->index_count = segments * segments * 6;
-  mesh->vertices = NULL; // Would be allocated and filled
-  mesh->indices = NULL;  // Would be allocated and filled
-  
+
+  // Unit-diameter UV sphere, segments stacks by segments slices. The seam
+  // column is duplicated so every row has segments + 1 vertices.
+  int stacks = segments;
+  int slices = segments;
+  int row = slices + 1;
+  mesh->vertex_count = (stacks + 1) * row;
+  // Rows touching a pole get one triangle per slice, the others two
+  mesh->index_count = slices * (stacks - 1) * 2 * 3;
+  mesh->layout = conx_vertex_layout(CONX_VERTEX_FLOAT, CONX_VERTEX_NONE);
+  mesh->vertices = malloc((size_t)mesh->layout.stride * mesh->vertex_count);
+  mesh->indices = malloc(sizeof(unsigned int) * mesh->index_count);
+  if (!mesh->vertices || !mesh->indices) {
+    conx_free_mesh(mesh);
+    return NULL;
+  }
+
+  float *v = mesh->vertices;
+  for (int i = 0; i <= stacks; i++) {
+    float polar = PI * (float)i / (float)stacks;
+    float ring = sinf(polar);
+    float y = cosf(polar);
+    for (int j = 0; j <= slices; j++) {
+      float azimuth = 2.0f * PI * (float)j / (float)slices;
+      float nx = ring * sinf(azimuth);
+      float nz = ring * cosf(azimuth);
+      v[0] = nx * 0.5f;
+      v[1] = y * 0.5f;
+      v[2] = nz * 0.5f;
+      v[3] = nx;
+      v[4] = y;
+      v[5] = nz;
+      v += mesh->layout.stride / sizeof(float);
+    }
+  }
+
+  unsigned int *index = mesh->indices;
+  for (int i = 0; i < stacks; i++) {
+    for (int j = 0; j < slices; j++) {
+      unsigned int top = i * row + j;
+      unsigned int bottom = top + row;
+      if (i > 0) {
+        *index++ = top;
+        *index++ = bottom;
+        *index++ = top + 1;
+      }
+      if (i < stacks - 1) {
+        *index++ = top + 1;
+        *index++ = bottom;
+        *index++ = bottom + 1;
+      }
+    }
+  }
+  conx_mesh_update_bounds(mesh);
+
+  if (is_3d_initialized) conx_upload_mesh(mesh);
   return mesh;
 }
 
+void conx_mesh_update_bounds(ConXMesh *mesh) {
+  if (!mesh || !mesh->vertices || mesh->vertex_count <= 0) return;
+
+  // Centered on the box around the vertices, which is close enough to the
+  // tightest sphere for culling
+  const float *v = (const float *)conx_mesh_vertex(mesh, 0);
+  Vec3 low = vec3_create(v[0], v[1], v[2]);
+  Vec3 high = low;
+  for (int i = 1; i < mesh->vertex_count; i++) {
+    v = (const float *)conx_mesh_vertex(mesh, i);
+    low = vec3_create(fminf(low.x, v[0]), fminf(low.y, v[1]), fminf(low.z, v[2]));
+    high = vec3_create(fmaxf(high.x, v[0]), fmaxf(high.y, v[1]), fmaxf(high.z, v[2]));
+  }
+  Vec3 center = vec3_multiply(vec3_add(low, high), 0.5f);
+
+  float radius_squared = 0.0f;
+  for (int i = 0; i < mesh->vertex_count; i++) {
+    v = (const float *)conx_mesh_vertex(mesh, i);
+    Vec3 offset = vec3_subtract(vec3_create(v[0], v[1], v[2]), center);
+    radius_squared = fmaxf(radius_squared, vec3_dot(offset, offset));
+  }
+  mesh->bounds_center = center;
+  mesh->bounds_radius = sqrtf(radius_squared);
+}
+
+bool conx_upload_mesh(ConXMesh *mesh) {
+  if (!mesh || !mesh->vertices || !mesh->indices) return false;
+  if (mesh->VBO) return true;
+  if (!is_3d_initialized || !conx_gl.has_buffers) return false;
+
+  conx_make_current();
+  if (conx_gl.has_vertex_arrays) {
+    conx_gl.GenVertexArrays(1, &mesh->VAO);
+    bind_vertex_array(mesh->VAO);
+  }
+
+  conx_gl.GenBuffers(1, &mesh->VBO);
+  bind_buffer(GL_ARRAY_BUFFER, mesh->VBO);
+  conx_gl.BufferData(GL_ARRAY_BUFFER, (ptrdiff_t)mesh->vertex_count * mesh->layout.stride,
+                     mesh->vertices, GL_STATIC_DRAW);
+
+  conx_gl.GenBuffers(1, &mesh->EBO);
+  bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+  conx_gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, (ptrdiff_t)mesh->index_count * sizeof(unsigned int),
+                     mesh->indices, GL_STATIC_DRAW);
+
+  // The vertex array records the buffers and pointers once, so drawing
+  // only has to bind it
+  if (mesh->VAO && conx_gl.core_profile) {
+    point_vertex_attributes(&mesh->layout);
+  } else if (mesh->VAO) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    point_vertex_arrays(&mesh->layout, NULL);
+  }
+
+  // Meshes can be created between frames, outside any flush
+  bind_vertex_array(0);
+  bind_buffer(GL_ARRAY_BUFFER, 0);
+  bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  return true;
+}
+
+// Deletes the GPU copies; the next draw uploads the mesh again
+static void release_mesh_buffers(ConXMesh *mesh) {
+  if (conx_gl.has_buffers && mesh->VBO) {
+    conx_make_current();
+    if (mesh->VAO) {
+      conx_gl.DeleteVertexArrays(1, &mesh->VAO);
+      if (gl_state.vertex_array == mesh->VAO) gl_state.vertex_array = 0;
+    }
+    if (mesh->VBO) {
+      conx_gl.DeleteBuffers(1, &mesh->VBO);
+      forget_buffer(mesh->VBO);
+    }
+    if (mesh->EBO) {
+      conx_gl.DeleteBuffers(1, &mesh->EBO);
+      forget_buffer(mesh->EBO);
+    }
+  }
+  mesh->VAO = mesh->VBO = mesh->EBO = 0;
+  if (mesh->vertices && gl_state.pointer_base == mesh->vertices) {
+    gl_state.pointer_buffer = CONX_GL_UNKNOWN;
+  }
+}
+
+bool conx_mesh_replace_data(ConXMesh *mesh, void *vertices, int vertex_count,
+                            unsigned int *indices, int index_count) {
+  void *kept_vertices = NULL;
+  unsigned int *kept_indices = NULL;
+  if (mesh->mapping) {
+    // Nothing may point into the cache file once it is unmapped
+    size_t vertex_size = (size_t)mesh->vertex_count * mesh->layout.stride;
+    size_t index_size = sizeof(unsigned int) * mesh->index_count;
+    if (vertices == mesh->vertices) {
+      vertices = kept_vertices = malloc(vertex_size ? vertex_size : 1);
+      if (!vertices) return false;
+      memcpy(vertices, mesh->vertices, vertex_size);
+    }
+    if (indices == mesh->indices) {
+      indices = kept_indices = malloc(index_size ? index_size : 1);
+      if (!indices) {
+        free(kept_vertices);
+        return false;
+      }
+      memcpy(indices, mesh->indices, index_size);
+    }
+  }
+
+  release_mesh_buffers(mesh);
+  if (mesh->mapping) {
+    conx_mesh_unmap(mesh);
+  } else {
+    if (mesh->vertices != vertices) free(mesh->vertices);
+    if (mesh->indices != indices) free(mesh->indices);
+  }
+  mesh->vertices = vertices;
+  mesh->indices = indices;
+  mesh->vertex_count = vertex_count;
+  mesh->index_count = index_count;
+  return true;
+}
+
 void conx_free_mesh(ConXMesh *mesh) {
   if (!mesh) return;
-  
-  if (mesh->vertices) free(mesh->vertices);
-  if (mesh->indices) free(mesh->indices);
+
+  release_mesh_buffers(mesh);
+  if (mesh->mapping) {
+    conx_mesh_unmap(mesh);
+  } else {
+    if (mesh->vertices) free(mesh->vertices);
+    if (mesh->indices) free(mesh->indices);
+  }
   free(mesh);
 }
 
-void conx_draw_object_3d(ConXObject3D *object) {
-  if (!object || !is_3d_initialized) return;
+void conx_3d_object_model(const ConXObject3D *object, float model[3][4]) {
+  Vec3 angle = vec3_multiply(object->rotation, PI / 180.0f);
+  float sx = sinf(angle.x), cx = cosf(angle.x);
+  float sy = sinf(angle.y), cy = cosf(angle.y);
+  float sz = sinf(angle.z), cz = cosf(angle.z);
+  // Rx * Ry * Rz
+  const float rotation[3][3] = {
+    {cy * cz, -cy * sz, sy},
+    {sx * sy * cz + cx * sz, cx * cz - sx * sy * sz, -sx * cy},
+    {sx * sz - cx * sy * cz, cx * sy * sz + sx * cz, cx * cy}
+  };
+  const float scale[3] = {object->scale.x, object->scale.y, object->scale.z};
+  const float position[3] = {object->position.x, object->position.y, object->position.z};
+
+  for (int row = 0; row < 3; row++) {
+    for (int column = 0; column < 3; column++) {
+      model[row][column] = rotation[row][column] * scale[column];
+    }
+    model[row][3] = position[row];
+  }
+}
+
+// The object's mesh bounds moved into world space, tested against the
+// frustum and then the occluders
+static bool object_visible(const ConXObject3D *object) {
+  ConXMesh *mesh = object->mesh;
+  if (mesh->bounds_radius == 0.0f) conx_mesh_update_bounds(mesh);
+
+  float model[3][4];
+  conx_3d_object_model(object, model);
+  Vec3 c = mesh->bounds_center;
+  Vec3 center = vec3_create(model[0][0] * c.x + model[0][1] * c.y + model[0][2] * c.z + model[0][3],
+                            model[1][0] * c.x + model[1][1] * c.y + model[1][2] * c.z + model[1][3],
+                            model[2][0] * c.x + model[2][1] * c.y + model[2][2] * c.z + model[2][3]);
+  float stretch = fmaxf(fabsf(object->scale.x), fmaxf(fabsf(object->scale.y),
+                                                      fabsf(object->scale.z)));
+  float radius = mesh->bounds_radius * stretch;
+  update_camera_matrices();
+  if (!conx_frustum_sphere_visible(&view_frustum, center, radius)) {
+    frame_stats.culled++;
+    return false;
+  }
+  if (occlusion_ready &&
+      !conx_occlusion_box_visible(occlusion, center, vec3_create(radius, radius, radius))) {
+    frame_stats.occluded++;
+    return false;
+  }
+  return true;
+}
+
+static void execute_object(void *payload) {
+  const ConXObject3D *object = payload;
+  flush_pending_batch();
+  if (object->mesh) {
+    if (!object_visible(object)) return;
+    frame_stats.visible++;
+  }
+
+  // Without the matrix stack an object is a batch of one
+  if (conx_gl.core_profile) {
+    if (!object->mesh || !instance_program) return;
+    ConXInstance instance = {
+      .color = {object->color.x, object->color.y, object->color.z, object->color.w}
+    };
+    conx_3d_object_model(object, instance.model);
+    draw_instances(object->mesh, &instance, 1, NULL);
+    return;
+  }
 
-  setup_3d_projection();
-  
   glPushMatrix();
   glTranslatef(object->position.x, object->position.y, object->position.z);
   glRotatef(object->rotation.x, 1.0f, 0.0f, 0.0f);
   glRotatef(object->rotation.y, 0.0f, 1.0f, 0.0f);
   glRotatef(object->rotation.z, 0.0f, 0.0f, 1.0f);
   glScalef(object->scale.x, object->scale.y, object->scale.z);
-  glColor4f(object->color.x, object->color.y, object->color.z, object->color.w);
+  const float color[4] = {object->color.x, object->color.y, object->color.z, object->color.w};
+  set_color(color);
 
-  // Draw the mesh (simplified)
-  if (object->mesh && object->mesh->vertices) {
-    // Would render the actual mesh here
+  if (object->mesh) {
+    draw_mesh(object->mesh);
   }
   
   glPopMatrix();
+}
+
+void conx_draw_object_3d(ConXObject3D *object) {
+  if (!object || !is_3d_initialized) return;
+
+  bool translucent = object->color.w < 1.0f;
+  uint64_t key = queue_key(object->mesh, object->position, translucent, true);
+  ConXObject3D *command = conx_render_push(key, translucent ? &translucent_pass : &opaque_pass,
+                                           execute_object, sizeof(ConXObject3D));
+  if (!command) return;
+  *command = *object;
+  commands_queued = true;
 }
\ No newline at end of file
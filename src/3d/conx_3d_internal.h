@@ -0,0 +1,54 @@
+#ifndef CONX_3D_INTERNAL_H
+#define CONX_3D_INTERNAL_H
+
+#include "conx_3d.h"
+#include "conx_gl.h"
+
+// One batched draw: the rows of an affine model matrix and a color
+typedef struct {
+  float model[3][4];
+  float color[4];
+} ConXInstance;
+
+// Instances collected over a frame, all drawn from one shared mesh.
+// Their world bounds sit beside the instances in stream form for the
+// frustum test: box half extents, or a sphere radius in extent[0].
+typedef struct {
+  ConXMesh *mesh;
+  ConXInstance *instances;
+  float *center[3];
+  float *extent[3];
+  bool spherical;
+  int count;
+  int capacity;
+  GLuint buffer;
+} ConXInstanceBatch;
+
+// Model rows of an object: translate, rotate about x, y then z in degrees,
+// then scale, the order conx_draw_object_3d applies them
+void conx_3d_object_model(const ConXObject3D *object, float model[3][4]);
+
+// Queues an instance of the batch's mesh with the given world bounds
+// (extent.x alone for spherical batches). It joins the batch when the
+// render queue replays it, after sorting.
+void conx_3d_queue_instance(ConXInstanceBatch *batch, const ConXInstance *instance, Vec3 center,
+                            Vec3 extent);
+// Frees the batch's arrays and instance buffer, but not its mesh
+void conx_3d_batch_release(ConXInstanceBatch *batch);
+
+// The batches conx_draw_cube and conx_draw_sphere fill, with their mesh
+// created; NULL if that fails. Spheres pick their level of detail from the
+// world-space center and radius.
+ConXInstanceBatch *conx_3d_cube_batch(void);
+ConXInstanceBatch *conx_3d_sphere_batch(Vec3 center, float radius);
+// Whether a mesh is one of those batches' meshes, any sphere level
+bool conx_3d_is_cube_mesh(const ConXMesh *mesh);
+bool conx_3d_is_sphere_mesh(const ConXMesh *mesh);
+
+// Queues every live object of the retained scene; conx_3d_flush calls
+// this once per frame
+void conx_scene_submit(void);
+// Clears the scene and frees its storage; conx_3d_shutdown calls this
+void conx_scene_shutdown(void);
+
+#endif
@@ -0,0 +1,193 @@
+#include "conx_frustum.h"
+#include <math.h>
+
+#if !defined(CONX_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define CONX_SIMD_X86 1
+#include <SDL2/SDL.h>
+#include <immintrin.h>
+
+// GCC and Clang need per-function permission to emit AVX2; MSVC does not
+#if defined(__GNUC__) || defined(__clang__)
+#define CONX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CONX_TARGET_AVX2
+#endif
+#endif
+
+void conx_frustum_extract(ConXFrustum *frustum, const Mat4 *view, const Mat4 *projection) {
+  // m[column][row], so rows of the clip matrix are read across columns
+  Mat4 clip = mat4_multiply(*view, *projection);
+  float row[4][4];
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 4; c++) {
+      row[r][c] = clip.m[c][r];
+    }
+  }
+
+  // Gribb and Hartmann: -w <= x, y, z <= w
+  for (int axis = 0; axis < 3; axis++) {
+    for (int c = 0; c < 4; c++) {
+      frustum->planes[axis * 2][c] = row[3][c] + row[axis][c];
+      frustum->planes[axis * 2 + 1][c] = row[3][c] - row[axis][c];
+    }
+  }
+
+  for (int p = 0; p < 6; p++) {
+    float *plane = frustum->planes[p];
+    float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    if (length <= 0.0f) continue;
+    for (int c = 0; c < 4; c++) {
+      plane[c] /= length;
+    }
+  }
+}
+
+// Summed in the same order as the vector lanes so every path agrees
+static inline float plane_distance(const float plane[4], float x, float y, float z) {
+  return (plane[0] * x + plane[1] * y) + (plane[2] * z + plane[3]);
+}
+
+bool conx_frustum_sphere_visible(const ConXFrustum *frustum, Vec3 center, float radius) {
+  for (int p = 0; p < 6; p++) {
+    if (plane_distance(frustum->planes[p], center.x, center.y, center.z) < -radius) return false;
+  }
+  return true;
+}
+
+bool conx_frustum_box_visible(const ConXFrustum *frustum, Vec3 center, Vec3 half_extents) {
+  for (int p = 0; p < 6; p++) {
+    const float *plane = frustum->planes[p];
+    // How far the box reaches along the plane normal
+    float reach = fabsf(plane[0]) * half_extents.x + fabsf(plane[1]) * half_extents.y +
+                  fabsf(plane[2]) * half_extents.z;
+    if (plane_distance(plane, center.x, center.y, center.z) < -reach) return false;
+  }
+  return true;
+}
+
+static int cull_scalar(const ConXFrustum *frustum, const float *const center[3],
+                       const float *const extent[3], bool spherical, int begin, int end,
+                       unsigned char *visible) {
+  int count = 0;
+  for (int i = begin; i < end; i++) {
+    Vec3 c = vec3_create(center[0][i], center[1][i], center[2][i]);
+    bool inside = spherical
+                      ? conx_frustum_sphere_visible(frustum, c, extent[0][i])
+                      : conx_frustum_box_visible(frustum, c,
+                                                 vec3_create(extent[0][i], extent[1][i],
+                                                             extent[2][i]));
+    visible[i] = inside;
+    count += inside;
+  }
+  return count;
+}
+
+#ifdef CONX_SIMD_X86
+
+// Four objects per vector, against every plane
+static int cull_sse(const ConXFrustum *frustum, const float *const center[3],
+                    const float *const extent[3], bool spherical, int count,
+                    unsigned char *visible) {
+  const __m128 sign_mask = _mm_set1_ps(-0.0f);
+  int total = 0;
+
+  for (int i = 0; i < count; i += 4) {
+    __m128 x = _mm_loadu_ps(center[0] + i);
+    __m128 y = _mm_loadu_ps(center[1] + i);
+    __m128 z = _mm_loadu_ps(center[2] + i);
+    __m128 ex = _mm_loadu_ps(extent[0] + i);
+    __m128 ey = spherical ? ex : _mm_loadu_ps(extent[1] + i);
+    __m128 ez = spherical ? ex : _mm_loadu_ps(extent[2] + i);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    for (int p = 0; p < 6; p++) {
+      const float *plane = frustum->planes[p];
+      __m128 a = _mm_set1_ps(plane[0]);
+      __m128 b = _mm_set1_ps(plane[1]);
+      __m128 c = _mm_set1_ps(plane[2]);
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)),
+                                   _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(plane[3])));
+      __m128 reach = ex;
+      if (!spherical) {
+        reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, a), ex),
+                                      _mm_mul_ps(_mm_andnot_ps(sign_mask, b), ey)),
+                           _mm_mul_ps(_mm_andnot_ps(sign_mask, c), ez));
+      }
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_xor_ps(reach, sign_mask)));
+    }
+
+    int mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; lane++) {
+      visible[i + lane] = (mask >> lane) & 1;
+      total += visible[i + lane];
+    }
+  }
+  return total;
+}
+
+// Eight objects per vector
+CONX_TARGET_AVX2
+static int cull_avx2(const ConXFrustum *frustum, const float *const center[3],
+                     const float *const extent[3], bool spherical, int count,
+                     unsigned char *visible) {
+  const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+  int total = 0;
+
+  for (int i = 0; i < count; i += 8) {
+    __m256 x = _mm256_loadu_ps(center[0] + i);
+    __m256 y = _mm256_loadu_ps(center[1] + i);
+    __m256 z = _mm256_loadu_ps(center[2] + i);
+    __m256 ex = _mm256_loadu_ps(extent[0] + i);
+    __m256 ey = spherical ? ex : _mm256_loadu_ps(extent[1] + i);
+    __m256 ez = spherical ? ex : _mm256_loadu_ps(extent[2] + i);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    for (int p = 0; p < 6; p++) {
+      const float *plane = frustum->planes[p];
+      __m256 a = _mm256_set1_ps(plane[0]);
+      __m256 b = _mm256_set1_ps(plane[1]);
+      __m256 c = _mm256_set1_ps(plane[2]);
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, x), _mm256_mul_ps(b, y)),
+                                      _mm256_add_ps(_mm256_mul_ps(c, z),
+                                                    _mm256_set1_ps(plane[3])));
+      __m256 reach = ex;
+      if (!spherical) {
+        reach = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(sign_mask, a), ex),
+                          _mm256_mul_ps(_mm256_andnot_ps(sign_mask, b), ey)),
+            _mm256_mul_ps(_mm256_andnot_ps(sign_mask, c), ez));
+      }
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_xor_ps(reach, sign_mask),
+                                                   _CMP_GE_OQ));
+    }
+
+    int mask = _mm256_movemask_ps(inside);
+    for (int lane = 0; lane < 8; lane++) {
+      visible[i + lane] = (mask >> lane) & 1;
+      total += visible[i + lane];
+    }
+  }
+  return total;
+}
+
+#endif
+
+int conx_frustum_cull(const ConXFrustum *frustum, const float *const center[3],
+                      const float *const extent[3], bool spherical, int count,
+                      unsigned char *visible) {
+  if (count <= 0) return 0;
+
+  // Whole vectors only; the remainder goes through the scalar test
+  int vectorized = 0;
+  int total = 0;
+#ifdef CONX_SIMD_X86
+  if (SDL_HasAVX2()) {
+    vectorized = count & ~7;
+    total = cull_avx2(frustum, center, extent, spherical, vectorized, visible);
+  } else {
+    vectorized = count & ~3;
+    total = cull_sse(frustum, center, extent, spherical, vectorized, visible);
+  }
+#endif
+  return total + cull_scalar(frustum, center, extent, spherical, vectorized, count, visible);
+}
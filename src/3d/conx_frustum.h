@@ -0,0 +1,30 @@
+#ifndef CONX_FRUSTUM_H
+#define CONX_FRUSTUM_H
+
+#include "conx_math.h"
+#include <stdbool.h>
+
+// Left, right, bottom, top, near and far planes as (a, b, c, d) with unit
+// normals pointing inwards: a point is inside a plane when
+// a * x + b * y + c * z + d >= 0
+typedef struct {
+  float planes[6][4];
+} ConXFrustum;
+
+// Planes of projection * view, in world space
+void conx_frustum_extract(ConXFrustum *frustum, const Mat4 *view, const Mat4 *projection);
+
+// Conservative tests: bounds that straddle a corner of the frustum may be
+// kept, bounds reported outside are always outside
+bool conx_frustum_sphere_visible(const ConXFrustum *frustum, Vec3 center, float radius);
+bool conx_frustum_box_visible(const ConXFrustum *frustum, Vec3 center, Vec3 half_extents);
+
+// Tests count axis-aligned boxes given as centers and half extents in
+// stream form, several at a time. With spherical set they are spheres
+// instead, with the radius in extent[0] and extent[1..2] unread. Writes 1
+// or 0 per object to visible and returns how many are visible.
+int conx_frustum_cull(const ConXFrustum *frustum, const float *const center[3],
+                      const float *const extent[3], bool spherical, int count,
+                      unsigned char *visible);
+
+#endif
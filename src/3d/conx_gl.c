@@ -0,0 +1,191 @@
+#include "conx_gl.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <string.h>
+
+ConXGLFunctions conx_gl;
+
+// Core name first, then the extension's suffixed name
+static void *get_proc(const char *name, const char *suffix) {
+  void *proc = SDL_GL_GetProcAddress(name);
+  if (!proc && suffix) {
+    char suffixed[64];
+    snprintf(suffixed, sizeof(suffixed), "%s%s", name, suffix);
+    proc = SDL_GL_GetProcAddress(suffixed);
+  }
+  return proc;
+}
+
+static bool has_version(int major, int minor) {
+  return conx_gl.major_version > major ||
+         (conx_gl.major_version == major && conx_gl.minor_version >= minor);
+}
+
+bool conx_gl_load(void) {
+  memset(&conx_gl, 0, sizeof(conx_gl));
+
+  const char *version = (const char *)glGetString(GL_VERSION);
+  if (!version) {
+    printf("No current OpenGL context\n");
+    return false;
+  }
+  if (sscanf(version, "%d.%d", &conx_gl.major_version, &conx_gl.minor_version) != 2) {
+    conx_gl.major_version = 1;
+    conx_gl.minor_version = 1;
+  }
+
+  // Lookups can succeed for entry points the context does not support, so
+  // the version or extension string decides
+  if (has_version(1, 5) || SDL_GL_ExtensionSupported("GL_ARB_vertex_buffer_object")) {
+    const char *suffix = has_version(1, 5) ? NULL : "ARB";
+    conx_gl.GenBuffers = get_proc("glGenBuffers", suffix);
+    conx_gl.DeleteBuffers = get_proc("glDeleteBuffers", suffix);
+    conx_gl.BindBuffer = get_proc("glBindBuffer", suffix);
+    conx_gl.BufferData = get_proc("glBufferData", suffix);
+    conx_gl.BufferSubData = get_proc("glBufferSubData", suffix);
+    conx_gl.has_buffers = conx_gl.GenBuffers && conx_gl.DeleteBuffers && conx_gl.BindBuffer &&
+                          conx_gl.BufferData && conx_gl.BufferSubData;
+  }
+
+  if (has_version(3, 0) || SDL_GL_ExtensionSupported("GL_ARB_vertex_array_object")) {
+    conx_gl.GenVertexArrays = get_proc("glGenVertexArrays", NULL);
+    conx_gl.DeleteVertexArrays = get_proc("glDeleteVertexArrays", NULL);
+    conx_gl.BindVertexArray = get_proc("glBindVertexArray", NULL);
+    conx_gl.has_vertex_arrays = conx_gl.has_buffers && conx_gl.GenVertexArrays &&
+                                conx_gl.DeleteVertexArrays && conx_gl.BindVertexArray;
+  }
+
+  if (has_version(2, 0)) {
+    conx_gl.CreateShader = get_proc("glCreateShader", NULL);
+    conx_gl.DeleteShader = get_proc("glDeleteShader", NULL);
+    conx_gl.ShaderSource = get_proc("glShaderSource", NULL);
+    conx_gl.CompileShader = get_proc("glCompileShader", NULL);
+    conx_gl.GetShaderiv = get_proc("glGetShaderiv", NULL);
+    conx_gl.GetShaderInfoLog = get_proc("glGetShaderInfoLog", NULL);
+    conx_gl.CreateProgram = get_proc("glCreateProgram", NULL);
+    conx_gl.DeleteProgram = get_proc("glDeleteProgram", NULL);
+    conx_gl.AttachShader = get_proc("glAttachShader", NULL);
+    conx_gl.BindAttribLocation = get_proc("glBindAttribLocation", NULL);
+    conx_gl.LinkProgram = get_proc("glLinkProgram", NULL);
+    conx_gl.GetProgramiv = get_proc("glGetProgramiv", NULL);
+    conx_gl.GetProgramInfoLog = get_proc("glGetProgramInfoLog", NULL);
+    conx_gl.UseProgram = get_proc("glUseProgram", NULL);
+    conx_gl.EnableVertexAttribArray = get_proc("glEnableVertexAttribArray", NULL);
+    conx_gl.DisableVertexAttribArray = get_proc("glDisableVertexAttribArray", NULL);
+    conx_gl.VertexAttribPointer = get_proc("glVertexAttribPointer", NULL);
+    conx_gl.has_shaders = conx_gl.CreateShader && conx_gl.DeleteShader && conx_gl.ShaderSource &&
+                          conx_gl.CompileShader && conx_gl.GetShaderiv &&
+                          conx_gl.GetShaderInfoLog && conx_gl.CreateProgram &&
+                          conx_gl.DeleteProgram && conx_gl.AttachShader &&
+                          conx_gl.BindAttribLocation && conx_gl.LinkProgram &&
+                          conx_gl.GetProgramiv && conx_gl.GetProgramInfoLog &&
+                          conx_gl.UseProgram && conx_gl.EnableVertexAttribArray &&
+                          conx_gl.DisableVertexAttribArray && conx_gl.VertexAttribPointer;
+  }
+
+  bool divisor = has_version(3, 3) || SDL_GL_ExtensionSupported("GL_ARB_instanced_arrays");
+  bool draw_instanced = has_version(3, 1) || SDL_GL_ExtensionSupported("GL_ARB_draw_instanced");
+  if (conx_gl.has_shaders && conx_gl.has_buffers && divisor && draw_instanced) {
+    conx_gl.VertexAttribDivisor = get_proc("glVertexAttribDivisor", has_version(3, 3) ? NULL : "ARB");
+    conx_gl.DrawElementsInstanced = get_proc("glDrawElementsInstanced",
+                                             has_version(3, 1) ? NULL : "ARB");
+    conx_gl.has_instancing = conx_gl.VertexAttribDivisor && conx_gl.DrawElementsInstanced;
+  }
+
+  if (has_version(3, 2)) {
+    GLint profile = 0;
+    glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+    conx_gl.core_profile = (profile & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
+  }
+
+  // Writes go through GL_COPY_WRITE_BUFFER, which GL 3.1 added, so the
+  // bindings drawing uses are left alone
+  bool map_range = has_version(3, 0) || SDL_GL_ExtensionSupported("GL_ARB_map_buffer_range");
+  bool sync = has_version(3, 2) || SDL_GL_ExtensionSupported("GL_ARB_sync");
+  bool copy_target = has_version(3, 1) || SDL_GL_ExtensionSupported("GL_ARB_copy_buffer");
+  if (conx_gl.has_buffers && map_range && sync && copy_target) {
+    conx_gl.MapBufferRange = get_proc("glMapBufferRange", NULL);
+    conx_gl.UnmapBuffer = get_proc("glUnmapBuffer", has_version(1, 5) ? NULL : "ARB");
+    conx_gl.FenceSync = get_proc("glFenceSync", NULL);
+    conx_gl.ClientWaitSync = get_proc("glClientWaitSync", NULL);
+    conx_gl.DeleteSync = get_proc("glDeleteSync", NULL);
+    conx_gl.has_streaming = conx_gl.MapBufferRange && conx_gl.UnmapBuffer && conx_gl.FenceSync &&
+                            conx_gl.ClientWaitSync && conx_gl.DeleteSync;
+  }
+
+  if (conx_gl.has_streaming &&
+      (has_version(4, 4) || SDL_GL_ExtensionSupported("GL_ARB_buffer_storage"))) {
+    conx_gl.BufferStorage = get_proc("glBufferStorage", NULL);
+    conx_gl.has_buffer_storage = conx_gl.BufferStorage != NULL;
+  }
+
+  if (conx_gl.has_shaders && conx_gl.has_buffers &&
+      (has_version(3, 1) || SDL_GL_ExtensionSupported("GL_ARB_uniform_buffer_object"))) {
+    conx_gl.GetUniformBlockIndex = get_proc("glGetUniformBlockIndex", NULL);
+    conx_gl.UniformBlockBinding = get_proc("glUniformBlockBinding", NULL);
+    conx_gl.BindBufferRange = get_proc("glBindBufferRange", NULL);
+    conx_gl.has_uniform_buffers = conx_gl.GetUniformBlockIndex && conx_gl.UniformBlockBinding &&
+                                  conx_gl.BindBufferRange;
+    if (conx_gl.has_uniform_buffers) {
+      GLint alignment = 0;
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      conx_gl.uniform_buffer_alignment = alignment > 0 ? alignment : 256;
+    }
+  }
+
+  if (!conx_gl.has_buffers) {
+    printf("OpenGL buffer objects unavailable, meshes draw from client memory\n");
+  }
+  return true;
+}
+
+static GLuint compile_shader(GLenum type, const char *source) {
+  GLuint shader = conx_gl.CreateShader(type);
+  conx_gl.ShaderSource(shader, 1, &source, NULL);
+  conx_gl.CompileShader(shader);
+
+  GLint status = GL_FALSE;
+  conx_gl.GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status != GL_TRUE) {
+    char log[1024];
+    conx_gl.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+    printf("Shader compilation failed: %s\n", log);
+    conx_gl.DeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+GLuint conx_gl_create_program(const char *vertex_source, const char *fragment_source,
+                              const char *const *attributes, int attribute_count) {
+  if (!conx_gl.has_shaders) return 0;
+
+  GLuint vertex = compile_shader(GL_VERTEX_SHADER, vertex_source);
+  GLuint fragment = vertex ? compile_shader(GL_FRAGMENT_SHADER, fragment_source) : 0;
+  if (!fragment) {
+    if (vertex) conx_gl.DeleteShader(vertex);
+    return 0;
+  }
+
+  GLuint program = conx_gl.CreateProgram();
+  conx_gl.AttachShader(program, vertex);
+  conx_gl.AttachShader(program, fragment);
+  for (int i = 0; i < attribute_count; i++) {
+    if (attributes[i]) conx_gl.BindAttribLocation(program, i, attributes[i]);
+  }
+  conx_gl.LinkProgram(program);
+  // The program keeps the compiled stages alive
+  conx_gl.DeleteShader(vertex);
+  conx_gl.DeleteShader(fragment);
+
+  GLint status = GL_FALSE;
+  conx_gl.GetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    char log[1024];
+    conx_gl.GetProgramInfoLog(program, sizeof(log), NULL, log);
+    printf("Shader program link failed: %s\n", log);
+    conx_gl.DeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
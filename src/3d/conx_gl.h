@@ -0,0 +1,150 @@
+#ifndef CONX_GL_H
+#define CONX_GL_H
+
+#include <GL/gl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+// Buffer object tokens, missing from gl.h headers that stop at GL 1.1
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT 0x8A34
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#endif
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
+#endif
+
+#ifndef GL_CONTEXT_PROFILE_MASK
+#define GL_CONTEXT_CORE_PROFILE_BIT 0x00000001
+#define GL_CONTEXT_PROFILE_MASK 0x9126
+#endif
+
+#ifndef GL_VERTEX_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#endif
+
+// GL entry points past 1.1, looked up from the current context at 3D init.
+// A feature's pointers are only set when its has_ flag is true.
+typedef struct {
+  // GL 1.5 or ARB_vertex_buffer_object
+  void (APIENTRY *GenBuffers)(GLsizei n, GLuint *buffers);
+  void (APIENTRY *DeleteBuffers)(GLsizei n, const GLuint *buffers);
+  void (APIENTRY *BindBuffer)(GLenum target, GLuint buffer);
+  void (APIENTRY *BufferData)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+  void (APIENTRY *BufferSubData)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void *data);
+
+  // GL 3.0 or ARB_vertex_array_object
+  void (APIENTRY *GenVertexArrays)(GLsizei n, GLuint *arrays);
+  void (APIENTRY *DeleteVertexArrays)(GLsizei n, const GLuint *arrays);
+  void (APIENTRY *BindVertexArray)(GLuint array);
+
+  // GL 2.0 shaders and generic vertex attributes
+  GLuint (APIENTRY *CreateShader)(GLenum type);
+  void (APIENTRY *DeleteShader)(GLuint shader);
+  void (APIENTRY *ShaderSource)(GLuint shader, GLsizei count, const char *const *strings,
+                                const GLint *lengths);
+  void (APIENTRY *CompileShader)(GLuint shader);
+  void (APIENTRY *GetShaderiv)(GLuint shader, GLenum name, GLint *value);
+  void (APIENTRY *GetShaderInfoLog)(GLuint shader, GLsizei size, GLsizei *length, char *log);
+  GLuint (APIENTRY *CreateProgram)(void);
+  void (APIENTRY *DeleteProgram)(GLuint program);
+  void (APIENTRY *AttachShader)(GLuint program, GLuint shader);
+  void (APIENTRY *BindAttribLocation)(GLuint program, GLuint index, const char *name);
+  void (APIENTRY *LinkProgram)(GLuint program);
+  void (APIENTRY *GetProgramiv)(GLuint program, GLenum name, GLint *value);
+  void (APIENTRY *GetProgramInfoLog)(GLuint program, GLsizei size, GLsizei *length, char *log);
+  void (APIENTRY *UseProgram)(GLuint program);
+  void (APIENTRY *EnableVertexAttribArray)(GLuint index);
+  void (APIENTRY *DisableVertexAttribArray)(GLuint index);
+  void (APIENTRY *VertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                       GLsizei stride, const void *pointer);
+
+  // GL 3.3, or ARB_instanced_arrays with GL 3.1 or ARB_draw_instanced
+  void (APIENTRY *VertexAttribDivisor)(GLuint index, GLuint divisor);
+  void (APIENTRY *DrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type,
+                                         const void *indices, GLsizei instance_count);
+
+  // GL 3.0 or ARB_map_buffer_range, with GL 3.2 or ARB_sync
+  void *(APIENTRY *MapBufferRange)(GLenum target, ptrdiff_t offset, ptrdiff_t length,
+                                   GLbitfield access);
+  GLboolean (APIENTRY *UnmapBuffer)(GLenum target);
+  GLsync (APIENTRY *FenceSync)(GLenum condition, GLbitfield flags);
+  GLenum (APIENTRY *ClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+  void (APIENTRY *DeleteSync)(GLsync sync);
+
+  // GL 4.4 or ARB_buffer_storage
+  void (APIENTRY *BufferStorage)(GLenum target, ptrdiff_t size, const void *data,
+                                 GLbitfield flags);
+
+  // GL 3.1 or ARB_uniform_buffer_object
+  GLuint (APIENTRY *GetUniformBlockIndex)(GLuint program, const char *name);
+  void (APIENTRY *UniformBlockBinding)(GLuint program, GLuint block, GLuint binding);
+  void (APIENTRY *BindBufferRange)(GLenum target, GLuint index, GLuint buffer, ptrdiff_t offset,
+                                   ptrdiff_t size);
+
+  int major_version;
+  int minor_version;
+  bool has_buffers;
+  bool has_vertex_arrays;
+  bool has_shaders;
+  bool has_instancing;
+  // Fenced, unsynchronized writes into buffers, which conx_stream needs
+  bool has_streaming;
+  bool has_buffer_storage;
+  bool has_uniform_buffers;
+  // A core profile context: no fixed-function pipeline, client arrays or
+  // vertex array 0, so the 3D path draws everything through shaders
+  bool core_profile;
+  int uniform_buffer_alignment;
+} ConXGLFunctions;
+
+extern ConXGLFunctions conx_gl;
+
+// Needs a current context. Returns false only when there is no context;
+// missing features are reported through the has_ flags.
+bool conx_gl_load(void);
+
+// Compiles and links a vertex/fragment pair, binding each attributes[i] to
+// location i first (NULL entries are skipped). Returns 0 and prints the
+// log on failure.
+GLuint conx_gl_create_program(const char *vertex_source, const char *fragment_source,
+                              const char *const *attributes, int attribute_count);
+
+#endif
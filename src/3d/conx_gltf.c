@@ -0,0 +1,581 @@
+#include "conx_mesh_import.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GLB_MAGIC 0x46546C67u      // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534Au // "JSON"
+#define GLB_CHUNK_BIN 0x004E4942u  // "BIN\0"
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_TRIANGLES 4
+#define JSON_MAX_DEPTH 64
+#define INITIAL_TOKEN_CAPACITY 256
+#define MAX_PATH_LENGTH 4096
+
+// Just enough JSON for glTF: values are tokenized in document order, each
+// followed by its children, and end is the index just past its last
+// descendant. Object members are a key token then a value token.
+typedef enum {
+  JSON_OBJECT,
+  JSON_ARRAY,
+  JSON_STRING,   // text excludes the quotes; escapes are left in
+  JSON_PRIMITIVE // numbers, true, false and null
+} JsonType;
+
+typedef struct {
+  JsonType type;
+  int start;
+  int length;
+  int size;              // members of an object, elements of an array
+  int end;
+} JsonToken;
+
+typedef struct {
+  const char *text;
+  size_t length;
+  size_t position;
+  JsonToken *tokens;
+  int count;
+  int capacity;
+} JsonDocument;
+
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  unsigned char *owned;  // set when data was read or decoded for this load
+} GltfBuffer;
+
+typedef struct {
+  JsonDocument json;
+  GltfBuffer *buffers;
+  int buffer_count;
+  const char *path;
+} GltfFile;
+
+// Where an accessor's elements are; element i starts at data + stride * i
+typedef struct {
+  const unsigned char *data;
+  size_t stride;
+  int count;
+  int component_type;
+  int components;
+} GltfAccessor;
+
+static int json_new_token(JsonDocument *doc, JsonType type) {
+  if (doc->count == doc->capacity) {
+    int capacity = doc->capacity ? doc->capacity * 2 : INITIAL_TOKEN_CAPACITY;
+    JsonToken *tokens = realloc(doc->tokens, sizeof(JsonToken) * capacity);
+    if (!tokens) return -1;
+    doc->tokens = tokens;
+    doc->capacity = capacity;
+  }
+  JsonToken *token = &doc->tokens[doc->count];
+  token->type = type;
+  token->start = (int)doc->position;
+  token->length = 0;
+  token->size = 0;
+  token->end = doc->count + 1;
+  return doc->count++;
+}
+
+static void json_skip_space(JsonDocument *doc) {
+  while (doc->position < doc->length) {
+    char c = doc->text[doc->position];
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+    doc->position++;
+  }
+}
+
+static bool json_at(const JsonDocument *doc, char c) {
+  return doc->position < doc->length && doc->text[doc->position] == c;
+}
+
+static bool json_parse_string(JsonDocument *doc) {
+  int token = json_new_token(doc, JSON_STRING);
+  if (token < 0) return false;
+
+  size_t start = ++doc->position;
+  while (doc->position < doc->length && doc->text[doc->position] != '"') {
+    if (doc->text[doc->position] == '\\') doc->position++;
+    doc->position++;
+  }
+  if (doc->position >= doc->length) return false;
+  doc->tokens[token].start = (int)start;
+  doc->tokens[token].length = (int)(doc->position - start);
+  doc->position++;
+  return true;
+}
+
+static bool json_parse_value(JsonDocument *doc, int depth) {
+  json_skip_space(doc);
+  if (doc->position >= doc->length || depth > JSON_MAX_DEPTH) return false;
+  if (doc->length > INT32_MAX) return false;
+
+  char c = doc->text[doc->position];
+  if (c == '"') return json_parse_string(doc);
+
+  if (c == '{' || c == '[') {
+    bool object = c == '{';
+    char close = object ? '}' : ']';
+    int token = json_new_token(doc, object ? JSON_OBJECT : JSON_ARRAY);
+    if (token < 0) return false;
+    doc->position++;
+    json_skip_space(doc);
+
+    if (json_at(doc, close)) {
+      doc->position++;
+    } else {
+      for (;;) {
+        if (object) {
+          json_skip_space(doc);
+          if (!json_at(doc, '"') || !json_parse_string(doc)) return false;
+          json_skip_space(doc);
+          if (!json_at(doc, ':')) return false;
+          doc->position++;
+        }
+        if (!json_parse_value(doc, depth + 1)) return false;
+        doc->tokens[token].size++;
+
+        json_skip_space(doc);
+        if (json_at(doc, close)) {
+          doc->position++;
+          break;
+        }
+        if (!json_at(doc, ',')) return false;
+        doc->position++;
+      }
+    }
+    doc->tokens[token].end = doc->count;
+    return true;
+  }
+
+  int token = json_new_token(doc, JSON_PRIMITIVE);
+  if (token < 0) return false;
+  size_t start = doc->position;
+  while (doc->position < doc->length) {
+    c = doc->text[doc->position];
+    if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r') break;
+    doc->position++;
+  }
+  doc->tokens[token].length = (int)(doc->position - start);
+  return doc->position > start;
+}
+
+static bool json_string_equals(const JsonDocument *doc, int token, const char *string) {
+  const JsonToken *t = &doc->tokens[token];
+  size_t length = strlen(string);
+  return t->type == JSON_STRING && (size_t)t->length == length &&
+         memcmp(doc->text + t->start, string, length) == 0;
+}
+
+// Value of an object's member, or -1
+static int json_member(const JsonDocument *doc, int object, const char *key) {
+  if (object < 0 || doc->tokens[object].type != JSON_OBJECT) return -1;
+
+  int token = object + 1;
+  for (int i = 0; i < doc->tokens[object].size; i++) {
+    if (json_string_equals(doc, token, key)) return token + 1;
+    token = doc->tokens[token + 1].end;
+  }
+  return -1;
+}
+
+static int json_element(const JsonDocument *doc, int array, int index) {
+  if (array < 0 || doc->tokens[array].type != JSON_ARRAY) return -1;
+  if (index < 0 || index >= doc->tokens[array].size) return -1;
+
+  int token = array + 1;
+  while (index-- > 0) token = doc->tokens[token].end;
+  return token;
+}
+
+static int json_length(const JsonDocument *doc, int array) {
+  return array >= 0 && doc->tokens[array].type == JSON_ARRAY ? doc->tokens[array].size : 0;
+}
+
+static double json_number(const JsonDocument *doc, int token, double fallback) {
+  if (token < 0 || doc->tokens[token].type != JSON_PRIMITIVE) return fallback;
+
+  char buffer[64];
+  int length = doc->tokens[token].length;
+  if (length >= (int)sizeof(buffer)) return fallback;
+  memcpy(buffer, doc->text + doc->tokens[token].start, length);
+  buffer[length] = '\0';
+  char *end;
+  double value = strtod(buffer, &end);
+  return end == buffer ? fallback : value;
+}
+
+// Array index held by a member, -1 when missing or not an index
+static int json_index(const JsonDocument *doc, int object, const char *key) {
+  double value = json_number(doc, json_member(doc, object, key), -1.0);
+  return value >= 0.0 && value <= INT32_MAX ? (int)value : -1;
+}
+
+static uint32_t read_u32(const unsigned char *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Finds the JSON and first binary chunk of a .glb
+static bool parse_glb(const unsigned char *data, size_t size, const char **json,
+                      size_t *json_length, const unsigned char **bin, size_t *bin_size) {
+  size_t length = read_u32(data + 8);
+  if (length > size) return false;
+
+  *json = NULL;
+  for (size_t offset = 12; offset + 8 <= length;) {
+    size_t chunk_length = read_u32(data + offset);
+    uint32_t type = read_u32(data + offset + 4);
+    offset += 8;
+    if (chunk_length > length - offset) return false;
+
+    if (type == GLB_CHUNK_JSON && !*json) {
+      *json = (const char *)data + offset;
+      *json_length = chunk_length;
+    } else if (type == GLB_CHUNK_BIN && !*bin) {
+      *bin = data + offset;
+      *bin_size = chunk_length;
+    }
+    offset += chunk_length;
+  }
+  return *json != NULL;
+}
+
+static int base64_value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+' || c == '-') return 62;
+  if (c == '/' || c == '_') return 63;
+  return -1;
+}
+
+static unsigned char *decode_base64(const char *text, size_t length, size_t *size) {
+  unsigned char *out = malloc(length / 4 * 3 + 3);
+  if (!out) return NULL;
+
+  uint32_t bits = 0;
+  int bit_count = 0;
+  size_t count = 0;
+  for (size_t i = 0; i < length && text[i] != '='; i++) {
+    int value = base64_value(text[i]);
+    if (value < 0) {
+      free(out);
+      return NULL;
+    }
+    bits = bits << 6 | (uint32_t)value;
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      out[count++] = (unsigned char)(bits >> bit_count);
+    }
+  }
+  *size = count;
+  return out;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Relative URIs resolve against the model's directory, percent escapes
+// decoded
+static unsigned char *read_external_buffer(const char *model_path, const char *uri,
+                                           size_t uri_length, size_t *size) {
+  char path[MAX_PATH_LENGTH];
+  const char *slash = strrchr(model_path, '/');
+  const char *backslash = strrchr(model_path, '\\');
+  if (backslash && (!slash || backslash > slash)) slash = backslash;
+  size_t length = slash ? (size_t)(slash - model_path) + 1 : 0;
+  if (length + uri_length >= sizeof(path)) return NULL;
+  memcpy(path, model_path, length);
+
+  for (size_t i = 0; i < uri_length; i++) {
+    if (uri[i] == '%' && i + 2 < uri_length && hex_value(uri[i + 1]) >= 0 &&
+        hex_value(uri[i + 2]) >= 0) {
+      path[length++] = (char)(hex_value(uri[i + 1]) * 16 + hex_value(uri[i + 2]));
+      i += 2;
+    } else {
+      path[length++] = uri[i];
+    }
+  }
+  path[length] = '\0';
+  return conx_read_file(path, size);
+}
+
+static bool load_buffers(GltfFile *file, const unsigned char *bin, size_t bin_size) {
+  const JsonDocument *json = &file->json;
+  int buffers = json_member(json, 0, "buffers");
+  int count = json_length(json, buffers);
+  if (count == 0) return true;
+
+  file->buffers = calloc(count, sizeof(GltfBuffer));
+  if (!file->buffers) return false;
+  file->buffer_count = count;
+
+  int token = buffers + 1;
+  for (int i = 0; i < count; i++, token = json->tokens[token].end) {
+    GltfBuffer *buffer = &file->buffers[i];
+    int uri = json_member(json, token, "uri");
+    if (uri < 0 || json->tokens[uri].type != JSON_STRING) {
+      // Only the first buffer of a .glb may live in its binary chunk
+      if (i == 0 && bin) {
+        buffer->data = bin;
+        buffer->size = bin_size;
+      }
+    } else {
+      const char *text = json->text + json->tokens[uri].start;
+      size_t length = (size_t)json->tokens[uri].length;
+      const char *marker = ";base64,";
+      const char *data = NULL;
+      if (length > 5 && memcmp(text, "data:", 5) == 0) {
+        for (const char *p = text; p + strlen(marker) <= text + length && !data; p++) {
+          if (memcmp(p, marker, strlen(marker)) == 0) data = p + strlen(marker);
+        }
+        if (data) {
+          buffer->owned = decode_base64(data, length - (size_t)(data - text), &buffer->size);
+        }
+      } else {
+        buffer->owned = read_external_buffer(file->path, text, length, &buffer->size);
+      }
+      buffer->data = buffer->owned;
+    }
+
+    double byte_length = json_number(json, json_member(json, token, "byteLength"), 0.0);
+    if (!buffer->data || (double)buffer->size < byte_length) {
+      printf("Failed to load buffer %d of %s\n", i, file->path);
+      return false;
+    }
+  }
+  return true;
+}
+
+static int type_components(const JsonDocument *doc, int token) {
+  if (token < 0) return 0;
+  if (json_string_equals(doc, token, "SCALAR")) return 1;
+  if (json_string_equals(doc, token, "VEC2")) return 2;
+  if (json_string_equals(doc, token, "VEC3")) return 3;
+  if (json_string_equals(doc, token, "VEC4")) return 4;
+  return 0;
+}
+
+static size_t component_size(int component_type) {
+  switch (component_type) {
+    case 5120: case GLTF_UNSIGNED_BYTE: return 1;
+    case 5122: case GLTF_UNSIGNED_SHORT: return 2;
+    case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+    default: return 0;
+  }
+}
+
+// Dense accessors only; every element read must lie inside the buffer view
+// and the view inside its buffer
+static bool get_accessor(const GltfFile *file, int index, GltfAccessor *accessor) {
+  const JsonDocument *json = &file->json;
+  int token = json_element(json, json_member(json, 0, "accessors"), index);
+  if (token < 0 || json_member(json, token, "sparse") >= 0) return false;
+  int view = json_element(json, json_member(json, 0, "bufferViews"),
+                          json_index(json, token, "bufferView"));
+  if (view < 0) return false;
+  int buffer = json_index(json, view, "buffer");
+  if (buffer < 0 || buffer >= file->buffer_count) return false;
+
+  accessor->component_type = (int)json_number(json, json_member(json, token, "componentType"), 0);
+  accessor->components = type_components(json, json_member(json, token, "type"));
+  size_t element_size = component_size(accessor->component_type) * accessor->components;
+  if (element_size == 0) return false;
+
+  double view_offset = json_number(json, json_member(json, view, "byteOffset"), 0.0);
+  double view_length = json_number(json, json_member(json, view, "byteLength"), -1.0);
+  double stride = json_number(json, json_member(json, view, "byteStride"), 0.0);
+  double offset = json_number(json, json_member(json, token, "byteOffset"), 0.0);
+  double count = json_number(json, json_member(json, token, "count"), -1.0);
+  if (stride == 0.0) stride = (double)element_size;
+  if (view_offset < 0.0 || view_length < 0.0 || offset < 0.0 || count < 0.0 ||
+      count > INT32_MAX || stride < (double)element_size ||
+      view_offset + view_length > (double)file->buffers[buffer].size) {
+    return false;
+  }
+  if (count > 0.0 && offset + stride * (count - 1.0) + (double)element_size > view_length) {
+    return false;
+  }
+
+  accessor->data = file->buffers[buffer].data + (size_t)view_offset + (size_t)offset;
+  accessor->stride = (size_t)stride;
+  accessor->count = (int)count;
+  return true;
+}
+
+static unsigned int read_index(const GltfAccessor *accessor, int i) {
+  const unsigned char *p = accessor->data + accessor->stride * (size_t)i;
+  if (accessor->component_type == GLTF_UNSIGNED_BYTE) return p[0];
+  if (accessor->component_type == GLTF_UNSIGNED_SHORT) return (unsigned int)(p[0] | p[1] << 8);
+  return read_u32(p);
+}
+
+static bool is_float_vector(const GltfAccessor *accessor, int components) {
+  return accessor->component_type == GLTF_FLOAT && accessor->components == components;
+}
+
+static bool is_index_accessor(const GltfAccessor *accessor) {
+  return accessor->components == 1 && (accessor->component_type == GLTF_UNSIGNED_BYTE ||
+                                       accessor->component_type == GLTF_UNSIGNED_SHORT ||
+                                       accessor->component_type == GLTF_UNSIGNED_INT);
+}
+
+// Appends one triangle-list primitive's vertices and indices to the mesh,
+// in the mesh's layout
+static bool append_primitive(const GltfFile *file, int primitive, ConXMesh *mesh) {
+  const JsonDocument *json = &file->json;
+  int attributes = json_member(json, primitive, "attributes");
+  GltfAccessor positions, normals, texcoords, indices;
+  if (!get_accessor(file, json_index(json, attributes, "POSITION"), &positions) ||
+      !is_float_vector(&positions, 3)) {
+    printf("Unsupported or missing positions in %s\n", file->path);
+    return false;
+  }
+  bool has_normals = json_member(json, attributes, "NORMAL") >= 0;
+  if (has_normals && (!get_accessor(file, json_index(json, attributes, "NORMAL"), &normals) ||
+                      !is_float_vector(&normals, 3) || normals.count != positions.count)) {
+    printf("Unsupported normals in %s\n", file->path);
+    return false;
+  }
+  bool has_texcoords = mesh->layout.texcoord_format != CONX_VERTEX_NONE &&
+                       json_member(json, attributes, "TEXCOORD_0") >= 0;
+  if (has_texcoords &&
+      (!get_accessor(file, json_index(json, attributes, "TEXCOORD_0"), &texcoords) ||
+       !is_float_vector(&texcoords, 2) || texcoords.count != positions.count)) {
+    printf("Unsupported texture coordinates in %s\n", file->path);
+    return false;
+  }
+  bool indexed = json_member(json, primitive, "indices") >= 0;
+  if (indexed && (!get_accessor(file, json_index(json, primitive, "indices"), &indices) ||
+                  !is_index_accessor(&indices))) {
+    printf("Unsupported indices in %s\n", file->path);
+    return false;
+  }
+
+  int index_count = indexed ? indices.count : positions.count;
+  index_count -= index_count % 3;
+  if ((int64_t)mesh->vertex_count + positions.count > INT32_MAX ||
+      (int64_t)mesh->index_count + index_count > INT32_MAX) {
+    printf("Too many vertices in %s\n", file->path);
+    return false;
+  }
+
+  size_t vertex_bytes = (size_t)(mesh->vertex_count + positions.count) * mesh->layout.stride;
+  void *vertices = realloc(mesh->vertices, vertex_bytes ? vertex_bytes : 1);
+  if (!vertices) return false;
+  mesh->vertices = vertices;
+  size_t index_total = (size_t)(mesh->index_count + index_count);
+  unsigned int *mesh_indices = realloc(mesh->indices,
+                                       sizeof(unsigned int) * (index_total ? index_total : 1));
+  if (!mesh_indices) return false;
+  mesh->indices = mesh_indices;
+
+  unsigned int base = (unsigned int)mesh->vertex_count;
+  for (int i = 0; i < positions.count; i++) {
+    float v[8] = {0};
+    memcpy(v, positions.data + positions.stride * (size_t)i, sizeof(float) * 3);
+    if (has_normals) {
+      memcpy(v + 3, normals.data + normals.stride * (size_t)i, sizeof(float) * 3);
+    }
+    if (has_texcoords) {
+      memcpy(v + 6, texcoords.data + texcoords.stride * (size_t)i, sizeof(float) * 2);
+    }
+    conx_vertex_encode(&mesh->layout, v, conx_mesh_vertex(mesh, (int)base + i));
+  }
+  for (int i = 0; i < index_count; i++) {
+    unsigned int index = indexed ? read_index(&indices, i) : (unsigned int)i;
+    if (index >= (unsigned int)positions.count) {
+      printf("Index out of range in %s\n", file->path);
+      return false;
+    }
+    mesh->indices[mesh->index_count + i] = base + index;
+  }
+  mesh->vertex_count += positions.count;
+  mesh->index_count += index_count;
+  return true;
+}
+
+// Every triangle-list primitive goes into one mesh, so texture
+// coordinates are kept if any of them has some; the rest get zeros
+static ConXMesh *build_mesh(const GltfFile *file) {
+  const JsonDocument *json = &file->json;
+  ConXMesh *mesh = calloc(1, sizeof(ConXMesh));
+  if (!mesh) return NULL;
+
+  bool skipped = false;
+  bool textured = false;
+  int meshes = json_member(json, 0, "meshes");
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      mesh->layout = conx_vertex_layout(CONX_VERTEX_FLOAT,
+                                        textured ? CONX_VERTEX_FLOAT : CONX_VERTEX_NONE);
+    }
+    int mesh_token = meshes + 1;
+    for (int i = 0; i < json_length(json, meshes); i++) {
+      int primitives = json_member(json, mesh_token, "primitives");
+      int primitive = primitives + 1;
+      for (int j = 0; j < json_length(json, primitives); j++) {
+        double mode = json_number(json, json_member(json, primitive, "mode"), GLTF_TRIANGLES);
+        int attributes = json_member(json, primitive, "attributes");
+        if (mode != GLTF_TRIANGLES) {
+          skipped = true;
+        } else if (pass == 0) {
+          textured |= json_member(json, attributes, "TEXCOORD_0") >= 0;
+        } else if (!append_primitive(file, primitive, mesh)) {
+          conx_free_mesh(mesh);
+          return NULL;
+        }
+        primitive = json->tokens[primitive].end;
+      }
+      mesh_token = json->tokens[mesh_token].end;
+    }
+  }
+
+  if (skipped) printf("Skipped primitives of %s that are not triangle lists\n", file->path);
+  if (mesh->index_count == 0) {
+    printf("No triangles in %s\n", file->path);
+    conx_free_mesh(mesh);
+    return NULL;
+  }
+  return mesh;
+}
+
+ConXMesh *conx_import_gltf(const unsigned char *data, size_t size, const char *path) {
+  GltfFile file;
+  memset(&file, 0, sizeof(file));
+  file.path = path;
+  file.json.text = (const char *)data;
+  file.json.length = size;
+
+  const unsigned char *bin = NULL;
+  size_t bin_size = 0;
+  if (size >= 12 && read_u32(data) == GLB_MAGIC &&
+      !parse_glb(data, size, &file.json.text, &file.json.length, &bin, &bin_size)) {
+    printf("Malformed binary glTF %s\n", path);
+    return NULL;
+  }
+
+  ConXMesh *mesh = NULL;
+  if (!json_parse_value(&file.json, 0) || file.json.tokens[0].type != JSON_OBJECT) {
+    printf("Failed to parse glTF JSON in %s\n", path);
+  } else if (load_buffers(&file, bin, bin_size)) {
+    mesh = build_mesh(&file);
+  }
+
+  for (int i = 0; i < file.buffer_count; i++) {
+    free(file.buffers[i].owned);
+  }
+  free(file.buffers);
+  free(file.json.tokens);
+  return mesh;
+}
@@ -0,0 +1,49 @@
+#ifndef CONX_MESH_IMPORT_H
+#define CONX_MESH_IMPORT_H
+
+#include "conx_3d.h"
+#include <stddef.h>
+
+// Model importers behind conx_load_mesh. They return a mesh with its
+// arrays malloc'd in a float layout, not uploaded and without bounds, or
+// NULL after printing why. Normals the source lacks are left zero for
+// conx_mesh_fill_normals.
+
+// text is NUL terminated; path is for messages
+ConXMesh *conx_import_obj(const char *text, const char *path);
+// .gltf JSON or .glb binary; path locates external buffers
+ConXMesh *conx_import_gltf(const unsigned char *data, size_t size, const char *path);
+
+// Whole file, NUL terminated past size; NULL if it cannot be read
+unsigned char *conx_read_file(const char *path, size_t *size);
+
+// Gives each vertex whose normal is zero the area-weighted average of the
+// normals of the triangles using it. Needs float normals.
+void conx_mesh_fill_normals(ConXMesh *mesh);
+
+// Releases the cache file a loaded mesh points into
+void conx_mesh_unmap(ConXMesh *mesh);
+
+// Whether offsets and formats fit inside the stride without overlapping
+// the position
+bool conx_vertex_layout_valid(const ConXVertexLayout *layout);
+
+static inline unsigned char *conx_mesh_vertex(const ConXMesh *mesh, int vertex) {
+  return (unsigned char *)mesh->vertices + (size_t)vertex * mesh->layout.stride;
+}
+
+// A vertex decoded to floats: position, normal, texture coordinates (0, 0
+// when the layout has none)
+void conx_vertex_decode(const ConXVertexLayout *layout, const unsigned char *vertex,
+                        float out[8]);
+void conx_vertex_encode(const ConXVertexLayout *layout, const float in[8],
+                        unsigned char *vertex);
+
+// Swaps in new arrays, freeing or unmapping the old ones and dropping the
+// GPU copies. Either array may be the mesh's current one, which is kept
+// (copied out first if it lives in a mapped cache). False when out of
+// memory, leaving the mesh as it was and the new arrays to the caller.
+bool conx_mesh_replace_data(ConXMesh *mesh, void *vertices, int vertex_count,
+                            unsigned int *indices, int index_count);
+
+#endif
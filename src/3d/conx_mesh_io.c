@@ -0,0 +1,445 @@
+#include "conx_mesh_import.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// .cxmesh layout: the header, then vertex_count vertices of stride bytes
+// laid out as the header describes, then index_count 32-bit indices, all
+// in the writer's byte order. The magic reads differently in the other
+// order, so foreign files are rejected rather than misread.
+#define CXMESH_MAGIC 0x48534D43u // "CMSH"
+#define CXMESH_VERSION 2
+#define CXMESH_EXTENSION ".cxmesh"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t stride;
+  uint32_t normal_format;
+  uint32_t normal_offset;
+  uint32_t texcoord_format;
+  uint32_t texcoord_offset;
+  uint32_t reserved;
+  uint64_t source_size;
+  int64_t source_mtime;
+  uint64_t source_hash;  // FNV-1a of the source file
+  float texcoord_bias[2];
+  float texcoord_scale[2];
+  float bounds_center[3];
+  float bounds_radius;
+} CXMeshHeader;
+
+_Static_assert(sizeof(CXMeshHeader) == 96, "cxmesh header layout");
+
+unsigned char *conx_read_file(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return NULL;
+
+  unsigned char *data = NULL;
+  long length = -1;
+  if (fseek(file, 0, SEEK_END) == 0) length = ftell(file);
+  if (length >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+    data = malloc((size_t)length + 1);
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(file);
+
+  if (!data) return NULL;
+  data[length] = '\0';
+  *size = (size_t)length;
+  return data;
+}
+
+static uint64_t hash_bytes(const unsigned char *data, size_t size) {
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * UINT64_C(0x100000001b3);
+  }
+  return hash;
+}
+
+// Float normal of a vertex in an imported mesh
+static float *normal_of(const ConXMesh *mesh, int vertex) {
+  return (float *)(conx_mesh_vertex(mesh, vertex) + mesh->layout.normal_offset);
+}
+
+void conx_mesh_fill_normals(ConXMesh *mesh) {
+  if (mesh->layout.normal_format != CONX_VERTEX_FLOAT) return;
+  bool *missing = malloc(sizeof(bool) * (mesh->vertex_count ? mesh->vertex_count : 1));
+  if (!missing) return;
+
+  bool any_missing = false;
+  for (int i = 0; i < mesh->vertex_count; i++) {
+    const float *n = normal_of(mesh, i);
+    missing[i] = n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f;
+    any_missing |= missing[i];
+  }
+
+  if (any_missing) {
+    // Unnormalized cross products weigh each face by its area
+    for (int i = 0; i + 2 < mesh->index_count; i += 3) {
+      const unsigned int *corner = &mesh->indices[i];
+      const float *a = (const float *)conx_mesh_vertex(mesh, (int)corner[0]);
+      const float *b = (const float *)conx_mesh_vertex(mesh, (int)corner[1]);
+      const float *c = (const float *)conx_mesh_vertex(mesh, (int)corner[2]);
+      Vec3 face = vec3_cross(vec3_create(b[0] - a[0], b[1] - a[1], b[2] - a[2]),
+                             vec3_create(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+      for (int k = 0; k < 3; k++) {
+        if (!missing[corner[k]]) continue;
+        float *n = normal_of(mesh, (int)corner[k]);
+        n[0] += face.x;
+        n[1] += face.y;
+        n[2] += face.z;
+      }
+    }
+
+    for (int i = 0; i < mesh->vertex_count; i++) {
+      if (!missing[i]) continue;
+      float *n = normal_of(mesh, i);
+      float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length > 0.0f) {
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+      } else {
+        // Only used by degenerate triangles, which draw nothing anyway
+        n[1] = 1.0f;
+      }
+    }
+  }
+  free(missing);
+}
+
+// Whole file in memory, shared with the page cache where mmap exists.
+// Private, so writes to the mesh stay out of the file.
+static void *map_file(const char *path, size_t *size) {
+#ifdef _WIN32
+  return conx_read_file(path, size);
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  void *data = NULL;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      data = NULL;
+    } else {
+      *size = (size_t)info.st_size;
+    }
+  }
+  close(fd);
+  return data;
+#endif
+}
+
+static void unmap_file(void *data, size_t size) {
+#ifdef _WIN32
+  (void)size;
+  free(data);
+#else
+  munmap(data, size);
+#endif
+}
+
+void conx_mesh_unmap(ConXMesh *mesh) {
+  unmap_file(mesh->mapping, mesh->mapping_size);
+  mesh->mapping = NULL;
+  mesh->vertices = NULL;
+  mesh->indices = NULL;
+}
+
+static ConXVertexLayout header_layout(const CXMeshHeader *header) {
+  ConXVertexLayout layout;
+  layout.stride = (int)header->stride;
+  layout.normal_format = (ConXVertexFormat)header->normal_format;
+  layout.normal_offset = (int)header->normal_offset;
+  layout.texcoord_format = (ConXVertexFormat)header->texcoord_format;
+  layout.texcoord_offset = (int)header->texcoord_offset;
+  memcpy(layout.texcoord_bias, header->texcoord_bias, sizeof(layout.texcoord_bias));
+  memcpy(layout.texcoord_scale, header->texcoord_scale, sizeof(layout.texcoord_scale));
+  return layout;
+}
+
+// A header of this version with a usable layout, whose arrays fit the file
+static const CXMeshHeader *check_cache(const void *data, size_t size) {
+  const CXMeshHeader *header = data;
+  if (size < sizeof(CXMeshHeader) || header->magic != CXMESH_MAGIC ||
+      header->version != CXMESH_VERSION || header->vertex_count == 0 ||
+      header->index_count == 0 || header->vertex_count > INT32_MAX ||
+      header->index_count > INT32_MAX || header->stride > 1024 ||
+      header->normal_offset > 1024 || header->texcoord_offset > 1024) {
+    return NULL;
+  }
+  ConXVertexLayout layout = header_layout(header);
+  if (!conx_vertex_layout_valid(&layout)) return NULL;
+
+  uint64_t vertex_bytes = (uint64_t)header->vertex_count * header->stride;
+  uint64_t expected = sizeof(CXMeshHeader) + vertex_bytes +
+                      (uint64_t)header->index_count * sizeof(uint32_t);
+  if (expected != size) return NULL;
+
+  // A damaged file must not send draws outside the vertices. Upload reads
+  // every index anyway, so this costs little next to it.
+  const uint32_t *indices = (const uint32_t *)((const unsigned char *)data +
+                                               sizeof(CXMeshHeader) + vertex_bytes);
+  uint32_t highest = 0;
+  for (uint32_t i = 0; i < header->index_count; i++) {
+    if (indices[i] > highest) highest = indices[i];
+  }
+  return highest < header->vertex_count ? header : NULL;
+}
+
+// Points the mesh into a checked cache
+static ConXMesh *mesh_from_cache(void *data, size_t size) {
+  const CXMeshHeader *header = data;
+  ConXMesh *mesh = calloc(1, sizeof(ConXMesh));
+  if (!mesh) return NULL;
+
+  unsigned char *arrays = (unsigned char *)data + sizeof(CXMeshHeader);
+  mesh->mapping = data;
+  mesh->mapping_size = size;
+  mesh->vertex_count = (int)header->vertex_count;
+  mesh->index_count = (int)header->index_count;
+  mesh->layout = header_layout(header);
+  mesh->vertices = arrays;
+  mesh->indices = (unsigned int *)(arrays + (size_t)header->stride * mesh->vertex_count);
+  mesh->bounds_center = vec3_create(header->bounds_center[0], header->bounds_center[1],
+                                    header->bounds_center[2]);
+  mesh->bounds_radius = header->bounds_radius;
+  return mesh;
+}
+
+// Written under a temporary name and renamed over the old cache, so a
+// reader never maps a half-written file
+static bool write_cache(const char *cache_path, const ConXMesh *mesh, const CXMeshHeader *header) {
+  size_t length = strlen(cache_path);
+  char *temporary = malloc(length + 5);
+  if (!temporary) return false;
+  memcpy(temporary, cache_path, length);
+  memcpy(temporary + length, ".tmp", 5);
+
+  FILE *file = fopen(temporary, "wb");
+  bool written = file != NULL;
+  if (file) {
+    size_t vertex_bytes = (size_t)mesh->vertex_count * mesh->layout.stride;
+    written = fwrite(header, sizeof(*header), 1, file) == 1 &&
+              fwrite(mesh->vertices, 1, vertex_bytes, file) == vertex_bytes &&
+              fwrite(mesh->indices, sizeof(unsigned int), (size_t)mesh->index_count, file) ==
+                  (size_t)mesh->index_count;
+    written = fclose(file) == 0 && written;
+  }
+#ifdef _WIN32
+  // rename does not replace existing files here
+  if (written) remove(cache_path);
+#endif
+  if (!written || rename(temporary, cache_path) != 0) {
+    printf("Failed to write mesh cache %s\n", cache_path);
+    remove(temporary);
+    written = false;
+  }
+  free(temporary);
+  return written;
+}
+
+static void fill_header(CXMeshHeader *header, const ConXMesh *mesh, uint64_t source_size,
+                        int64_t source_mtime, uint64_t source_hash) {
+  const ConXVertexLayout *layout = &mesh->layout;
+  memset(header, 0, sizeof(*header));
+  header->magic = CXMESH_MAGIC;
+  header->version = CXMESH_VERSION;
+  header->vertex_count = (uint32_t)mesh->vertex_count;
+  header->index_count = (uint32_t)mesh->index_count;
+  header->stride = (uint32_t)layout->stride;
+  header->normal_format = (uint32_t)layout->normal_format;
+  header->normal_offset = (uint32_t)layout->normal_offset;
+  header->texcoord_format = (uint32_t)layout->texcoord_format;
+  header->texcoord_offset = (uint32_t)layout->texcoord_offset;
+  header->source_size = source_size;
+  header->source_mtime = source_mtime;
+  header->source_hash = source_hash;
+  memcpy(header->texcoord_bias, layout->texcoord_bias, sizeof(header->texcoord_bias));
+  memcpy(header->texcoord_scale, layout->texcoord_scale, sizeof(header->texcoord_scale));
+  header->bounds_center[0] = mesh->bounds_center.x;
+  header->bounds_center[1] = mesh->bounds_center.y;
+  header->bounds_center[2] = mesh->bounds_center.z;
+  header->bounds_radius = mesh->bounds_radius;
+}
+
+// Records the source's new modification time in a cache whose contents
+// still match, so the next load can skip hashing
+static void touch_cache(const char *cache_path, int64_t mtime) {
+  FILE *file = fopen(cache_path, "r+b");
+  if (!file) return;
+  if (fseek(file, (long)offsetof(CXMeshHeader, source_mtime), SEEK_SET) == 0) {
+    fwrite(&mtime, sizeof(mtime), 1, file);
+  }
+  fclose(file);
+}
+
+static bool has_extension(const char *path, const char *extension) {
+  size_t length = strlen(path);
+  size_t extension_length = strlen(extension);
+  if (length < extension_length) return false;
+  const char *tail = path + length - extension_length;
+  for (size_t i = 0; i < extension_length; i++) {
+    char c = tail[i];
+    if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+    if (c != extension[i]) return false;
+  }
+  return true;
+}
+
+static ConXMesh *import_source(const unsigned char *data, size_t size, const char *path) {
+  ConXMesh *mesh = NULL;
+  if (has_extension(path, ".obj")) {
+    mesh = conx_import_obj((const char *)data, path);
+  } else if (has_extension(path, ".gltf") || has_extension(path, ".glb")) {
+    mesh = conx_import_gltf(data, size, path);
+  } else {
+    printf("Unknown mesh format %s\n", path);
+  }
+  if (!mesh) return NULL;
+
+  conx_mesh_fill_normals(mesh);
+  conx_mesh_update_bounds(mesh);
+  printf("Loaded mesh: %s (%d vertices, %d triangles)\n", path, mesh->vertex_count,
+         mesh->index_count / 3);
+  return mesh;
+}
+
+// A cache file named directly, taken as it is
+static ConXMesh *load_cache_file(const char *path) {
+  size_t size = 0;
+  void *data = map_file(path, &size);
+  ConXMesh *mesh = data && check_cache(data, size) ? mesh_from_cache(data, size) : NULL;
+  if (!mesh) {
+    printf("Failed to load mesh cache %s\n", path);
+    if (data) unmap_file(data, size);
+  }
+  return mesh;
+}
+
+static char *default_cache_path(const char *path) {
+  size_t length = strlen(path);
+  char *cache_path = malloc(length + sizeof(CXMESH_EXTENSION));
+  if (!cache_path) return NULL;
+  memcpy(cache_path, path, length);
+  memcpy(cache_path + length, CXMESH_EXTENSION, sizeof(CXMESH_EXTENSION));
+  return cache_path;
+}
+
+ConXMesh *conx_import_mesh(const char *path) {
+  if (!path) return NULL;
+
+  size_t size = 0;
+  unsigned char *source = conx_read_file(path, &size);
+  if (!source) {
+    printf("Failed to read mesh %s\n", path);
+    return NULL;
+  }
+  ConXMesh *mesh = import_source(source, size, path);
+  free(source);
+  if (mesh) conx_upload_mesh(mesh);
+  return mesh;
+}
+
+bool conx_mesh_write_cache(const ConXMesh *mesh, const char *source_path,
+                           const char *cache_path) {
+  if (!mesh || !mesh->vertices || !mesh->indices || !source_path) return false;
+
+  struct stat info;
+  size_t size = 0;
+  unsigned char *source = stat(source_path, &info) == 0 ? conx_read_file(source_path, &size)
+                                                        : NULL;
+  if (!source) {
+    printf("Failed to read mesh %s\n", source_path);
+    return false;
+  }
+  CXMeshHeader header;
+  fill_header(&header, mesh, (uint64_t)size, (int64_t)info.st_mtime, hash_bytes(source, size));
+  free(source);
+
+  char *default_path = cache_path ? NULL : default_cache_path(source_path);
+  bool written = (cache_path || default_path) &&
+                 write_cache(cache_path ? cache_path : default_path, mesh, &header);
+  free(default_path);
+  return written;
+}
+
+ConXMesh *conx_load_mesh(const char *path) {
+  if (!path) return NULL;
+  if (has_extension(path, CXMESH_EXTENSION)) {
+    ConXMesh *mesh = load_cache_file(path);
+    if (mesh) conx_upload_mesh(mesh);
+    return mesh;
+  }
+
+  char *cache_path = default_cache_path(path);
+  if (!cache_path) return NULL;
+
+  struct stat info;
+  bool have_source = stat(path, &info) == 0;
+  unsigned char *source = NULL;
+  size_t source_size = 0;
+  uint64_t source_hash = 0;
+
+  size_t cache_size = 0;
+  void *cache = map_file(cache_path, &cache_size);
+  const CXMeshHeader *header = cache ? check_cache(cache, cache_size) : NULL;
+  bool fresh = header != NULL;
+  if (header && have_source) {
+    // Same size and time is taken on trust; a new time with the same
+    // contents, as after a checkout, only costs a hash
+    fresh = header->source_size == (uint64_t)info.st_size;
+    if (fresh && header->source_mtime != (int64_t)info.st_mtime) {
+      source = conx_read_file(path, &source_size);
+      source_hash = source ? hash_bytes(source, source_size) : 0;
+      fresh = source && source_hash == header->source_hash;
+      if (fresh) touch_cache(cache_path, (int64_t)info.st_mtime);
+    }
+  }
+
+  ConXMesh *mesh = NULL;
+  if (fresh) {
+    mesh = mesh_from_cache(cache, cache_size);
+    if (mesh) cache = NULL;
+  }
+  if (cache) unmap_file(cache, cache_size);
+
+  if (!mesh && !have_source) {
+    printf("Failed to load mesh %s: file not found\n", path);
+  } else if (!mesh) {
+    if (!source) {
+      source = conx_read_file(path, &source_size);
+      if (source) source_hash = hash_bytes(source, source_size);
+    }
+    if (!source) {
+      printf("Failed to read mesh %s\n", path);
+    } else if ((mesh = import_source(source, source_size, path))) {
+      CXMeshHeader header;
+      fill_header(&header, mesh, (uint64_t)source_size, (int64_t)info.st_mtime, source_hash);
+      write_cache(cache_path, mesh, &header);
+    }
+  }
+  free(source);
+  free(cache_path);
+
+  if (mesh) conx_upload_mesh(mesh);
+  return mesh;
+}
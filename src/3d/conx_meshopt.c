@@ -0,0 +1,302 @@
+#include "conx_meshopt.h"
+#include "conx_mesh_import.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Forsyth's vertex scoring: the last triangle's vertices score a flat
+// LAST_TRIANGLE_SCORE so the next triangle does not just reuse its edge,
+// older entries decay with their cache position, and vertices with few
+// triangles left are boosted so they get finished instead of stranded
+#define LAST_TRIANGLE_SCORE 0.75f
+#define CACHE_DECAY_POWER 1.5f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+#define VALENCE_TABLE_SIZE 32
+
+static void *allocate(size_t count, size_t size) {
+  return malloc(count ? count * size : 1);
+}
+
+static uint32_t hash_vertex(const unsigned char *vertex, int stride) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < stride; i++) {
+    hash = (hash ^ vertex[i]) * 16777619u;
+  }
+  return hash;
+}
+
+bool conx_meshopt_weld(ConXMesh *mesh) {
+  if (!mesh || mesh->vertex_count == 0) return true;
+
+  int stride = mesh->layout.stride;
+  uint32_t table_size = 1;
+  while (table_size < (uint32_t)mesh->vertex_count * 2) table_size *= 2;
+  int *table = malloc(sizeof(int) * table_size);
+  unsigned int *remap = malloc(sizeof(unsigned int) * mesh->vertex_count);
+  unsigned char *vertices = allocate((size_t)mesh->vertex_count, (size_t)stride);
+  unsigned int *indices = allocate((size_t)mesh->index_count, sizeof(unsigned int));
+  if (!table || !remap || !vertices || !indices) {
+    printf("Failed to allocate mesh weld\n");
+    free(table);
+    free(remap);
+    free(vertices);
+    free(indices);
+    return false;
+  }
+  memset(table, 0xFF, sizeof(int) * table_size);
+
+  int unique = 0;
+  for (int i = 0; i < mesh->vertex_count; i++) {
+    const unsigned char *vertex = conx_mesh_vertex(mesh, i);
+    uint32_t slot = hash_vertex(vertex, stride) & (table_size - 1);
+    while (table[slot] >= 0 &&
+           memcmp(vertices + (size_t)table[slot] * stride, vertex, (size_t)stride) != 0) {
+      slot = (slot + 1) & (table_size - 1);
+    }
+    if (table[slot] < 0) {
+      table[slot] = unique;
+      memcpy(vertices + (size_t)unique * stride, vertex, (size_t)stride);
+      unique++;
+    }
+    remap[i] = (unsigned int)table[slot];
+  }
+  for (int i = 0; i < mesh->index_count; i++) {
+    indices[i] = remap[mesh->indices[i]];
+  }
+  free(table);
+  free(remap);
+
+  if (!conx_mesh_replace_data(mesh, vertices, unique, indices, mesh->index_count)) {
+    free(vertices);
+    free(indices);
+    return false;
+  }
+  return true;
+}
+
+typedef struct {
+  float cache[CONX_MESHOPT_CACHE_SIZE];
+  float valence[VALENCE_TABLE_SIZE];
+} ScoreTable;
+
+static void build_score_table(ScoreTable *table) {
+  for (int i = 0; i < CONX_MESHOPT_CACHE_SIZE; i++) {
+    if (i < 3) {
+      table->cache[i] = LAST_TRIANGLE_SCORE;
+    } else {
+      float scale = 1.0f / (CONX_MESHOPT_CACHE_SIZE - 3);
+      table->cache[i] = powf(1.0f - (float)(i - 3) * scale, CACHE_DECAY_POWER);
+    }
+  }
+  for (int i = 0; i < VALENCE_TABLE_SIZE; i++) {
+    table->valence[i] = i ? VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER) : 0.0f;
+  }
+}
+
+static float vertex_score(const ScoreTable *table, int cache_position, int remaining) {
+  // Nothing left to draw with it, so it can never help a triangle
+  if (remaining == 0) return -1.0f;
+
+  float score = cache_position >= 0 ? table->cache[cache_position] : 0.0f;
+  if (remaining < VALENCE_TABLE_SIZE) return score + table->valence[remaining];
+  return score + VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+}
+
+bool conx_meshopt_vertex_cache(ConXMesh *mesh) {
+  if (!mesh || mesh->index_count < 3) return true;
+
+  int triangle_count = mesh->index_count / 3;
+  int vertex_count = mesh->vertex_count;
+  // Per vertex: where its triangles start in adjacency and how many of
+  // them are not emitted yet, which are kept at the front of its range
+  int *offsets = allocate((size_t)vertex_count + 1, sizeof(int));
+  int *remaining = allocate((size_t)vertex_count, sizeof(int));
+  int *adjacency = allocate((size_t)triangle_count * 3, sizeof(int));
+  int *cache_position = allocate((size_t)vertex_count, sizeof(int));
+  float *score = allocate((size_t)vertex_count, sizeof(float));
+  float *triangle_score = allocate((size_t)triangle_count, sizeof(float));
+  bool *emitted = calloc((size_t)triangle_count, sizeof(bool));
+  unsigned int *indices = allocate((size_t)mesh->index_count, sizeof(unsigned int));
+  bool allocated = offsets && remaining && adjacency && cache_position && score &&
+                   triangle_score && emitted && indices;
+  if (!allocated) {
+    printf("Failed to allocate vertex cache optimization\n");
+    free(indices);
+  } else {
+    const unsigned int *source = mesh->indices;
+    memset(remaining, 0, sizeof(int) * vertex_count);
+    for (int i = 0; i < triangle_count * 3; i++) remaining[source[i]]++;
+    offsets[0] = 0;
+    for (int v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + remaining[v];
+    memset(remaining, 0, sizeof(int) * vertex_count);
+    for (int i = 0; i < triangle_count * 3; i++) {
+      unsigned int v = source[i];
+      adjacency[offsets[v] + remaining[v]++] = i / 3;
+    }
+
+    ScoreTable table;
+    build_score_table(&table);
+    for (int v = 0; v < vertex_count; v++) {
+      cache_position[v] = -1;
+      score[v] = vertex_score(&table, -1, remaining[v]);
+    }
+    for (int t = 0; t < triangle_count; t++) {
+      const unsigned int *corner = &source[t * 3];
+      triangle_score[t] = score[corner[0]] + score[corner[1]] + score[corner[2]];
+    }
+
+    // Room for the cache plus the three vertices pushed past its end
+    unsigned int cache[CONX_MESHOPT_CACHE_SIZE + 3];
+    unsigned int next_cache[CONX_MESHOPT_CACHE_SIZE + 3];
+    int cache_count = 0;
+    int best = 0;
+    int scan = 0;
+
+    for (int output = 0; output < triangle_count; output++) {
+      // Nothing in the cache touches a triangle left: take the next in
+      // the original order
+      if (best < 0) {
+        while (emitted[scan]) scan++;
+        best = scan;
+      }
+      const unsigned int *corner = &source[best * 3];
+      memcpy(&indices[output * 3], corner, sizeof(unsigned int) * 3);
+      emitted[best] = true;
+
+      for (int k = 0; k < 3; k++) {
+        unsigned int v = corner[k];
+        int *triangles = &adjacency[offsets[v]];
+        for (int j = 0; j < remaining[v]; j++) {
+          if (triangles[j] == best) {
+            triangles[j] = triangles[--remaining[v]];
+            break;
+          }
+        }
+      }
+
+      int next_count = 0;
+      for (int k = 0; k < 3; k++) {
+        bool seen = false;
+        for (int j = 0; j < next_count; j++) seen |= next_cache[j] == corner[k];
+        if (!seen) next_cache[next_count++] = corner[k];
+      }
+      for (int j = 0; j < cache_count; j++) {
+        unsigned int v = cache[j];
+        if (v != corner[0] && v != corner[1] && v != corner[2]) next_cache[next_count++] = v;
+      }
+
+      // Rescore everything whose position or valence moved, evicted
+      // vertices included, and carry the change to their triangles
+      for (int j = 0; j < next_count; j++) {
+        unsigned int v = next_cache[j];
+        cache_position[v] = j < CONX_MESHOPT_CACHE_SIZE ? j : -1;
+        float updated = vertex_score(&table, cache_position[v], remaining[v]);
+        float delta = updated - score[v];
+        score[v] = updated;
+        const int *triangles = &adjacency[offsets[v]];
+        for (int i = 0; i < remaining[v]; i++) triangle_score[triangles[i]] += delta;
+      }
+      cache_count = next_count < CONX_MESHOPT_CACHE_SIZE ? next_count : CONX_MESHOPT_CACHE_SIZE;
+      memcpy(cache, next_cache, sizeof(unsigned int) * cache_count);
+
+      best = -1;
+      float best_score = -INFINITY;
+      for (int j = 0; j < cache_count; j++) {
+        unsigned int v = cache[j];
+        const int *triangles = &adjacency[offsets[v]];
+        for (int i = 0; i < remaining[v]; i++) {
+          if (triangle_score[triangles[i]] > best_score) {
+            best_score = triangle_score[triangles[i]];
+            best = triangles[i];
+          }
+        }
+      }
+    }
+  }
+
+  free(offsets);
+  free(remaining);
+  free(adjacency);
+  free(cache_position);
+  free(score);
+  free(triangle_score);
+  free(emitted);
+  if (!allocated) return false;
+
+  // Meshes generated row by row can already beat the greedy order; those
+  // keep theirs. A trailing partial triangle is never drawn, so it is not
+  // kept either way.
+  ConXMesh reordered = *mesh;
+  reordered.indices = indices;
+  reordered.index_count = triangle_count * 3;
+  bool better = conx_meshopt_acmr(&reordered, CONX_MESHOPT_CACHE_SIZE) <
+                conx_meshopt_acmr(mesh, CONX_MESHOPT_CACHE_SIZE);
+  if (!better) {
+    memcpy(indices, mesh->indices, sizeof(unsigned int) * triangle_count * 3);
+  }
+  if (!conx_mesh_replace_data(mesh, mesh->vertices, mesh->vertex_count, indices,
+                              triangle_count * 3)) {
+    free(indices);
+    return false;
+  }
+  return true;
+}
+
+bool conx_meshopt_vertex_fetch(ConXMesh *mesh) {
+  if (!mesh || mesh->vertex_count == 0) return true;
+
+  int stride = mesh->layout.stride;
+  int *remap = malloc(sizeof(int) * mesh->vertex_count);
+  unsigned char *vertices = allocate((size_t)mesh->vertex_count, (size_t)stride);
+  unsigned int *indices = allocate((size_t)mesh->index_count, sizeof(unsigned int));
+  if (!remap || !vertices || !indices) {
+    printf("Failed to allocate vertex fetch optimization\n");
+    free(remap);
+    free(vertices);
+    free(indices);
+    return false;
+  }
+  memset(remap, 0xFF, sizeof(int) * mesh->vertex_count);
+
+  int used = 0;
+  for (int i = 0; i < mesh->index_count; i++) {
+    unsigned int v = mesh->indices[i];
+    if (remap[v] < 0) {
+      remap[v] = used;
+      memcpy(vertices + (size_t)used * stride, conx_mesh_vertex(mesh, (int)v), (size_t)stride);
+      used++;
+    }
+    indices[i] = (unsigned int)remap[v];
+  }
+  free(remap);
+
+  if (!conx_mesh_replace_data(mesh, vertices, used, indices, mesh->index_count)) {
+    free(vertices);
+    free(indices);
+    return false;
+  }
+  return true;
+}
+
+float conx_meshopt_acmr(const ConXMesh *mesh, int cache_size) {
+  if (!mesh || mesh->index_count < 3 || cache_size <= 0) return 0.0f;
+
+  // A vertex is still cached while fewer than cache_size misses came
+  // after the one that loaded it
+  unsigned int *loaded_at = calloc((size_t)mesh->vertex_count, sizeof(unsigned int));
+  if (!loaded_at) return 0.0f;
+
+  unsigned int misses = 0;
+  int triangle_count = mesh->index_count / 3;
+  for (int i = 0; i < triangle_count * 3; i++) {
+    unsigned int v = mesh->indices[i];
+    if (loaded_at[v] == 0 || misses - loaded_at[v] >= (unsigned int)cache_size) {
+      loaded_at[v] = ++misses;
+    }
+  }
+  free(loaded_at);
+  return (float)misses / (float)triangle_count;
+}
@@ -0,0 +1,275 @@
+#include "conx_mesh_import.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_OBJ_CAPACITY 1024
+
+// A face corner as 0-based indices, texcoord and normal -1 when the face
+// gives none
+typedef struct {
+  int position;
+  int texcoord;
+  int normal;
+} ObjCorner;
+
+// What the file declares, before corners are welded into vertices.
+// Triangles are three consecutive corners.
+typedef struct {
+  float *positions;
+  int position_count;
+  int position_capacity;
+  float *texcoords;
+  int texcoord_count;
+  int texcoord_capacity;
+  float *normals;
+  int normal_count;
+  int normal_capacity;
+  ObjCorner *corners;
+  int corner_count;
+  int corner_capacity;
+  ObjCorner *polygon;
+  int polygon_capacity;
+} ObjData;
+
+// Welds corners that share all three indices; corner is the first one
+// seen, -1 while the slot is empty
+typedef struct {
+  int corner;
+  unsigned int vertex;
+} ObjWeldSlot;
+
+static bool reserve(void **array, int *capacity, int needed, size_t element_size) {
+  if (needed <= *capacity) return true;
+
+  int grown_capacity = *capacity ? *capacity : INITIAL_OBJ_CAPACITY;
+  while (grown_capacity < needed) grown_capacity *= 2;
+  void *grown = realloc(*array, element_size * grown_capacity);
+  if (!grown) return false;
+  *array = grown;
+  *capacity = grown_capacity;
+  return true;
+}
+
+static const char *skip_blanks(const char *p) {
+  while (*p == ' ' || *p == '\t') p++;
+  return p;
+}
+
+static const char *skip_line(const char *p) {
+  while (*p && *p != '\n') p++;
+  return *p ? p + 1 : p;
+}
+
+static bool at_line_end(const char *p) {
+  return *p == '\n' || *p == '\r' || *p == '\0' || *p == '#';
+}
+
+// strtof would run on into the next line, so each number must start on
+// this one
+static bool parse_floats(const char **cursor, float *out, int count) {
+  const char *p = *cursor;
+  for (int i = 0; i < count; i++) {
+    p = skip_blanks(p);
+    if (at_line_end(p)) return false;
+    char *end;
+    out[i] = strtof(p, &end);
+    if (end == p) return false;
+    p = end;
+  }
+  *cursor = p;
+  return true;
+}
+
+// OBJ indices count from 1, or back from the latest element when negative
+static bool parse_index(const char **cursor, int count, int *index) {
+  char first = **cursor;
+  if (first != '-' && (first < '0' || first > '9')) return false;
+  char *end;
+  long value = strtol(*cursor, &end, 10);
+  if (end == *cursor || value == 0) return false;
+  *cursor = end;
+  *index = value > 0 ? (int)(value - 1) : count + (int)value;
+  return true;
+}
+
+// v, v/vt, v//vn or v/vt/vn
+static bool parse_corner(const char **cursor, const ObjData *data, ObjCorner *corner) {
+  const char *p = *cursor;
+  if (!parse_index(&p, data->position_count, &corner->position)) return false;
+  corner->texcoord = -1;
+  corner->normal = -1;
+  if (*p == '/') {
+    p++;
+    if (*p != '/' && !parse_index(&p, data->texcoord_count, &corner->texcoord)) return false;
+    if (*p == '/') {
+      p++;
+      if (!parse_index(&p, data->normal_count, &corner->normal)) return false;
+    }
+  }
+  *cursor = p;
+  return true;
+}
+
+// Polygons are split into a fan around their first corner
+static bool parse_face(const char **cursor, ObjData *data) {
+  const char *p = *cursor;
+  int count = 0;
+  for (p = skip_blanks(p); !at_line_end(p); p = skip_blanks(p)) {
+    bool reserved = reserve((void **)&data->polygon, &data->polygon_capacity, count + 1,
+                            sizeof(ObjCorner));
+    if (!reserved || !parse_corner(&p, data, &data->polygon[count])) {
+      return false;
+    }
+    count++;
+  }
+  if (count < 3) return false;
+
+  int needed = data->corner_count + (count - 2) * 3;
+  if (!reserve((void **)&data->corners, &data->corner_capacity, needed, sizeof(ObjCorner))) {
+    return false;
+  }
+  for (int i = 2; i < count; i++) {
+    ObjCorner *triangle = &data->corners[data->corner_count];
+    triangle[0] = data->polygon[0];
+    triangle[1] = data->polygon[i - 1];
+    triangle[2] = data->polygon[i];
+    data->corner_count += 3;
+  }
+  *cursor = p;
+  return true;
+}
+
+static bool parse_obj(const char *text, ObjData *data, const char *path) {
+  int line = 1;
+  for (const char *p = text; *p; p = skip_line(p), line++) {
+    p = skip_blanks(p);
+    bool ok = true;
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      p++;
+      ok = reserve((void **)&data->positions, &data->position_capacity,
+                   (data->position_count + 1) * 3, sizeof(float)) &&
+           parse_floats(&p, &data->positions[data->position_count * 3], 3);
+      if (ok) data->position_count++;
+    } else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+      p += 2;
+      ok = reserve((void **)&data->normals, &data->normal_capacity,
+                   (data->normal_count + 1) * 3, sizeof(float)) &&
+           parse_floats(&p, &data->normals[data->normal_count * 3], 3);
+      if (ok) data->normal_count++;
+    } else if (p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+      p += 2;
+      ok = reserve((void **)&data->texcoords, &data->texcoord_capacity,
+                   (data->texcoord_count + 1) * 2, sizeof(float)) &&
+           parse_floats(&p, &data->texcoords[data->texcoord_count * 2], 2);
+      if (ok) data->texcoord_count++;
+    } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      p++;
+      ok = parse_face(&p, data);
+    }
+    // Groups, materials and the rest draw the same without them
+
+    if (!ok) {
+      printf("Failed to parse %s line %d\n", path, line);
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline uint32_t hash_corner(const ObjCorner *corner) {
+  uint64_t key = (uint64_t)(uint32_t)corner->position << 32 ^
+                 (uint64_t)(uint32_t)(corner->texcoord + 1) << 16 ^ (uint32_t)(corner->normal + 1);
+  key ^= key >> 33;
+  key *= UINT64_C(0xff51afd7ed558ccd);
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+static inline bool same_corner(const ObjCorner *a, const ObjCorner *b) {
+  return a->position == b->position && a->texcoord == b->texcoord && a->normal == b->normal;
+}
+
+// One vertex per distinct corner, in first-use order. Texture
+// coordinates are kept only when some face uses them.
+static ConXMesh *weld_corners(const ObjData *data, const char *path) {
+  bool textured = false;
+  for (int i = 0; i < data->corner_count; i++) {
+    const ObjCorner *corner = &data->corners[i];
+    if (corner->position < 0 || corner->position >= data->position_count ||
+        corner->texcoord < -1 || corner->texcoord >= data->texcoord_count ||
+        corner->normal < -1 || corner->normal >= data->normal_count) {
+      printf("Face index out of range in %s\n", path);
+      return NULL;
+    }
+    textured |= corner->texcoord >= 0;
+  }
+
+  uint32_t table_size = 1;
+  while (table_size < (uint32_t)data->corner_count * 2) table_size *= 2;
+  ObjWeldSlot *table = malloc(sizeof(ObjWeldSlot) * table_size);
+  ConXMesh *mesh = calloc(1, sizeof(ConXMesh));
+  if (mesh) {
+    mesh->layout = conx_vertex_layout(CONX_VERTEX_FLOAT,
+                                      textured ? CONX_VERTEX_FLOAT : CONX_VERTEX_NONE);
+    mesh->vertices = malloc((size_t)mesh->layout.stride * data->corner_count);
+    mesh->indices = malloc(sizeof(unsigned int) * data->corner_count);
+  }
+  if (!table || !mesh || !mesh->vertices || !mesh->indices) {
+    printf("Failed to allocate mesh for %s\n", path);
+    free(table);
+    conx_free_mesh(mesh);
+    return NULL;
+  }
+  memset(table, 0xFF, sizeof(ObjWeldSlot) * table_size);
+
+  for (int i = 0; i < data->corner_count; i++) {
+    const ObjCorner *corner = &data->corners[i];
+    uint32_t slot = hash_corner(corner) & (table_size - 1);
+    while (table[slot].corner >= 0 && !same_corner(&data->corners[table[slot].corner], corner)) {
+      slot = (slot + 1) & (table_size - 1);
+    }
+
+    if (table[slot].corner < 0) {
+      table[slot].corner = i;
+      table[slot].vertex = (unsigned int)mesh->vertex_count;
+      float v[8] = {0};
+      memcpy(v, &data->positions[corner->position * 3], sizeof(float) * 3);
+      if (corner->normal >= 0) {
+        memcpy(v + 3, &data->normals[corner->normal * 3], sizeof(float) * 3);
+      }
+      if (corner->texcoord >= 0) {
+        memcpy(v + 6, &data->texcoords[corner->texcoord * 2], sizeof(float) * 2);
+      }
+      conx_vertex_encode(&mesh->layout, v, conx_mesh_vertex(mesh, mesh->vertex_count++));
+    }
+    mesh->indices[mesh->index_count++] = table[slot].vertex;
+  }
+  free(table);
+
+  void *vertices = realloc(mesh->vertices, (size_t)mesh->layout.stride * mesh->vertex_count);
+  if (vertices) mesh->vertices = vertices;
+  return mesh;
+}
+
+ConXMesh *conx_import_obj(const char *text, const char *path) {
+  ObjData data;
+  memset(&data, 0, sizeof(data));
+
+  ConXMesh *mesh = NULL;
+  if (parse_obj(text, &data, path)) {
+    if (data.corner_count == 0) {
+      printf("No faces in %s\n", path);
+    } else {
+      mesh = weld_corners(&data, path);
+    }
+  }
+
+  free(data.positions);
+  free(data.texcoords);
+  free(data.normals);
+  free(data.corners);
+  free(data.polygon);
+  return mesh;
+}
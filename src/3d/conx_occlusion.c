@@ -0,0 +1,531 @@
+#include "conx_occlusion.h"
+#include "conx_3d_internal.h"
+#include "conx_jobs.h"
+#include "conx_mesh_import.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(CONX_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define CONX_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Rows each rasterization job owns, so jobs never write the same pixels
+#define BAND_HEIGHT 8
+// Pyramid levels are picked so a box spans at most this many texels a side
+#define TEST_SPAN 4
+#define MAX_LEVELS 16
+#define INITIAL_TRIANGLE_CAPACITY 1024
+// Five clip planes can add one vertex each
+#define MAX_CLIPPED_VERTICES 8
+// A box must be this much farther than the occluders to count as hidden,
+// relative to depth, which absorbs interpolation error on coplanar faces
+#define DEPTH_MARGIN 1e-4f
+
+// A triangle set up for its pixels: edge functions that are positive
+// inside, and 1 / w as a plane over the screen, all at pixel (x, y)
+// meaning the center x + 0.5, y + 0.5. Pixels with any edge below zero
+// are outside.
+typedef struct {
+  float edge[3][3];   // a, b, c of a * x + b * y + c
+  float depth[3];
+  int min_x, min_y, max_x, max_y;
+} OcclusionTriangle;
+
+typedef struct {
+  float v[4]; // clip-space x, y, z, w
+} ClipVertex;
+
+// An occluder's vertices, transformed once and shared by its triangles.
+// Screen positions are only valid for vertices in front of the near plane.
+typedef struct {
+  ClipVertex clip;
+  float screen[3];    // x, y in pixels and 1 / w
+  unsigned int outside; // bit per clip plane the vertex is behind
+} OccluderVertex;
+
+struct ConXOcclusionBuffer {
+  int width;
+  int height;
+  // Level 0 is the depth buffer itself, each level after it the minimum,
+  // the farthest depth, of a 2x2 block of the one before
+  float *levels[MAX_LEVELS];
+  int level_width[MAX_LEVELS];
+  int level_height[MAX_LEVELS];
+  int level_count;
+  float clip[4][4]; // rows of projection * view
+
+  OcclusionTriangle *triangles;
+  int triangle_count;
+  int triangle_capacity;
+  OccluderVertex *vertices;
+  int vertex_capacity;
+  // Triangles touching each band: bin_start[band] to bin_start[band + 1]
+  int *bin_start;
+  int *bin_triangles;
+  int bin_capacity;
+  int band_count;
+  ConXJobPool *jobs;
+};
+
+ConXOcclusionBuffer *conx_occlusion_create(int width, int height, int thread_count) {
+  if (width <= 0 || height <= 0) return NULL;
+
+  ConXOcclusionBuffer *buffer = calloc(1, sizeof(ConXOcclusionBuffer));
+  if (!buffer) return NULL;
+  buffer->width = (width + 3) & ~3;
+  buffer->height = height;
+  buffer->band_count = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  buffer->bin_start = malloc(sizeof(int) * (buffer->band_count + 1));
+
+  bool allocated = buffer->bin_start != NULL;
+  int level_width = buffer->width;
+  int level_height = height;
+  for (int level = 0; allocated && level < MAX_LEVELS; level++) {
+    buffer->levels[level] = calloc((size_t)level_width * level_height, sizeof(float));
+    buffer->level_width[level] = level_width;
+    buffer->level_height[level] = level_height;
+    buffer->level_count = level + 1;
+    allocated = buffer->levels[level] != NULL;
+    if (level_width == 1 && level_height == 1) break;
+    level_width = (level_width + 1) / 2;
+    level_height = (level_height + 1) / 2;
+  }
+  if (!allocated) {
+    printf("Failed to allocate occlusion buffer\n");
+    conx_occlusion_destroy(buffer);
+    return NULL;
+  }
+
+  if (thread_count != 1) buffer->jobs = conx_job_pool_create(thread_count);
+  return buffer;
+}
+
+void conx_occlusion_destroy(ConXOcclusionBuffer *buffer) {
+  if (!buffer) return;
+
+  if (buffer->jobs) conx_job_pool_destroy(buffer->jobs);
+  for (int level = 0; level < buffer->level_count; level++) {
+    free(buffer->levels[level]);
+  }
+  free(buffer->triangles);
+  free(buffer->vertices);
+  free(buffer->bin_start);
+  free(buffer->bin_triangles);
+  free(buffer);
+}
+
+void conx_occlusion_begin(ConXOcclusionBuffer *buffer, const Mat4 *view, const Mat4 *projection) {
+  // m[column][row], so rows of the clip matrix are read across columns
+  Mat4 clip = mat4_multiply(*view, *projection);
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 4; c++) {
+      buffer->clip[r][c] = clip.m[c][r];
+    }
+  }
+  for (int level = 0; level < buffer->level_count; level++) {
+    memset(buffer->levels[level], 0,
+           sizeof(float) * buffer->level_width[level] * buffer->level_height[level]);
+  }
+  buffer->triangle_count = 0;
+}
+
+// Triangle setup
+
+static ClipVertex to_clip(const ConXOcclusionBuffer *buffer, const float world[3]) {
+  ClipVertex out;
+  for (int r = 0; r < 4; r++) {
+    const float *row = buffer->clip[r];
+    out.v[r] = row[0] * world[0] + row[1] * world[1] + row[2] * world[2] + row[3];
+  }
+  return out;
+}
+
+// Signed distance to each clip plane: near (z >= -w), then left, right,
+// bottom and top. There is no far plane; 1 / w stays positive past it.
+static float plane_distance(const ClipVertex *vertex, int plane) {
+  const float *v = vertex->v;
+  switch (plane) {
+    case 0: return v[2] + v[3];
+    case 1: return v[0] + v[3];
+    case 2: return v[3] - v[0];
+    case 3: return v[1] + v[3];
+    default: return v[3] - v[1];
+  }
+}
+
+// Sutherland-Hodgman against each plane in turn. Returns the vertex count
+// of what is left, 0 if nothing is.
+static int clip_polygon(ClipVertex *polygon, int count) {
+  ClipVertex scratch[MAX_CLIPPED_VERTICES];
+  for (int plane = 0; plane < 5 && count > 0; plane++) {
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+      const ClipVertex *a = &polygon[i];
+      const ClipVertex *b = &polygon[(i + 1) % count];
+      float da = plane_distance(a, plane);
+      float db = plane_distance(b, plane);
+      if (da >= 0.0f) scratch[kept++] = *a;
+      if ((da >= 0.0f) != (db >= 0.0f)) {
+        float t = da / (da - db);
+        ClipVertex *crossing = &scratch[kept++];
+        for (int c = 0; c < 4; c++) crossing->v[c] = a->v[c] + (b->v[c] - a->v[c]) * t;
+      }
+    }
+    memcpy(polygon, scratch, sizeof(ClipVertex) * kept);
+    count = kept;
+  }
+  return count;
+}
+
+static bool reserve_triangles(ConXOcclusionBuffer *buffer, int needed) {
+  if (needed <= buffer->triangle_capacity) return true;
+
+  int capacity = buffer->triangle_capacity ? buffer->triangle_capacity : INITIAL_TRIANGLE_CAPACITY;
+  while (capacity < needed) capacity *= 2;
+  OcclusionTriangle *grown = realloc(buffer->triangles, sizeof(OcclusionTriangle) * capacity);
+  if (!grown) return false;
+  buffer->triangles = grown;
+  buffer->triangle_capacity = capacity;
+  return true;
+}
+
+// Screen position and 1 / w of three projected vertices
+static void setup_triangle(ConXOcclusionBuffer *buffer, const float *const screen[3]) {
+  float x0 = screen[0][0], y0 = screen[0][1];
+  float dx1 = screen[1][0] - x0, dy1 = screen[1][1] - y0;
+  float dx2 = screen[2][0] - x0, dy2 = screen[2][1] - y0;
+  float area = dx1 * dy2 - dx2 * dy1;
+  if (fabsf(area) < 1e-8f) return;
+
+  float min_x = fminf(x0, fminf(screen[1][0], screen[2][0]));
+  float max_x = fmaxf(x0, fmaxf(screen[1][0], screen[2][0]));
+  float min_y = fminf(y0, fminf(screen[1][1], screen[2][1]));
+  float max_y = fmaxf(y0, fmaxf(screen[1][1], screen[2][1]));
+  // Pixels whose centers fall inside the bounds
+  int first_x = (int)ceilf(min_x - 0.5f), last_x = (int)floorf(max_x - 0.5f);
+  int first_y = (int)ceilf(min_y - 0.5f), last_y = (int)floorf(max_y - 0.5f);
+  if (first_x < 0) first_x = 0;
+  if (first_y < 0) first_y = 0;
+  if (last_x > buffer->width - 1) last_x = buffer->width - 1;
+  if (last_y > buffer->height - 1) last_y = buffer->height - 1;
+  if (first_x > last_x || first_y > last_y) return;
+  if (!reserve_triangles(buffer, buffer->triangle_count + 1)) return;
+
+  OcclusionTriangle *triangle = &buffer->triangles[buffer->triangle_count++];
+  // Either winding draws, so the edges face inwards for both
+  float sign = area > 0.0f ? 1.0f : -1.0f;
+  for (int i = 0; i < 3; i++) {
+    const float *a = screen[i];
+    const float *b = screen[(i + 1) % 3];
+    float ea = -(b[1] - a[1]) * sign;
+    float eb = (b[0] - a[0]) * sign;
+    // Evaluated at pixel centers
+    triangle->edge[i][0] = ea;
+    triangle->edge[i][1] = eb;
+    triangle->edge[i][2] = -(ea * a[0] + eb * a[1]) + (ea + eb) * 0.5f;
+  }
+  float dz1 = screen[1][2] - screen[0][2], dz2 = screen[2][2] - screen[0][2];
+  float depth_x = (dz1 * dy2 - dz2 * dy1) / area;
+  float depth_y = (dz2 * dx1 - dz1 * dx2) / area;
+  triangle->depth[0] = depth_x;
+  triangle->depth[1] = depth_y;
+  triangle->depth[2] = screen[0][2] - depth_x * x0 - depth_y * y0 + (depth_x + depth_y) * 0.5f;
+  triangle->min_x = first_x;
+  triangle->min_y = first_y;
+  triangle->max_x = last_x;
+  triangle->max_y = last_y;
+}
+
+static void project(const ConXOcclusionBuffer *buffer, const ClipVertex *clip, float screen[3]) {
+  float inverse_w = 1.0f / clip->v[3];
+  screen[0] = (clip->v[0] * inverse_w + 1.0f) * buffer->width * 0.5f;
+  screen[1] = (clip->v[1] * inverse_w + 1.0f) * buffer->height * 0.5f;
+  screen[2] = inverse_w;
+}
+
+// A triangle crossing a clip plane, cut down to what is inside
+static void setup_clipped(ConXOcclusionBuffer *buffer, const OccluderVertex *const corner[3]) {
+  ClipVertex polygon[MAX_CLIPPED_VERTICES];
+  for (int k = 0; k < 3; k++) polygon[k] = corner[k]->clip;
+  int count = clip_polygon(polygon, 3);
+  if (count < 3) return;
+
+  float screen[MAX_CLIPPED_VERTICES][3];
+  for (int k = 0; k < count; k++) project(buffer, &polygon[k], screen[k]);
+  // Fan around the first vertex, the clipped polygon being convex
+  for (int k = 2; k < count; k++) {
+    const float *const fan[3] = {screen[0], screen[k - 1], screen[k]};
+    setup_triangle(buffer, fan);
+  }
+}
+
+void conx_occlusion_add_occluder(ConXOcclusionBuffer *buffer, const ConXObject3D *object) {
+  const ConXMesh *mesh = object ? object->mesh : NULL;
+  if (!buffer || !mesh || !mesh->vertices || !mesh->indices) return;
+
+  if (mesh->vertex_count > buffer->vertex_capacity) {
+    OccluderVertex *grown = realloc(buffer->vertices, sizeof(OccluderVertex) * mesh->vertex_count);
+    if (!grown) return;
+    buffer->vertices = grown;
+    buffer->vertex_capacity = mesh->vertex_count;
+  }
+
+  float model[3][4];
+  conx_3d_object_model(object, model);
+  for (int i = 0; i < mesh->vertex_count; i++) {
+    const float *local = (const float *)conx_mesh_vertex(mesh, i);
+    float world[3];
+    for (int r = 0; r < 3; r++) {
+      world[r] = model[r][0] * local[0] + model[r][1] * local[1] + model[r][2] * local[2] +
+                 model[r][3];
+    }
+    OccluderVertex *vertex = &buffer->vertices[i];
+    vertex->clip = to_clip(buffer, world);
+    vertex->outside = 0;
+    for (int plane = 0; plane < 5; plane++) {
+      if (plane_distance(&vertex->clip, plane) < 0.0f) vertex->outside |= 1u << plane;
+    }
+    if (!(vertex->outside & 1u)) project(buffer, &vertex->clip, vertex->screen);
+  }
+
+  for (int i = 0; i + 2 < mesh->index_count; i += 3) {
+    const OccluderVertex *const corner[3] = {
+      &buffer->vertices[mesh->indices[i]],
+      &buffer->vertices[mesh->indices[i + 1]],
+      &buffer->vertices[mesh->indices[i + 2]]
+    };
+    // Wholly behind one plane, or wholly inside and needing no clipping
+    if (corner[0]->outside & corner[1]->outside & corner[2]->outside) continue;
+    if (corner[0]->outside | corner[1]->outside | corner[2]->outside) {
+      setup_clipped(buffer, corner);
+    } else {
+      const float *const screen[3] = {corner[0]->screen, corner[1]->screen, corner[2]->screen};
+      setup_triangle(buffer, screen);
+    }
+  }
+}
+
+// Rasterization. Pixels keep the largest 1 / w, the nearest occluder.
+
+#ifdef CONX_SIMD_X86
+
+// Four pixels of a row per vector
+static void rasterize_triangle(const OcclusionTriangle *triangle, float *depth, int width,
+                               int first_row, int last_row) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+  int first_x = triangle->min_x & ~3;
+  __m128 step[3];
+  for (int i = 0; i < 3; i++) step[i] = _mm_set1_ps(triangle->edge[i][0] * 4.0f);
+  __m128 depth_step = _mm_set1_ps(triangle->depth[0] * 4.0f);
+
+  for (int y = first_row; y <= last_row; y++) {
+    __m128 x = _mm_add_ps(_mm_set1_ps((float)first_x), lane);
+    __m128 edge[3];
+    for (int i = 0; i < 3; i++) {
+      const float *e = triangle->edge[i];
+      edge[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[0]), x), _mm_set1_ps(e[1] * y + e[2]));
+    }
+    const float *d = triangle->depth;
+    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(d[0]), x), _mm_set1_ps(d[1] * y + d[2]));
+
+    float *row = depth + (size_t)y * width;
+    for (int column = first_x; column <= triangle->max_x; column += 4) {
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge[0], zero),
+                                            _mm_cmpge_ps(edge[1], zero)),
+                                 _mm_cmpge_ps(edge[2], zero));
+      if (_mm_movemask_ps(inside)) {
+        // Masked-out lanes offer 0, which never beats a stored depth
+        __m128 stored = _mm_loadu_ps(row + column);
+        _mm_storeu_ps(row + column, _mm_max_ps(stored, _mm_and_ps(inside, z)));
+      }
+      for (int i = 0; i < 3; i++) edge[i] = _mm_add_ps(edge[i], step[i]);
+      z = _mm_add_ps(z, depth_step);
+    }
+  }
+}
+
+#else
+
+static void rasterize_triangle(const OcclusionTriangle *triangle, float *depth, int width,
+                               int first_row, int last_row) {
+  for (int y = first_row; y <= last_row; y++) {
+    float *row = depth + (size_t)y * width;
+    for (int x = triangle->min_x; x <= triangle->max_x; x++) {
+      bool inside = true;
+      for (int i = 0; i < 3; i++) {
+        const float *e = triangle->edge[i];
+        inside &= e[0] * x + e[1] * y + e[2] >= 0.0f;
+      }
+      if (!inside) continue;
+      const float *d = triangle->depth;
+      float z = d[0] * x + d[1] * y + d[2];
+      if (z > row[x]) row[x] = z;
+    }
+  }
+}
+
+#endif
+
+static void rasterize_bands(void *context, int begin, int end) {
+  ConXOcclusionBuffer *buffer = context;
+  for (int band = begin; band < end; band++) {
+    int band_first = band * BAND_HEIGHT;
+    int band_last = band_first + BAND_HEIGHT - 1;
+    if (band_last > buffer->height - 1) band_last = buffer->height - 1;
+
+    for (int i = buffer->bin_start[band]; i < buffer->bin_start[band + 1]; i++) {
+      const OcclusionTriangle *triangle = &buffer->triangles[buffer->bin_triangles[i]];
+      int first_row = triangle->min_y > band_first ? triangle->min_y : band_first;
+      int last_row = triangle->max_y < band_last ? triangle->max_y : band_last;
+      rasterize_triangle(triangle, buffer->levels[0], buffer->width, first_row, last_row);
+    }
+  }
+}
+
+// Each texel keeps the farthest of the up to four below it
+static void build_pyramid(ConXOcclusionBuffer *buffer) {
+  for (int level = 1; level < buffer->level_count; level++) {
+    const float *below = buffer->levels[level - 1];
+    int below_width = buffer->level_width[level - 1];
+    int below_height = buffer->level_height[level - 1];
+    float *texels = buffer->levels[level];
+
+    for (int y = 0; y < buffer->level_height[level]; y++) {
+      int y0 = y * 2;
+      int y1 = y0 + 1 < below_height ? y0 + 1 : y0;
+      for (int x = 0; x < buffer->level_width[level]; x++) {
+        int x0 = x * 2;
+        int x1 = x0 + 1 < below_width ? x0 + 1 : x0;
+        float a = fminf(below[y0 * below_width + x0], below[y0 * below_width + x1]);
+        float b = fminf(below[y1 * below_width + x0], below[y1 * below_width + x1]);
+        texels[y * buffer->level_width[level] + x] = fminf(a, b);
+      }
+    }
+  }
+}
+
+void conx_occlusion_rasterize(ConXOcclusionBuffer *buffer) {
+  if (!buffer || buffer->triangle_count == 0) return;
+
+  // Bin triangles by the bands their rows cross
+  memset(buffer->bin_start, 0, sizeof(int) * (buffer->band_count + 1));
+  int total = 0;
+  for (int i = 0; i < buffer->triangle_count; i++) {
+    const OcclusionTriangle *triangle = &buffer->triangles[i];
+    for (int band = triangle->min_y / BAND_HEIGHT; band <= triangle->max_y / BAND_HEIGHT; band++) {
+      buffer->bin_start[band + 1]++;
+      total++;
+    }
+  }
+  if (total > buffer->bin_capacity) {
+    int *grown = realloc(buffer->bin_triangles, sizeof(int) * total);
+    if (!grown) {
+      // Without occluders everything stays visible, which is still correct
+      printf("Failed to bin occluder triangles\n");
+      buffer->triangle_count = 0;
+      return;
+    }
+    buffer->bin_triangles = grown;
+    buffer->bin_capacity = total;
+  }
+  for (int band = 0; band < buffer->band_count; band++) {
+    buffer->bin_start[band + 1] += buffer->bin_start[band];
+  }
+  // Filled through a moving cursor per band, which ends where the next
+  // band starts
+  int *cursor = buffer->bin_start;
+  for (int i = 0; i < buffer->triangle_count; i++) {
+    const OcclusionTriangle *triangle = &buffer->triangles[i];
+    for (int band = triangle->min_y / BAND_HEIGHT; band <= triangle->max_y / BAND_HEIGHT; band++) {
+      buffer->bin_triangles[cursor[band]++] = i;
+    }
+  }
+  for (int band = buffer->band_count; band > 0; band--) {
+    buffer->bin_start[band] = buffer->bin_start[band - 1];
+  }
+  buffer->bin_start[0] = 0;
+
+  conx_job_pool_parallel_for(buffer->jobs, buffer->band_count, 1, rasterize_bands, buffer);
+  build_pyramid(buffer);
+  buffer->triangle_count = 0;
+}
+
+// Tests
+
+bool conx_occlusion_box_visible(const ConXOcclusionBuffer *buffer, Vec3 center,
+                                Vec3 half_extents) {
+  if (!buffer) return true;
+
+  // The box's screen rectangle and its nearest depth, from its corners
+  float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+  float nearest = 0.0f;
+  for (int corner = 0; corner < 8; corner++) {
+    const float world[3] = {
+      center.x + (corner & 1 ? half_extents.x : -half_extents.x),
+      center.y + (corner & 2 ? half_extents.y : -half_extents.y),
+      center.z + (corner & 4 ? half_extents.z : -half_extents.z)
+    };
+    ClipVertex clip = to_clip(buffer, world);
+    if (plane_distance(&clip, 0) <= 0.0f) return true;
+
+    float inverse_w = 1.0f / clip.v[3];
+    float x = (clip.v[0] * inverse_w + 1.0f) * buffer->width * 0.5f;
+    float y = (clip.v[1] * inverse_w + 1.0f) * buffer->height * 0.5f;
+    min_x = fminf(min_x, x);
+    max_x = fmaxf(max_x, x);
+    min_y = fminf(min_y, y);
+    max_y = fmaxf(max_y, y);
+    nearest = fmaxf(nearest, inverse_w);
+  }
+
+  // Every pixel the rectangle touches
+  if (max_x < 0.0f || max_y < 0.0f || min_x >= buffer->width || min_y >= buffer->height) {
+    return true;
+  }
+  int x0 = min_x > 0.0f ? (int)min_x : 0;
+  int y0 = min_y > 0.0f ? (int)min_y : 0;
+  int x1 = max_x < buffer->width - 1 ? (int)max_x : buffer->width - 1;
+  int y1 = max_y < buffer->height - 1 ? (int)max_y : buffer->height - 1;
+
+  int level = 0;
+  while (level + 1 < buffer->level_count &&
+         ((x1 >> level) - (x0 >> level) >= TEST_SPAN || (y1 >> level) - (y0 >> level) >= TEST_SPAN)) {
+    level++;
+  }
+  const float *texels = buffer->levels[level];
+  int level_width = buffer->level_width[level];
+  float threshold = nearest * (1.0f + DEPTH_MARGIN);
+  for (int y = y0 >> level; y <= y1 >> level; y++) {
+    for (int x = x0 >> level; x <= x1 >> level; x++) {
+      if (texels[y * level_width + x] <= threshold) return true;
+    }
+  }
+  return false;
+}
+
+int conx_occlusion_cull(const ConXOcclusionBuffer *buffer, const float *const center[3],
+                        const float *const extent[3], bool spherical, int count,
+                        unsigned char *visible) {
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    if (!visible[i]) continue;
+
+    Vec3 c = vec3_create(center[0][i], center[1][i], center[2][i]);
+    // The box around the sphere
+    Vec3 e = spherical ? vec3_create(extent[0][i], extent[0][i], extent[0][i])
+                       : vec3_create(extent[0][i], extent[1][i], extent[2][i]);
+    visible[i] = conx_occlusion_box_visible(buffer, c, e);
+    total += visible[i];
+  }
+  return total;
+}
+
+const float *conx_occlusion_get_depth(const ConXOcclusionBuffer *buffer, int *width, int *height) {
+  if (width) *width = buffer->width;
+  if (height) *height = buffer->height;
+  return buffer->levels[0];
+}
@@ -0,0 +1,348 @@
+#include "conx_3d_internal.h"
+#include "conx_render.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Handles pack a slot index with the slot's generation, like physics body
+// handles, so a handle to a removed object stops resolving
+#define SCENE_INDEX_BITS 20
+#define SCENE_INDEX_MASK ((1 << SCENE_INDEX_BITS) - 1)
+#define SCENE_GENERATION_MASK 0x7FF
+#define INITIAL_SCENE_CAPACITY 64
+
+// Which batch an object joins each frame
+typedef enum {
+  SCENE_BATCH_CUBE,   // the shared cube batch
+  SCENE_BATCH_SPHERE, // a shared sphere batch, picked by level of detail
+  SCENE_BATCH_MESH,   // the scene's own batch for the object's mesh
+  SCENE_BATCH_NONE    // no mesh, nothing to draw
+} SceneBatchKind;
+
+typedef struct {
+  ConXObject3D object;
+  ConXInstance instance; // rebuilt from object when dirty
+  Vec3 center;           // world bounds: box half extents for cubes, else
+  Vec3 extent;           // a sphere with the radius in extent.x
+  SceneBatchKind kind;
+  int mesh_batch;        // index into mesh_batches for SCENE_BATCH_MESH
+  bool dirty;
+  bool occluder;
+} SceneEntry;
+
+typedef struct {
+  int index;             // packed entry, -1 when free
+  int generation;        // bumped every time the slot is freed
+  int next_free;
+} SceneSlot;
+
+// Objects sharing a mesh the 3D subsystem does not own
+typedef struct {
+  ConXInstanceBatch batch;
+  int users;
+} SceneMeshBatch;
+
+// Live objects stay packed; entry_handles[i] is the handle of entries[i]
+static SceneEntry *entries = NULL;
+static int *entry_handles = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+static SceneSlot *slots = NULL;
+static int slot_count = 0;
+static int slot_capacity = 0;
+static int free_slot = -1;
+// Generation new slots start at. Shutdown frees the slots but moves this
+// past their generations, so old handles stay stale in the next scene.
+static int first_generation = 0;
+static SceneMeshBatch *mesh_batches = NULL;
+static int mesh_batch_count = 0;
+
+// Packed index of the object a handle refers to, or -1 if it is stale
+static int entry_index(int handle) {
+  if (handle < 0) return -1;
+
+  int slot = handle & SCENE_INDEX_MASK;
+  if (slot >= slot_count) return -1;
+  return slots[slot].generation == handle >> SCENE_INDEX_BITS ? slots[slot].index : -1;
+}
+
+static int acquire_mesh_batch(ConXMesh *mesh) {
+  int unused = -1;
+  for (int i = 0; i < mesh_batch_count; i++) {
+    if (mesh_batches[i].users > 0 && mesh_batches[i].batch.mesh == mesh) {
+      mesh_batches[i].users++;
+      return i;
+    }
+    if (mesh_batches[i].users == 0 && unused < 0) unused = i;
+  }
+
+  if (unused < 0) {
+    SceneMeshBatch *batches = realloc(mesh_batches, sizeof(SceneMeshBatch) * (mesh_batch_count + 1));
+    if (!batches) return -1;
+    mesh_batches = batches;
+    unused = mesh_batch_count++;
+  }
+  SceneMeshBatch *entry = &mesh_batches[unused];
+  memset(entry, 0, sizeof(*entry));
+  entry->batch.mesh = mesh;
+  // Arbitrary meshes are bounded by spheres
+  entry->batch.spherical = true;
+  entry->users = 1;
+  return unused;
+}
+
+static void release_mesh_batch(int index) {
+  SceneMeshBatch *entry = &mesh_batches[index];
+  if (--entry->users == 0) conx_3d_batch_release(&entry->batch);
+}
+
+// Picks the object's batch, taking a reference on the scene's own batches
+static void attach(SceneEntry *entry) {
+  ConXMesh *mesh = entry->object.mesh;
+  entry->mesh_batch = -1;
+  if (!mesh) {
+    entry->kind = SCENE_BATCH_NONE;
+  } else if (conx_3d_is_cube_mesh(mesh)) {
+    entry->kind = SCENE_BATCH_CUBE;
+  } else if (conx_3d_is_sphere_mesh(mesh)) {
+    entry->kind = SCENE_BATCH_SPHERE;
+  } else {
+    entry->mesh_batch = acquire_mesh_batch(mesh);
+    entry->kind = entry->mesh_batch < 0 ? SCENE_BATCH_NONE : SCENE_BATCH_MESH;
+  }
+  entry->dirty = true;
+}
+
+static void detach(SceneEntry *entry) {
+  if (entry->kind == SCENE_BATCH_MESH) release_mesh_batch(entry->mesh_batch);
+  entry->kind = SCENE_BATCH_NONE;
+}
+
+static bool reserve_entries(void) {
+  if (entry_count < entry_capacity) return true;
+
+  int capacity = entry_capacity ? entry_capacity * 2 : INITIAL_SCENE_CAPACITY;
+  SceneEntry *grown = realloc(entries, sizeof(SceneEntry) * capacity);
+  if (!grown) return false;
+  entries = grown;
+  int *handles = realloc(entry_handles, sizeof(int) * capacity);
+  if (!handles) return false;
+  entry_handles = handles;
+  entry_capacity = capacity;
+  return true;
+}
+
+static int allocate_slot(void) {
+  if (free_slot >= 0) {
+    int slot = free_slot;
+    free_slot = slots[slot].next_free;
+    return slot;
+  }
+
+  if (slot_count > SCENE_INDEX_MASK) {
+    printf("Scene is full at %d objects\n", slot_count);
+    return -1;
+  }
+  if (slot_count == slot_capacity) {
+    int capacity = slot_capacity ? slot_capacity * 2 : INITIAL_SCENE_CAPACITY;
+    SceneSlot *grown = realloc(slots, sizeof(SceneSlot) * capacity);
+    if (!grown) return -1;
+    slots = grown;
+    slot_capacity = capacity;
+  }
+  slots[slot_count].generation = first_generation;
+  return slot_count++;
+}
+
+// A new generation ends every handle to the slot's last object
+static void release_slot(int slot) {
+  slots[slot].index = -1;
+  slots[slot].generation = (slots[slot].generation + 1) & SCENE_GENERATION_MASK;
+  slots[slot].next_free = free_slot;
+  free_slot = slot;
+}
+
+int conx_scene_add(const ConXObject3D *object) {
+  if (!object) return -1;
+  if (!reserve_entries()) {
+    printf("Failed to grow scene\n");
+    return -1;
+  }
+  int slot = allocate_slot();
+  if (slot < 0) return -1;
+
+  int index = entry_count++;
+  SceneEntry *entry = &entries[index];
+  entry->object = *object;
+  entry->occluder = false;
+  attach(entry);
+
+  slots[slot].index = index;
+  int handle = (slots[slot].generation << SCENE_INDEX_BITS) | slot;
+  entry_handles[index] = handle;
+  return handle;
+}
+
+void conx_scene_remove(int handle) {
+  int index = entry_index(handle);
+  if (index < 0) return;
+
+  detach(&entries[index]);
+
+  // The last object fills the hole
+  int last = --entry_count;
+  if (index != last) {
+    entries[index] = entries[last];
+    entry_handles[index] = entry_handles[last];
+    slots[entry_handles[index] & SCENE_INDEX_MASK].index = index;
+  }
+
+  release_slot(handle & SCENE_INDEX_MASK);
+}
+
+bool conx_scene_is_valid(int handle) {
+  return entry_index(handle) >= 0;
+}
+
+// Slots are released rather than forgotten, so handles from before the
+// clear never resolve to objects added after it
+void conx_scene_clear(void) {
+  for (int i = 0; i < entry_count; i++) {
+    detach(&entries[i]);
+    release_slot(entry_handles[i] & SCENE_INDEX_MASK);
+  }
+  entry_count = 0;
+}
+
+void conx_scene_shutdown(void) {
+  conx_scene_clear();
+  for (int i = 0; i < slot_count; i++) {
+    // Every slot is free, so its generation is one no handle holds
+    int generation = slots[i].generation;
+    if (generation > first_generation) first_generation = generation;
+  }
+  free(mesh_batches);
+  free(entries);
+  free(entry_handles);
+  free(slots);
+  mesh_batches = NULL;
+  mesh_batch_count = 0;
+  entries = NULL;
+  entry_handles = NULL;
+  entry_capacity = 0;
+  slots = NULL;
+  slot_count = slot_capacity = 0;
+  free_slot = -1;
+}
+
+int conx_scene_count(void) {
+  return entry_count;
+}
+
+const ConXObject3D *conx_scene_get(int handle) {
+  int index = entry_index(handle);
+  return index < 0 ? NULL : &entries[index].object;
+}
+
+void conx_scene_set(int handle, const ConXObject3D *object) {
+  int index = entry_index(handle);
+  if (index < 0 || !object) return;
+
+  SceneEntry *entry = &entries[index];
+  if (object->mesh == entry->object.mesh) {
+    entry->object = *object;
+    entry->dirty = true;
+    return;
+  }
+  detach(entry);
+  entry->object = *object;
+  attach(entry);
+}
+
+void conx_scene_set_position(int handle, Vec3 position) {
+  int index = entry_index(handle);
+  if (index < 0) return;
+  entries[index].object.position = position;
+  entries[index].dirty = true;
+}
+
+void conx_scene_set_transform(int handle, Vec3 position, Vec3 rotation, Vec3 scale) {
+  int index = entry_index(handle);
+  if (index < 0) return;
+  entries[index].object.position = position;
+  entries[index].object.rotation = rotation;
+  entries[index].object.scale = scale;
+  entries[index].dirty = true;
+}
+
+void conx_scene_set_color(int handle, Vec4 color) {
+  int index = entry_index(handle);
+  if (index < 0) return;
+  entries[index].object.color = color;
+  entries[index].dirty = true;
+}
+
+void conx_scene_set_occluder(int handle, bool occluder) {
+  int index = entry_index(handle);
+  if (index < 0) return;
+  entries[index].occluder = occluder;
+}
+
+// Model rows, color and world bounds from the object
+static void rebuild(SceneEntry *entry) {
+  const ConXObject3D *object = &entry->object;
+  float (*m)[4] = entry->instance.model;
+  conx_3d_object_model(object, m);
+  entry->instance.color[0] = object->color.x;
+  entry->instance.color[1] = object->color.y;
+  entry->instance.color[2] = object->color.z;
+  entry->instance.color[3] = object->color.w;
+  entry->dirty = false;
+
+  float stretch = fmaxf(fabsf(object->scale.x), fmaxf(fabsf(object->scale.y),
+                                                      fabsf(object->scale.z)));
+  if (entry->kind == SCENE_BATCH_CUBE) {
+    // The box around the rotated unit cube
+    entry->center = object->position;
+    entry->extent = vec3_create((fabsf(m[0][0]) + fabsf(m[0][1]) + fabsf(m[0][2])) * 0.5f,
+                                (fabsf(m[1][0]) + fabsf(m[1][1]) + fabsf(m[1][2])) * 0.5f,
+                                (fabsf(m[2][0]) + fabsf(m[2][1]) + fabsf(m[2][2])) * 0.5f);
+  } else if (entry->kind == SCENE_BATCH_SPHERE) {
+    entry->center = object->position;
+    entry->extent = vec3_create(stretch * 0.5f, 0.0f, 0.0f);
+  } else if (entry->kind == SCENE_BATCH_MESH) {
+    ConXMesh *mesh = object->mesh;
+    if (mesh->bounds_radius == 0.0f) conx_mesh_update_bounds(mesh);
+    Vec3 c = mesh->bounds_center;
+    entry->center = vec3_create(m[0][0] * c.x + m[0][1] * c.y + m[0][2] * c.z + m[0][3],
+                                m[1][0] * c.x + m[1][1] * c.y + m[1][2] * c.z + m[1][3],
+                                m[2][0] * c.x + m[2][1] * c.y + m[2][2] * c.z + m[2][3]);
+    entry->extent = vec3_create(mesh->bounds_radius * stretch, 0.0f, 0.0f);
+  }
+}
+
+void conx_scene_submit(void) {
+  // The scene draws on the default layer, whatever the caller last set
+  int layer = conx_render_get_layer();
+  conx_render_set_layer(0);
+  for (int i = 0; i < entry_count; i++) {
+    SceneEntry *entry = &entries[i];
+    if (entry->kind == SCENE_BATCH_NONE) continue;
+    if (entry->dirty) rebuild(entry);
+    if (entry->occluder) conx_draw_occluder(&entry->object);
+
+    ConXInstanceBatch *batch;
+    if (entry->kind == SCENE_BATCH_CUBE) {
+      batch = conx_3d_cube_batch();
+    } else if (entry->kind == SCENE_BATCH_SPHERE) {
+      batch = conx_3d_sphere_batch(entry->center, entry->extent.x);
+    } else {
+      batch = &mesh_batches[entry->mesh_batch].batch;
+    }
+    if (!batch) continue;
+
+    conx_3d_queue_instance(batch, &entry->instance, entry->center, entry->extent);
+  }
+  conx_render_set_layer(layer);
+}
@@ -0,0 +1,127 @@
+#include "conx_stream.h"
+#include <stdio.h>
+#include <string.h>
+
+// How long one wait for a fence may block before trying again
+#define FENCE_WAIT_NANOSECONDS 100000000ull
+
+// A buffer of CONX_STREAM_FRAMES regions, mapped for good when buffer
+// storage allows it. Only GL_COPY_WRITE_BUFFER is bound, which no drawing
+// state depends on.
+static bool create_buffer(size_t region_size, GLuint *buffer, unsigned char **mapped) {
+  ptrdiff_t size = (ptrdiff_t)(region_size * CONX_STREAM_FRAMES);
+  *mapped = NULL;
+  conx_gl.GenBuffers(1, buffer);
+  conx_gl.BindBuffer(GL_COPY_WRITE_BUFFER, *buffer);
+  if (conx_gl.has_buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    conx_gl.BufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+    *mapped = conx_gl.MapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+    if (!*mapped) {
+      printf("Failed to map %ld byte stream buffer\n", (long)size);
+      conx_gl.DeleteBuffers(1, buffer);
+      *buffer = 0;
+      return false;
+    }
+  } else {
+    conx_gl.BufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+  return true;
+}
+
+static void delete_fences(ConXStreamBuffer *stream) {
+  for (int i = 0; i < CONX_STREAM_FRAMES; i++) {
+    if (stream->fences[i]) conx_gl.DeleteSync(stream->fences[i]);
+    stream->fences[i] = NULL;
+  }
+}
+
+bool conx_stream_create(ConXStreamBuffer *stream, size_t region_size) {
+  memset(stream, 0, sizeof(*stream));
+  if (!conx_gl.has_streaming || region_size == 0) return false;
+  if (!create_buffer(region_size, &stream->buffer, &stream->mapped)) return false;
+  stream->region_size = region_size;
+  return true;
+}
+
+void conx_stream_destroy(ConXStreamBuffer *stream) {
+  if (stream->buffer) {
+    delete_fences(stream);
+    // Deleting the buffer unmaps it
+    conx_gl.DeleteBuffers(1, &stream->buffer);
+  }
+  memset(stream, 0, sizeof(*stream));
+}
+
+// Draws this frame made from the old buffer still read it after deletion,
+// so nothing waits on its fences. The new region holds the write twice
+// over, leaving the rest of the frame room.
+static bool grow(ConXStreamBuffer *stream, size_t needed) {
+  size_t region_size = stream->region_size * 2;
+  while (region_size < needed * 2) region_size *= 2;
+
+  GLuint buffer;
+  unsigned char *mapped;
+  if (!create_buffer(region_size, &buffer, &mapped)) return false;
+  delete_fences(stream);
+  conx_gl.DeleteBuffers(1, &stream->buffer);
+  stream->buffer = buffer;
+  stream->mapped = mapped;
+  stream->region_size = region_size;
+  stream->region = 0;
+  stream->used = 0;
+  stream->generation++;
+  return true;
+}
+
+bool conx_stream_write(ConXStreamBuffer *stream, const void *data, size_t size,
+                       size_t alignment, size_t *offset) {
+  if (!stream->buffer) return false;
+
+  size_t start = (stream->used + alignment - 1) & ~(alignment - 1);
+  if (start + size > stream->region_size) {
+    if (!grow(stream, size)) return false;
+    start = 0;
+  }
+
+  size_t position = (size_t)stream->region * stream->region_size + start;
+  if (stream->mapped) {
+    memcpy(stream->mapped + position, data, size);
+  } else {
+    // The fences already keep the GPU off this range
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    conx_gl.BindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+    void *target = conx_gl.MapBufferRange(GL_COPY_WRITE_BUFFER, (ptrdiff_t)position,
+                                          (ptrdiff_t)size, access);
+    if (!target) return false;
+    memcpy(target, data, size);
+    conx_gl.UnmapBuffer(GL_COPY_WRITE_BUFFER);
+  }
+  stream->used = start + size;
+  *offset = position;
+  return true;
+}
+
+bool conx_stream_end_frame(ConXStreamBuffer *stream) {
+  if (!stream->buffer) return false;
+
+  if (stream->used > 0) {
+    stream->fences[stream->region] = conx_gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  stream->region = (stream->region + 1) % CONX_STREAM_FRAMES;
+  stream->used = 0;
+
+  GLsync fence = stream->fences[stream->region];
+  if (!fence) return false;
+  stream->fences[stream->region] = NULL;
+
+  bool waited = false;
+  GLenum status = conx_gl.ClientWaitSync(fence, 0, 0);
+  while (status == GL_TIMEOUT_EXPIRED) {
+    // Flushing makes sure the fence reaches the GPU and can signal
+    waited = true;
+    status = conx_gl.ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_NANOSECONDS);
+  }
+  conx_gl.DeleteSync(fence);
+  return waited;
+}
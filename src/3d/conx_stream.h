@@ -0,0 +1,46 @@
+#ifndef CONX_STREAM_H
+#define CONX_STREAM_H
+
+#include "conx_gl.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Ring buffer for data rewritten every frame, such as instances and frame
+// uniforms. The buffer holds one region per frame in flight; a frame
+// writes its own region, and a fence marks when the GPU is done reading
+// it. The CPU only waits when it comes back to a region whose fence has
+// not passed, which means the GPU is more than two frames behind.
+//
+// With buffer storage the whole buffer stays mapped; otherwise each write
+// maps its range unsynchronized, which the fences make safe just the same.
+#define CONX_STREAM_FRAMES 3
+
+typedef struct {
+  GLuint buffer;
+  unsigned char *mapped;       // persistent mapping, NULL when writes map
+  size_t region_size;          // bytes each frame can write
+  int region;                  // the current frame's region
+  size_t used;                 // bytes written to it so far
+  GLsync fences[CONX_STREAM_FRAMES];
+  // Changes whenever a write replaces buffer with a larger one, deleting
+  // the old one and with it any binding it had
+  unsigned int generation;
+} ConXStreamBuffer;
+
+// Needs conx_gl.has_streaming. Returns false and leaves the stream empty
+// on failure.
+bool conx_stream_create(ConXStreamBuffer *stream, size_t region_size);
+void conx_stream_destroy(ConXStreamBuffer *stream);
+
+// Copies size bytes into the current region at a multiple of alignment (a
+// power of two) and stores their offset in buffer. A region too small for
+// the frame is doubled until it fits, in a new buffer. Returns false only
+// when that fails.
+bool conx_stream_write(ConXStreamBuffer *stream, const void *data, size_t size,
+                       size_t alignment, size_t *offset);
+
+// Fences the frame's writes and moves to the next region, waiting for the
+// GPU to finish with it first if needed. Returns whether it had to wait.
+bool conx_stream_end_frame(ConXStreamBuffer *stream);
+
+#endif
@@ -0,0 +1,158 @@
+#include "conx_mesh_import.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POSITION_SIZE (3 * (int)sizeof(float))
+#define UNORM16_MAX 65535.0f
+#define SNORM8_MAX 127.0f
+
+static int normal_size(ConXVertexFormat format) {
+  switch (format) {
+    case CONX_VERTEX_FLOAT: return 3 * (int)sizeof(float);
+    case CONX_VERTEX_SNORM8: return 4;
+    default: return -1;
+  }
+}
+
+static int texcoord_size(ConXVertexFormat format) {
+  switch (format) {
+    case CONX_VERTEX_NONE: return 0;
+    case CONX_VERTEX_FLOAT: return 2 * (int)sizeof(float);
+    case CONX_VERTEX_UNORM16: return 2 * (int)sizeof(uint16_t);
+    default: return -1;
+  }
+}
+
+ConXVertexLayout conx_vertex_layout(ConXVertexFormat normal, ConXVertexFormat texcoord) {
+  ConXVertexLayout layout;
+  memset(&layout, 0, sizeof(layout));
+  layout.normal_format = normal;
+  layout.texcoord_format = texcoord;
+  layout.normal_offset = POSITION_SIZE;
+  layout.texcoord_offset = layout.normal_offset + normal_size(normal);
+  layout.stride = layout.texcoord_offset + texcoord_size(texcoord);
+  layout.texcoord_scale[0] = layout.texcoord_scale[1] = 1.0f;
+  return layout;
+}
+
+// Attributes stay 4-byte aligned, so GL and the float reads here never
+// see a misaligned one
+bool conx_vertex_layout_valid(const ConXVertexLayout *layout) {
+  int normal = normal_size(layout->normal_format);
+  int texcoord = texcoord_size(layout->texcoord_format);
+  if (normal < 0 || texcoord < 0 || layout->stride % 4 != 0 || layout->normal_offset % 4 != 0) {
+    return false;
+  }
+  if (layout->normal_offset < POSITION_SIZE || layout->normal_offset + normal > layout->stride) {
+    return false;
+  }
+  if (texcoord == 0) return true;
+
+  int start = layout->texcoord_offset;
+  bool overlaps = start < layout->normal_offset + normal && layout->normal_offset < start + texcoord;
+  return start % 4 == 0 && start >= POSITION_SIZE && start + texcoord <= layout->stride &&
+         !overlaps;
+}
+
+void conx_vertex_decode(const ConXVertexLayout *layout, const unsigned char *vertex,
+                        float out[8]) {
+  memcpy(out, vertex, sizeof(float) * 3);
+
+  const unsigned char *normal = vertex + layout->normal_offset;
+  if (layout->normal_format == CONX_VERTEX_SNORM8) {
+    for (int i = 0; i < 3; i++) {
+      out[3 + i] = fmaxf((float)(int8_t)normal[i] / SNORM8_MAX, -1.0f);
+    }
+  } else {
+    memcpy(out + 3, normal, sizeof(float) * 3);
+  }
+
+  const unsigned char *texcoord = vertex + layout->texcoord_offset;
+  if (layout->texcoord_format == CONX_VERTEX_FLOAT) {
+    memcpy(out + 6, texcoord, sizeof(float) * 2);
+  } else if (layout->texcoord_format == CONX_VERTEX_UNORM16) {
+    uint16_t packed[2];
+    memcpy(packed, texcoord, sizeof(packed));
+    for (int i = 0; i < 2; i++) {
+      out[6 + i] = layout->texcoord_bias[i] + layout->texcoord_scale[i] * (packed[i] / UNORM16_MAX);
+    }
+  } else {
+    out[6] = out[7] = 0.0f;
+  }
+}
+
+static uint16_t pack_unorm16(float value) {
+  return (uint16_t)lrintf(fminf(fmaxf(value, 0.0f), 1.0f) * UNORM16_MAX);
+}
+
+void conx_vertex_encode(const ConXVertexLayout *layout, const float in[8],
+                        unsigned char *vertex) {
+  memcpy(vertex, in, sizeof(float) * 3);
+
+  unsigned char *normal = vertex + layout->normal_offset;
+  if (layout->normal_format == CONX_VERTEX_SNORM8) {
+    for (int i = 0; i < 3; i++) {
+      normal[i] = (unsigned char)(int8_t)lrintf(fminf(fmaxf(in[3 + i], -1.0f), 1.0f) * SNORM8_MAX);
+    }
+    normal[3] = 0;
+  } else {
+    memcpy(normal, in + 3, sizeof(float) * 3);
+  }
+
+  unsigned char *texcoord = vertex + layout->texcoord_offset;
+  if (layout->texcoord_format == CONX_VERTEX_FLOAT) {
+    memcpy(texcoord, in + 6, sizeof(float) * 2);
+  } else if (layout->texcoord_format == CONX_VERTEX_UNORM16) {
+    uint16_t packed[2];
+    for (int i = 0; i < 2; i++) {
+      float scale = layout->texcoord_scale[i];
+      packed[i] = scale != 0.0f ? pack_unorm16((in[6 + i] - layout->texcoord_bias[i]) / scale) : 0;
+    }
+    memcpy(texcoord, packed, sizeof(packed));
+  }
+}
+
+bool conx_mesh_set_layout(ConXMesh *mesh, ConXVertexLayout layout) {
+  if (!mesh || !mesh->vertices || !conx_vertex_layout_valid(&layout)) return false;
+
+  // Packed texture coordinates span exactly the range in use
+  if (layout.texcoord_format == CONX_VERTEX_UNORM16) {
+    float low[2] = {INFINITY, INFINITY};
+    float high[2] = {-INFINITY, -INFINITY};
+    for (int i = 0; i < mesh->vertex_count; i++) {
+      float v[8];
+      conx_vertex_decode(&mesh->layout, conx_mesh_vertex(mesh, i), v);
+      for (int k = 0; k < 2; k++) {
+        low[k] = fminf(low[k], v[6 + k]);
+        high[k] = fmaxf(high[k], v[6 + k]);
+      }
+    }
+    for (int k = 0; k < 2; k++) {
+      layout.texcoord_bias[k] = mesh->vertex_count > 0 ? low[k] : 0.0f;
+      layout.texcoord_scale[k] = mesh->vertex_count > 0 ? high[k] - low[k] : 0.0f;
+    }
+  }
+
+  unsigned char *vertices = calloc(mesh->vertex_count ? (size_t)mesh->vertex_count : 1,
+                                   (size_t)layout.stride);
+  if (!vertices) {
+    printf("Failed to allocate vertices for a new layout\n");
+    return false;
+  }
+  for (int i = 0; i < mesh->vertex_count; i++) {
+    float v[8];
+    conx_vertex_decode(&mesh->layout, conx_mesh_vertex(mesh, i), v);
+    conx_vertex_encode(&layout, v, vertices + (size_t)i * layout.stride);
+  }
+
+  if (!conx_mesh_replace_data(mesh, vertices, mesh->vertex_count, mesh->indices,
+                              mesh->index_count)) {
+    free(vertices);
+    return false;
+  }
+  mesh->layout = layout;
+  return true;
+}
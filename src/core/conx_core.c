@@ -1,6 +1,9 @@
 #include "conx.h"
 #include "conx_lua.h"
 #include "conx_csharp.h"
+#include "conx_physics.h"
+#include "conx_3d.h"
+#include "conx_render.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <GL/gl.h>
@@ -9,6 +12,12 @@
 
 static ConXEngine *engine = NULL;
 
+static void set_context_version(bool core_profile) {
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, core_profile ? 3 : 2);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, core_profile ? 3 : 1);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, core_profile ? SDL_GL_CONTEXT_PROFILE_CORE : 0);
+}
+
 bool conx_init(const ConXConfig *config) {
   if (engine) {
     printf("Engine already initialized\n");
@@ -41,8 +50,7 @@ bool conx_init(const ConXConfig *config) {
   }
 
   // Set OpenGL attributes
-  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+  set_context_version(config->core_profile);
   SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
   SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 
@@ -66,6 +74,11 @@ bool conx_init(const ConXConfig *config) {
 
   // Create OpenGL context
   SDL_GLContext gl_context = SDL_GL_CreateContext((SDL_Window *)engine->window);
+  if (!gl_context && config->core_profile) {
+    printf("OpenGL 3.3 core context unavailable, using 2.1: %s\n", SDL_GetError());
+    set_context_version(false);
+    gl_context = SDL_GL_CreateContext((SDL_Window *)engine->window);
+  }
   if (!gl_context) {
     printf("OpenGL context creation failed: %s\n", SDL_GetError());
     SDL_DestroyWindow((SDL_Window *)engine->window);
@@ -75,7 +88,9 @@ bool conx_init(const ConXConfig *config) {
     return false;
   }
 
-  // Create renderer
+  // Create renderer. It makes its own 2.1 context, and would recreate the
+  // window, losing ours, if the attributes asked for anything else.
+  set_context_version(false);
   engine->renderer =
       SDL_CreateRenderer((SDL_Window *)engine->window, -1,
                          SDL_RENDERER_ACCELERATED |
@@ -90,8 +105,15 @@ bool conx_init(const ConXConfig *config) {
     return false;
   }
 
+  engine->gl_context = gl_context;
+  SDL_GL_MakeCurrent((SDL_Window *)engine->window, gl_context);
+
   engine->running = true;
   engine->delta_time = 0.0;
+  engine->fixed_delta_time = config->tick_rate > 0 ? 1.0 / config->tick_rate : 0.0;
+  engine->accumulator = 0.0;
+  engine->max_substeps = config->max_substeps > 0 ? config->max_substeps : 1;
+  engine->interpolation_alpha = 1.0f;
 
   printf("ConX Engine initialized successfully\n");
   return true;
@@ -101,9 +123,13 @@ void conx_shutdown(void) {
   if (!engine)
     return;
 
+  conx_render_shutdown();
   if (engine->renderer) {
     SDL_DestroyRenderer((SDL_Renderer *)engine->renderer);
   }
+  if (engine->gl_context) {
+    SDL_GL_DeleteContext((SDL_GLContext)engine->gl_context);
+  }
   if (engine->window) {
     SDL_DestroyWindow((SDL_Window *)engine->window);
   }
@@ -116,6 +142,44 @@ void conx_shutdown(void) {
   printf("ConX Engine shutdown\n");
 }
 
+// Advance the simulation in fixed steps for the time that has passed.
+// What is left over sets the alpha used to blend the last two states.
+static void run_fixed_steps(lua_State *L) {
+  double step = engine->fixed_delta_time;
+  if (step <= 0.0) return;
+
+  // After a long stall, catching up would take longer than the stall
+  // itself; drop the excess instead
+  engine->accumulator += engine->delta_time / 1000.0;
+  double max_time = step * engine->max_substeps;
+  if (engine->accumulator > max_time) {
+    engine->accumulator = max_time;
+  }
+
+  while (engine->accumulator >= step) {
+    if (L) {
+      lua_getglobal(L, "fixed_update");
+      if (lua_isfunction(L, -1)) {
+        lua_pushnumber(L, step);
+        if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+          const char *error = lua_tostring(L, -1);
+          printf("Lua fixed update error: %s\n", error);
+          lua_pop(L, 1);
+        }
+      } else {
+        lua_pop(L, 1);
+      }
+    }
+
+    if (conx_physics_get_world()->max_bodies > 0) {
+      conx_physics_update((float)step);
+    }
+    engine->accumulator -= step;
+  }
+
+  engine->interpolation_alpha = (float)(engine->accumulator / step);
+}
+
 void conx_run(void) {
   if (!engine || !engine->running)
     return;
@@ -133,6 +197,9 @@ void conx_run(void) {
     while (SDL_PollEvent(&event)) {
       if (event.type == SDL_QUIT) {
         engine->running = false;
+      } else if (event.type == SDL_WINDOWEVENT &&
+                 event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+        conx_3d_resize(event.window.data1, event.window.data2);
       }
     }
     
@@ -188,6 +255,8 @@ void conx_run(void) {
         conx_lua_reload_current_file();
       }
 
+      run_fixed_steps(L);
+
       // Call Lua update function
       lua_getglobal(L, "update");
       if (lua_isfunction(L, -1)) {
@@ -200,6 +269,8 @@ void conx_run(void) {
         lua_pop(L, 1);
       }
     } else if (domain) {
+      run_fixed_steps(NULL);
+
       // Call C# update and render functions
       float delta_seconds = (float)(engine->delta_time / 1000.0);
       conx_csharp_execute_update(delta_seconds);
@@ -213,17 +284,28 @@ ConXEngine *conx_get_engine(void) { return engine; }
 void conx_set_clear_color(float r, float g, float b, float a) {
   if (!engine)
     return;
+  conx_make_current();
   glClearColor(r, g, b, a);
 }
 
 void conx_clear_screen(void) {
   if (!engine)
     return;
+  conx_make_current();
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
+void conx_make_current(void) {
+  if (!engine || !engine->gl_context)
+    return;
+  if (SDL_GL_GetCurrentContext() != (SDL_GLContext)engine->gl_context) {
+    SDL_GL_MakeCurrent((SDL_Window *)engine->window, (SDL_GLContext)engine->gl_context);
+  }
+}
+
 void conx_swap_buffers(void) {
   if (!engine || !engine->window)
     return;
+  conx_3d_end_frame();
   SDL_GL_SwapWindow((SDL_Window *)engine->window);
 }
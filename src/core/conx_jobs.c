@@ -0,0 +1,157 @@
+#include "conx_jobs.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct ConXJobPool {
+  SDL_Thread **workers;
+  int worker_count;
+  SDL_mutex *mutex;
+  SDL_cond *work_ready;
+  SDL_cond *work_done;
+  SDL_atomic_t busy;
+
+  // Current job, published under mutex by bumping generation
+  ConXJobFunction function;
+  void *context;
+  int count;
+  int batch_size;
+  SDL_atomic_t next_batch;
+  int generation;
+  int active_workers;
+  bool quit;
+};
+
+// Claim batches until the job runs out
+static void run_batches(ConXJobPool *pool) {
+  int batch_count = (pool->count + pool->batch_size - 1) / pool->batch_size;
+
+  for (;;) {
+    int batch = SDL_AtomicAdd(&pool->next_batch, 1);
+    if (batch >= batch_count) break;
+
+    int begin = batch * pool->batch_size;
+    int end = begin + pool->batch_size;
+    if (end > pool->count) end = pool->count;
+    pool->function(pool->context, begin, end);
+  }
+}
+
+static int worker_main(void *data) {
+  ConXJobPool *pool = (ConXJobPool *)data;
+  int seen_generation = 0;
+
+  SDL_LockMutex(pool->mutex);
+  for (;;) {
+    while (!pool->quit && pool->generation == seen_generation) {
+      SDL_CondWait(pool->work_ready, pool->mutex);
+    }
+    if (pool->quit) break;
+    seen_generation = pool->generation;
+    SDL_UnlockMutex(pool->mutex);
+
+    run_batches(pool);
+
+    SDL_LockMutex(pool->mutex);
+    if (--pool->active_workers == 0) {
+      SDL_CondSignal(pool->work_done);
+    }
+  }
+  SDL_UnlockMutex(pool->mutex);
+  return 0;
+}
+
+ConXJobPool *conx_job_pool_create(int thread_count) {
+  if (thread_count <= 0) {
+    thread_count = SDL_GetCPUCount();
+    if (thread_count <= 0) thread_count = 1;
+  }
+
+  ConXJobPool *pool = (ConXJobPool *)calloc(1, sizeof(ConXJobPool));
+  if (!pool) {
+    printf("Failed to allocate job pool\n");
+    return NULL;
+  }
+
+  pool->mutex = SDL_CreateMutex();
+  pool->work_ready = SDL_CreateCond();
+  pool->work_done = SDL_CreateCond();
+  pool->workers = (SDL_Thread **)calloc((size_t)thread_count, sizeof(SDL_Thread *));
+  if (!pool->mutex || !pool->work_ready || !pool->work_done || !pool->workers) {
+    printf("Failed to create job pool: %s\n", SDL_GetError());
+    conx_job_pool_destroy(pool);
+    return NULL;
+  }
+
+  for (int i = 0; i < thread_count - 1; i++) {
+    pool->workers[i] = SDL_CreateThread(worker_main, "conx_worker", pool);
+    if (!pool->workers[i]) {
+      printf("Failed to create worker thread: %s\n", SDL_GetError());
+      break;
+    }
+    pool->worker_count++;
+  }
+
+  return pool;
+}
+
+void conx_job_pool_destroy(ConXJobPool *pool) {
+  if (!pool) return;
+
+  if (pool->mutex) {
+    SDL_LockMutex(pool->mutex);
+    pool->quit = true;
+    if (pool->work_ready) SDL_CondBroadcast(pool->work_ready);
+    SDL_UnlockMutex(pool->mutex);
+  }
+
+  for (int i = 0; i < pool->worker_count; i++) {
+    SDL_WaitThread(pool->workers[i], NULL);
+  }
+
+  free(pool->workers);
+  if (pool->work_done) SDL_DestroyCond(pool->work_done);
+  if (pool->work_ready) SDL_DestroyCond(pool->work_ready);
+  if (pool->mutex) SDL_DestroyMutex(pool->mutex);
+  free(pool);
+}
+
+int conx_job_pool_thread_count(const ConXJobPool *pool) {
+  return pool ? pool->worker_count + 1 : 1;
+}
+
+void conx_job_pool_parallel_for(ConXJobPool *pool, int count, int batch_size,
+                                ConXJobFunction function, void *context) {
+  if (count <= 0) return;
+  if (batch_size <= 0) batch_size = 1;
+
+  // Not worth waking anyone, or the pool is already running a job
+  if (!pool || pool->worker_count == 0 || count <= batch_size ||
+      !SDL_AtomicCAS(&pool->busy, 0, 1)) {
+    function(context, 0, count);
+    return;
+  }
+
+  SDL_LockMutex(pool->mutex);
+  pool->function = function;
+  pool->context = context;
+  pool->count = count;
+  pool->batch_size = batch_size;
+  SDL_AtomicSet(&pool->next_batch, 0);
+  pool->active_workers = pool->worker_count;
+  pool->generation++;
+  SDL_CondBroadcast(pool->work_ready);
+  SDL_UnlockMutex(pool->mutex);
+
+  run_batches(pool);
+
+  SDL_LockMutex(pool->mutex);
+  while (pool->active_workers > 0) {
+    SDL_CondWait(pool->work_done, pool->mutex);
+  }
+  pool->function = NULL;
+  pool->context = NULL;
+  SDL_UnlockMutex(pool->mutex);
+
+  SDL_AtomicSet(&pool->busy, 0);
+}
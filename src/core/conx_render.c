@@ -0,0 +1,257 @@
+#include "conx_render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LAYER_SHIFT 56
+#define PASS_SHIFT 54
+#define ORDER_MASK ((UINT64_C(1) << PASS_SHIFT) - 1)
+#define PAYLOAD_ALIGN 16
+#define INITIAL_COMMAND_CAPACITY 256
+#define INITIAL_ID_CAPACITY 1024
+#define MAX_RESOURCE_ID ((1u << CONX_RENDER_ID_BITS) - 1)
+
+typedef struct {
+  const ConXRenderPass *pass;
+  ConXRenderCommandFn execute;
+  size_t payload;        // offset into the payload arena
+} ConXRenderCommand;
+
+// What gets sorted: the key and the command it belongs to
+typedef struct {
+  uint64_t key;
+  uint32_t command;
+} ConXSortEntry;
+
+// Resource ids live for one frame; entries from older frames are free
+typedef struct {
+  const void *resource;
+  unsigned int frame;
+  unsigned int id;
+} ConXResourceSlot;
+
+static ConXRenderCommand *commands = NULL;
+static ConXSortEntry *sort_entries = NULL;
+static ConXSortEntry *sort_scratch = NULL;
+static int command_count = 0;
+static int command_capacity = 0;
+static unsigned char *payloads = NULL;
+static size_t payload_size = 0;
+static size_t payload_capacity = 0;
+
+static ConXResourceSlot *resource_slots = NULL;
+static int resource_capacity = 0;
+static unsigned int resource_count = 0;
+// Never 0, which marks unused slots
+static unsigned int resource_frame = 1;
+
+static int current_layer = 0;
+static ConXRenderQueueStats last_stats;
+
+void conx_render_set_layer(int layer) {
+  if (layer < CONX_RENDER_LAYER_MIN) layer = CONX_RENDER_LAYER_MIN;
+  if (layer > CONX_RENDER_LAYER_MAX) layer = CONX_RENDER_LAYER_MAX;
+  current_layer = layer;
+}
+
+int conx_render_get_layer(void) {
+  return current_layer;
+}
+
+uint64_t conx_render_key(int pass, uint64_t order) {
+  uint64_t layer = (uint64_t)(current_layer - CONX_RENDER_LAYER_MIN);
+  return (layer << LAYER_SHIFT) | ((uint64_t)(pass & 3) << PASS_SHIFT) | (order & ORDER_MASK);
+}
+
+uint32_t conx_render_depth_bits(float depth) {
+  // Positive floats order the same as their bit patterns; NaN fails the test
+  if (!(depth > 0.0f)) return 0;
+  uint32_t bits;
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits >> (31 - CONX_RENDER_DEPTH_BITS);
+}
+
+static inline uint32_t hash_pointer(const void *pointer) {
+  uint64_t value = (uint64_t)(uintptr_t)pointer;
+  value ^= value >> 33;
+  value *= UINT64_C(0xff51afd7ed558ccd);
+  value ^= value >> 33;
+  return (uint32_t)value;
+}
+
+// Doubles the table, carrying over this frame's entries
+static bool grow_resource_slots(void) {
+  int capacity = resource_capacity ? resource_capacity * 2 : INITIAL_ID_CAPACITY;
+  ConXResourceSlot *slots = calloc(capacity, sizeof(ConXResourceSlot));
+  if (!slots) return false;
+
+  for (int i = 0; i < resource_capacity; i++) {
+    const ConXResourceSlot *old = &resource_slots[i];
+    if (old->frame != resource_frame) continue;
+    uint32_t index = hash_pointer(old->resource) & (capacity - 1);
+    while (slots[index].frame == resource_frame) {
+      index = (index + 1) & (capacity - 1);
+    }
+    slots[index] = *old;
+  }
+  free(resource_slots);
+  resource_slots = slots;
+  resource_capacity = capacity;
+  return true;
+}
+
+unsigned int conx_render_resource_id(const void *resource) {
+  if (!resource) return 0;
+  // Kept at most half full so probes stay short
+  if ((int)resource_count * 2 >= resource_capacity && !grow_resource_slots()) {
+    return MAX_RESOURCE_ID;
+  }
+
+  uint32_t mask = (uint32_t)resource_capacity - 1;
+  uint32_t index = hash_pointer(resource) & mask;
+  while (resource_slots[index].frame == resource_frame) {
+    if (resource_slots[index].resource == resource) return resource_slots[index].id;
+    index = (index + 1) & mask;
+  }
+
+  ConXResourceSlot *slot = &resource_slots[index];
+  slot->resource = resource;
+  slot->frame = resource_frame;
+  resource_count++;
+  slot->id = resource_count < MAX_RESOURCE_ID ? resource_count : MAX_RESOURCE_ID;
+  return slot->id;
+}
+
+static bool reserve_commands(void) {
+  if (command_count < command_capacity) return true;
+
+  int capacity = command_capacity ? command_capacity * 2 : INITIAL_COMMAND_CAPACITY;
+  ConXRenderCommand *grown = realloc(commands, sizeof(ConXRenderCommand) * capacity);
+  if (!grown) return false;
+  commands = grown;
+  ConXSortEntry *entries = realloc(sort_entries, sizeof(ConXSortEntry) * capacity);
+  if (!entries) return false;
+  sort_entries = entries;
+  ConXSortEntry *scratch = realloc(sort_scratch, sizeof(ConXSortEntry) * capacity);
+  if (!scratch) return false;
+  sort_scratch = scratch;
+  command_capacity = capacity;
+  return true;
+}
+
+void *conx_render_push(uint64_t key, const ConXRenderPass *pass, ConXRenderCommandFn execute,
+                       size_t size) {
+  size_t aligned = (size + PAYLOAD_ALIGN - 1) & ~(size_t)(PAYLOAD_ALIGN - 1);
+  if (payload_size + aligned > payload_capacity) {
+    size_t capacity = payload_capacity ? payload_capacity * 2 : 4096;
+    while (capacity < payload_size + aligned) capacity *= 2;
+    unsigned char *grown = realloc(payloads, capacity);
+    if (!grown) {
+      printf("Failed to grow render queue\n");
+      return NULL;
+    }
+    payloads = grown;
+    payload_capacity = capacity;
+  }
+  if (!reserve_commands()) {
+    printf("Failed to grow render queue\n");
+    return NULL;
+  }
+
+  int index = command_count++;
+  commands[index].pass = pass;
+  commands[index].execute = execute;
+  commands[index].payload = payload_size;
+  sort_entries[index].key = key;
+  sort_entries[index].command = (uint32_t)index;
+  payload_size += aligned;
+  return payloads + commands[index].payload;
+}
+
+// Least significant byte first, each pass stable, skipping bytes every key
+// shares. Returns the array holding the result.
+static ConXSortEntry *radix_sort(ConXSortEntry *entries, ConXSortEntry *scratch, int count) {
+  static int histograms[8][256];
+  memset(histograms, 0, sizeof(histograms));
+  for (int i = 0; i < count; i++) {
+    uint64_t key = entries[i].key;
+    for (int byte = 0; byte < 8; byte++) {
+      histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+    }
+  }
+
+  for (int byte = 0; byte < 8; byte++) {
+    int *histogram = histograms[byte];
+    if (histogram[(entries[0].key >> (byte * 8)) & 0xFF] == count) continue;
+
+    int offset = 0;
+    for (int bucket = 0; bucket < 256; bucket++) {
+      int bucket_count = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucket_count;
+    }
+    for (int i = 0; i < count; i++) {
+      scratch[histogram[(entries[i].key >> (byte * 8)) & 0xFF]++] = entries[i];
+    }
+    ConXSortEntry *swap = entries;
+    entries = scratch;
+    scratch = swap;
+  }
+  return entries;
+}
+
+void conx_render_submit(void) {
+  ConXRenderQueueStats stats = {0};
+  if (command_count > 0) {
+    const ConXSortEntry *sorted = radix_sort(sort_entries, sort_scratch, command_count);
+
+    const ConXRenderPass *pass = NULL;
+    for (int i = 0; i < command_count; i++) {
+      const ConXRenderCommand *command = &commands[sorted[i].command];
+      if (command->pass != pass || i == 0) {
+        if (pass && pass->end) pass->end();
+        pass = command->pass;
+        if (pass && pass->begin) pass->begin();
+        stats.pass_changes++;
+      }
+      command->execute(payloads + command->payload);
+    }
+    if (pass && pass->end) pass->end();
+    stats.commands = command_count;
+    last_stats = stats;
+  }
+  conx_render_discard();
+}
+
+void conx_render_discard(void) {
+  command_count = 0;
+  payload_size = 0;
+  resource_count = 0;
+  if (++resource_frame == 0) {
+    // Stamps wrapped, so old entries could look current
+    if (resource_slots) memset(resource_slots, 0, sizeof(ConXResourceSlot) * resource_capacity);
+    resource_frame = 1;
+  }
+}
+
+void conx_render_shutdown(void) {
+  free(commands);
+  free(sort_entries);
+  free(sort_scratch);
+  free(payloads);
+  free(resource_slots);
+  commands = NULL;
+  sort_entries = NULL;
+  sort_scratch = NULL;
+  payloads = NULL;
+  resource_slots = NULL;
+  command_count = command_capacity = 0;
+  payload_size = payload_capacity = 0;
+  resource_capacity = 0;
+  resource_count = 0;
+  resource_frame = 1;
+}
+
+ConXRenderQueueStats conx_render_get_stats(void) {
+  return last_stats;
+}
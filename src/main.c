@@ -20,7 +20,10 @@ int main(int argc, char *argv[]) {
                        .window_height = 600,
                        .window_title = "ConX Engine",
                        .fullscreen = false,
-                       .vsync = true};
+                       .vsync = true,
+                       .tick_rate = 0,
+                       .max_substeps = 5,
+                       .core_profile = false};
 
   // Try to get configuration from Lua
   if (!conx_lua_get_config(argv[1], &config)) {
@@ -43,6 +43,11 @@ Vec3 vec3_normalize(Vec3 v) {
   return v;
 }
 
+Vec3 vec3_lerp(Vec3 a, Vec3 b, float t) {
+  Vec3 result = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t};
+  return result;
+}
+
 Mat4 mat4_identity(void) {
   Mat4 result = {0};
   result.m[0][0] = 1.0f;
@@ -112,3 +117,25 @@ Mat4 mat4_orthographic(float left, float right, float bottom, float top,
 
   return result;
 }
+
+Mat4 mat4_look_at(Vec3 eye, Vec3 target, Vec3 up) {
+  Vec3 forward = vec3_normalize(vec3_subtract(target, eye));
+  Vec3 side = vec3_normalize(vec3_cross(forward, up));
+  Vec3 camera_up = vec3_cross(side, forward);
+
+  Mat4 result = mat4_identity();
+  result.m[0][0] = side.x;
+  result.m[1][0] = side.y;
+  result.m[2][0] = side.z;
+  result.m[0][1] = camera_up.x;
+  result.m[1][1] = camera_up.y;
+  result.m[2][1] = camera_up.z;
+  result.m[0][2] = -forward.x;
+  result.m[1][2] = -forward.y;
+  result.m[2][2] = -forward.z;
+  result.m[3][0] = -vec3_dot(side, eye);
+  result.m[3][1] = -vec3_dot(camera_up, eye);
+  result.m[3][2] = vec3_dot(forward, eye);
+
+  return result;
+}
@@ -0,0 +1,828 @@
+#include "conx_physics_internal.h"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_SIZE - 1)
+
+// Bodies covering more cells than this are handled outside the grid
+#define GRID_MAX_CELLS_PER_BODY 64
+
+// Extra room around dynamic tree leaves so small moves need no refit
+#define BVH_DYNAMIC_MARGIN 0.1f
+
+// Pair buffer
+
+static bool pair_buffer_reserve(ConXPairBuffer *buffer, int capacity) {
+  if (capacity <= buffer->capacity) return true;
+
+  int new_capacity = buffer->capacity ? buffer->capacity : 256;
+  while (new_capacity < capacity) new_capacity *= 2;
+
+  ConXBodyPair *pairs = realloc(buffer->pairs, sizeof(ConXBodyPair) * new_capacity);
+  if (!pairs) return false;
+  buffer->pairs = pairs;
+
+  ConXBodyPair *scratch = realloc(buffer->scratch, sizeof(ConXBodyPair) * new_capacity);
+  if (!scratch) return false;
+  buffer->scratch = scratch;
+
+  buffer->capacity = new_capacity;
+  return true;
+}
+
+bool conx_pair_buffer_push(ConXPairBuffer *buffer, int a, int b) {
+  if (buffer->count >= buffer->capacity &&
+      !pair_buffer_reserve(buffer, buffer->count + 1)) {
+    return false;
+  }
+
+  ConXBodyPair *pair = &buffer->pairs[buffer->count++];
+  pair->a = a < b ? a : b;
+  pair->b = a < b ? b : a;
+  return true;
+}
+
+// One counting-sort pass over an 11-bit digit of either a or b.
+// Returns false when every pair shares the digit and the pass was skipped.
+static bool radix_pass(const ConXBodyPair *src, ConXBodyPair *dst, int count,
+                       bool use_a, int shift) {
+  int offsets[RADIX_SIZE] = {0};
+
+  for (int i = 0; i < count; i++) {
+    uint32_t key = (uint32_t)(use_a ? src[i].a : src[i].b);
+    offsets[(key >> shift) & RADIX_MASK]++;
+  }
+
+  int sum = 0;
+  for (int d = 0; d < RADIX_SIZE; d++) {
+    if (offsets[d] == count) return false;
+    int n = offsets[d];
+    offsets[d] = sum;
+    sum += n;
+  }
+
+  for (int i = 0; i < count; i++) {
+    uint32_t key = (uint32_t)(use_a ? src[i].a : src[i].b);
+    dst[offsets[(key >> shift) & RADIX_MASK]++] = src[i];
+  }
+  return true;
+}
+
+void conx_pair_buffer_sort(ConXPairBuffer *buffer) {
+  if (buffer->count < 2) return;
+
+  // LSD radix sort by (a, b) so pairs are visited in the same order as the
+  // old nested i/j loop, whatever order the broadphase found them in.
+  int max_id = 0;
+  for (int i = 0; i < buffer->count; i++) {
+    if (buffer->pairs[i].b > max_id) max_id = buffer->pairs[i].b;
+  }
+
+  ConXBodyPair *src = buffer->pairs;
+  ConXBodyPair *dst = buffer->scratch;
+
+  for (int field = 0; field < 2; field++) {
+    for (int shift = 0; shift < 32 && (max_id >> shift) > 0; shift += RADIX_BITS) {
+      if (radix_pass(src, dst, buffer->count, field == 1, shift)) {
+        ConXBodyPair *tmp = src;
+        src = dst;
+        dst = tmp;
+      }
+    }
+  }
+
+  if (src != buffer->pairs) {
+    memcpy(buffer->pairs, src, sizeof(ConXBodyPair) * buffer->count);
+  }
+}
+
+void conx_pair_buffer_free(ConXPairBuffer *buffer) {
+  free(buffer->pairs);
+  free(buffer->scratch);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+// Sweep-and-prune
+
+static inline bool endpoint_less(const ConXSapEndpoint *a, const ConXSapEndpoint *b) {
+  if (a->value != b->value) return a->value < b->value;
+  // Min endpoints first so touching boxes are still reported
+  return (a->id & 1) < (b->id & 1);
+}
+
+static int endpoint_compare(const void *lhs, const void *rhs) {
+  const ConXSapEndpoint *a = lhs;
+  const ConXSapEndpoint *b = rhs;
+  if (endpoint_less(a, b)) return -1;
+  if (endpoint_less(b, a)) return 1;
+  return (a->id > b->id) - (a->id < b->id);
+}
+
+static void insertion_sort(ConXSapEndpoint *endpoints, int count) {
+  for (int i = 1; i < count; i++) {
+    ConXSapEndpoint key = endpoints[i];
+    int j = i - 1;
+    while (j >= 0 && endpoint_less(&key, &endpoints[j])) {
+      endpoints[j + 1] = endpoints[j];
+      j--;
+    }
+    endpoints[j + 1] = key;
+  }
+}
+
+static bool sap_reserve(ConXSweepAndPrune *sap, int count) {
+  if (count <= sap->capacity) return true;
+
+  int new_capacity = sap->capacity ? sap->capacity : 64;
+  while (new_capacity < count) new_capacity *= 2;
+
+  ConXSapEndpoint *endpoints = realloc(sap->endpoints, sizeof(ConXSapEndpoint) * new_capacity * 2);
+  if (!endpoints) return false;
+  sap->endpoints = endpoints;
+
+  ConXSapActive *active = realloc(sap->active, sizeof(ConXSapActive) * new_capacity);
+  if (!active) return false;
+  sap->active = active;
+
+  int *active_index = realloc(sap->active_index, sizeof(int) * new_capacity);
+  if (!active_index) return false;
+  sap->active_index = active_index;
+
+  sap->capacity = new_capacity;
+  return true;
+}
+
+void conx_sap_free(ConXSweepAndPrune *sap) {
+  free(sap->endpoints);
+  free(sap->active);
+  free(sap->active_index);
+  memset(sap, 0, sizeof(*sap));
+}
+
+// Drop the endpoints of removed bodies and renumber the rest. The order
+// of the survivors is unchanged, so the list stays sorted.
+void conx_sap_compact(ConXSweepAndPrune *sap, const int *remap) {
+  int body_count = 0;
+  for (int b = 0; b < sap->body_count; b++) {
+    if (remap[b] >= 0) body_count++;
+  }
+
+  int kept = 0;
+  for (int i = 0; i < sap->endpoint_count; i++) {
+    ConXSapEndpoint e = sap->endpoints[i];
+    int body = remap[e.id >> 1];
+    if (body < 0) continue;
+    e.id = (body << 1) | (e.id & 1);
+    sap->endpoints[kept++] = e;
+  }
+  sap->endpoint_count = kept;
+  sap->body_count = body_count;
+}
+
+void conx_sap_update(ConXSweepAndPrune *sap, const ConXAABB *aabbs,
+                     const unsigned char *is_static, int count,
+                     ConXPairBuffer *out) {
+  if (count < sap->body_count) {
+    // Bodies went away, start over
+    sap->endpoint_count = 0;
+    sap->body_count = 0;
+  }
+  if (!sap_reserve(sap, count)) return;
+
+  // Append endpoints for bodies created since the last update
+  int added = 0;
+  for (int body = sap->body_count; body < count; body++) {
+    sap->endpoints[sap->endpoint_count++].id = body << 1;
+    sap->endpoints[sap->endpoint_count++].id = (body << 1) | 1;
+    added += 2;
+  }
+  sap->body_count = count;
+
+  // Refresh endpoint values from this frame's boxes
+  for (int i = 0; i < sap->endpoint_count; i++) {
+    ConXSapEndpoint *e = &sap->endpoints[i];
+    const ConXAABB *box = &aabbs[e->id >> 1];
+    e->value = (e->id & 1) ? box->max.x : box->min.x;
+  }
+
+  // Coherent frames only need a few swaps; a large batch of new bodies
+  // would make insertion sort quadratic, so fall back to a full sort.
+  if (added > sap->endpoint_count / 4) {
+    qsort(sap->endpoints, sap->endpoint_count, sizeof(ConXSapEndpoint), endpoint_compare);
+  } else {
+    insertion_sort(sap->endpoints, sap->endpoint_count);
+  }
+
+  // Sweep, keeping the set of boxes whose x interval is open
+  int active_count = 0;
+  for (int i = 0; i < sap->endpoint_count; i++) {
+    int id = sap->endpoints[i].id;
+    int body = id >> 1;
+
+    if (id & 1) {
+      int slot = sap->active_index[body];
+      ConXSapActive *last = &sap->active[--active_count];
+      sap->active[slot] = *last;
+      sap->active_index[last->body] = slot;
+      continue;
+    }
+
+    const ConXAABB *box = &aabbs[body];
+    int body_static = is_static[body];
+    for (int k = 0; k < active_count; k++) {
+      const ConXSapActive *other = &sap->active[k];
+      if (box->min.y <= other->max_y && box->max.y >= other->min_y &&
+          box->min.z <= other->max_z && box->max.z >= other->min_z &&
+          !(body_static && other->is_static)) {
+        conx_pair_buffer_push(out, body, other->body);
+      }
+    }
+
+    ConXSapActive *entry = &sap->active[active_count];
+    entry->min_y = box->min.y;
+    entry->max_y = box->max.y;
+    entry->min_z = box->min.z;
+    entry->max_z = box->max.z;
+    entry->body = body;
+    entry->is_static = body_static;
+    sap->active_index[body] = active_count++;
+  }
+}
+
+// Spatial hash grid
+
+static inline int grid_coord(const ConXGrid *grid, float value) {
+  return (int)floorf(value * grid->inv_cell_size);
+}
+
+static inline unsigned int grid_hash(const int cell[3]) {
+  return ((unsigned int)cell[0] * 73856093u) ^
+         ((unsigned int)cell[1] * 19349663u) ^
+         ((unsigned int)cell[2] * 83492791u);
+}
+
+static bool grid_reserve(ConXGrid *grid, int body_count) {
+  if (body_count <= grid->range_capacity) return true;
+
+  ConXGridRange *ranges = realloc(grid->ranges, sizeof(ConXGridRange) * body_count);
+  if (!ranges) return false;
+  grid->ranges = ranges;
+
+  int *oversized = realloc(grid->oversized, sizeof(int) * body_count);
+  if (!oversized) return false;
+  grid->oversized = oversized;
+
+  int *static_oversized = realloc(grid->static_oversized, sizeof(int) * body_count);
+  if (!static_oversized) return false;
+  grid->static_oversized = static_oversized;
+
+  unsigned char *in_static_layer = realloc(grid->in_static_layer, body_count);
+  if (!in_static_layer) return false;
+  grid->in_static_layer = in_static_layer;
+
+  grid->range_capacity = body_count;
+  return true;
+}
+
+static bool grid_layer_reserve(ConXGridLayer *layer, int entry_count, int bucket_count) {
+  if (entry_count > layer->entry_capacity) {
+    int new_capacity = layer->entry_capacity ? layer->entry_capacity : 256;
+    while (new_capacity < entry_count) new_capacity *= 2;
+
+    ConXGridEntry *entries = realloc(layer->entries, sizeof(ConXGridEntry) * new_capacity);
+    if (!entries) return false;
+    layer->entries = entries;
+    layer->entry_capacity = new_capacity;
+  }
+
+  if (bucket_count != layer->bucket_count) {
+    int *bucket_start = realloc(layer->bucket_start, sizeof(int) * (bucket_count + 1));
+    if (!bucket_start) return false;
+    layer->bucket_start = bucket_start;
+    layer->bucket_count = bucket_count;
+  }
+  return true;
+}
+
+static void grid_layer_free(ConXGridLayer *layer) {
+  free(layer->entries);
+  free(layer->bucket_start);
+  memset(layer, 0, sizeof(*layer));
+}
+
+void conx_grid_free(ConXGrid *grid) {
+  free(grid->ranges);
+  free(grid->oversized);
+  free(grid->static_oversized);
+  free(grid->in_static_layer);
+  grid_layer_free(&grid->dynamic_layer);
+  grid_layer_free(&grid->static_layer);
+  grid->ranges = NULL;
+  grid->oversized = NULL;
+  grid->static_oversized = NULL;
+  grid->in_static_layer = NULL;
+  grid->range_capacity = 0;
+  grid->static_oversized_count = 0;
+  grid->body_count = 0;
+}
+
+void conx_grid_touch(ConXGrid *grid, const unsigned char *is_static, int body) {
+  if (body >= grid->body_count) return;
+  if (is_static[body] || grid->in_static_layer[body]) {
+    grid->static_dirty = true;
+  }
+}
+
+// Removing a static body needs a static rebuild; otherwise the static
+// layer only has its body ids renumbered
+void conx_grid_compact(ConXGrid *grid, const int *remap) {
+  int body_count = 0;
+  for (int b = 0; b < grid->body_count; b++) {
+    int target = remap[b];
+    if (target < 0) {
+      if (grid->in_static_layer[b]) grid->static_dirty = true;
+      continue;
+    }
+    grid->ranges[target] = grid->ranges[b];
+    grid->in_static_layer[target] = grid->in_static_layer[b];
+    body_count++;
+  }
+
+  if (!grid->static_dirty) {
+    ConXGridLayer *layer = &grid->static_layer;
+    int entry_count = layer->bucket_count > 0 ? layer->bucket_start[layer->bucket_count] : 0;
+    for (int i = 0; i < entry_count; i++) {
+      layer->entries[i].body = remap[layer->entries[i].body];
+    }
+    for (int i = 0; i < grid->static_oversized_count; i++) {
+      grid->static_oversized[i] = remap[grid->static_oversized[i]];
+    }
+  }
+  grid->body_count = body_count;
+}
+
+// Hash every body whose is_static flag equals want_static into layer.
+// Bodies too large for the grid get max[0] = INT_MIN and are listed in
+// oversized instead. Returns the number of oversized bodies, or -1.
+static int grid_build_layer(ConXGrid *grid, ConXGridLayer *layer, const ConXAABB *aabbs,
+                            const unsigned char *is_static, int count, int want_static,
+                            int *oversized) {
+  // Cell ranges, and how many (body, cell) entries they produce
+  int entry_count = 0;
+  int oversized_count = 0;
+  for (int b = 0; b < count; b++) {
+    if (is_static[b] != want_static) continue;
+
+    ConXGridRange *range = &grid->ranges[b];
+    range->min[0] = grid_coord(grid, aabbs[b].min.x);
+    range->min[1] = grid_coord(grid, aabbs[b].min.y);
+    range->min[2] = grid_coord(grid, aabbs[b].min.z);
+    range->max[0] = grid_coord(grid, aabbs[b].max.x);
+    range->max[1] = grid_coord(grid, aabbs[b].max.y);
+    range->max[2] = grid_coord(grid, aabbs[b].max.z);
+
+    long long cells = (long long)(range->max[0] - range->min[0] + 1) *
+                      (range->max[1] - range->min[1] + 1) *
+                      (range->max[2] - range->min[2] + 1);
+    if (cells > GRID_MAX_CELLS_PER_BODY) {
+      range->max[0] = INT_MIN;
+      oversized[oversized_count++] = b;
+    } else {
+      entry_count += (int)cells;
+    }
+  }
+
+  int bucket_count = 64;
+  while (bucket_count < entry_count) bucket_count *= 2;
+  if (!grid_layer_reserve(layer, entry_count, bucket_count)) return -1;
+
+  unsigned int mask = (unsigned int)bucket_count - 1;
+  int *bucket_start = layer->bucket_start;
+  memset(bucket_start, 0, sizeof(int) * (bucket_count + 1));
+
+  // Counting sort: histogram, inclusive prefix sum, then scatter backwards
+  // so each bucket_start[h] ends up at the first entry of bucket h
+  int cell[3];
+  for (int b = 0; b < count; b++) {
+    const ConXGridRange *range = &grid->ranges[b];
+    if (is_static[b] != want_static || range->max[0] == INT_MIN) continue;
+    for (cell[0] = range->min[0]; cell[0] <= range->max[0]; cell[0]++)
+      for (cell[1] = range->min[1]; cell[1] <= range->max[1]; cell[1]++)
+        for (cell[2] = range->min[2]; cell[2] <= range->max[2]; cell[2]++)
+          bucket_start[grid_hash(cell) & mask]++;
+  }
+
+  for (int h = 1; h <= bucket_count; h++) {
+    bucket_start[h] += bucket_start[h - 1];
+  }
+
+  for (int b = count - 1; b >= 0; b--) {
+    const ConXGridRange *range = &grid->ranges[b];
+    if (is_static[b] != want_static || range->max[0] == INT_MIN) continue;
+    for (cell[0] = range->min[0]; cell[0] <= range->max[0]; cell[0]++)
+      for (cell[1] = range->min[1]; cell[1] <= range->max[1]; cell[1]++)
+        for (cell[2] = range->min[2]; cell[2] <= range->max[2]; cell[2]++) {
+          ConXGridEntry *entry = &layer->entries[--bucket_start[grid_hash(cell) & mask]];
+          entry->cell[0] = cell[0];
+          entry->cell[1] = cell[1];
+          entry->cell[2] = cell[2];
+          entry->body = b;
+        }
+  }
+
+  return oversized_count;
+}
+
+// Two boxes share several cells, so a pair is only reported from the cell
+// holding the min corner of their overlap
+static inline bool grid_owns_pair(const ConXGrid *grid, const int cell[3],
+                                  const ConXAABB *box1, const ConXAABB *box2) {
+  return grid_coord(grid, fmaxf(box1->min.x, box2->min.x)) == cell[0] &&
+         grid_coord(grid, fmaxf(box1->min.y, box2->min.y)) == cell[1] &&
+         grid_coord(grid, fmaxf(box1->min.z, box2->min.z)) == cell[2];
+}
+
+void conx_grid_update(ConXGrid *grid, const ConXAABB *aabbs,
+                      const unsigned char *is_static, int count,
+                      ConXPairBuffer *out) {
+  if (count <= 0 || !grid_reserve(grid, count)) return;
+
+  if (count < grid->body_count) {
+    grid->static_dirty = true;
+  }
+  for (int b = grid->body_count; b < count; b++) {
+    grid->in_static_layer[b] = 0;
+    if (is_static[b]) grid->static_dirty = true;
+  }
+  grid->body_count = count;
+
+  if (grid->static_dirty) {
+    int oversized_count = grid_build_layer(grid, &grid->static_layer, aabbs, is_static,
+                                           count, 1, grid->static_oversized);
+    if (oversized_count < 0) return;
+    grid->static_oversized_count = oversized_count;
+    memcpy(grid->in_static_layer, is_static, count);
+    grid->static_dirty = false;
+  }
+
+  int oversized_count = grid_build_layer(grid, &grid->dynamic_layer, aabbs, is_static,
+                                         count, 0, grid->oversized);
+  if (oversized_count < 0) return;
+
+  // Moving pairs within each bucket of the dynamic layer
+  const ConXGridLayer *layer = &grid->dynamic_layer;
+  for (int h = 0; h < layer->bucket_count; h++) {
+    int start = layer->bucket_start[h];
+    int end = layer->bucket_start[h + 1];
+
+    for (int i = start; i < end; i++) {
+      const ConXGridEntry *e1 = &layer->entries[i];
+      const ConXAABB *box1 = &aabbs[e1->body];
+
+      for (int j = i + 1; j < end; j++) {
+        const ConXGridEntry *e2 = &layer->entries[j];
+        if (e1->cell[0] != e2->cell[0] || e1->cell[1] != e2->cell[1] ||
+            e1->cell[2] != e2->cell[2]) {
+          continue;
+        }
+
+        const ConXAABB *box2 = &aabbs[e2->body];
+        if (conx_aabb_overlap(box1, box2) && grid_owns_pair(grid, e1->cell, box1, box2)) {
+          conx_pair_buffer_push(out, e1->body, e2->body);
+        }
+      }
+    }
+  }
+
+  // Moving bodies probe the cells they cover in the static layer
+  const ConXGridLayer *statics = &grid->static_layer;
+  unsigned int static_mask = (unsigned int)statics->bucket_count - 1;
+  int cell[3];
+  for (int b = 0; b < count; b++) {
+    const ConXGridRange *range = &grid->ranges[b];
+    if (statics->bucket_count == 0) break;
+    if (is_static[b] || range->max[0] == INT_MIN) continue;
+
+    const ConXAABB *box1 = &aabbs[b];
+    for (cell[0] = range->min[0]; cell[0] <= range->max[0]; cell[0]++)
+      for (cell[1] = range->min[1]; cell[1] <= range->max[1]; cell[1]++)
+        for (cell[2] = range->min[2]; cell[2] <= range->max[2]; cell[2]++) {
+          unsigned int h = grid_hash(cell) & static_mask;
+          for (int i = statics->bucket_start[h]; i < statics->bucket_start[h + 1]; i++) {
+            const ConXGridEntry *e = &statics->entries[i];
+            if (e->cell[0] != cell[0] || e->cell[1] != cell[1] || e->cell[2] != cell[2]) {
+              continue;
+            }
+
+            const ConXAABB *box2 = &aabbs[e->body];
+            if (conx_aabb_overlap(box1, box2) && grid_owns_pair(grid, cell, box1, box2)) {
+              conx_pair_buffer_push(out, b, e->body);
+            }
+          }
+        }
+  }
+
+  // Oversized moving bodies against everything else
+  for (int k = 0; k < oversized_count; k++) {
+    int big = grid->oversized[k];
+    for (int b = 0; b < count; b++) {
+      if (b == big) continue;
+      if (!is_static[b] && grid->ranges[b].max[0] == INT_MIN && b < big) continue;
+      if (conx_aabb_overlap(&aabbs[big], &aabbs[b])) {
+        conx_pair_buffer_push(out, big, b);
+      }
+    }
+  }
+
+  // Oversized static bodies against moving bodies that fit the grid
+  for (int k = 0; k < grid->static_oversized_count; k++) {
+    int big = grid->static_oversized[k];
+    for (int b = 0; b < count; b++) {
+      if (is_static[b] || grid->ranges[b].max[0] == INT_MIN) continue;
+      if (conx_aabb_overlap(&aabbs[big], &aabbs[b])) {
+        conx_pair_buffer_push(out, big, b);
+      }
+    }
+  }
+}
+
+// Dynamic AABB trees
+
+static void bvh_pair_callback(void *context, int body_a, int body_b) {
+  ConXBroadphase *broadphase = context;
+  // Leaves are fattened, confirm against the tight boxes
+  if (conx_aabb_overlap(&broadphase->aabbs[body_a], &broadphase->aabbs[body_b])) {
+    conx_pair_buffer_push(&broadphase->pairs, body_a, body_b);
+  }
+}
+
+// Bring both trees in line with the current boxes. Static bodies are only
+// visited when they were touched through the API since the last sync.
+static void bvh_sync(ConXBroadphase *broadphase, int body_count) {
+  int first_new = broadphase->proxy_count;
+  broadphase->proxy_count = body_count;
+  for (int body = first_new; body < body_count; body++) {
+    broadphase->proxies[body] = CONX_BVH_NULL;
+    conx_broadphase_touch(broadphase, body);
+  }
+
+  for (int i = 0; i < broadphase->dirty_count; i++) {
+    int body = broadphase->dirty_list[i];
+    broadphase->dirty[body] = 0;
+
+    bool is_static = broadphase->is_static[body];
+    int proxy = broadphase->proxies[body];
+    if (proxy != CONX_BVH_NULL) {
+      ConXBvh *tree = broadphase->proxy_static[body] ? &broadphase->static_tree
+                                                     : &broadphase->dynamic_tree;
+      conx_bvh_destroy_proxy(tree, proxy);
+    }
+
+    // A body that moves gets its leaf stretched along the last step's motion,
+    // the same as a leaf the move loop below reinserts
+    ConXBvh *tree = is_static ? &broadphase->static_tree : &broadphase->dynamic_tree;
+    Vec3 displacement = is_static ? vec3_create(0.0f, 0.0f, 0.0f) : broadphase->motion[body];
+    broadphase->proxies[body] = conx_bvh_create_proxy(tree, &broadphase->aabbs[body],
+                                                      displacement, body);
+    broadphase->proxy_static[body] = is_static;
+  }
+  broadphase->dirty_count = 0;
+
+  for (int body = 0; body < body_count; body++) {
+    if (broadphase->proxy_static[body] || broadphase->proxies[body] == CONX_BVH_NULL) continue;
+    conx_bvh_move_proxy(&broadphase->dynamic_tree, broadphase->proxies[body],
+                        &broadphase->aabbs[body], broadphase->motion[body]);
+  }
+
+  broadphase->trees_stale = false;
+}
+
+static void bvh_update(ConXBroadphase *broadphase, int body_count) {
+  bvh_sync(broadphase, body_count);
+
+  conx_bvh_query_pairs(&broadphase->dynamic_tree, NULL, bvh_pair_callback, broadphase);
+  conx_bvh_query_pairs(&broadphase->dynamic_tree, &broadphase->static_tree,
+                       bvh_pair_callback, broadphase);
+}
+
+typedef struct {
+  const ConXBroadphase *broadphase;
+  const ConXAABB *box;
+  int *body_ids;
+  int max_results;
+  int count;
+} BvhQueryContext;
+
+static bool bvh_query_callback(void *context, int body) {
+  BvhQueryContext *ctx = context;
+  if (!conx_aabb_overlap(&ctx->broadphase->aabbs[body], ctx->box)) return true;
+
+  ctx->body_ids[ctx->count++] = body;
+  return ctx->count < ctx->max_results;
+}
+
+// Broadphase
+
+ConXBroadphase *conx_broadphase_create(const ConXPhysicsConfig *config) {
+  ConXBroadphase *broadphase = calloc(1, sizeof(ConXBroadphase));
+  if (!broadphase) return NULL;
+
+  int capacity = config->max_bodies;
+  broadphase->type = config->broadphase;
+  broadphase->grid.cell_size = config->grid_cell_size;
+  broadphase->grid.inv_cell_size = 1.0f / config->grid_cell_size;
+  conx_bvh_init(&broadphase->static_tree, 0.0f);
+  conx_bvh_init(&broadphase->dynamic_tree, BVH_DYNAMIC_MARGIN);
+  broadphase->trees_stale = true;
+
+  broadphase->aabbs = malloc(sizeof(ConXAABB) * capacity);
+  broadphase->motion = calloc(capacity, sizeof(Vec3));
+  broadphase->is_static = malloc(sizeof(unsigned char) * capacity);
+  broadphase->proxies = malloc(sizeof(int) * capacity);
+  broadphase->proxy_static = calloc(capacity, sizeof(unsigned char));
+  broadphase->dirty = calloc(capacity, sizeof(unsigned char));
+  broadphase->dirty_list = malloc(sizeof(int) * capacity);
+  if (!broadphase->aabbs || !broadphase->motion || !broadphase->is_static ||
+      !broadphase->proxies || !broadphase->proxy_static || !broadphase->dirty ||
+      !broadphase->dirty_list) {
+    conx_broadphase_destroy(broadphase);
+    return NULL;
+  }
+
+  broadphase->capacity = capacity;
+  return broadphase;
+}
+
+bool conx_broadphase_reserve(ConXBroadphase *broadphase, int capacity) {
+  if (capacity <= broadphase->capacity) return true;
+
+  int old = broadphase->capacity;
+  ConXAABB *aabbs = realloc(broadphase->aabbs, sizeof(ConXAABB) * capacity);
+  if (!aabbs) return false;
+  broadphase->aabbs = aabbs;
+
+  Vec3 *motion = realloc(broadphase->motion, sizeof(Vec3) * capacity);
+  if (!motion) return false;
+  memset(motion + old, 0, sizeof(Vec3) * (capacity - old));
+  broadphase->motion = motion;
+
+  unsigned char **flags[] = {&broadphase->is_static, &broadphase->proxy_static, &broadphase->dirty};
+  for (int i = 0; i < 3; i++) {
+    unsigned char *grown = realloc(*flags[i], capacity);
+    if (!grown) return false;
+    memset(grown + old, 0, capacity - old);
+    *flags[i] = grown;
+  }
+
+  int *proxies = realloc(broadphase->proxies, sizeof(int) * capacity);
+  if (!proxies) return false;
+  broadphase->proxies = proxies;
+
+  int *dirty_list = realloc(broadphase->dirty_list, sizeof(int) * capacity);
+  if (!dirty_list) return false;
+  broadphase->dirty_list = dirty_list;
+
+  broadphase->capacity = capacity;
+  return true;
+}
+
+void conx_broadphase_compact(ConXBroadphase *broadphase, const int *remap, int old_count) {
+  // Tree leaves of removed bodies go first, while their proxies are known
+  for (int body = 0; body < broadphase->proxy_count; body++) {
+    if (remap[body] >= 0 || broadphase->proxies[body] == CONX_BVH_NULL) continue;
+    ConXBvh *tree = broadphase->proxy_static[body] ? &broadphase->static_tree
+                                                   : &broadphase->dynamic_tree;
+    conx_bvh_destroy_proxy(tree, broadphase->proxies[body]);
+  }
+  conx_bvh_remap_bodies(&broadphase->static_tree, remap);
+  conx_bvh_remap_bodies(&broadphase->dynamic_tree, remap);
+
+  int dirty_count = 0;
+  for (int i = 0; i < broadphase->dirty_count; i++) {
+    int body = remap[broadphase->dirty_list[i]];
+    if (body >= 0) broadphase->dirty_list[dirty_count++] = body;
+  }
+  broadphase->dirty_count = dirty_count;
+
+  // Survivors only ever move down, so one forward pass is enough
+  int proxy_count = 0;
+  for (int body = 0; body < old_count; body++) {
+    int target = remap[body];
+    if (target < 0) continue;
+    broadphase->aabbs[target] = broadphase->aabbs[body];
+    broadphase->motion[target] = broadphase->motion[body];
+    broadphase->is_static[target] = broadphase->is_static[body];
+    if (body < broadphase->proxy_count) {
+      broadphase->proxies[target] = broadphase->proxies[body];
+      broadphase->proxy_static[target] = broadphase->proxy_static[body];
+      broadphase->dirty[target] = broadphase->dirty[body];
+      proxy_count++;
+    }
+  }
+  // Bodies created in the freed slots must start without a proxy's flags,
+  // or touching them would think they are already queued for the trees
+  int freed = broadphase->proxy_count - proxy_count;
+  memset(broadphase->dirty + proxy_count, 0, freed);
+  memset(broadphase->proxy_static + proxy_count, 0, freed);
+  broadphase->proxy_count = proxy_count;
+
+  conx_sap_compact(&broadphase->sap, remap);
+  conx_grid_compact(&broadphase->grid, remap);
+}
+
+// Forget everything carried over between steps. Sweep-and-prune keeps its
+// endpoints as long as the body count matches, since they only hold ids.
+void conx_broadphase_reset(ConXBroadphase *broadphase, int body_count) {
+  conx_bvh_clear(&broadphase->static_tree);
+  conx_bvh_clear(&broadphase->dynamic_tree);
+  memset(broadphase->dirty, 0, broadphase->capacity);
+  memset(broadphase->proxy_static, 0, broadphase->capacity);
+  memset(broadphase->motion, 0, sizeof(Vec3) * broadphase->capacity);
+  broadphase->dirty_count = 0;
+  broadphase->proxy_count = 0;
+  broadphase->trees_stale = true;
+
+  if (broadphase->sap.body_count != body_count) {
+    broadphase->sap.endpoint_count = 0;
+    broadphase->sap.body_count = 0;
+  }
+  broadphase->grid.body_count = 0;
+  broadphase->grid.static_dirty = true;
+}
+
+void conx_broadphase_destroy(ConXBroadphase *broadphase) {
+  if (!broadphase) return;
+
+  free(broadphase->aabbs);
+  free(broadphase->motion);
+  free(broadphase->is_static);
+  free(broadphase->proxies);
+  free(broadphase->proxy_static);
+  free(broadphase->dirty);
+  free(broadphase->dirty_list);
+  conx_sap_free(&broadphase->sap);
+  conx_grid_free(&broadphase->grid);
+  conx_bvh_free(&broadphase->static_tree);
+  conx_bvh_free(&broadphase->dynamic_tree);
+  conx_pair_buffer_free(&broadphase->pairs);
+  free(broadphase);
+}
+
+void conx_broadphase_touch(ConXBroadphase *broadphase, int body) {
+  conx_grid_touch(&broadphase->grid, broadphase->is_static, body);
+  if (body >= broadphase->proxy_count || broadphase->dirty[body]) return;
+
+  broadphase->dirty[body] = 1;
+  broadphase->dirty_list[broadphase->dirty_count++] = body;
+}
+
+void conx_broadphase_update(ConXBroadphase *broadphase, int body_count) {
+  broadphase->pairs.count = 0;
+
+  switch (broadphase->type) {
+  case CONX_BROADPHASE_GRID:
+    conx_grid_update(&broadphase->grid, broadphase->aabbs, broadphase->is_static,
+                     body_count, &broadphase->pairs);
+    broadphase->trees_stale = true;
+    break;
+  case CONX_BROADPHASE_BVH:
+    bvh_update(broadphase, body_count);
+    break;
+  case CONX_BROADPHASE_SAP:
+  default:
+    conx_sap_update(&broadphase->sap, broadphase->aabbs, broadphase->is_static,
+                    body_count, &broadphase->pairs);
+    broadphase->trees_stale = true;
+    break;
+  }
+
+  conx_pair_buffer_sort(&broadphase->pairs);
+}
+
+void conx_broadphase_prepare_queries(ConXBroadphase *broadphase, int body_count) {
+  // Bodies move after the step builds its pairs, and other broadphases
+  // leave the trees alone entirely, so catch up lazily
+  if (broadphase->trees_stale || broadphase->proxy_count != body_count ||
+      broadphase->dirty_count > 0) {
+    bvh_sync(broadphase, body_count);
+  }
+}
+
+int conx_broadphase_query(ConXBroadphase *broadphase, int body_count,
+                          const ConXAABB *box, int *body_ids, int max_results) {
+  if (max_results <= 0) return 0;
+
+  conx_broadphase_prepare_queries(broadphase, body_count);
+
+  BvhQueryContext ctx = {broadphase, box, body_ids, max_results, 0};
+  conx_bvh_query(&broadphase->static_tree, box, bvh_query_callback, &ctx);
+  if (ctx.count < max_results) {
+    conx_bvh_query(&broadphase->dynamic_tree, box, bvh_query_callback, &ctx);
+  }
+  return ctx.count;
+}
@@ -0,0 +1,502 @@
+#include "conx_physics_internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Balanced trees stay far below this depth even with millions of leaves
+#define BVH_STACK_SIZE 256
+
+// How many steps of motion a dynamic leaf is stretched to cover
+#define BVH_DISPLACEMENT_MULTIPLIER 2.0f
+
+static inline ConXAABB aabb_union(const ConXAABB *a, const ConXAABB *b) {
+  ConXAABB result;
+  result.min = vec3_create(fminf(a->min.x, b->min.x), fminf(a->min.y, b->min.y),
+                           fminf(a->min.z, b->min.z));
+  result.max = vec3_create(fmaxf(a->max.x, b->max.x), fmaxf(a->max.y, b->max.y),
+                           fmaxf(a->max.z, b->max.z));
+  return result;
+}
+
+static inline bool aabb_contains(const ConXAABB *outer, const ConXAABB *inner) {
+  return outer->min.x <= inner->min.x && outer->min.y <= inner->min.y &&
+         outer->min.z <= inner->min.z && outer->max.x >= inner->max.x &&
+         outer->max.y >= inner->max.y && outer->max.z >= inner->max.z;
+}
+
+// Half the surface area, the cost metric for choosing where to insert
+static inline float aabb_area(const ConXAABB *box) {
+  float dx = box->max.x - box->min.x;
+  float dy = box->max.y - box->min.y;
+  float dz = box->max.z - box->min.z;
+  return dx * dy + dy * dz + dz * dx;
+}
+
+static int bvh_allocate_node(ConXBvh *tree) {
+  if (tree->free_list == CONX_BVH_NULL) {
+    int new_capacity = tree->node_capacity ? tree->node_capacity * 2 : 64;
+    ConXBvhNode *nodes = realloc(tree->nodes, sizeof(ConXBvhNode) * new_capacity);
+    if (!nodes) return CONX_BVH_NULL;
+
+    for (int i = tree->node_capacity; i < new_capacity - 1; i++) {
+      nodes[i].parent = i + 1;
+      nodes[i].height = -1;
+    }
+    nodes[new_capacity - 1].parent = CONX_BVH_NULL;
+    nodes[new_capacity - 1].height = -1;
+
+    tree->free_list = tree->node_capacity;
+    tree->nodes = nodes;
+    tree->node_capacity = new_capacity;
+  }
+
+  int id = tree->free_list;
+  ConXBvhNode *node = &tree->nodes[id];
+  tree->free_list = node->parent;
+  node->parent = CONX_BVH_NULL;
+  node->child1 = CONX_BVH_NULL;
+  node->child2 = CONX_BVH_NULL;
+  node->height = 0;
+  node->body = -1;
+  tree->node_count++;
+  return id;
+}
+
+static void bvh_free_node(ConXBvh *tree, int id) {
+  tree->nodes[id].parent = tree->free_list;
+  tree->nodes[id].height = -1;
+  tree->free_list = id;
+  tree->node_count--;
+}
+
+static inline int max_int(int a, int b) { return a > b ? a : b; }
+
+// AVL-style rotation: if one child of A is more than one level taller
+// than the other, promote it. Returns the index of the new subtree root.
+static int bvh_balance(ConXBvh *tree, int ia) {
+  ConXBvhNode *nodes = tree->nodes;
+  ConXBvhNode *a = &nodes[ia];
+  if (a->height < 2) return ia;
+
+  int ib = a->child1;
+  int ic = a->child2;
+  ConXBvhNode *b = &nodes[ib];
+  ConXBvhNode *c = &nodes[ic];
+  int balance = c->height - b->height;
+
+  if (balance > 1) {
+    // Rotate C up
+    int i_f = c->child1;
+    int ig = c->child2;
+    ConXBvhNode *f = &nodes[i_f];
+    ConXBvhNode *g = &nodes[ig];
+
+    c->child1 = ia;
+    c->parent = a->parent;
+    a->parent = ic;
+
+    if (c->parent != CONX_BVH_NULL) {
+      if (nodes[c->parent].child1 == ia) {
+        nodes[c->parent].child1 = ic;
+      } else {
+        nodes[c->parent].child2 = ic;
+      }
+    } else {
+      tree->root = ic;
+    }
+
+    if (f->height > g->height) {
+      c->child2 = i_f;
+      a->child2 = ig;
+      g->parent = ia;
+      a->box = aabb_union(&b->box, &g->box);
+      c->box = aabb_union(&a->box, &f->box);
+      a->height = 1 + max_int(b->height, g->height);
+      c->height = 1 + max_int(a->height, f->height);
+    } else {
+      c->child2 = ig;
+      a->child2 = i_f;
+      f->parent = ia;
+      a->box = aabb_union(&b->box, &f->box);
+      c->box = aabb_union(&a->box, &g->box);
+      a->height = 1 + max_int(b->height, f->height);
+      c->height = 1 + max_int(a->height, g->height);
+    }
+    return ic;
+  }
+
+  if (balance < -1) {
+    // Rotate B up
+    int id = b->child1;
+    int ie = b->child2;
+    ConXBvhNode *d = &nodes[id];
+    ConXBvhNode *e = &nodes[ie];
+
+    b->child1 = ia;
+    b->parent = a->parent;
+    a->parent = ib;
+
+    if (b->parent != CONX_BVH_NULL) {
+      if (nodes[b->parent].child1 == ia) {
+        nodes[b->parent].child1 = ib;
+      } else {
+        nodes[b->parent].child2 = ib;
+      }
+    } else {
+      tree->root = ib;
+    }
+
+    if (d->height > e->height) {
+      b->child2 = id;
+      a->child1 = ie;
+      e->parent = ia;
+      a->box = aabb_union(&c->box, &e->box);
+      b->box = aabb_union(&a->box, &d->box);
+      a->height = 1 + max_int(c->height, e->height);
+      b->height = 1 + max_int(a->height, d->height);
+    } else {
+      b->child2 = ie;
+      a->child1 = id;
+      d->parent = ia;
+      a->box = aabb_union(&c->box, &d->box);
+      b->box = aabb_union(&a->box, &e->box);
+      a->height = 1 + max_int(c->height, d->height);
+      b->height = 1 + max_int(a->height, e->height);
+    }
+    return ib;
+  }
+
+  return ia;
+}
+
+// Refit boxes and heights from index up to the root, rebalancing on the way
+static void bvh_refit_ancestors(ConXBvh *tree, int index) {
+  while (index != CONX_BVH_NULL) {
+    index = bvh_balance(tree, index);
+
+    ConXBvhNode *node = &tree->nodes[index];
+    ConXBvhNode *child1 = &tree->nodes[node->child1];
+    ConXBvhNode *child2 = &tree->nodes[node->child2];
+    node->height = 1 + max_int(child1->height, child2->height);
+    node->box = aabb_union(&child1->box, &child2->box);
+
+    index = node->parent;
+  }
+}
+
+static bool bvh_insert_leaf(ConXBvh *tree, int leaf) {
+  if (tree->root == CONX_BVH_NULL) {
+    tree->root = leaf;
+    tree->nodes[leaf].parent = CONX_BVH_NULL;
+    return true;
+  }
+
+  // Descend towards the sibling with the lowest area increase
+  ConXAABB leaf_box = tree->nodes[leaf].box;
+  int index = tree->root;
+  while (tree->nodes[index].height > 0) {
+    const ConXBvhNode *node = &tree->nodes[index];
+    const ConXBvhNode *child1 = &tree->nodes[node->child1];
+    const ConXBvhNode *child2 = &tree->nodes[node->child2];
+
+    ConXAABB combined = aabb_union(&node->box, &leaf_box);
+    float combined_area = aabb_area(&combined);
+
+    // Cost of making a new parent for this node and the leaf
+    float cost = 2.0f * combined_area;
+    // Minimum cost of pushing the leaf further down
+    float inheritance_cost = 2.0f * (combined_area - aabb_area(&node->box));
+
+    ConXAABB box1 = aabb_union(&leaf_box, &child1->box);
+    float cost1 = aabb_area(&box1) + inheritance_cost;
+    if (child1->height > 0) cost1 -= aabb_area(&child1->box);
+
+    ConXAABB box2 = aabb_union(&leaf_box, &child2->box);
+    float cost2 = aabb_area(&box2) + inheritance_cost;
+    if (child2->height > 0) cost2 -= aabb_area(&child2->box);
+
+    if (cost < cost1 && cost < cost2) break;
+    index = cost1 < cost2 ? node->child1 : node->child2;
+  }
+
+  int sibling = index;
+  int new_parent = bvh_allocate_node(tree);
+  if (new_parent == CONX_BVH_NULL) return false;
+
+  ConXBvhNode *nodes = tree->nodes;
+  int old_parent = nodes[sibling].parent;
+  nodes[new_parent].parent = old_parent;
+  nodes[new_parent].box = aabb_union(&leaf_box, &nodes[sibling].box);
+  nodes[new_parent].height = nodes[sibling].height + 1;
+  nodes[new_parent].child1 = sibling;
+  nodes[new_parent].child2 = leaf;
+  nodes[sibling].parent = new_parent;
+  nodes[leaf].parent = new_parent;
+
+  if (old_parent != CONX_BVH_NULL) {
+    if (nodes[old_parent].child1 == sibling) {
+      nodes[old_parent].child1 = new_parent;
+    } else {
+      nodes[old_parent].child2 = new_parent;
+    }
+  } else {
+    tree->root = new_parent;
+  }
+
+  bvh_refit_ancestors(tree, nodes[leaf].parent);
+  return true;
+}
+
+static void bvh_remove_leaf(ConXBvh *tree, int leaf) {
+  if (leaf == tree->root) {
+    tree->root = CONX_BVH_NULL;
+    return;
+  }
+
+  ConXBvhNode *nodes = tree->nodes;
+  int parent = nodes[leaf].parent;
+  int grand_parent = nodes[parent].parent;
+  int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+  if (grand_parent != CONX_BVH_NULL) {
+    if (nodes[grand_parent].child1 == parent) {
+      nodes[grand_parent].child1 = sibling;
+    } else {
+      nodes[grand_parent].child2 = sibling;
+    }
+    nodes[sibling].parent = grand_parent;
+    bvh_free_node(tree, parent);
+    bvh_refit_ancestors(tree, grand_parent);
+  } else {
+    tree->root = sibling;
+    nodes[sibling].parent = CONX_BVH_NULL;
+    bvh_free_node(tree, parent);
+  }
+}
+
+// Grow a box by the margin, then stretch it along the expected motion
+static ConXAABB bvh_fatten(const ConXBvh *tree, const ConXAABB *box, Vec3 displacement) {
+  ConXAABB fat;
+  fat.min = vec3_create(box->min.x - tree->margin, box->min.y - tree->margin,
+                        box->min.z - tree->margin);
+  fat.max = vec3_create(box->max.x + tree->margin, box->max.y + tree->margin,
+                        box->max.z + tree->margin);
+
+  Vec3 d = vec3_multiply(displacement, BVH_DISPLACEMENT_MULTIPLIER);
+  if (d.x < 0.0f) fat.min.x += d.x; else fat.max.x += d.x;
+  if (d.y < 0.0f) fat.min.y += d.y; else fat.max.y += d.y;
+  if (d.z < 0.0f) fat.min.z += d.z; else fat.max.z += d.z;
+  return fat;
+}
+
+void conx_bvh_init(ConXBvh *tree, float margin) {
+  memset(tree, 0, sizeof(*tree));
+  tree->root = CONX_BVH_NULL;
+  tree->free_list = CONX_BVH_NULL;
+  tree->margin = margin;
+}
+
+void conx_bvh_free(ConXBvh *tree) {
+  free(tree->nodes);
+  conx_bvh_init(tree, tree->margin);
+}
+
+// Drop every node but keep the storage for the next build
+void conx_bvh_clear(ConXBvh *tree) {
+  for (int i = 0; i < tree->node_capacity; i++) {
+    tree->nodes[i].parent = i + 1 < tree->node_capacity ? i + 1 : CONX_BVH_NULL;
+    tree->nodes[i].height = -1;
+  }
+  tree->free_list = tree->node_capacity > 0 ? 0 : CONX_BVH_NULL;
+  tree->root = CONX_BVH_NULL;
+  tree->node_count = 0;
+}
+
+int conx_bvh_create_proxy(ConXBvh *tree, const ConXAABB *box, Vec3 displacement, int body) {
+  int proxy = bvh_allocate_node(tree);
+  if (proxy == CONX_BVH_NULL) return CONX_BVH_NULL;
+
+  tree->nodes[proxy].box = bvh_fatten(tree, box, displacement);
+  tree->nodes[proxy].body = body;
+
+  if (!bvh_insert_leaf(tree, proxy)) {
+    bvh_free_node(tree, proxy);
+    return CONX_BVH_NULL;
+  }
+  return proxy;
+}
+
+void conx_bvh_destroy_proxy(ConXBvh *tree, int proxy) {
+  bvh_remove_leaf(tree, proxy);
+  bvh_free_node(tree, proxy);
+}
+
+void conx_bvh_remap_bodies(ConXBvh *tree, const int *remap) {
+  for (int i = 0; i < tree->node_capacity; i++) {
+    ConXBvhNode *node = &tree->nodes[i];
+    if (node->height == 0) node->body = remap[node->body];
+  }
+}
+
+bool conx_bvh_move_proxy(ConXBvh *tree, int proxy, const ConXAABB *box, Vec3 displacement) {
+  ConXBvhNode *leaf = &tree->nodes[proxy];
+  if (aabb_contains(&leaf->box, box)) return false;
+
+  ConXAABB fat = bvh_fatten(tree, box, displacement);
+
+  // Small moves stay inside the parent's box, so no ancestor changes
+  if (leaf->parent != CONX_BVH_NULL &&
+      aabb_contains(&tree->nodes[leaf->parent].box, &fat)) {
+    leaf->box = fat;
+    return true;
+  }
+
+  bvh_remove_leaf(tree, proxy);
+  tree->nodes[proxy].box = fat;
+  bvh_insert_leaf(tree, proxy);
+  return true;
+}
+
+void conx_bvh_query(const ConXBvh *tree, const ConXAABB *box,
+                    ConXBvhQueryFn callback, void *context) {
+  if (tree->root == CONX_BVH_NULL) return;
+
+  int stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = tree->root;
+
+  while (top > 0) {
+    const ConXBvhNode *node = &tree->nodes[stack[--top]];
+    if (!conx_aabb_overlap(&node->box, box)) continue;
+
+    if (node->height == 0) {
+      if (!callback(context, node->body)) return;
+    } else if (top + 2 <= BVH_STACK_SIZE) {
+      stack[top++] = node->child1;
+      stack[top++] = node->child2;
+    }
+  }
+}
+
+// Distance along the ray at which it enters box, or INFINITY if it misses
+// within max_distance. Starting inside the box counts as entering at 0.
+static inline float ray_enter_box(const ConXAABB *box, Vec3 origin, Vec3 inv_direction,
+                                  float max_distance) {
+  float t1 = (box->min.x - origin.x) * inv_direction.x;
+  float t2 = (box->max.x - origin.x) * inv_direction.x;
+  float enter = fminf(t1, t2);
+  float leave = fmaxf(t1, t2);
+
+  t1 = (box->min.y - origin.y) * inv_direction.y;
+  t2 = (box->max.y - origin.y) * inv_direction.y;
+  enter = fmaxf(enter, fminf(t1, t2));
+  leave = fminf(leave, fmaxf(t1, t2));
+
+  t1 = (box->min.z - origin.z) * inv_direction.z;
+  t2 = (box->max.z - origin.z) * inv_direction.z;
+  enter = fmaxf(enter, fminf(t1, t2));
+  leave = fminf(leave, fmaxf(t1, t2));
+
+  enter = fmaxf(enter, 0.0f);
+  return enter <= leave && enter <= max_distance ? enter : INFINITY;
+}
+
+float conx_bvh_raycast(const ConXBvh *tree, Vec3 origin, Vec3 direction, float max_distance,
+                       ConXBvhClipFn callback, void *context) {
+  if (tree->root == CONX_BVH_NULL) return max_distance;
+
+  Vec3 inv_direction = vec3_create(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+  int stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = tree->root;
+
+  while (top > 0 && max_distance > 0.0f) {
+    const ConXBvhNode *node = &tree->nodes[stack[--top]];
+    if (ray_enter_box(&node->box, origin, inv_direction, max_distance) == INFINITY) continue;
+
+    if (node->height == 0) {
+      max_distance = callback(context, node->body, max_distance);
+    } else if (top + 2 <= BVH_STACK_SIZE) {
+      stack[top++] = node->child1;
+      stack[top++] = node->child2;
+    }
+  }
+  return max_distance;
+}
+
+static inline float box_distance_squared(const ConXAABB *box, Vec3 point) {
+  float dx = fmaxf(fmaxf(box->min.x - point.x, point.x - box->max.x), 0.0f);
+  float dy = fmaxf(fmaxf(box->min.y - point.y, point.y - box->max.y), 0.0f);
+  float dz = fmaxf(fmaxf(box->min.z - point.z, point.z - box->max.z), 0.0f);
+  return dx * dx + dy * dy + dz * dz;
+}
+
+float conx_bvh_nearest(const ConXBvh *tree, Vec3 point, float max_distance,
+                       ConXBvhClipFn callback, void *context) {
+  if (tree->root == CONX_BVH_NULL) return max_distance;
+
+  int stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = tree->root;
+
+  while (top > 0) {
+    const ConXBvhNode *node = &tree->nodes[stack[--top]];
+    if (box_distance_squared(&node->box, point) > max_distance * max_distance) continue;
+
+    if (node->height == 0) {
+      max_distance = callback(context, node->body, max_distance);
+    } else if (top + 2 <= BVH_STACK_SIZE) {
+      // Nearer child on top, so the bound shrinks before the other is seen
+      int near = node->child1;
+      int far = node->child2;
+      if (box_distance_squared(&tree->nodes[far].box, point) <
+          box_distance_squared(&tree->nodes[near].box, point)) {
+        near = node->child2;
+        far = node->child1;
+      }
+      stack[top++] = far;
+      stack[top++] = near;
+    }
+  }
+  return max_distance;
+}
+
+// Descend two subtrees together, reporting overlapping leaf pairs
+static void bvh_cross_pairs(const ConXBvh *tree_a, int ia, const ConXBvh *tree_b, int ib,
+                            ConXBvhPairFn callback, void *context) {
+  const ConXBvhNode *a = &tree_a->nodes[ia];
+  const ConXBvhNode *b = &tree_b->nodes[ib];
+  if (!conx_aabb_overlap(&a->box, &b->box)) return;
+
+  if (a->height == 0 && b->height == 0) {
+    callback(context, a->body, b->body);
+  } else if (b->height == 0 || (a->height > 0 && aabb_area(&a->box) > aabb_area(&b->box))) {
+    bvh_cross_pairs(tree_a, a->child1, tree_b, ib, callback, context);
+    bvh_cross_pairs(tree_a, a->child2, tree_b, ib, callback, context);
+  } else {
+    bvh_cross_pairs(tree_a, ia, tree_b, b->child1, callback, context);
+    bvh_cross_pairs(tree_a, ia, tree_b, b->child2, callback, context);
+  }
+}
+
+static void bvh_self_pairs(const ConXBvh *tree, int index,
+                           ConXBvhPairFn callback, void *context) {
+  const ConXBvhNode *node = &tree->nodes[index];
+  if (node->height == 0) return;
+
+  bvh_self_pairs(tree, node->child1, callback, context);
+  bvh_self_pairs(tree, node->child2, callback, context);
+  bvh_cross_pairs(tree, node->child1, tree, node->child2, callback, context);
+}
+
+void conx_bvh_query_pairs(const ConXBvh *tree, const ConXBvh *other,
+                          ConXBvhPairFn callback, void *context) {
+  if (tree->root == CONX_BVH_NULL) return;
+
+  // One pass over the tree pair instead of one query per leaf
+  if (!other) {
+    bvh_self_pairs(tree, tree->root, callback, context);
+  } else if (other->root != CONX_BVH_NULL) {
+    bvh_cross_pairs(tree, tree->root, other, other->root, callback, context);
+  }
+}
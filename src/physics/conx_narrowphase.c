@@ -0,0 +1,282 @@
+#include "conx_physics_internal.h"
+#include <math.h>
+#include <string.h>
+
+#if !defined(CONX_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define CONX_SIMD_X86 1
+#include <SDL2/SDL.h>
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CONX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CONX_TARGET_AVX2
+#endif
+#endif
+
+// Pairs gathered into lanes at once, a multiple of the lane width
+#define NARROWPHASE_BLOCK 256
+#define NARROWPHASE_LANES 8
+
+// Sphere pairs in structure-of-arrays form. Lanes hold body indices, and
+// the kernels gather positions straight from the body streams. The sphere
+// is always body s; for sphere/sphere pairs o is the other sphere and
+// radius holds the sum of both radii, for sphere/box pairs o is the box.
+typedef struct {
+  int s[NARROWPHASE_BLOCK], o[NARROWPHASE_BLOCK];
+  float hx[NARROWPHASE_BLOCK], hy[NARROWPHASE_BLOCK], hz[NARROWPHASE_BLOCK];
+  float radius[NARROWPHASE_BLOCK];
+
+  // Kernel output: sphere centre minus closest point, its squared length,
+  // and one hit bit per lane
+  float dx[NARROWPHASE_BLOCK], dy[NARROWPHASE_BLOCK], dz[NARROWPHASE_BLOCK];
+  float d2[NARROWPHASE_BLOCK];
+  unsigned char hits[NARROWPHASE_BLOCK / NARROWPHASE_LANES];
+
+  int pair[NARROWPHASE_BLOCK];
+  bool flip[NARROWPHASE_BLOCK];     // box was body a, normal must point the other way
+  int count;
+} SphereLanes;
+
+static inline Vec3 stream_position(const ConXBodyStreams *s, int body) {
+  return vec3_create(s->position_x[body], s->position_y[body], s->position_z[body]);
+}
+
+static bool check_box_collision(Vec3 pos1, Vec3 half1, Vec3 pos2, Vec3 half2, Vec3 *normal, float *depth) {
+  Vec3 diff = vec3_subtract(pos1, pos2);
+  Vec3 abs_diff = {fabsf(diff.x), fabsf(diff.y), fabsf(diff.z)};
+  Vec3 overlap = vec3_subtract(vec3_add(half1, half2), abs_diff);
+
+  if (overlap.x > 0 && overlap.y > 0 && overlap.z > 0) {
+    // Find axis with minimum overlap
+    if (overlap.x < overlap.y && overlap.x < overlap.z) {
+      *normal = vec3_create(diff.x > 0 ? 1 : -1, 0, 0);
+      *depth = overlap.x;
+    } else if (overlap.y < overlap.z) {
+      *normal = vec3_create(0, diff.y > 0 ? 1 : -1, 0);
+      *depth = overlap.y;
+    } else {
+      *normal = vec3_create(0, 0, diff.z > 0 ? 1 : -1);
+      *depth = overlap.z;
+    }
+    return true;
+  }
+  return false;
+}
+
+// Kernels. Lanes past count are zero-filled and their hit bits ignored.
+// Both versions compute d2 as (dx * dx + dy * dy) + dz * dz without fused
+// multiply-adds, so they agree bit for bit.
+
+static void sphere_sphere_scalar(const ConXBodyStreams *st, SphereLanes *lanes, int count) {
+  for (int i = 0; i < count; i += NARROWPHASE_LANES) {
+    unsigned char bits = 0;
+    for (int l = i; l < i + NARROWPHASE_LANES; l++) {
+      int s = lanes->s[l], o = lanes->o[l];
+      float dx = st->position_x[s] - st->position_x[o];
+      float dy = st->position_y[s] - st->position_y[o];
+      float dz = st->position_z[s] - st->position_z[o];
+      float d2 = dx * dx + dy * dy + dz * dz;
+      lanes->dx[l] = dx;
+      lanes->dy[l] = dy;
+      lanes->dz[l] = dz;
+      lanes->d2[l] = d2;
+      if (d2 < lanes->radius[l] * lanes->radius[l]) bits |= (unsigned char)(1u << (l - i));
+    }
+    lanes->hits[i / NARROWPHASE_LANES] = bits;
+  }
+}
+
+// Sphere centre minus its closest point on the box along one axis
+static inline float box_offset(float sphere, float box, float half) {
+  return sphere - fmaxf(box - half, fminf(sphere, box + half));
+}
+
+static void sphere_box_scalar(const ConXBodyStreams *st, SphereLanes *lanes, int count) {
+  for (int i = 0; i < count; i += NARROWPHASE_LANES) {
+    unsigned char bits = 0;
+    for (int l = i; l < i + NARROWPHASE_LANES; l++) {
+      int s = lanes->s[l], o = lanes->o[l];
+      float dx = box_offset(st->position_x[s], st->position_x[o], lanes->hx[l]);
+      float dy = box_offset(st->position_y[s], st->position_y[o], lanes->hy[l]);
+      float dz = box_offset(st->position_z[s], st->position_z[o], lanes->hz[l]);
+      float d2 = dx * dx + dy * dy + dz * dz;
+      lanes->dx[l] = dx;
+      lanes->dy[l] = dy;
+      lanes->dz[l] = dz;
+      lanes->d2[l] = d2;
+      if (d2 < lanes->radius[l] * lanes->radius[l]) bits |= (unsigned char)(1u << (l - i));
+    }
+    lanes->hits[i / NARROWPHASE_LANES] = bits;
+  }
+}
+
+#ifdef CONX_SIMD_X86
+
+CONX_TARGET_AVX2
+static inline __m256 squared_length_avx2(__m256 dx, __m256 dy, __m256 dz) {
+  return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                       _mm256_mul_ps(dz, dz));
+}
+
+CONX_TARGET_AVX2
+static inline void store_lanes_avx2(SphereLanes *lanes, int i, __m256 dx, __m256 dy, __m256 dz) {
+  __m256 d2 = squared_length_avx2(dx, dy, dz);
+  __m256 r = _mm256_loadu_ps(&lanes->radius[i]);
+  _mm256_storeu_ps(&lanes->dx[i], dx);
+  _mm256_storeu_ps(&lanes->dy[i], dy);
+  _mm256_storeu_ps(&lanes->dz[i], dz);
+  _mm256_storeu_ps(&lanes->d2[i], d2);
+  lanes->hits[i / NARROWPHASE_LANES] =
+      (unsigned char)_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(r, r), _CMP_LT_OQ));
+}
+
+CONX_TARGET_AVX2
+static void sphere_sphere_avx2(const ConXBodyStreams *st, SphereLanes *lanes, int count) {
+  for (int i = 0; i < count; i += NARROWPHASE_LANES) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)&lanes->s[i]);
+    __m256i o = _mm256_loadu_si256((const __m256i *)&lanes->o[i]);
+    __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(st->position_x, s, 4),
+                              _mm256_i32gather_ps(st->position_x, o, 4));
+    __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(st->position_y, s, 4),
+                              _mm256_i32gather_ps(st->position_y, o, 4));
+    __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(st->position_z, s, 4),
+                              _mm256_i32gather_ps(st->position_z, o, 4));
+    store_lanes_avx2(lanes, i, dx, dy, dz);
+  }
+}
+
+// box_offset for eight lanes. max(lo, min(p, hi)) matches
+// fmaxf(lo, fminf(p, hi)) for finite input.
+CONX_TARGET_AVX2
+static inline __m256 box_offset_avx2(const float *position, __m256i s, __m256i o, const float *half,
+                                     int i) {
+  __m256 p = _mm256_i32gather_ps(position, s, 4);
+  __m256 c = _mm256_i32gather_ps(position, o, 4);
+  __m256 h = _mm256_loadu_ps(&half[i]);
+  __m256 closest = _mm256_max_ps(_mm256_sub_ps(c, h), _mm256_min_ps(p, _mm256_add_ps(c, h)));
+  return _mm256_sub_ps(p, closest);
+}
+
+CONX_TARGET_AVX2
+static void sphere_box_avx2(const ConXBodyStreams *st, SphereLanes *lanes, int count) {
+  for (int i = 0; i < count; i += NARROWPHASE_LANES) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)&lanes->s[i]);
+    __m256i o = _mm256_loadu_si256((const __m256i *)&lanes->o[i]);
+    store_lanes_avx2(lanes, i, box_offset_avx2(st->position_x, s, o, lanes->hx, i),
+                     box_offset_avx2(st->position_y, s, o, lanes->hy, i),
+                     box_offset_avx2(st->position_z, s, o, lanes->hz, i));
+  }
+}
+
+#endif
+
+static void sphere_sphere_kernel(const ConXBodyStreams *streams, SphereLanes *lanes, int count) {
+#ifdef CONX_SIMD_X86
+  if (SDL_HasAVX2()) {
+    sphere_sphere_avx2(streams, lanes, count);
+    return;
+  }
+#endif
+  sphere_sphere_scalar(streams, lanes, count);
+}
+
+static void sphere_box_kernel(const ConXBodyStreams *streams, SphereLanes *lanes, int count) {
+#ifdef CONX_SIMD_X86
+  if (SDL_HasAVX2()) {
+    sphere_box_avx2(streams, lanes, count);
+    return;
+  }
+#endif
+  sphere_box_scalar(streams, lanes, count);
+}
+
+// Gathering
+
+static void push_sphere_pair(SphereLanes *lanes, int pair, int sphere, float radius,
+                             int other, Vec3 half_extents, bool flip) {
+  int l = lanes->count++;
+  lanes->s[l] = sphere;
+  lanes->o[l] = other;
+  lanes->hx[l] = half_extents.x;
+  lanes->hy[l] = half_extents.y;
+  lanes->hz[l] = half_extents.z;
+  lanes->radius[l] = radius;
+  lanes->pair[l] = pair;
+  lanes->flip[l] = flip;
+}
+
+// Fill the tail of the last vector with a real body so the kernels never
+// gather from garbage indices
+static int pad_lanes(SphereLanes *lanes) {
+  int padded = (lanes->count + NARROWPHASE_LANES - 1) & ~(NARROWPHASE_LANES - 1);
+  for (int l = lanes->count; l < padded; l++) {
+    lanes->s[l] = lanes->o[l] = lanes->s[0];
+    lanes->hx[l] = lanes->hy[l] = lanes->hz[l] = 0.0f;
+    lanes->radius[l] = 0.0f;
+  }
+  return padded;
+}
+
+// Turn the kernel's hit bits into contacts. Only hits pay for the square
+// root and the normalize.
+static void finish_sphere_lanes(const SphereLanes *lanes, bool is_box, ConXContactResult *contacts) {
+  for (int l = 0; l < lanes->count; l++) {
+    ConXContactResult *contact = &contacts[lanes->pair[l]];
+    contact->hit = (lanes->hits[l / NARROWPHASE_LANES] >> (l % NARROWPHASE_LANES)) & 1;
+    if (!contact->hit) continue;
+
+    Vec3 diff = vec3_create(lanes->dx[l], lanes->dy[l], lanes->dz[l]);
+    float distance = sqrtf(lanes->d2[l]);
+    Vec3 normal = is_box && distance <= 0.0f ? vec3_create(0, 1, 0) : vec3_normalize(diff);
+    contact->normal = lanes->flip[l] ? vec3_multiply(normal, -1.0f) : normal;
+    contact->depth = lanes->radius[l] - distance;
+  }
+}
+
+static void narrowphase_block(const ConXBodyStreams *streams, const ConXCollisionShape *shapes,
+                              const ConXBodyPair *pairs, int begin, int end,
+                              ConXContactResult *contacts) {
+  SphereLanes spheres;
+  SphereLanes boxes;
+  spheres.count = 0;
+  boxes.count = 0;
+  const Vec3 no_extents = vec3_create(0.0f, 0.0f, 0.0f);
+
+  // Bucket by shape pair; box/box is rare and stays scalar
+  for (int p = begin; p < end; p++) {
+    int a = pairs[p].a;
+    int b = pairs[p].b;
+    const ConXCollisionShape *shape_a = &shapes[a];
+    const ConXCollisionShape *shape_b = &shapes[b];
+
+    if (shape_a->type == CONX_SHAPE_SPHERE && shape_b->type == CONX_SHAPE_SPHERE) {
+      push_sphere_pair(&spheres, p, a, shape_a->radius + shape_b->radius, b, no_extents, false);
+    } else if (shape_a->type == CONX_SHAPE_SPHERE) {
+      push_sphere_pair(&boxes, p, a, shape_a->radius, b, shape_b->half_extents, false);
+    } else if (shape_b->type == CONX_SHAPE_SPHERE) {
+      push_sphere_pair(&boxes, p, b, shape_b->radius, a, shape_a->half_extents, true);
+    } else {
+      contacts[p].hit = check_box_collision(stream_position(streams, a), shape_a->half_extents,
+                                            stream_position(streams, b), shape_b->half_extents,
+                                            &contacts[p].normal, &contacts[p].depth);
+    }
+  }
+
+  if (spheres.count > 0) {
+    sphere_sphere_kernel(streams, &spheres, pad_lanes(&spheres));
+    finish_sphere_lanes(&spheres, false, contacts);
+  }
+  if (boxes.count > 0) {
+    sphere_box_kernel(streams, &boxes, pad_lanes(&boxes));
+    finish_sphere_lanes(&boxes, true, contacts);
+  }
+}
+
+void conx_narrowphase(const ConXBodyStreams *streams, const ConXCollisionShape *shapes,
+                      const ConXBodyPair *pairs, int begin, int end, ConXContactResult *contacts) {
+  for (int p = begin; p < end; p += NARROWPHASE_BLOCK) {
+    int block_end = p + NARROWPHASE_BLOCK < end ? p + NARROWPHASE_BLOCK : end;
+    narrowphase_block(streams, shapes, pairs, p, block_end, contacts);
+  }
+}
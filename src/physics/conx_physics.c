@@ -1,241 +1,1103 @@
-#include "conx_physics.h"
+#include "conx_physics_internal.h"
+#include "conx_jobs.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
-static ConXPhysicsWorld physics_world = {0};
+// Candidate pairs per narrowphase job
+#define NARROWPHASE_BATCH_SIZE 256
 
-bool conx_physics_init(int max_bodies) {
-  physics_world.bodies = malloc(sizeof(ConXRigidBody) * max_bodies);
-  physics_world.shapes = malloc(sizeof(ConXCollisionShape) * max_bodies);
+ConXPhysicsConfig conx_physics_config_create(int max_bodies) {
+  ConXPhysicsConfig config;
+  config.max_bodies = max_bodies;
+  config.broadphase = CONX_BROADPHASE_SAP;
+  config.grid_cell_size = 1.0f;
+  config.thread_count = 1;
+  config.allow_sleep = true;
+  config.sleep_velocity = 0.05f;
+  config.sleep_time = 0.5f;
+  config.solver_iterations = 8;
+  return config;
+}
+
+// Streams are allocated with room for whole SIMD lanes past the last body
+static int padded_capacity(int count) {
+  return (count + CONX_PHYSICS_SIMD_WIDTH - 1) & ~(CONX_PHYSICS_SIMD_WIDTH - 1);
+}
+
+static void *alloc_stream(int capacity, size_t element_size) {
+  void *stream = conx_aligned_alloc((size_t)capacity * element_size);
+  if (stream) memset(stream, 0, (size_t)capacity * element_size);
+  return stream;
+}
+
+#define FLOAT_STREAM_COUNT 13
+
+static void float_streams(ConXBodyStreams *streams, float **out[FLOAT_STREAM_COUNT]) {
+  float **all[FLOAT_STREAM_COUNT] = {
+    &streams->position_x, &streams->position_y, &streams->position_z,
+    &streams->previous_x, &streams->previous_y, &streams->previous_z,
+    &streams->velocity_x, &streams->velocity_y, &streams->velocity_z,
+    &streams->acceleration_x, &streams->acceleration_y, &streams->acceleration_z,
+    &streams->mass
+  };
+  memcpy(out, all, sizeof(all));
+}
+
+// Streams need 32-byte alignment, so they are moved by hand rather than
+// with realloc. Returns NULL and leaves the old stream alone on failure.
+static void *grow_stream(void *stream, int old_capacity, int capacity, size_t element_size) {
+  void *grown = alloc_stream(capacity, element_size);
+  if (!grown) return NULL;
+  if (stream) memcpy(grown, stream, element_size * old_capacity);
+  conx_aligned_free(stream);
+  return grown;
+}
+
+static bool grow_streams(ConXBodyStreams *streams, int old_capacity, int capacity) {
+  float **floats[FLOAT_STREAM_COUNT];
+  float_streams(streams, floats);
+
+  for (int i = 0; i < FLOAT_STREAM_COUNT; i++) {
+    float *grown = grow_stream(*floats[i], old_capacity, capacity, sizeof(float));
+    if (!grown) return false;
+    *floats[i] = grown;
+  }
+
+  uint32_t *mask = grow_stream(streams->integrate_mask, old_capacity, capacity, sizeof(uint32_t));
+  if (!mask) return false;
+  streams->integrate_mask = mask;
+  return true;
+}
+
+// Resize every per-body array to hold capacity bodies
+static bool grow_bodies(ConXPhysicsWorld *world, int capacity) {
+  int old_capacity = world->max_bodies;
+  if (!grow_streams(&world->streams, padded_capacity(old_capacity), padded_capacity(capacity)) ||
+      !conx_broadphase_reserve(world->broadphase, capacity)) {
+    return false;
+  }
+
+#define GROW_BODY_ARRAY(array)                                      \
+  do {                                                              \
+    void *grown = realloc(world->array,                      \
+                          sizeof(*world->array) * capacity); \
+    if (!grown) return false;                                       \
+    world->array = grown;                                    \
+  } while (0)
+
+  GROW_BODY_ARRAY(restitution);
+  GROW_BODY_ARRAY(is_static);
+  GROW_BODY_ARRAY(is_sleeping);
+  GROW_BODY_ARRAY(rest_time);
+  GROW_BODY_ARRAY(island_next);
+  GROW_BODY_ARRAY(island_parent);
+  GROW_BODY_ARRAY(island_restless);
+  GROW_BODY_ARRAY(collision_callbacks);
+  GROW_BODY_ARRAY(shapes);
+  GROW_BODY_ARRAY(handles);
+#undef GROW_BODY_ARRAY
+
+  world->max_bodies = capacity;
+  return true;
+}
+
+static void free_streams(ConXBodyStreams *streams) {
+  conx_aligned_free(streams->position_x);
+  conx_aligned_free(streams->position_y);
+  conx_aligned_free(streams->position_z);
+  conx_aligned_free(streams->previous_x);
+  conx_aligned_free(streams->previous_y);
+  conx_aligned_free(streams->previous_z);
+  conx_aligned_free(streams->velocity_x);
+  conx_aligned_free(streams->velocity_y);
+  conx_aligned_free(streams->velocity_z);
+  conx_aligned_free(streams->acceleration_x);
+  conx_aligned_free(streams->acceleration_y);
+  conx_aligned_free(streams->acceleration_z);
+  conx_aligned_free(streams->mass);
+  conx_aligned_free(streams->integrate_mask);
+  memset(streams, 0, sizeof(*streams));
+}
+
+bool conx_world_init(ConXPhysicsWorld *world, const ConXPhysicsConfig *config) {
+  memset(world, 0, sizeof(*world));
+  if (!config || config->max_bodies <= 0) return false;
+  if (config->broadphase == CONX_BROADPHASE_GRID && config->grid_cell_size <= 0.0f) return false;
+
+  world->broadphase = conx_broadphase_create(config);
+  world->solver = calloc(1, sizeof(ConXContactSolver));
+  
+  // A single-threaded world runs the narrowphase inline with no pool
+  bool jobs_ok = true;
+  if (config->thread_count != 1) {
+    world->jobs = conx_job_pool_create(config->thread_count);
+    jobs_ok = world->jobs != NULL;
+  }
   
-  if (!physics_world.bodies || !physics_world.shapes) {
-    conx_physics_shutdown();
+  if (!world->broadphase || !world->solver || !jobs_ok ||
+      !grow_bodies(world, config->max_bodies)) {
+    conx_world_shutdown(world);
     return false;
   }
   
-  physics_world.max_bodies = max_bodies;
-  physics_world.body_count = 0;
-  physics_world.gravity = vec3_create(0.0f, -9.81f, 0.0f);
+  world->body_count = 0;
+  world->free_slot = -1;
+  world->removed_count = 0;
+  world->gravity = vec3_create(0.0f, -9.81f, 0.0f);
+  world->allow_sleep = config->allow_sleep;
+  world->sleep_velocity = config->sleep_velocity;
+  world->sleep_time = config->sleep_time;
+  world->solver_iterations = config->solver_iterations;
   
   return true;
 }
 
-void conx_physics_shutdown(void) {
-  if (physics_world.bodies) {
-    free(physics_world.bodies);
-    physics_world.bodies = NULL;
+void conx_world_shutdown(ConXPhysicsWorld *world) {
+  free_streams(&world->streams);
+  free(world->restitution);
+  world->restitution = NULL;
+  free(world->is_static);
+  world->is_static = NULL;
+  free(world->is_sleeping);
+  world->is_sleeping = NULL;
+  free(world->rest_time);
+  world->rest_time = NULL;
+  free(world->island_next);
+  world->island_next = NULL;
+  free(world->island_parent);
+  world->island_parent = NULL;
+  free(world->island_restless);
+  world->island_restless = NULL;
+  free(world->collision_callbacks);
+  world->collision_callbacks = NULL;
+  if (world->shapes) {
+    free(world->shapes);
+    world->shapes = NULL;
   }
-  if (physics_world.shapes) {
-    free(physics_world.shapes);
-    physics_world.shapes = NULL;
+  free(world->handles);
+  world->handles = NULL;
+  for (int i = 0; i < world->slot_chunk_count; i++) {
+    free(world->slot_chunks[i]);
   }
-  physics_world.body_count = 0;
-  physics_world.max_bodies = 0;
+  free(world->slot_chunks);
+  world->slot_chunks = NULL;
+  world->slot_chunk_count = 0;
+  world->slot_count = 0;
+  world->free_slot = -1;
+  world->removed_count = 0;
+  if (world->broadphase) {
+    conx_broadphase_destroy(world->broadphase);
+    world->broadphase = NULL;
+  }
+  if (world->solver) {
+    conx_solver_free(world->solver);
+    free(world->solver);
+    world->solver = NULL;
+  }
+  conx_job_pool_destroy(world->jobs);
+  world->jobs = NULL;
+  free(world->contacts);
+  world->contacts = NULL;
+  world->contact_capacity = 0;
+  free(world->contact_events);
+  world->contact_events = NULL;
+  world->contact_event_count = 0;
+  world->contact_event_capacity = 0;
+  world->body_count = 0;
+  world->max_bodies = 0;
+}
+
+ConXPhysicsWorld *conx_world_create(const ConXPhysicsConfig *config) {
+  ConXPhysicsWorld *world = malloc(sizeof(ConXPhysicsWorld));
+  if (!world) {
+    printf("Failed to allocate physics world\n");
+    return NULL;
+  }
+  if (!conx_world_init(world, config)) {
+    free(world);
+    return NULL;
+  }
+  return world;
+}
+
+void conx_world_destroy(ConXPhysicsWorld *world) {
+  if (!world) return;
+  conx_world_shutdown(world);
+  free(world);
+}
+
+static inline Vec3 body_position(ConXPhysicsWorld *world, int id) {
+  const ConXBodyStreams *s = &world->streams;
+  return vec3_create(s->position_x[id], s->position_y[id], s->position_z[id]);
+}
+
+static inline Vec3 body_velocity(ConXPhysicsWorld *world, int id) {
+  const ConXBodyStreams *s = &world->streams;
+  return vec3_create(s->velocity_x[id], s->velocity_y[id], s->velocity_z[id]);
+}
+
+static inline void set_body_velocity(ConXPhysicsWorld *world, int id, Vec3 velocity) {
+  ConXBodyStreams *s = &world->streams;
+  s->velocity_x[id] = velocity.x;
+  s->velocity_y[id] = velocity.y;
+  s->velocity_z[id] = velocity.z;
+}
+
+static inline ConXBodySlot *body_slot(ConXPhysicsWorld *world, int slot) {
+  return &world->slot_chunks[slot / CONX_BODY_CHUNK_SIZE][slot % CONX_BODY_CHUNK_SIZE];
 }
 
-void conx_physics_set_gravity(Vec3 gravity) {
-  physics_world.gravity = gravity;
+// Packed index of the body a handle refers to, or -1 if it is stale
+static inline int body_index(ConXPhysicsWorld *world, int handle) {
+  if (handle < 0) return -1;
+
+  int slot = handle & CONX_BODY_INDEX_MASK;
+  if (slot >= world->slot_count) return -1;
+  const ConXBodySlot *entry = body_slot(world, slot);
+  return entry->generation == handle >> CONX_BODY_INDEX_BITS ? entry->index : -1;
 }
 
-int conx_physics_create_body(Vec3 position, float mass) {
-  if (physics_world.body_count >= physics_world.max_bodies) {
-    return -1;
+// Add slot chunks until slot_count slots fit
+static bool reserve_slots(ConXPhysicsWorld *world, int slot_count) {
+  while (slot_count > world->slot_chunk_count * CONX_BODY_CHUNK_SIZE) {
+    ConXBodySlot **chunks = realloc(world->slot_chunks,
+                                    sizeof(ConXBodySlot *) * (world->slot_chunk_count + 1));
+    if (!chunks) return false;
+    world->slot_chunks = chunks;
+
+    ConXBodySlot *chunk = calloc(CONX_BODY_CHUNK_SIZE, sizeof(ConXBodySlot));
+    if (!chunk) return false;
+    chunks[world->slot_chunk_count++] = chunk;
   }
+  return true;
+}
+
+// Reuse a freed slot, or take the next one, adding a chunk when full
+static int allocate_slot(ConXPhysicsWorld *world) {
+  if (world->free_slot >= 0) {
+    int slot = world->free_slot;
+    world->free_slot = body_slot(world, slot)->next_free;
+    return slot;
+  }
+
+  if (world->slot_count > CONX_BODY_INDEX_MASK) return -1;
+  if (!reserve_slots(world, world->slot_count + 1)) return -1;
+  return world->slot_count++;
+}
+
+// Refresh the broadphase box of one body from its position and shape
+static void update_body_bounds(ConXPhysicsWorld *world, int id) {
+  ConXBroadphase *broadphase = world->broadphase;
+  ConXCollisionShape *shape = &world->shapes[id];
+  Vec3 position = body_position(world, id);
+  Vec3 extents = shape->type == CONX_SHAPE_SPHERE
+                     ? vec3_create(shape->radius, shape->radius, shape->radius)
+                     : shape->half_extents;
+
+  broadphase->aabbs[id].min = vec3_subtract(position, extents);
+  broadphase->aabbs[id].max = vec3_add(position, extents);
+  broadphase->is_static[id] = world->is_static[id] || world->is_sleeping[id];
+}
+
+// Bounds changed outside the step, e.g. static geometry was moved
+static void touch_body(ConXPhysicsWorld *world, int id) {
+  update_body_bounds(world, id);
+  conx_broadphase_touch(world->broadphase, id);
+}
+
+// Wake every body in the sleeping island that contains id
+static void wake_island(ConXPhysicsWorld *world, int id) {
+  if (!world->is_sleeping[id]) return;
+
+  int body = id;
+  do {
+    int next = world->island_next[body];
+    world->is_sleeping[body] = false;
+    world->rest_time[body] = 0.0f;
+    world->streams.integrate_mask[body] = 0xFFFFFFFFu;
+    touch_body(world, body);
+    body = next;
+  } while (body != id);
+}
+
+static void sleep_body(ConXPhysicsWorld *world, int id) {
+  world->is_sleeping[id] = true;
+  world->streams.integrate_mask[id] = 0u;
+  set_body_velocity(world, id, vec3_create(0.0f, 0.0f, 0.0f));
+  touch_body(world, id);
+}
+
+void conx_world_set_gravity(ConXPhysicsWorld *world, Vec3 gravity) {
+  world->gravity = gravity;
+
+  // Resting under the old gravity says nothing about the new one
+  for (int i = 0; i < world->body_count; i++) {
+    wake_island(world, i);
+  }
+}
+
+int conx_world_create_body(ConXPhysicsWorld *world, Vec3 position, float mass) {
+  if (world->max_bodies <= 0) return -1;
+
+  // Grow by whole chunks, at least doubling
+  if (world->body_count >= world->max_bodies) {
+    int capacity = world->max_bodies * 2;
+    capacity = (capacity + CONX_BODY_CHUNK_SIZE - 1) / CONX_BODY_CHUNK_SIZE * CONX_BODY_CHUNK_SIZE;
+    if (!grow_bodies(world, capacity)) {
+      printf("Failed to grow physics world to %d bodies\n", capacity);
+      return -1;
+    }
+  }
+
+  int slot = allocate_slot(world);
+  if (slot < 0) return -1;
+
+  int id = world->body_count++;
+  ConXBodySlot *entry = body_slot(world, slot);
+  entry->index = id;
+  int handle = (entry->generation << CONX_BODY_INDEX_BITS) | slot;
+  world->handles[id] = handle;
+  ConXBodyStreams *s = &world->streams;
   
-  int id = physics_world.body_count++;
-  ConXRigidBody *body = &physics_world.bodies[id];
-  
-  body->position = position;
-  body->velocity = vec3_create(0.0f, 0.0f, 0.0f);
-  body->acceleration = vec3_create(0.0f, 0.0f, 0.0f);
-  body->mass = mass;
-  body->restitution = 0.5f;
-  body->is_static = false;
-  body->collision_callback = NULL;
+  s->position_x[id] = position.x;
+  s->position_y[id] = position.y;
+  s->position_z[id] = position.z;
+  s->previous_x[id] = position.x;
+  s->previous_y[id] = position.y;
+  s->previous_z[id] = position.z;
+  s->velocity_x[id] = s->velocity_y[id] = s->velocity_z[id] = 0.0f;
+  s->acceleration_x[id] = s->acceleration_y[id] = s->acceleration_z[id] = 0.0f;
+  s->mass[id] = mass;
+  s->integrate_mask[id] = 0xFFFFFFFFu;
+  world->restitution[id] = 0.5f;
+  world->is_static[id] = false;
+  world->is_sleeping[id] = false;
+  world->rest_time[id] = 0.0f;
+  world->collision_callbacks[id] = NULL;
   
   // Initialize shape as sphere with radius 0.5
-  physics_world.shapes[id].type = CONX_SHAPE_SPHERE;
-  physics_world.shapes[id].radius = 0.5f;
+  world->shapes[id].type = CONX_SHAPE_SPHERE;
+  world->shapes[id].radius = 0.5f;
+  update_body_bounds(world, id);
   
-  return id;
+  return handle;
 }
 
-void conx_physics_set_body_velocity(int body_id, Vec3 velocity) {
-  if (body_id >= 0 && body_id < physics_world.body_count) {
-    physics_world.bodies[body_id].velocity = velocity;
+void conx_world_destroy_body(ConXPhysicsWorld *world, int body_id) {
+  int id = body_index(world, body_id);
+  if (id < 0) return;
+
+  // Bodies resting on it must not stay asleep in mid-air
+  wake_island(world, id);
+
+  int slot = body_id & CONX_BODY_INDEX_MASK;
+  ConXBodySlot *entry = body_slot(world, slot);
+  entry->index = -1;
+  entry->generation = (entry->generation + 1) & CONX_BODY_GENERATION_MASK;
+  entry->next_free = world->free_slot;
+  world->free_slot = slot;
+
+  // Inert until the next step compacts it away
+  world->handles[id] = -1;
+  world->streams.integrate_mask[id] = 0u;
+  if (world->removed_count == 0 || id < world->first_removed) {
+    world->first_removed = id;
   }
+  world->removed_count++;
+}
+
+bool conx_world_is_body_valid(ConXPhysicsWorld *world, int body_id) {
+  return body_index(world, body_id) >= 0;
 }
 
-void conx_physics_set_body_static(int body_id, bool is_static) {
-  if (body_id >= 0 && body_id < physics_world.body_count) {
-    physics_world.bodies[body_id].is_static = is_static;
+void conx_world_set_body_position(ConXPhysicsWorld *world, int body_id, Vec3 position) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    wake_island(world, id);
+    ConXBodyStreams *s = &world->streams;
+    s->position_x[id] = position.x;
+    s->position_y[id] = position.y;
+    s->position_z[id] = position.z;
+
+    // Teleport, nothing to blend from
+    s->previous_x[id] = position.x;
+    s->previous_y[id] = position.y;
+    s->previous_z[id] = position.z;
+    touch_body(world, id);
   }
 }
 
-void conx_physics_add_sphere_shape(int body_id, float radius) {
-  if (body_id >= 0 && body_id < physics_world.body_count) {
-    physics_world.shapes[body_id].type = CONX_SHAPE_SPHERE;
-    physics_world.shapes[body_id].radius = radius;
+void conx_world_set_body_velocity(ConXPhysicsWorld *world, int body_id, Vec3 velocity) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    wake_island(world, id);
+    set_body_velocity(world, id, velocity);
   }
 }
 
-void conx_physics_add_box_shape(int body_id, Vec3 half_extents) {
-  if (body_id >= 0 && body_id < physics_world.body_count) {
-    physics_world.shapes[body_id].type = CONX_SHAPE_BOX;
-    physics_world.shapes[body_id].half_extents = half_extents;
+void conx_world_set_body_static(ConXPhysicsWorld *world, int body_id, bool is_static) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    wake_island(world, id);
+    ConXBodyStreams *s = &world->streams;
+    world->is_static[id] = is_static;
+    world->rest_time[id] = 0.0f;
+    s->integrate_mask[id] = is_static ? 0u : 0xFFFFFFFFu;
+    s->acceleration_x[id] = s->acceleration_y[id] = s->acceleration_z[id] = 0.0f;
+    touch_body(world, id);
   }
 }
 
-ConXRigidBody* conx_physics_get_body(int body_id) {
-  if (body_id >= 0 && body_id < physics_world.body_count) {
-    return &physics_world.bodies[body_id];
+void conx_world_set_body_restitution(ConXPhysicsWorld *world, int body_id, float restitution) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    world->restitution[id] = restitution;
   }
-  return NULL;
 }
 
-ConXPhysicsWorld* conx_physics_get_world(void) {
-  return &physics_world;
+void conx_world_apply_force(ConXPhysicsWorld *world, int body_id, Vec3 force) {
+  int id = body_index(world, body_id);
+  if (id >= 0 && !world->is_static[id] &&
+      world->streams.mass[id] > 0.0f) {
+    wake_island(world, id);
+    ConXBodyStreams *s = &world->streams;
+    float inv_mass = 1.0f / s->mass[id];
+    s->acceleration_x[id] += force.x * inv_mass;
+    s->acceleration_y[id] += force.y * inv_mass;
+    s->acceleration_z[id] += force.z * inv_mass;
+  }
 }
 
-void conx_physics_set_collision_callback(int body_id, ConXCollisionCallback callback) {
-  if (body_id >= 0 && body_id < physics_world.body_count) {
-    physics_world.bodies[body_id].collision_callback = callback;
+void conx_world_add_sphere_shape(ConXPhysicsWorld *world, int body_id, float radius) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    wake_island(world, id);
+    world->shapes[id].type = CONX_SHAPE_SPHERE;
+    world->shapes[id].radius = radius;
+    touch_body(world, id);
   }
 }
 
-static bool check_sphere_collision(Vec3 pos1, float r1, Vec3 pos2, float r2, Vec3 *normal) {
-  Vec3 diff = vec3_subtract(pos1, pos2);
-  float distance = vec3_length(diff);
-  if (distance < (r1 + r2)) {
-    *normal = vec3_normalize(diff);
-    return true;
+void conx_world_add_box_shape(ConXPhysicsWorld *world, int body_id, Vec3 half_extents) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    wake_island(world, id);
+    world->shapes[id].type = CONX_SHAPE_BOX;
+    world->shapes[id].half_extents = half_extents;
+    touch_body(world, id);
   }
-  return false;
 }
 
-static bool check_sphere_box_collision(Vec3 sphere_pos, float radius, Vec3 box_pos, Vec3 half_extents, Vec3 *normal) {
-  Vec3 closest = {
-    fmaxf(box_pos.x - half_extents.x, fminf(sphere_pos.x, box_pos.x + half_extents.x)),
-    fmaxf(box_pos.y - half_extents.y, fminf(sphere_pos.y, box_pos.y + half_extents.y)),
-    fmaxf(box_pos.z - half_extents.z, fminf(sphere_pos.z, box_pos.z + half_extents.z))
-  };
-  
-  Vec3 diff = vec3_subtract(sphere_pos, closest);
-  float distance = vec3_length(diff);
-  
-  if (distance < radius) {
-    *normal = distance > 0 ? vec3_normalize(diff) : vec3_create(0, 1, 0);
-    return true;
+Vec3 conx_world_get_interpolated_position(ConXPhysicsWorld *world, int body_id, float alpha) {
+  int id = body_index(world, body_id);
+  if (id < 0) return vec3_create(0.0f, 0.0f, 0.0f);
+
+  const ConXBodyStreams *s = &world->streams;
+  Vec3 previous = vec3_create(s->previous_x[id], s->previous_y[id], s->previous_z[id]);
+  return vec3_lerp(previous, body_position(world, id), alpha);
+}
+
+const ConXRigidBody* conx_world_get_body(ConXPhysicsWorld *world, int body_id) {
+  int id = body_index(world, body_id);
+  if (id < 0) return NULL;
+
+  const ConXBodyStreams *s = &world->streams;
+  ConXRigidBody *view = &world->body_view;
+  view->position = body_position(world, id);
+  view->velocity = body_velocity(world, id);
+  view->acceleration = vec3_create(s->acceleration_x[id], s->acceleration_y[id],
+                                   s->acceleration_z[id]);
+  view->mass = s->mass[id];
+  view->restitution = world->restitution[id];
+  view->is_static = world->is_static[id];
+  view->is_sleeping = world->is_sleeping[id];
+  view->collision_callback = world->collision_callbacks[id];
+  return view;
+}
+
+bool conx_world_is_body_sleeping(ConXPhysicsWorld *world, int body_id) {
+  int id = body_index(world, body_id);
+  return id >= 0 && world->is_sleeping[id];
+}
+
+void conx_world_wake_body(ConXPhysicsWorld *world, int body_id) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    wake_island(world, id);
   }
-  return false;
 }
 
-static bool check_box_collision(Vec3 pos1, Vec3 half1, Vec3 pos2, Vec3 half2, Vec3 *normal) {
-  Vec3 diff = vec3_subtract(pos1, pos2);
-  Vec3 abs_diff = {fabsf(diff.x), fabsf(diff.y), fabsf(diff.z)};
-  Vec3 overlap = vec3_subtract(vec3_add(half1, half2), abs_diff);
-  
-  if (overlap.x > 0 && overlap.y > 0 && overlap.z > 0) {
-    // Find axis with minimum overlap
-    if (overlap.x < overlap.y && overlap.x < overlap.z) {
-      *normal = vec3_create(diff.x > 0 ? 1 : -1, 0, 0);
-    } else if (overlap.y < overlap.z) {
-      *normal = vec3_create(0, diff.y > 0 ? 1 : -1, 0);
-    } else {
-      *normal = vec3_create(0, 0, diff.z > 0 ? 1 : -1);
+void conx_world_set_collision_callback(ConXPhysicsWorld *world, int body_id,
+                                       ConXCollisionCallback callback) {
+  int id = body_index(world, body_id);
+  if (id >= 0) {
+    world->collision_callbacks[id] = callback;
+  }
+}
+
+int conx_world_query_aabb(ConXPhysicsWorld *world, Vec3 min, Vec3 max, int *body_ids, int max_results) {
+  if (!world->broadphase || !body_ids) return 0;
+
+  ConXAABB box = {min, max};
+  int count = conx_broadphase_query(world->broadphase, world->body_count,
+                                    &box, body_ids, max_results);
+
+  // Report handles, skipping bodies destroyed since the last step
+  int kept = 0;
+  for (int i = 0; i < count; i++) {
+    int handle = world->handles[body_ids[i]];
+    if (handle >= 0) body_ids[kept++] = handle;
+  }
+  return kept;
+}
+
+static void narrowphase_batch(void *context, int begin, int end) {
+  ConXPhysicsWorld *world = context;
+  conx_narrowphase(&world->streams, world->shapes, world->broadphase->pairs.pairs,
+                   begin, end, world->contacts);
+}
+
+static bool reserve_contacts(ConXPhysicsWorld *world, int count) {
+  if (count <= world->contact_capacity) return true;
+
+  int capacity = world->contact_capacity ? world->contact_capacity : 256;
+  while (capacity < count) capacity *= 2;
+
+  ConXContactResult *contacts = realloc(world->contacts, sizeof(ConXContactResult) * capacity);
+  if (!contacts) return false;
+  world->contacts = contacts;
+  world->contact_capacity = capacity;
+  return true;
+}
+
+static int island_find(int *parent, int id) {
+  while (parent[id] != id) {
+    parent[id] = parent[parent[id]];
+    id = parent[id];
+  }
+  return id;
+}
+
+// Group awake bodies into islands through this step's contacts and put to
+// sleep every island whose bodies have all rested long enough
+static void update_islands(ConXPhysicsWorld *world, const ConXBodyPair *pairs, int pair_count,
+                           float dt) {
+  const ConXBodyStreams *s = &world->streams;
+  const bool *is_static = world->is_static;
+  bool *is_sleeping = world->is_sleeping;
+  int *parent = world->island_parent;
+  int *next = world->island_next;
+  unsigned char *restless = world->island_restless;
+  float sleep_speed_sq = world->sleep_velocity * world->sleep_velocity;
+
+  for (int i = 0; i < world->body_count; i++) {
+    if (is_static[i] || is_sleeping[i]) continue;
+    parent[i] = i;
+    next[i] = i;
+    restless[i] = 0;
+
+    float speed_sq = s->velocity_x[i] * s->velocity_x[i] + s->velocity_y[i] * s->velocity_y[i] +
+                     s->velocity_z[i] * s->velocity_z[i];
+    world->rest_time[i] = speed_sq < sleep_speed_sq ? world->rest_time[i] + dt : 0.0f;
+  }
+
+  // Static bodies touch everything resting on them, so they never join
+  // islands together. The lower id becomes the root.
+  for (int p = 0; p < pair_count; p++) {
+    if (!world->contacts[p].hit) continue;
+    int a = pairs[p].a;
+    int b = pairs[p].b;
+    if (is_static[a] || is_static[b]) continue;
+
+    int root_a = island_find(parent, a);
+    int root_b = island_find(parent, b);
+    if (root_a < root_b) {
+      parent[root_b] = root_a;
+    } else if (root_b < root_a) {
+      parent[root_a] = root_b;
+    }
+  }
+
+  for (int i = 0; i < world->body_count; i++) {
+    if (is_static[i] || is_sleeping[i]) continue;
+    if (world->rest_time[i] < world->sleep_time) {
+      restless[island_find(parent, i)] = 1;
+    }
+  }
+
+  // Link each sleeping island into a ring through its root so that waking
+  // any body wakes the rest
+  for (int i = 0; i < world->body_count; i++) {
+    if (is_static[i] || is_sleeping[i]) continue;
+    int root = island_find(parent, i);
+    if (restless[root]) continue;
+
+    if (i != root) {
+      next[i] = next[root];
+      next[root] = i;
     }
-    return true;
+    sleep_body(world, i);
   }
-  return false;
 }
 
-static void resolve_collision(ConXRigidBody *body1, ConXRigidBody *body2, Vec3 normal) {
-  if (body1->is_static && body2->is_static) return;
-  
-  Vec3 relative_velocity = vec3_subtract(body1->velocity, body2->velocity);
-  float velocity_along_normal = vec3_dot(relative_velocity, normal);
-  
-  if (velocity_along_normal > 0) return;
-  
-  float restitution = (body1->restitution + body2->restitution) * 0.5f;
-  float impulse_scalar = -(1 + restitution) * velocity_along_normal;
-  
-  if (!body1->is_static && !body2->is_static) {
-    impulse_scalar /= (1.0f / body1->mass + 1.0f / body2->mass);
-  } else if (body1->is_static) {
-    impulse_scalar /= (1.0f / body2->mass);
-  } else {
-    impulse_scalar /= (1.0f / body1->mass);
+// Find and solve contacts at the current positions
+static void solve_contacts(ConXPhysicsWorld *world, float dt) {
+  ConXBroadphase *broadphase = world->broadphase;
+  world->contact_event_count = 0;
+
+  // Broadphase: collect pairs whose boxes overlap. Static bodies keep the
+  // bounds they were given when last changed through the API.
+  conx_broadphase_update(broadphase, world->body_count);
+
+  // Narrowphase: test candidate pairs in parallel batches, one result
+  // slot per pair
+  const ConXBodyPair *pairs = broadphase->pairs.pairs;
+  int pair_count = broadphase->pairs.count;
+  if (!reserve_contacts(world, pair_count)) {
+    // No new contacts this step, so last step's manifolds keep holding
+    // bodies apart; with nothing new to compare, no events are reported
+    printf("Failed to allocate %d contact results\n", pair_count);
+    conx_solver_solve(world->solver, &world->streams, world->body_count, world->is_static,
+                      world->restitution, world->solver_iterations, dt);
+    return;
   }
-  
-  Vec3 impulse = vec3_multiply(normal, impulse_scalar);
-  
-  if (!body1->is_static) {
-    body1->velocity = vec3_add(body1->velocity, vec3_multiply(impulse, 1.0f / body1->mass));
-  }
-  if (!body2->is_static) {
-    body2->velocity = vec3_subtract(body2->velocity, vec3_multiply(impulse, 1.0f / body2->mass));
-  }
-}
-
-void conx_physics_update(float dt) {
-  // Apply gravity and integrate
-  for (int i = 0; i < physics_world.body_count; i++) {
-    ConXRigidBody *body = &physics_world.bodies[i];
-    
-    if (body->is_static) continue;
-    
-    // Apply gravity
-    body->acceleration = vec3_add(body->acceleration, physics_world.gravity);
-    
-    // Integrate velocity
-    body->velocity = vec3_add(body->velocity, vec3_multiply(body->acceleration, dt));
-    
-    // Integrate position
-    body->position = vec3_add(body->position, vec3_multiply(body->velocity, dt));
-    
-    // Reset acceleration
-    body->acceleration = vec3_create(0.0f, 0.0f, 0.0f);
+  conx_job_pool_parallel_for(world->jobs, pair_count, NARROWPHASE_BATCH_SIZE,
+                             narrowphase_batch, world);
+
+  // Manifolds are built on this thread in sorted pair order, so results
+  // do not depend on thread count. Sleep states must still be the ones the
+  // broadphase saw, so islands are woken afterwards.
+  ConXContactSolver *solver = world->solver;
+  conx_solver_begin(solver, world->is_static, world->is_sleeping);
+  for (int p = 0; p < pair_count; p++) {
+    if (!world->contacts[p].hit) continue;
+    conx_solver_add_contact(solver, pairs[p].a, pairs[p].b,
+                            world->contacts[p].normal, world->contacts[p].depth);
   }
-  
-  // Check collisions
-  for (int i = 0; i < physics_world.body_count; i++) {
-    for (int j = i + 1; j < physics_world.body_count; j++) {
-      ConXRigidBody *body1 = &physics_world.bodies[i];
-      ConXRigidBody *body2 = &physics_world.bodies[j];
-      ConXCollisionShape *shape1 = &physics_world.shapes[i];
-      ConXCollisionShape *shape2 = &physics_world.shapes[j];
-      
-      Vec3 normal;
-      bool collision = false;
-      
-      if (shape1->type == CONX_SHAPE_SPHERE && shape2->type == CONX_SHAPE_SPHERE) {
-        collision = check_sphere_collision(body1->position, shape1->radius, 
-                                         body2->position, shape2->radius, &normal);
-      } else if (shape1->type == CONX_SHAPE_SPHERE && shape2->type == CONX_SHAPE_BOX) {
-        collision = check_sphere_box_collision(body1->position, shape1->radius,
-                                             body2->position, shape2->half_extents, &normal);
-      } else if (shape1->type == CONX_SHAPE_BOX && shape2->type == CONX_SHAPE_SPHERE) {
-        collision = check_sphere_box_collision(body2->position, shape2->radius,
-                                             body1->position, shape1->half_extents, &normal);
-        normal = vec3_multiply(normal, -1.0f);
-      } else if (shape1->type == CONX_SHAPE_BOX && shape2->type == CONX_SHAPE_BOX) {
-        collision = check_box_collision(body1->position, shape1->half_extents,
-                                      body2->position, shape2->half_extents, &normal);
-      }
-      
-      if (collision) {
-        // Call collision callbacks
-        if (body1->collision_callback) {
-          body1->collision_callback(i, j, normal);
-        }
-        if (body2->collision_callback) {
-          body2->collision_callback(j, i, vec3_multiply(normal, -1.0f));
-        }
-        
-        resolve_collision(body1, body2, normal);
-      }
+  conx_solver_end(solver);
+
+  // An awake body ran into a sleeping one. The woken island's contacts
+  // were carried as dormant and must hold it up from this step on.
+  for (int p = 0; p < pair_count; p++) {
+    if (!world->contacts[p].hit) continue;
+    wake_island(world, pairs[p].a);
+    wake_island(world, pairs[p].b);
+  }
+  conx_solver_wake_dormant(solver);
+
+  conx_solver_solve(solver, &world->streams, world->body_count, world->is_static,
+                    world->restitution, world->solver_iterations, dt);
+
+  if (!conx_solver_build_events(solver, &world->contact_events,
+                                &world->contact_event_count,
+                                &world->contact_event_capacity)) {
+    printf("Failed to allocate contact events\n");
+  }
+  for (int e = 0; e < world->contact_event_count; e++) {
+    ConXContactEvent *event = &world->contact_events[e];
+    event->body1_id = world->handles[event->body1_id];
+    event->body2_id = world->handles[event->body2_id];
+  }
+}
+
+// Legacy per-body callbacks, fed from the event buffer
+static void dispatch_callbacks(ConXPhysicsWorld *world) {
+  for (int e = 0; e < world->contact_event_count; e++) {
+    const ConXContactEvent *event = &world->contact_events[e];
+    if (event->state == CONX_CONTACT_END) continue;
+
+    // Earlier callbacks may have destroyed either body
+    int i = body_index(world, event->body1_id);
+    ConXCollisionCallback callback1 = i >= 0 ? world->collision_callbacks[i] : NULL;
+    if (callback1) {
+      callback1(event->body1_id, event->body2_id, event->normal);
+    }
+    int j = body_index(world, event->body2_id);
+    ConXCollisionCallback callback2 = j >= 0 ? world->collision_callbacks[j] : NULL;
+    if (callback2) {
+      callback2(event->body2_id, event->body1_id, vec3_multiply(event->normal, -1.0f));
+    }
+  }
+}
+
+const ConXContactEvent *conx_world_get_contact_events(ConXPhysicsWorld *world, int *count) {
+  if (count) *count = world->contact_event_count;
+  return world->contact_events;
+}
+
+static void move_body(ConXPhysicsWorld *world, int from, int to) {
+  ConXBodyStreams *s = &world->streams;
+  float **floats[FLOAT_STREAM_COUNT];
+  float_streams(s, floats);
+  for (int k = 0; k < FLOAT_STREAM_COUNT; k++) {
+    (*floats[k])[to] = (*floats[k])[from];
+  }
+  s->integrate_mask[to] = s->integrate_mask[from];
+
+  world->restitution[to] = world->restitution[from];
+  world->is_static[to] = world->is_static[from];
+  world->is_sleeping[to] = world->is_sleeping[from];
+  world->rest_time[to] = world->rest_time[from];
+  world->island_next[to] = world->island_next[from];
+  world->collision_callbacks[to] = world->collision_callbacks[from];
+  world->shapes[to] = world->shapes[from];
+  world->handles[to] = world->handles[from];
+}
+
+// Close the gaps left by destroyed bodies. Survivors keep their order, so
+// sorted pair lists and manifolds stay sorted after renumbering.
+static void compact_bodies(ConXPhysicsWorld *world) {
+  int old_count = world->body_count;
+  int first = world->first_removed;
+  int *handles = world->handles;
+  // Island scratch is free between steps
+  int *remap = world->island_parent;
+
+  // Wake whatever was touching a removed body last step
+  const ConXContactSolver *solver = world->solver;
+  for (int i = 0; i < solver->count; i++) {
+    int a = solver->manifolds[i].a;
+    int b = solver->manifolds[i].b;
+    if (handles[a] < 0 && handles[b] >= 0) wake_island(world, b);
+    if (handles[b] < 0 && handles[a] >= 0) wake_island(world, a);
+  }
+
+  for (int i = 0; i < first; i++) {
+    remap[i] = i;
+  }
+  int count = first;
+  for (int i = first; i < old_count; i++) {
+    if (handles[i] < 0) {
+      remap[i] = -1;
+      continue;
+    }
+    remap[i] = count;
+    move_body(world, i, count);
+    body_slot(world, handles[count] & CONX_BODY_INDEX_MASK)->index = count;
+    count++;
+  }
+
+  // Sleeping islands are rings of indices
+  for (int i = 0; i < count; i++) {
+    if (world->is_sleeping[i]) {
+      world->island_next[i] = remap[world->island_next[i]];
+    }
+  }
+
+  // Padding lanes past the last body must read as zero and masked out
+  ConXBodyStreams *s = &world->streams;
+  float **floats[FLOAT_STREAM_COUNT];
+  float_streams(s, floats);
+  int vacated = old_count - count;
+  for (int k = 0; k < FLOAT_STREAM_COUNT; k++) {
+    memset(*floats[k] + count, 0, sizeof(float) * vacated);
+  }
+  memset(s->integrate_mask + count, 0, sizeof(uint32_t) * vacated);
+
+  conx_broadphase_compact(world->broadphase, remap, old_count);
+  conx_solver_compact(world->solver, remap);
+  world->body_count = count;
+  world->removed_count = 0;
+}
+
+void conx_world_update(ConXPhysicsWorld *world, float dt) {
+  ConXBodyStreams *s = &world->streams;
+  ConXBroadphase *broadphase = world->broadphase;
+
+  if (world->removed_count > 0) {
+    compact_bodies(world);
+  }
+
+  // Keep this step's starting positions for render interpolation
+  size_t stream_bytes = sizeof(float) * padded_capacity(world->body_count);
+  memcpy(s->previous_x, s->position_x, stream_bytes);
+  memcpy(s->previous_y, s->position_y, stream_bytes);
+  memcpy(s->previous_z, s->position_z, stream_bytes);
+
+  // Apply gravity and forces, several bodies per instruction
+  conx_integrate_velocities(s, world->body_count, world->gravity, dt);
+
+  for (int i = 0; i < world->body_count; i++) {
+    if (world->is_static[i] || world->is_sleeping[i]) continue;
+    update_body_bounds(world, i);
+    broadphase->motion[i] = vec3_create(s->velocity_x[i] * dt, s->velocity_y[i] * dt,
+                                        s->velocity_z[i] * dt);
+  }
+
+  solve_contacts(world, dt);
+
+  // Move with the solved velocities
+  conx_integrate_positions(s, world->body_count, dt);
+
+  // Queries between steps see the boxes at the new positions. The motion
+  // is the whole step's displacement, including the solver's push.
+  for (int i = 0; i < world->body_count; i++) {
+    if (world->is_static[i] || world->is_sleeping[i]) continue;
+    update_body_bounds(world, i);
+    broadphase->motion[i] = vec3_create(s->position_x[i] - s->previous_x[i],
+                                        s->position_y[i] - s->previous_y[i],
+                                        s->position_z[i] - s->previous_z[i]);
+  }
+  broadphase->trees_stale = true;
+
+  if (world->allow_sleep) {
+    update_islands(world, broadphase->pairs.pairs, broadphase->pairs.count, dt);
+  }
+
+  dispatch_callbacks(world);
+}
+
+typedef struct {
+  ConXPhysicsWorld *const *worlds;
+  float dt;
+  bool inline_narrowphase;
+} StepWorldsJob;
+
+static void step_worlds_batch(void *context, int begin, int end) {
+  const StepWorldsJob *job = context;
+  for (int i = begin; i < end; i++) {
+    ConXPhysicsWorld *world = job->worlds[i];
+    // The stepping pool already has every thread busy; the world's own
+    // workers would only compete with it
+    struct ConXJobPool *own_jobs = world->jobs;
+    if (job->inline_narrowphase) world->jobs = NULL;
+    conx_world_update(world, job->dt);
+    world->jobs = own_jobs;
+  }
+}
+
+void conx_physics_step_worlds(ConXPhysicsWorld *const *worlds, int count, float dt,
+                              struct ConXJobPool *jobs) {
+  if (!worlds || count <= 0) return;
+
+  // One world per batch; worlds share nothing, so any split gives the same
+  // results as stepping them one after another
+  StepWorldsJob job = {worlds, dt, jobs != NULL};
+  conx_job_pool_parallel_for(jobs, count, 1, step_worlds_batch, &job);
+}
+
+// Snapshots
+
+#define SNAPSHOT_MAGIC 0x50534E43u   // "CNSP"
+#define SNAPSHOT_VERSION 1u
+#define SNAPSHOT_BODY_SECTIONS (FLOAT_STREAM_COUNT + 9)
+
+// Fixed-size header; every section after it starts on an 8-byte boundary
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+  int32_t body_count;
+  int32_t slot_count;
+  int32_t free_slot;
+  int32_t removed_count;
+  int32_t first_removed;
+  int32_t manifold_count;
+  Vec3 gravity;
+  uint32_t reserved;
+} SnapshotHeader;
+
+typedef struct {
+  void *data;
+  size_t element_size;
+} SnapshotSection;
+
+// Per-body arrays in snapshot order. Pointers are taken after any growth.
+static void body_sections(ConXPhysicsWorld *world, SnapshotSection sections[SNAPSHOT_BODY_SECTIONS]) {
+  float **floats[FLOAT_STREAM_COUNT];
+  float_streams(&world->streams, floats);
+
+  int n = 0;
+  for (int k = 0; k < FLOAT_STREAM_COUNT; k++) {
+    sections[n++] = (SnapshotSection){*floats[k], sizeof(float)};
+  }
+  sections[n++] = (SnapshotSection){world->streams.integrate_mask, sizeof(uint32_t)};
+  sections[n++] = (SnapshotSection){world->restitution, sizeof(float)};
+  sections[n++] = (SnapshotSection){world->rest_time, sizeof(float)};
+  sections[n++] = (SnapshotSection){world->island_next, sizeof(int)};
+  sections[n++] = (SnapshotSection){world->handles, sizeof(int)};
+  sections[n++] = (SnapshotSection){world->shapes, sizeof(ConXCollisionShape)};
+  sections[n++] = (SnapshotSection){world->collision_callbacks, sizeof(ConXCollisionCallback)};
+  sections[n++] = (SnapshotSection){world->is_static, sizeof(bool)};
+  sections[n++] = (SnapshotSection){world->is_sleeping, sizeof(bool)};
+}
+
+static inline size_t section_bytes(size_t bytes) {
+  return (bytes + 7) & ~(size_t)7;
+}
+
+static size_t snapshot_bytes(ConXPhysicsWorld *world, int body_count, int slot_count,
+                             int manifold_count) {
+  SnapshotSection sections[SNAPSHOT_BODY_SECTIONS];
+  body_sections(world, sections);
+
+  size_t size = sizeof(SnapshotHeader);
+  for (int i = 0; i < SNAPSHOT_BODY_SECTIONS; i++) {
+    size += section_bytes(sections[i].element_size * body_count);
+  }
+  size += section_bytes(sizeof(ConXBodySlot) * slot_count);
+  size += section_bytes(sizeof(ConXContactManifold) * manifold_count);
+  return size;
+}
+
+// Copy into the snapshot, zeroing the alignment tail so equal states give
+// equal bytes
+static unsigned char *write_section(unsigned char *out, const void *data, size_t bytes) {
+  size_t padded = section_bytes(bytes);
+  if (bytes > 0) memcpy(out, data, bytes);
+  memset(out + bytes, 0, padded - bytes);
+  return out + padded;
+}
+
+size_t conx_world_snapshot_size(ConXPhysicsWorld *world) {
+  if (!world->solver) return 0;
+  return snapshot_bytes(world, world->body_count, world->slot_count,
+                        world->solver->count);
+}
+
+size_t conx_world_save_snapshot(ConXPhysicsWorld *world, void *buffer, size_t capacity) {
+  size_t size = conx_world_snapshot_size(world);
+  if (size == 0 || !buffer || capacity < size) return 0;
+
+  const ConXContactSolver *solver = world->solver;
+  int count = world->body_count;
+  SnapshotHeader header = {0};
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.size = size;
+  header.body_count = count;
+  header.slot_count = world->slot_count;
+  header.free_slot = world->free_slot;
+  header.removed_count = world->removed_count;
+  header.first_removed = world->first_removed;
+  header.manifold_count = solver->count;
+  header.gravity = world->gravity;
+
+  unsigned char *out = buffer;
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+
+  SnapshotSection sections[SNAPSHOT_BODY_SECTIONS];
+  body_sections(world, sections);
+  for (int i = 0; i < SNAPSHOT_BODY_SECTIONS; i++) {
+    out = write_section(out, sections[i].data, sections[i].element_size * count);
+  }
+
+  // Slots are chunked, copy chunk by chunk into one packed section
+  size_t slot_bytes = sizeof(ConXBodySlot) * world->slot_count;
+  for (int c = 0; c * CONX_BODY_CHUNK_SIZE < world->slot_count; c++) {
+    int n = world->slot_count - c * CONX_BODY_CHUNK_SIZE;
+    if (n > CONX_BODY_CHUNK_SIZE) n = CONX_BODY_CHUNK_SIZE;
+    memcpy(out + sizeof(ConXBodySlot) * c * CONX_BODY_CHUNK_SIZE, world->slot_chunks[c],
+           sizeof(ConXBodySlot) * n);
+  }
+  memset(out + slot_bytes, 0, section_bytes(slot_bytes) - slot_bytes);
+  out += section_bytes(slot_bytes);
+
+  write_section(out, solver->manifolds, sizeof(ConXContactManifold) * solver->count);
+  return size;
+}
+
+bool conx_world_restore_snapshot(ConXPhysicsWorld *world, const void *buffer, size_t size) {
+  if (!world->solver || !buffer || size < sizeof(SnapshotHeader)) return false;
+
+  SnapshotHeader header;
+  memcpy(&header, buffer, sizeof(header));
+  if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+      header.body_count < 0 || header.slot_count < header.body_count ||
+      header.slot_count > CONX_BODY_INDEX_MASK + 1 || header.manifold_count < 0 ||
+      header.size > size ||
+      header.size != snapshot_bytes(world, header.body_count, header.slot_count,
+                                    header.manifold_count)) {
+    printf("Invalid physics snapshot\n");
+    return false;
+  }
+
+  // All allocation happens up front and only when the snapshot is larger
+  // than anything this world has held, so a failure leaves the world as it was
+  int count = header.body_count;
+  const unsigned char *in = (const unsigned char *)buffer + sizeof(header);
+  const unsigned char *manifolds = (const unsigned char *)buffer + header.size -
+                                   section_bytes(sizeof(ConXContactManifold) * header.manifold_count);
+  if (count > world->max_bodies) {
+    int capacity = (count + CONX_BODY_CHUNK_SIZE - 1) / CONX_BODY_CHUNK_SIZE * CONX_BODY_CHUNK_SIZE;
+    if (!grow_bodies(world, capacity)) {
+      printf("Failed to grow physics world to %d bodies\n", capacity);
+      return false;
+    }
+  }
+  if (!reserve_slots(world, header.slot_count) ||
+      !conx_solver_restore(world->solver, (const ConXContactManifold *)manifolds,
+                           header.manifold_count)) {
+    printf("Failed to restore physics snapshot\n");
+    return false;
+  }
+
+  SnapshotSection sections[SNAPSHOT_BODY_SECTIONS];
+  body_sections(world, sections);
+  for (int i = 0; i < SNAPSHOT_BODY_SECTIONS; i++) {
+    size_t bytes = sections[i].element_size * count;
+    if (bytes > 0) memcpy(sections[i].data, in, bytes);
+    in += section_bytes(bytes);
+  }
+
+  // Padding lanes past the last body must read as zero and masked out
+  int old_count = world->body_count;
+  if (old_count > count) {
+    float **floats[FLOAT_STREAM_COUNT];
+    float_streams(&world->streams, floats);
+    for (int k = 0; k < FLOAT_STREAM_COUNT; k++) {
+      memset(*floats[k] + count, 0, sizeof(float) * (old_count - count));
     }
+    memset(world->streams.integrate_mask + count, 0, sizeof(uint32_t) * (old_count - count));
+  }
+
+  for (int c = 0; c * CONX_BODY_CHUNK_SIZE < header.slot_count; c++) {
+    int n = header.slot_count - c * CONX_BODY_CHUNK_SIZE;
+    if (n > CONX_BODY_CHUNK_SIZE) n = CONX_BODY_CHUNK_SIZE;
+    memcpy(world->slot_chunks[c], in + sizeof(ConXBodySlot) * c * CONX_BODY_CHUNK_SIZE,
+           sizeof(ConXBodySlot) * n);
   }
-}
\ No newline at end of file
+
+  world->body_count = count;
+  world->slot_count = header.slot_count;
+  world->free_slot = header.free_slot;
+  world->removed_count = header.removed_count;
+  world->first_removed = header.first_removed;
+  world->gravity = header.gravity;
+  world->contact_event_count = 0;
+
+  // Broadphase state is derived, rebuild it from the restored bodies
+  conx_broadphase_reset(world->broadphase, count);
+  for (int i = 0; i < count; i++) {
+    update_body_bounds(world, i);
+  }
+  return true;
+}
+
+void conx_physics_snapshot_delta(void *out, const void *base, size_t base_size,
+                                 const void *snapshot, size_t snapshot_size) {
+  unsigned char *dst = out;
+  const unsigned char *a = base;
+  const unsigned char *b = snapshot;
+  size_t shared = base_size < snapshot_size ? base_size : snapshot_size;
+
+  // Word-wide where possible; memcpy keeps unaligned buffers legal
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= shared; i += sizeof(uint64_t)) {
+    uint64_t x, y;
+    memcpy(&x, a + i, sizeof(x));
+    memcpy(&y, b + i, sizeof(y));
+    x ^= y;
+    memcpy(dst + i, &x, sizeof(x));
+  }
+  for (; i < shared; i++) {
+    dst[i] = a[i] ^ b[i];
+  }
+  // Past the end of the base counts as zeros
+  if (snapshot_size > shared) {
+    memmove(dst + shared, b + shared, snapshot_size - shared);
+  }
+}
@@ -0,0 +1,123 @@
+#include "conx_physics.h"
+
+// The world behind the conx_physics_* shorthands
+static ConXPhysicsWorld default_world = {0};
+
+bool conx_physics_init(int max_bodies) {
+  ConXPhysicsConfig config = conx_physics_config_create(max_bodies);
+  return conx_physics_init_with_config(&config);
+}
+
+bool conx_physics_init_with_config(const ConXPhysicsConfig *config) {
+  conx_world_shutdown(&default_world);
+  return conx_world_init(&default_world, config);
+}
+
+void conx_physics_shutdown(void) {
+  conx_world_shutdown(&default_world);
+}
+
+ConXPhysicsWorld* conx_physics_get_world(void) {
+  return &default_world;
+}
+
+void conx_physics_update(float dt) {
+  conx_world_update(&default_world, dt);
+}
+
+void conx_physics_set_gravity(Vec3 gravity) {
+  conx_world_set_gravity(&default_world, gravity);
+}
+
+int conx_physics_create_body(Vec3 position, float mass) {
+  return conx_world_create_body(&default_world, position, mass);
+}
+
+void conx_physics_destroy_body(int body_id) {
+  conx_world_destroy_body(&default_world, body_id);
+}
+
+bool conx_physics_is_body_valid(int body_id) {
+  return conx_world_is_body_valid(&default_world, body_id);
+}
+
+void conx_physics_set_body_position(int body_id, Vec3 position) {
+  conx_world_set_body_position(&default_world, body_id, position);
+}
+
+void conx_physics_set_body_velocity(int body_id, Vec3 velocity) {
+  conx_world_set_body_velocity(&default_world, body_id, velocity);
+}
+
+void conx_physics_set_body_static(int body_id, bool is_static) {
+  conx_world_set_body_static(&default_world, body_id, is_static);
+}
+
+void conx_physics_set_body_restitution(int body_id, float restitution) {
+  conx_world_set_body_restitution(&default_world, body_id, restitution);
+}
+
+void conx_physics_apply_force(int body_id, Vec3 force) {
+  conx_world_apply_force(&default_world, body_id, force);
+}
+
+void conx_physics_add_sphere_shape(int body_id, float radius) {
+  conx_world_add_sphere_shape(&default_world, body_id, radius);
+}
+
+void conx_physics_add_box_shape(int body_id, Vec3 half_extents) {
+  conx_world_add_box_shape(&default_world, body_id, half_extents);
+}
+
+bool conx_physics_is_body_sleeping(int body_id) {
+  return conx_world_is_body_sleeping(&default_world, body_id);
+}
+
+void conx_physics_wake_body(int body_id) {
+  conx_world_wake_body(&default_world, body_id);
+}
+
+Vec3 conx_physics_get_interpolated_position(int body_id, float alpha) {
+  return conx_world_get_interpolated_position(&default_world, body_id, alpha);
+}
+
+const ConXRigidBody* conx_physics_get_body(int body_id) {
+  return conx_world_get_body(&default_world, body_id);
+}
+
+const ConXContactEvent *conx_physics_get_contact_events(int *count) {
+  return conx_world_get_contact_events(&default_world, count);
+}
+
+void conx_physics_set_collision_callback(int body_id, ConXCollisionCallback callback) {
+  conx_world_set_collision_callback(&default_world, body_id, callback);
+}
+
+int conx_physics_query_aabb(Vec3 min, Vec3 max, int *body_ids, int max_results) {
+  return conx_world_query_aabb(&default_world, min, max, body_ids, max_results);
+}
+
+void conx_physics_raycast_batch(const ConXRay *rays, int count, ConXRayHit *hits) {
+  conx_world_raycast_batch(&default_world, rays, count, hits);
+}
+
+void conx_physics_overlap_sphere_batch(const ConXSphereQuery *spheres, int count,
+                                       int max_per_query, int *body_ids, int *counts) {
+  conx_world_overlap_sphere_batch(&default_world, spheres, count, max_per_query, body_ids, counts);
+}
+
+void conx_physics_nearest_batch(const ConXNearestQuery *queries, int count, ConXNearestHit *hits) {
+  conx_world_nearest_batch(&default_world, queries, count, hits);
+}
+
+size_t conx_physics_snapshot_size(void) {
+  return conx_world_snapshot_size(&default_world);
+}
+
+size_t conx_physics_save_snapshot(void *buffer, size_t capacity) {
+  return conx_world_save_snapshot(&default_world, buffer, capacity);
+}
+
+bool conx_physics_restore_snapshot(const void *buffer, size_t size) {
+  return conx_world_restore_snapshot(&default_world, buffer, size);
+}
@@ -0,0 +1,281 @@
+#ifndef CONX_PHYSICS_INTERNAL_H
+#define CONX_PHYSICS_INTERNAL_H
+
+#include "conx_physics.h"
+#include <stddef.h>
+
+// Axis-aligned bounding box
+typedef struct {
+  Vec3 min;
+  Vec3 max;
+} ConXAABB;
+
+// Candidate pair reported by a broadphase (always a < b)
+typedef struct {
+  int a;
+  int b;
+} ConXBodyPair;
+
+typedef struct {
+  ConXBodyPair *pairs;
+  ConXBodyPair *scratch;
+  int count;
+  int capacity;
+} ConXPairBuffer;
+
+// Sweep-and-prune endpoint, id is (body << 1) | is_max
+typedef struct {
+  float value;
+  int id;
+} ConXSapEndpoint;
+
+// Open interval during the sweep, with the y/z bounds copied in so the
+// inner loop reads contiguous memory
+typedef struct {
+  float min_y, max_y;
+  float min_z, max_z;
+  int body;
+  int is_static;
+} ConXSapActive;
+
+// Incremental sweep-and-prune along the x axis. Endpoints stay sorted
+// between frames so the per-frame insertion sort is close to O(n).
+typedef struct {
+  ConXSapEndpoint *endpoints;
+  int endpoint_count;
+  int body_count;
+  ConXSapActive *active;
+  int *active_index;
+  int capacity;
+} ConXSweepAndPrune;
+
+// Grid cell coordinates of one body's box, or marked oversized
+typedef struct {
+  int min[3];
+  int max[3];
+} ConXGridRange;
+
+// One (body, cell) occupancy record, counting-sorted by cell hash
+typedef struct {
+  int cell[3];
+  int body;
+} ConXGridEntry;
+
+// Entries bucketed by cell hash, bucket h is [bucket_start[h], bucket_start[h + 1])
+typedef struct {
+  ConXGridEntry *entries;
+  int entry_capacity;
+  int *bucket_start;
+  int bucket_count;
+} ConXGridLayer;
+
+// Uniform spatial hash in flat arrays. Moving bodies are rehashed every
+// step; static and sleeping bodies live in a second layer that is only
+// rebuilt when one of them changes. Bodies that span too many cells
+// (large static boxes) skip the grid and are tested against every other
+// box directly.
+typedef struct {
+  float cell_size;
+  float inv_cell_size;
+  ConXGridRange *ranges;
+  int range_capacity;
+  ConXGridLayer dynamic_layer;
+  ConXGridLayer static_layer;
+  int *oversized;
+  int *static_oversized;
+  int static_oversized_count;
+  unsigned char *in_static_layer;
+  int body_count;
+  bool static_dirty;
+} ConXGrid;
+
+// Body handles pack a slot index with the slot's generation, so a handle
+// to a destroyed body stops resolving once the slot is reused
+#define CONX_BODY_INDEX_BITS 20
+#define CONX_BODY_INDEX_MASK ((1 << CONX_BODY_INDEX_BITS) - 1)
+#define CONX_BODY_GENERATION_MASK 0x7FF
+// Slots are allocated this many at a time and never move
+#define CONX_BODY_CHUNK_SIZE 1024
+
+#define CONX_BVH_NULL (-1)
+
+// Dynamic AABB tree node. Leaves hold a fattened box for one body;
+// free nodes reuse parent as the free-list link.
+typedef struct {
+  ConXAABB box;
+  int parent;
+  int child1;
+  int child2;
+  int height;
+  int body;
+} ConXBvhNode;
+
+typedef struct {
+  ConXBvhNode *nodes;
+  int node_capacity;
+  int node_count;
+  int root;
+  int free_list;
+  float margin;
+} ConXBvh;
+
+// Return false to stop the query
+typedef bool (*ConXBvhQueryFn)(void *context, int body);
+typedef void (*ConXBvhPairFn)(void *context, int body_a, int body_b);
+// Leaf test for ray and nearest-point searches. Returns the new search
+// distance: unchanged to keep going, smaller to clip, 0 to stop.
+typedef float (*ConXBvhClipFn)(void *context, int body, float max_distance);
+
+// Contact between two touching bodies (a < b), rebuilt every step in pair
+// order. The normal points from b towards a.
+typedef struct {
+  int a;
+  int b;
+  Vec3 normal;
+  float depth;
+  float normal_impulse;   // accumulated this step, carried over to warm start the next
+  float position_impulse;
+  float inv_mass_a;
+  float inv_mass_b;
+  float effective_mass;
+  float velocity_bias;
+  float position_bias;
+  bool dormant;           // both bodies asleep or static, kept but not solved
+} ConXContactManifold;
+
+// Manifolds of this step and the last. Both are sorted by body pair, so
+// carrying impulses over is a single merge.
+typedef struct ConXContactSolver {
+  ConXContactManifold *manifolds;
+  int count;
+  int capacity;
+  ConXContactManifold *previous;
+  int previous_count;
+  int previous_capacity;
+  int previous_cursor;
+  const bool *is_static;
+  const bool *is_sleeping;
+
+  // Per-body pseudo velocities used only to push bodies out of overlap
+  float *pseudo_x, *pseudo_y, *pseudo_z;
+  int *touched;
+  unsigned char *is_touched;
+  int body_capacity;
+} ConXContactSolver;
+
+// Broadphase state owned by a physics world
+typedef struct ConXBroadphase {
+  ConXBroadphaseType type;
+  ConXAABB *aabbs;
+  Vec3 *motion;             // displacement over the last step
+  unsigned char *is_static; // static or sleeping, pairs of two such bodies are skipped
+  int capacity;
+  ConXSweepAndPrune sap;
+  ConXGrid grid;
+  ConXPairBuffer pairs;
+
+  // Static and dynamic bodies live in separate trees so level geometry
+  // is never refit or rebalanced unless it is changed through the API
+  ConXBvh static_tree;
+  ConXBvh dynamic_tree;
+  int *proxies;
+  unsigned char *proxy_static;
+  unsigned char *dirty;
+  int *dirty_list;
+  int dirty_count;
+  int proxy_count;
+  bool trees_stale;
+} ConXBroadphase;
+
+// 32-byte aligned allocations for body streams
+void *conx_aligned_alloc(size_t size);
+void conx_aligned_free(void *ptr);
+
+// Integration over all body streams, before and after the contact solver
+void conx_integrate_velocities(ConXBodyStreams *streams, int count, Vec3 gravity, float dt);
+void conx_integrate_positions(ConXBodyStreams *streams, int count, float dt);
+
+// Contact generation for pairs [begin, end), one result per pair. Reads
+// positions and shapes only, so any number of ranges can run at once.
+// Sphere pairs are tested eight lanes at a time with AVX2, gathering
+// positions from the streams by body index; narrowphase_benchmark shows
+// about 1.5x over one pair at a time. Other CPUs run the lanes in scalar.
+void conx_narrowphase(const ConXBodyStreams *streams, const ConXCollisionShape *shapes,
+                      const ConXBodyPair *pairs, int begin, int end, ConXContactResult *contacts);
+
+// Contact solver
+void conx_solver_free(ConXContactSolver *solver);
+void conx_solver_begin(ConXContactSolver *solver, const bool *is_static, const bool *is_sleeping);
+bool conx_solver_add_contact(ConXContactSolver *solver, int a, int b, Vec3 normal, float depth);
+void conx_solver_end(ConXContactSolver *solver);
+void conx_solver_wake_dormant(ConXContactSolver *solver);
+void conx_solver_compact(ConXContactSolver *solver, const int *remap);
+bool conx_solver_restore(ConXContactSolver *solver, const ConXContactManifold *manifolds, int count);
+void conx_solver_solve(ConXContactSolver *solver, ConXBodyStreams *streams, int body_count,
+                       const bool *is_static, const float *restitution, int iterations, float dt);
+bool conx_solver_build_events(const ConXContactSolver *solver, ConXContactEvent **events,
+                              int *event_count, int *event_capacity);
+
+// Pair buffer
+bool conx_pair_buffer_push(ConXPairBuffer *buffer, int a, int b);
+void conx_pair_buffer_sort(ConXPairBuffer *buffer);
+void conx_pair_buffer_free(ConXPairBuffer *buffer);
+
+// Broadphase lifecycle
+ConXBroadphase *conx_broadphase_create(const ConXPhysicsConfig *config);
+void conx_broadphase_destroy(ConXBroadphase *broadphase);
+void conx_broadphase_update(ConXBroadphase *broadphase, int body_count);
+void conx_broadphase_touch(ConXBroadphase *broadphase, int body);
+bool conx_broadphase_reserve(ConXBroadphase *broadphase, int capacity);
+void conx_broadphase_reset(ConXBroadphase *broadphase, int body_count);
+// remap[old] is the body's new index, or -1 if it was removed. Survivors
+// keep their relative order.
+void conx_broadphase_compact(ConXBroadphase *broadphase, const int *remap, int old_count);
+// Bring the query trees up to date; after this they can be read from
+// several threads at once until the world changes
+void conx_broadphase_prepare_queries(ConXBroadphase *broadphase, int body_count);
+int conx_broadphase_query(ConXBroadphase *broadphase, int body_count,
+                          const ConXAABB *box, int *body_ids, int max_results);
+
+// Sweep-and-prune
+void conx_sap_free(ConXSweepAndPrune *sap);
+void conx_sap_update(ConXSweepAndPrune *sap, const ConXAABB *aabbs,
+                     const unsigned char *is_static, int count,
+                     ConXPairBuffer *out);
+void conx_sap_compact(ConXSweepAndPrune *sap, const int *remap);
+
+// Spatial hash grid
+void conx_grid_free(ConXGrid *grid);
+void conx_grid_touch(ConXGrid *grid, const unsigned char *is_static, int body);
+void conx_grid_compact(ConXGrid *grid, const int *remap);
+void conx_grid_update(ConXGrid *grid, const ConXAABB *aabbs,
+                      const unsigned char *is_static, int count,
+                      ConXPairBuffer *out);
+
+// Dynamic AABB tree
+void conx_bvh_init(ConXBvh *tree, float margin);
+void conx_bvh_free(ConXBvh *tree);
+void conx_bvh_clear(ConXBvh *tree);
+int conx_bvh_create_proxy(ConXBvh *tree, const ConXAABB *box, Vec3 displacement, int body);
+void conx_bvh_destroy_proxy(ConXBvh *tree, int proxy);
+void conx_bvh_remap_bodies(ConXBvh *tree, const int *remap);
+bool conx_bvh_move_proxy(ConXBvh *tree, int proxy, const ConXAABB *box, Vec3 displacement);
+void conx_bvh_query(const ConXBvh *tree, const ConXAABB *box,
+                    ConXBvhQueryFn callback, void *context);
+// Ray along a unit direction and nearest leaves to a point. Both return
+// the final search distance.
+float conx_bvh_raycast(const ConXBvh *tree, Vec3 origin, Vec3 direction, float max_distance,
+                       ConXBvhClipFn callback, void *context);
+float conx_bvh_nearest(const ConXBvh *tree, Vec3 point, float max_distance,
+                       ConXBvhClipFn callback, void *context);
+// Overlapping leaf pairs within tree (other == NULL) or between two trees
+void conx_bvh_query_pairs(const ConXBvh *tree, const ConXBvh *other,
+                          ConXBvhPairFn callback, void *context);
+
+static inline bool conx_aabb_overlap(const ConXAABB *a, const ConXAABB *b) {
+  return a->min.x <= b->max.x && a->max.x >= b->min.x &&
+         a->min.y <= b->max.y && a->max.y >= b->min.y &&
+         a->min.z <= b->max.z && a->max.z >= b->min.z;
+}
+
+#endif
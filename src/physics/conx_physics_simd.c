@@ -0,0 +1,194 @@
+#include "conx_physics_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(CONX_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define CONX_SIMD_X86 1
+#include <SDL2/SDL.h>
+#include <immintrin.h>
+
+// GCC and Clang need per-function permission to emit AVX2; MSVC does not
+#if defined(__GNUC__) || defined(__clang__)
+#define CONX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CONX_TARGET_AVX2
+#endif
+#endif
+
+#define STREAM_ALIGNMENT 32
+
+// Aligned allocation
+
+void *conx_aligned_alloc(size_t size) {
+  // Over-allocate and keep the original pointer just before the block
+  void *raw = malloc(size + STREAM_ALIGNMENT + sizeof(void *));
+  if (!raw) return NULL;
+
+  uintptr_t address = (uintptr_t)raw + sizeof(void *);
+  address = (address + STREAM_ALIGNMENT - 1) & ~(uintptr_t)(STREAM_ALIGNMENT - 1);
+  ((void **)address)[-1] = raw;
+  return (void *)address;
+}
+
+void conx_aligned_free(void *ptr) {
+  if (ptr) free(((void **)ptr)[-1]);
+}
+
+// Integration kernels. The step integrates in two passes around the
+// contact solver:
+//   velocity += (acceleration + gravity) * dt, then acceleration = 0
+//   position += velocity * dt
+// Masked-out (static or sleeping) lanes add zero and already have zero
+// acceleration, so all kernels give bit-identical results to the scalar
+// loops. Vectors with no lane set are skipped, which makes runs of
+// sleeping bodies free.
+
+#ifndef CONX_SIMD_X86
+
+static void integrate_velocities_scalar(ConXBodyStreams *s, int count, Vec3 gravity, float dt) {
+  for (int i = 0; i < count; i++) {
+    if (!s->integrate_mask[i]) continue;
+
+    s->velocity_x[i] += (s->acceleration_x[i] + gravity.x) * dt;
+    s->velocity_y[i] += (s->acceleration_y[i] + gravity.y) * dt;
+    s->velocity_z[i] += (s->acceleration_z[i] + gravity.z) * dt;
+    s->acceleration_x[i] = 0.0f;
+    s->acceleration_y[i] = 0.0f;
+    s->acceleration_z[i] = 0.0f;
+  }
+}
+
+static void integrate_positions_scalar(ConXBodyStreams *s, int count, float dt) {
+  for (int i = 0; i < count; i++) {
+    if (!s->integrate_mask[i]) continue;
+
+    s->position_x[i] += s->velocity_x[i] * dt;
+    s->position_y[i] += s->velocity_y[i] * dt;
+    s->position_z[i] += s->velocity_z[i] * dt;
+  }
+}
+
+#else
+
+static inline void velocity_axis_sse(float *velocity, float *acceleration,
+                                     __m128 mask, __m128 gravity, __m128 dt) {
+  __m128 a = _mm_add_ps(_mm_load_ps(acceleration), gravity);
+  __m128 v = _mm_add_ps(_mm_load_ps(velocity), _mm_and_ps(_mm_mul_ps(a, dt), mask));
+  _mm_store_ps(velocity, v);
+  _mm_store_ps(acceleration, _mm_setzero_ps());
+}
+
+static inline void position_axis_sse(float *position, const float *velocity,
+                                     __m128 mask, __m128 dt) {
+  __m128 p = _mm_add_ps(_mm_load_ps(position), _mm_and_ps(_mm_mul_ps(_mm_load_ps(velocity), dt), mask));
+  _mm_store_ps(position, p);
+}
+
+static void integrate_velocities_sse(ConXBodyStreams *s, int count, Vec3 gravity, float dt) {
+  __m128 gx = _mm_set1_ps(gravity.x);
+  __m128 gy = _mm_set1_ps(gravity.y);
+  __m128 gz = _mm_set1_ps(gravity.z);
+  __m128 vdt = _mm_set1_ps(dt);
+
+  for (int i = 0; i < count; i += 4) {
+    __m128 mask = _mm_load_ps((const float *)&s->integrate_mask[i]);
+    if (_mm_movemask_ps(mask) == 0) continue;
+    velocity_axis_sse(&s->velocity_x[i], &s->acceleration_x[i], mask, gx, vdt);
+    velocity_axis_sse(&s->velocity_y[i], &s->acceleration_y[i], mask, gy, vdt);
+    velocity_axis_sse(&s->velocity_z[i], &s->acceleration_z[i], mask, gz, vdt);
+  }
+}
+
+static void integrate_positions_sse(ConXBodyStreams *s, int count, float dt) {
+  __m128 vdt = _mm_set1_ps(dt);
+
+  for (int i = 0; i < count; i += 4) {
+    __m128 mask = _mm_load_ps((const float *)&s->integrate_mask[i]);
+    if (_mm_movemask_ps(mask) == 0) continue;
+    position_axis_sse(&s->position_x[i], &s->velocity_x[i], mask, vdt);
+    position_axis_sse(&s->position_y[i], &s->velocity_y[i], mask, vdt);
+    position_axis_sse(&s->position_z[i], &s->velocity_z[i], mask, vdt);
+  }
+}
+
+CONX_TARGET_AVX2
+static inline void velocity_axis_avx2(float *velocity, float *acceleration,
+                                      __m256 mask, __m256 gravity, __m256 dt) {
+  __m256 a = _mm256_add_ps(_mm256_load_ps(acceleration), gravity);
+  __m256 v = _mm256_add_ps(_mm256_load_ps(velocity), _mm256_and_ps(_mm256_mul_ps(a, dt), mask));
+  _mm256_store_ps(velocity, v);
+  _mm256_store_ps(acceleration, _mm256_setzero_ps());
+}
+
+CONX_TARGET_AVX2
+static inline void position_axis_avx2(float *position, const float *velocity,
+                                      __m256 mask, __m256 dt) {
+  __m256 p = _mm256_add_ps(_mm256_load_ps(position),
+                           _mm256_and_ps(_mm256_mul_ps(_mm256_load_ps(velocity), dt), mask));
+  _mm256_store_ps(position, p);
+}
+
+CONX_TARGET_AVX2
+static void integrate_velocities_avx2(ConXBodyStreams *s, int count, Vec3 gravity, float dt) {
+  __m256 gx = _mm256_set1_ps(gravity.x);
+  __m256 gy = _mm256_set1_ps(gravity.y);
+  __m256 gz = _mm256_set1_ps(gravity.z);
+  __m256 vdt = _mm256_set1_ps(dt);
+
+  for (int i = 0; i < count; i += 8) {
+    __m256 mask = _mm256_load_ps((const float *)&s->integrate_mask[i]);
+    if (_mm256_movemask_ps(mask) == 0) continue;
+    velocity_axis_avx2(&s->velocity_x[i], &s->acceleration_x[i], mask, gx, vdt);
+    velocity_axis_avx2(&s->velocity_y[i], &s->acceleration_y[i], mask, gy, vdt);
+    velocity_axis_avx2(&s->velocity_z[i], &s->acceleration_z[i], mask, gz, vdt);
+  }
+}
+
+CONX_TARGET_AVX2
+static void integrate_positions_avx2(ConXBodyStreams *s, int count, float dt) {
+  __m256 vdt = _mm256_set1_ps(dt);
+
+  for (int i = 0; i < count; i += 8) {
+    __m256 mask = _mm256_load_ps((const float *)&s->integrate_mask[i]);
+    if (_mm256_movemask_ps(mask) == 0) continue;
+    position_axis_avx2(&s->position_x[i], &s->velocity_x[i], mask, vdt);
+    position_axis_avx2(&s->position_y[i], &s->velocity_y[i], mask, vdt);
+    position_axis_avx2(&s->position_z[i], &s->velocity_z[i], mask, vdt);
+  }
+}
+
+#endif
+
+// Streams are padded to CONX_PHYSICS_SIMD_WIDTH with zeroed, masked-out
+// lanes, so whole vectors can run past the last body
+static inline int padded_count(int count) {
+  return (count + CONX_PHYSICS_SIMD_WIDTH - 1) & ~(CONX_PHYSICS_SIMD_WIDTH - 1);
+}
+
+void conx_integrate_velocities(ConXBodyStreams *streams, int count, Vec3 gravity, float dt) {
+  if (count <= 0) return;
+
+#ifdef CONX_SIMD_X86
+  if (SDL_HasAVX2()) {
+    integrate_velocities_avx2(streams, padded_count(count), gravity, dt);
+  } else {
+    integrate_velocities_sse(streams, padded_count(count), gravity, dt);
+  }
+#else
+  integrate_velocities_scalar(streams, count, gravity, dt);
+#endif
+}
+
+void conx_integrate_positions(ConXBodyStreams *streams, int count, float dt) {
+  if (count <= 0) return;
+
+#ifdef CONX_SIMD_X86
+  if (SDL_HasAVX2()) {
+    integrate_positions_avx2(streams, padded_count(count), dt);
+  } else {
+    integrate_positions_sse(streams, padded_count(count), dt);
+  }
+#else
+  integrate_positions_scalar(streams, count, dt);
+#endif
+}
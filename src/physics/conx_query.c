@@ -0,0 +1,284 @@
+#include "conx_physics_internal.h"
+#include "conx_jobs.h"
+#include <math.h>
+
+// Queries per job batch
+#define QUERY_BATCH_SIZE 64
+
+static inline Vec3 body_position(const ConXPhysicsWorld *world, int body) {
+  const ConXBodyStreams *s = &world->streams;
+  return vec3_create(s->position_x[body], s->position_y[body], s->position_z[body]);
+}
+
+static inline Vec3 box_closest_point(Vec3 center, Vec3 half_extents, Vec3 point) {
+  return vec3_create(fmaxf(center.x - half_extents.x, fminf(point.x, center.x + half_extents.x)),
+                     fmaxf(center.y - half_extents.y, fminf(point.y, center.y + half_extents.y)),
+                     fmaxf(center.z - half_extents.z, fminf(point.z, center.z + half_extents.z)));
+}
+
+// Raycasts
+
+// Entry distance of a ray starting outside the sphere, or -1 on a miss
+static float ray_sphere(Vec3 origin, Vec3 direction, Vec3 center, float radius, Vec3 *normal) {
+  Vec3 m = vec3_subtract(origin, center);
+  float b = vec3_dot(m, direction);
+  float c = vec3_dot(m, m) - radius * radius;
+  if (c <= 0.0f || b > 0.0f) return -1.0f;
+
+  float discriminant = b * b - c;
+  if (discriminant < 0.0f) return -1.0f;
+
+  float t = -b - sqrtf(discriminant);
+  *normal = vec3_normalize(vec3_subtract(vec3_add(origin, vec3_multiply(direction, t)), center));
+  return t;
+}
+
+// Slab test, keeping the axis the ray enters through for the normal
+static float ray_box(Vec3 origin, Vec3 direction, Vec3 center, Vec3 half_extents, Vec3 *normal) {
+  const float o[3] = {origin.x - center.x, origin.y - center.y, origin.z - center.z};
+  const float d[3] = {direction.x, direction.y, direction.z};
+  const float h[3] = {half_extents.x, half_extents.y, half_extents.z};
+  float enter = -INFINITY;
+  float leave = INFINITY;
+  int axis = -1;
+  float sign = 0.0f;
+
+  for (int i = 0; i < 3; i++) {
+    if (d[i] == 0.0f) {
+      if (o[i] < -h[i] || o[i] > h[i]) return -1.0f;
+      continue;
+    }
+    float t1 = (-h[i] - o[i]) / d[i];
+    float t2 = (h[i] - o[i]) / d[i];
+    float face = -1.0f;
+    if (t1 > t2) {
+      float t = t1;
+      t1 = t2;
+      t2 = t;
+      face = 1.0f;
+    }
+    if (t1 > enter) {
+      enter = t1;
+      axis = i;
+      sign = face;
+    }
+    if (t2 < leave) leave = t2;
+  }
+
+  // Starting inside, or missing
+  if (axis < 0 || enter <= 0.0f || enter > leave) return -1.0f;
+
+  float n[3] = {0.0f, 0.0f, 0.0f};
+  n[axis] = sign;
+  *normal = vec3_create(n[0], n[1], n[2]);
+  return enter;
+}
+
+typedef struct {
+  const ConXPhysicsWorld *world;
+  Vec3 origin;
+  Vec3 direction;
+  ConXRayHit *hit;
+} RayContext;
+
+static float ray_leaf(void *context, int body, float max_distance) {
+  RayContext *ctx = context;
+  const ConXPhysicsWorld *world = ctx->world;
+  if (world->handles[body] < 0) return max_distance;
+
+  const ConXCollisionShape *shape = &world->shapes[body];
+  Vec3 center = body_position(world, body);
+  Vec3 normal;
+  float t = shape->type == CONX_SHAPE_SPHERE
+                ? ray_sphere(ctx->origin, ctx->direction, center, shape->radius, &normal)
+                : ray_box(ctx->origin, ctx->direction, center, shape->half_extents, &normal);
+  if (t < 0.0f || t > max_distance) return max_distance;
+  if (t == max_distance && ctx->hit->body_id >= 0) return max_distance;
+
+  ctx->hit->body_id = world->handles[body];
+  ctx->hit->distance = t;
+  ctx->hit->point = vec3_add(ctx->origin, vec3_multiply(ctx->direction, t));
+  ctx->hit->normal = normal;
+  return t;
+}
+
+static void raycast_one(const ConXPhysicsWorld *world, const ConXRay *ray, ConXRayHit *hit) {
+  hit->body_id = -1;
+  hit->distance = ray->max_distance;
+  hit->point = vec3_create(0.0f, 0.0f, 0.0f);
+  hit->normal = vec3_create(0.0f, 0.0f, 0.0f);
+
+  float length = vec3_length(ray->direction);
+  if (length <= 0.0f || !(ray->max_distance > 0.0f)) return;
+
+  RayContext ctx = {world, ray->origin, vec3_multiply(ray->direction, 1.0f / length), hit};
+  float max_distance = conx_bvh_raycast(&world->broadphase->static_tree, ctx.origin, ctx.direction,
+                                        ray->max_distance, ray_leaf, &ctx);
+  conx_bvh_raycast(&world->broadphase->dynamic_tree, ctx.origin, ctx.direction,
+                   max_distance, ray_leaf, &ctx);
+}
+
+typedef struct {
+  const ConXPhysicsWorld *world;
+  const ConXRay *rays;
+  ConXRayHit *hits;
+} RayBatch;
+
+static void raycast_batch(void *context, int begin, int end) {
+  const RayBatch *batch = context;
+  for (int i = begin; i < end; i++) {
+    raycast_one(batch->world, &batch->rays[i], &batch->hits[i]);
+  }
+}
+
+// Sphere overlaps
+
+typedef struct {
+  const ConXPhysicsWorld *world;
+  Vec3 center;
+  float radius;
+  int *body_ids;
+  int max_results;
+  int count;
+} OverlapContext;
+
+static bool overlap_leaf(void *context, int body) {
+  OverlapContext *ctx = context;
+  const ConXPhysicsWorld *world = ctx->world;
+  if (world->handles[body] < 0) return true;
+
+  const ConXCollisionShape *shape = &world->shapes[body];
+  Vec3 center = body_position(world, body);
+  float reach = ctx->radius;
+  Vec3 closest = center;
+  if (shape->type == CONX_SHAPE_SPHERE) {
+    reach += shape->radius;
+  } else {
+    closest = box_closest_point(center, shape->half_extents, ctx->center);
+  }
+
+  Vec3 diff = vec3_subtract(ctx->center, closest);
+  if (vec3_dot(diff, diff) >= reach * reach) return true;
+
+  ctx->body_ids[ctx->count++] = world->handles[body];
+  return ctx->count < ctx->max_results;
+}
+
+typedef struct {
+  const ConXPhysicsWorld *world;
+  const ConXSphereQuery *spheres;
+  int max_per_query;
+  int *body_ids;
+  int *counts;
+} OverlapBatch;
+
+static void overlap_batch(void *context, int begin, int end) {
+  const OverlapBatch *batch = context;
+  const ConXBroadphase *broadphase = batch->world->broadphase;
+
+  for (int i = begin; i < end; i++) {
+    const ConXSphereQuery *sphere = &batch->spheres[i];
+    OverlapContext ctx = {batch->world, sphere->center, sphere->radius,
+                          batch->body_ids + (size_t)i * batch->max_per_query,
+                          batch->max_per_query, 0};
+    Vec3 extents = vec3_create(sphere->radius, sphere->radius, sphere->radius);
+    ConXAABB box = {vec3_subtract(sphere->center, extents), vec3_add(sphere->center, extents)};
+
+    conx_bvh_query(&broadphase->static_tree, &box, overlap_leaf, &ctx);
+    if (ctx.count < ctx.max_results) {
+      conx_bvh_query(&broadphase->dynamic_tree, &box, overlap_leaf, &ctx);
+    }
+    batch->counts[i] = ctx.count;
+  }
+}
+
+// Nearest body
+
+typedef struct {
+  const ConXPhysicsWorld *world;
+  Vec3 point;
+  int ignore_body;
+  ConXNearestHit *hit;
+} NearestContext;
+
+static float nearest_leaf(void *context, int body, float max_distance) {
+  NearestContext *ctx = context;
+  const ConXPhysicsWorld *world = ctx->world;
+  int handle = world->handles[body];
+  if (handle < 0 || handle == ctx->ignore_body) return max_distance;
+
+  const ConXCollisionShape *shape = &world->shapes[body];
+  Vec3 center = body_position(world, body);
+  float distance;
+  if (shape->type == CONX_SHAPE_SPHERE) {
+    distance = fmaxf(vec3_length(vec3_subtract(ctx->point, center)) - shape->radius, 0.0f);
+  } else {
+    distance = vec3_length(vec3_subtract(ctx->point, box_closest_point(center, shape->half_extents,
+                                                                       ctx->point)));
+  }
+  if (distance > max_distance) return max_distance;
+
+  // Ties go to whichever body was seen first
+  if (distance == max_distance && ctx->hit->body_id >= 0) return max_distance;
+  ctx->hit->body_id = handle;
+  ctx->hit->distance = distance;
+  return distance;
+}
+
+typedef struct {
+  const ConXPhysicsWorld *world;
+  const ConXNearestQuery *queries;
+  ConXNearestHit *hits;
+} NearestBatch;
+
+static void nearest_batch(void *context, int begin, int end) {
+  const NearestBatch *batch = context;
+  const ConXBroadphase *broadphase = batch->world->broadphase;
+
+  for (int i = begin; i < end; i++) {
+    const ConXNearestQuery *query = &batch->queries[i];
+    ConXNearestHit *hit = &batch->hits[i];
+    hit->body_id = -1;
+    hit->distance = query->max_distance;
+
+    NearestContext ctx = {batch->world, query->point, query->ignore_body, hit};
+    float max_distance = conx_bvh_nearest(&broadphase->static_tree, query->point,
+                                          query->max_distance, nearest_leaf, &ctx);
+    conx_bvh_nearest(&broadphase->dynamic_tree, query->point, max_distance, nearest_leaf, &ctx);
+  }
+}
+
+// Batch entry points
+
+static bool prepare_world(ConXPhysicsWorld *world) {
+  if (!world || !world->broadphase) return false;
+  conx_broadphase_prepare_queries(world->broadphase, world->body_count);
+  return true;
+}
+
+void conx_world_raycast_batch(ConXPhysicsWorld *world, const ConXRay *rays, int count,
+                              ConXRayHit *hits) {
+  if (!prepare_world(world) || !rays || !hits || count <= 0) return;
+
+  RayBatch batch = {world, rays, hits};
+  conx_job_pool_parallel_for(world->jobs, count, QUERY_BATCH_SIZE, raycast_batch, &batch);
+}
+
+void conx_world_overlap_sphere_batch(ConXPhysicsWorld *world, const ConXSphereQuery *spheres,
+                                     int count, int max_per_query, int *body_ids, int *counts) {
+  if (!prepare_world(world) || !spheres || !body_ids || !counts || count <= 0 ||
+      max_per_query <= 0) {
+    return;
+  }
+
+  OverlapBatch batch = {world, spheres, max_per_query, body_ids, counts};
+  conx_job_pool_parallel_for(world->jobs, count, QUERY_BATCH_SIZE, overlap_batch, &batch);
+}
+
+void conx_world_nearest_batch(ConXPhysicsWorld *world, const ConXNearestQuery *queries, int count,
+                              ConXNearestHit *hits) {
+  if (!prepare_world(world) || !queries || !hits || count <= 0) return;
+
+  NearestBatch batch = {world, queries, hits};
+  conx_job_pool_parallel_for(world->jobs, count, QUERY_BATCH_SIZE, nearest_batch, &batch);
+}
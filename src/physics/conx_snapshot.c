@@ -0,0 +1,80 @@
+#include "conx_physics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool conx_snapshot_ring_init(ConXSnapshotRing *ring, int capacity) {
+  memset(ring, 0, sizeof(*ring));
+  if (capacity <= 0) return false;
+
+  ring->entries = calloc((size_t)capacity, sizeof(ConXSnapshotEntry));
+  if (!ring->entries) {
+    printf("Failed to allocate snapshot ring\n");
+    return false;
+  }
+  ring->capacity = capacity;
+  return true;
+}
+
+void conx_snapshot_ring_free(ConXSnapshotRing *ring) {
+  for (int i = 0; i < ring->capacity; i++) {
+    free(ring->entries[i].data);
+  }
+  free(ring->entries);
+  memset(ring, 0, sizeof(*ring));
+}
+
+static ConXSnapshotEntry *find_entry(const ConXSnapshotRing *ring, uint32_t tick) {
+  if (ring->capacity <= 0) return NULL;
+
+  ConXSnapshotEntry *entry = &ring->entries[tick % (uint32_t)ring->capacity];
+  return entry->valid && entry->tick == tick ? entry : NULL;
+}
+
+bool conx_snapshot_ring_save(ConXSnapshotRing *ring, ConXPhysicsWorld *world, uint32_t tick) {
+  if (ring->capacity <= 0) return false;
+
+  size_t size = conx_world_snapshot_size(world);
+  if (size == 0) return false;
+
+  // Buffers only grow, so a steady world saves without allocating
+  ConXSnapshotEntry *entry = &ring->entries[tick % (uint32_t)ring->capacity];
+  if (entry->capacity < size) {
+    size_t capacity = entry->capacity ? entry->capacity : size;
+    while (capacity < size) capacity *= 2;
+    unsigned char *data = realloc(entry->data, capacity);
+    if (!data) {
+      printf("Failed to grow snapshot buffer to %zu bytes\n", capacity);
+      return false;
+    }
+    entry->data = data;
+    entry->capacity = capacity;
+  }
+
+  entry->size = conx_world_save_snapshot(world, entry->data, entry->capacity);
+  entry->tick = tick;
+  entry->valid = entry->size > 0;
+  return entry->valid;
+}
+
+bool conx_snapshot_ring_restore(const ConXSnapshotRing *ring, ConXPhysicsWorld *world,
+                                uint32_t tick) {
+  const ConXSnapshotEntry *entry = find_entry(ring, tick);
+  return entry && conx_world_restore_snapshot(world, entry->data, entry->size);
+}
+
+const void *conx_snapshot_ring_get(const ConXSnapshotRing *ring, uint32_t tick, size_t *size) {
+  const ConXSnapshotEntry *entry = find_entry(ring, tick);
+  if (size) *size = entry ? entry->size : 0;
+  return entry ? entry->data : NULL;
+}
+
+size_t conx_snapshot_ring_delta(const ConXSnapshotRing *ring, uint32_t tick,
+                                void *out, size_t capacity) {
+  const ConXSnapshotEntry *current = find_entry(ring, tick);
+  const ConXSnapshotEntry *previous = find_entry(ring, tick - 1);
+  if (!current || !previous || !out || capacity < current->size) return 0;
+
+  conx_physics_snapshot_delta(out, previous->data, previous->size, current->data, current->size);
+  return current->size;
+}
@@ -0,0 +1,360 @@
+#include "conx_physics_internal.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fraction of the penetration beyond the slop removed per step
+#define SOLVER_BAUMGARTE 0.2f
+// Penetration allowed to remain so resting contacts stay touching
+#define SOLVER_LINEAR_SLOP 0.005f
+// Slower approaches are treated as resting and do not bounce
+#define SOLVER_RESTITUTION_THRESHOLD 1.0f
+// Cached impulses are only reused while the normal stays within ~18 degrees
+#define SOLVER_WARM_START_MIN_DOT 0.95f
+
+void conx_solver_free(ConXContactSolver *solver) {
+  free(solver->manifolds);
+  free(solver->previous);
+  free(solver->pseudo_x);
+  free(solver->pseudo_y);
+  free(solver->pseudo_z);
+  free(solver->touched);
+  free(solver->is_touched);
+  memset(solver, 0, sizeof(*solver));
+}
+
+// Keep last step's manifolds for warm starting and start a new list.
+// is_static and is_sleeping must not change until conx_solver_end.
+void conx_solver_begin(ConXContactSolver *solver, const bool *is_static, const bool *is_sleeping) {
+  ConXContactManifold *manifolds = solver->previous;
+  int capacity = solver->previous_capacity;
+
+  solver->previous = solver->manifolds;
+  solver->previous_count = solver->count;
+  solver->previous_capacity = solver->capacity;
+  solver->manifolds = manifolds;
+  solver->capacity = capacity;
+  solver->count = 0;
+  solver->previous_cursor = 0;
+  solver->is_static = is_static;
+  solver->is_sleeping = is_sleeping;
+}
+
+static ConXContactManifold *push_manifold(ConXContactSolver *solver) {
+  if (solver->count >= solver->capacity) {
+    int capacity = solver->capacity ? solver->capacity * 2 : 256;
+    ConXContactManifold *manifolds = realloc(solver->manifolds, sizeof(ConXContactManifold) * capacity);
+    if (!manifolds) return NULL;
+    solver->manifolds = manifolds;
+    solver->capacity = capacity;
+  }
+  return &solver->manifolds[solver->count++];
+}
+
+static inline bool is_inactive(const ConXContactSolver *solver, int body) {
+  return solver->is_static[body] || solver->is_sleeping[body];
+}
+
+// The broadphase skips pairs of two inactive bodies, so last step's
+// contacts between them are carried over untouched instead of ending
+static bool carry_dormant(ConXContactSolver *solver, int a, int b) {
+  while (solver->previous_cursor < solver->previous_count) {
+    const ConXContactManifold *old = &solver->previous[solver->previous_cursor];
+    if (old->a > a || (old->a == a && old->b >= b)) break;
+    solver->previous_cursor++;
+
+    if (is_inactive(solver, old->a) && is_inactive(solver, old->b)) {
+      ConXContactManifold *m = push_manifold(solver);
+      if (!m) return false;
+      *m = *old;
+      m->dormant = true;
+    }
+  }
+  return true;
+}
+
+// Contacts must be added in body-pair order
+bool conx_solver_add_contact(ConXContactSolver *solver, int a, int b, Vec3 normal, float depth) {
+  if (!carry_dormant(solver, a, b)) return false;
+
+  ConXContactManifold *m = push_manifold(solver);
+  if (!m) return false;
+  // Padding too, so snapshots of equal states are byte-identical
+  memset(m, 0, sizeof(*m));
+  m->a = a;
+  m->b = b;
+  m->normal = normal;
+  m->depth = depth;
+  return true;
+}
+
+void conx_solver_end(ConXContactSolver *solver) {
+  carry_dormant(solver, INT_MAX, INT_MAX);
+}
+
+// Islands woken after conx_solver_end solve their carried contacts this
+// step. Sleeping bodies did not move, so the carried contacts still hold.
+void conx_solver_wake_dormant(ConXContactSolver *solver) {
+  for (int i = 0; i < solver->count; i++) {
+    ConXContactManifold *m = &solver->manifolds[i];
+    if (m->dormant && !(is_inactive(solver, m->a) && is_inactive(solver, m->b))) {
+      m->dormant = false;
+    }
+  }
+}
+
+// Renumber the manifolds kept for warm starting after bodies were
+// removed, dropping those that touched a removed body
+void conx_solver_compact(ConXContactSolver *solver, const int *remap) {
+  int kept = 0;
+  for (int i = 0; i < solver->count; i++) {
+    ConXContactManifold m = solver->manifolds[i];
+    m.a = remap[m.a];
+    m.b = remap[m.b];
+    if (m.a < 0 || m.b < 0) continue;
+    solver->manifolds[kept++] = m;
+  }
+  solver->count = kept;
+  solver->previous_count = 0;
+}
+
+// Replace the manifolds kept for warm starting, e.g. from a snapshot
+bool conx_solver_restore(ConXContactSolver *solver, const ConXContactManifold *manifolds, int count) {
+  if (count > solver->capacity) {
+    ConXContactManifold *grown = realloc(solver->manifolds, sizeof(ConXContactManifold) * count);
+    if (!grown) return false;
+    solver->manifolds = grown;
+    solver->capacity = count;
+  }
+
+  if (count > 0) memcpy(solver->manifolds, manifolds, sizeof(ConXContactManifold) * count);
+  solver->count = count;
+  solver->previous_count = 0;
+  return true;
+}
+
+static bool reserve_bodies(ConXContactSolver *solver, int body_count) {
+  if (body_count <= solver->body_capacity) return true;
+
+  float **pseudo[] = {&solver->pseudo_x, &solver->pseudo_y, &solver->pseudo_z};
+  for (int i = 0; i < 3; i++) {
+    float *stream = realloc(*pseudo[i], sizeof(float) * body_count);
+    if (!stream) return false;
+    memset(stream + solver->body_capacity, 0, sizeof(float) * (body_count - solver->body_capacity));
+    *pseudo[i] = stream;
+  }
+
+  int *touched = realloc(solver->touched, sizeof(int) * body_count);
+  if (!touched) return false;
+  solver->touched = touched;
+
+  unsigned char *is_touched = realloc(solver->is_touched, body_count);
+  if (!is_touched) return false;
+  memset(is_touched + solver->body_capacity, 0, body_count - solver->body_capacity);
+  solver->is_touched = is_touched;
+
+  solver->body_capacity = body_count;
+  return true;
+}
+
+static inline bool pair_less(const ConXContactManifold *lhs, const ConXContactManifold *rhs) {
+  return lhs->a < rhs->a || (lhs->a == rhs->a && lhs->b < rhs->b);
+}
+
+static inline float inverse_mass(const ConXBodyStreams *s, const bool *is_static, int id) {
+  return !is_static[id] && s->mass[id] > 0.0f ? 1.0f / s->mass[id] : 0.0f;
+}
+
+// Relative velocity along the normal, positive when separating
+static inline float normal_speed(const float *vx, const float *vy, const float *vz,
+                                 const ConXContactManifold *m) {
+  return (vx[m->a] - vx[m->b]) * m->normal.x +
+         (vy[m->a] - vy[m->b]) * m->normal.y +
+         (vz[m->a] - vz[m->b]) * m->normal.z;
+}
+
+static inline void apply_impulse(float *vx, float *vy, float *vz,
+                                 const ConXContactManifold *m, float impulse) {
+  float px = m->normal.x * impulse;
+  float py = m->normal.y * impulse;
+  float pz = m->normal.z * impulse;
+
+  vx[m->a] += px * m->inv_mass_a;
+  vy[m->a] += py * m->inv_mass_a;
+  vz[m->a] += pz * m->inv_mass_a;
+  vx[m->b] -= px * m->inv_mass_b;
+  vy[m->b] -= py * m->inv_mass_b;
+  vz[m->b] -= pz * m->inv_mass_b;
+}
+
+static inline void touch(ConXContactSolver *solver, int *touched_count, int body, float inv_mass) {
+  if (inv_mass > 0.0f && !solver->is_touched[body]) {
+    solver->is_touched[body] = 1;
+    solver->touched[(*touched_count)++] = body;
+  }
+}
+
+void conx_solver_solve(ConXContactSolver *solver, ConXBodyStreams *streams, int body_count,
+                       const bool *is_static, const float *restitution, int iterations, float dt) {
+  if (solver->count == 0 || dt <= 0.0f || !reserve_bodies(solver, body_count)) return;
+
+  float *vx = streams->velocity_x;
+  float *vy = streams->velocity_y;
+  float *vz = streams->velocity_z;
+  float *px = solver->pseudo_x;
+  float *py = solver->pseudo_y;
+  float *pz = solver->pseudo_z;
+  int touched_count = 0;
+
+  // Prepare constraints, carrying impulses over from contacts that
+  // persisted since the last step
+  int previous = 0;
+  for (int i = 0; i < solver->count; i++) {
+    ConXContactManifold *m = &solver->manifolds[i];
+
+    while (previous < solver->previous_count && pair_less(&solver->previous[previous], m)) {
+      previous++;
+    }
+    if (previous < solver->previous_count) {
+      const ConXContactManifold *old = &solver->previous[previous];
+      if (old->a == m->a && old->b == m->b &&
+          vec3_dot(old->normal, m->normal) > SOLVER_WARM_START_MIN_DOT) {
+        m->normal_impulse = old->normal_impulse;
+      }
+    }
+
+    // Dormant contacts keep their impulse for when the island wakes but
+    // take part as an inert constraint
+    if (m->dormant) {
+      m->inv_mass_a = m->inv_mass_b = 0.0f;
+      m->effective_mass = 0.0f;
+      m->velocity_bias = m->position_bias = 0.0f;
+      continue;
+    }
+
+    m->inv_mass_a = inverse_mass(streams, is_static, m->a);
+    m->inv_mass_b = inverse_mass(streams, is_static, m->b);
+    float k = m->inv_mass_a + m->inv_mass_b;
+    m->effective_mass = k > 0.0f ? 1.0f / k : 0.0f;
+    touch(solver, &touched_count, m->a, m->inv_mass_a);
+    touch(solver, &touched_count, m->b, m->inv_mass_b);
+
+    // Bounce back only if the bodies hit hard enough
+    float approach = normal_speed(vx, vy, vz, m);
+    m->velocity_bias = 0.0f;
+    if (approach < -SOLVER_RESTITUTION_THRESHOLD) {
+      m->velocity_bias = -0.5f * (restitution[m->a] + restitution[m->b]) * approach;
+    }
+
+    float overlap = m->depth - SOLVER_LINEAR_SLOP;
+    m->position_bias = overlap > 0.0f ? SOLVER_BAUMGARTE / dt * overlap : 0.0f;
+  }
+
+  // Warm start
+  for (int i = 0; i < solver->count; i++) {
+    const ConXContactManifold *m = &solver->manifolds[i];
+    if (m->normal_impulse != 0.0f) {
+      apply_impulse(vx, vy, vz, m, m->normal_impulse);
+    }
+  }
+
+  // Sequential impulses. Clamping the accumulated impulse rather than each
+  // increment lets later iterations take back an overshoot.
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    for (int i = 0; i < solver->count; i++) {
+      ConXContactManifold *m = &solver->manifolds[i];
+
+      float lambda = m->effective_mass * (m->velocity_bias - normal_speed(vx, vy, vz, m));
+      float total = m->normal_impulse + lambda;
+      if (total < 0.0f) total = 0.0f;
+      lambda = total - m->normal_impulse;
+      m->normal_impulse = total;
+
+      apply_impulse(vx, vy, vz, m, lambda);
+    }
+  }
+
+  // Penetration is resolved with pseudo velocities that move the bodies
+  // this step and are then dropped, so pushing apart adds no energy
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    for (int i = 0; i < solver->count; i++) {
+      ConXContactManifold *m = &solver->manifolds[i];
+      if (m->position_bias == 0.0f && m->position_impulse == 0.0f) continue;
+
+      float lambda = m->effective_mass * (m->position_bias - normal_speed(px, py, pz, m));
+      float total = m->position_impulse + lambda;
+      if (total < 0.0f) total = 0.0f;
+      lambda = total - m->position_impulse;
+      m->position_impulse = total;
+
+      apply_impulse(px, py, pz, m, lambda);
+    }
+  }
+
+  for (int i = 0; i < touched_count; i++) {
+    int body = solver->touched[i];
+    streams->position_x[body] += px[body] * dt;
+    streams->position_y[body] += py[body] * dt;
+    streams->position_z[body] += pz[body] * dt;
+    px[body] = py[body] = pz[body] = 0.0f;
+    solver->is_touched[body] = 0;
+  }
+}
+
+static bool reserve_events(ConXContactEvent **events, int *event_capacity, int count) {
+  if (count <= *event_capacity) return true;
+
+  int capacity = *event_capacity ? *event_capacity : 256;
+  while (capacity < count) capacity *= 2;
+  ConXContactEvent *grown = realloc(*events, sizeof(ConXContactEvent) * capacity);
+  if (!grown) return false;
+  *events = grown;
+  *event_capacity = capacity;
+  return true;
+}
+
+static inline void write_event(ConXContactEvent *event, const ConXContactManifold *m,
+                               float impulse, ConXContactState state) {
+  event->body1_id = m->a;
+  event->body2_id = m->b;
+  event->normal = m->normal;
+  event->impulse = impulse;
+  event->state = state;
+}
+
+// Merge this step's manifolds with the last step's: pairs only in the new
+// list begin, pairs in both stay, pairs only in the old list end. Dormant
+// pairs report nothing.
+bool conx_solver_build_events(const ConXContactSolver *solver, ConXContactEvent **events,
+                              int *event_count, int *event_capacity) {
+  *event_count = 0;
+  if (!reserve_events(events, event_capacity, solver->count + solver->previous_count)) {
+    return false;
+  }
+
+  ConXContactEvent *out = *events;
+  int count = 0;
+  int i = 0;
+  int previous = 0;
+  while (i < solver->count || previous < solver->previous_count) {
+    const ConXContactManifold *m = i < solver->count ? &solver->manifolds[i] : NULL;
+    const ConXContactManifold *old = previous < solver->previous_count ? &solver->previous[previous] : NULL;
+
+    if (old && (!m || pair_less(old, m))) {
+      write_event(&out[count++], old, 0.0f, CONX_CONTACT_END);
+      previous++;
+      continue;
+    }
+
+    bool persisted = old && old->a == m->a && old->b == m->b;
+    if (!m->dormant) {
+      write_event(&out[count++], m, m->normal_impulse,
+                  persisted ? CONX_CONTACT_STAY : CONX_CONTACT_BEGIN);
+    }
+    if (persisted) previous++;
+    i++;
+  }
+
+  *event_count = count;
+  return true;
+}
@@ -3,6 +3,7 @@
 #include "conx_math.h"
 #include "conx_2d.h"
 #include "conx_3d.h"
+#include "conx_render.h"
 #include "conx_physics.h"
 #include <GL/gl.h>
 #include <stdio.h>
@@ -12,6 +13,13 @@
 static ConXLuaState lua_state = {0};
 static int original_require_ref = LUA_NOREF;
 
+// Grow-only buffer for converting query batches between Lua and C
+static void *query_scratch = NULL;
+static size_t query_scratch_size = 0;
+
+// Physics history for rollback, sized by physics_init's history option
+static ConXSnapshotRing physics_history = {0};
+
 // File tracking for hot reload
 static void add_tracked_file(const char *filepath) {
   if (lua_state.tracked_count >= MAX_TRACKED_FILES) return;
@@ -98,8 +106,28 @@ static int lua_conx_clear_screen(lua_State *L) {
   return 0;
 }
 
+// Draws only point at their mesh or texture until ConX.swap_buffers
+// replays the frame, so the registry keeps each one used this frame
+// referenced until then
+static void pin_frame_resource(lua_State *L, int arg) {
+  lua_getfield(L, LUA_REGISTRYINDEX, "ConX.FrameResources");
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, "ConX.FrameResources");
+  }
+  lua_pushvalue(L, arg);
+  lua_pushboolean(L, 1);
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+}
+
 static int lua_conx_swap_buffers(lua_State *L) {
   conx_swap_buffers();
+  // The frame's draws have replayed, so what they used may be collected
+  lua_pushnil(L);
+  lua_setfield(L, LUA_REGISTRYINDEX, "ConX.FrameResources");
   return 0;
 }
 
@@ -161,17 +189,14 @@ static int lua_conx_set_3d_mode(lua_State *L) {
     if (engine && engine->window) {
       int width, height;
       SDL_GetWindowSize((SDL_Window*)engine->window, &width, &height);
-      glViewport(0, 0, width, height);
-      
-      // Update camera aspect ratio
-      ConXCamera *camera = conx_3d_get_camera();
-      if (camera) {
-        camera->aspect = (float)width / (float)height;
-      }
+      // Sets the viewport and camera aspect ratio
+      conx_3d_resize(width, height);
     }
     
+    conx_make_current();
     glEnable(GL_DEPTH_TEST);
   } else {
+    conx_make_current();
     glDisable(GL_DEPTH_TEST);
   }
   return 0;
@@ -212,6 +237,240 @@ static int lua_conx_draw_sphere(lua_State *L) {
   return 0;
 }
 
+// ConX.get_render_stats() returns the last frame's {draw_calls, instances,
+// triangles, state_changes, state_skipped, culled, occluded, visible,
+// stream_waits, commands, pass_changes}; instances is what draw_calls was
+// before batching, and commands what the render queue sorted
+static int lua_conx_get_render_stats(lua_State *L) {
+  ConXRenderStats stats = conx_3d_get_stats();
+  ConXRenderQueueStats queue = conx_render_get_stats();
+  lua_createtable(L, 0, 11);
+  lua_pushinteger(L, stats.draw_calls);
+  lua_setfield(L, -2, "draw_calls");
+  lua_pushinteger(L, stats.instances);
+  lua_setfield(L, -2, "instances");
+  lua_pushinteger(L, stats.triangles);
+  lua_setfield(L, -2, "triangles");
+  lua_pushinteger(L, stats.state_changes);
+  lua_setfield(L, -2, "state_changes");
+  lua_pushinteger(L, stats.state_skipped);
+  lua_setfield(L, -2, "state_skipped");
+  lua_pushinteger(L, stats.culled);
+  lua_setfield(L, -2, "culled");
+  lua_pushinteger(L, stats.occluded);
+  lua_setfield(L, -2, "occluded");
+  lua_pushinteger(L, stats.visible);
+  lua_setfield(L, -2, "visible");
+  lua_pushinteger(L, stats.stream_waits);
+  lua_setfield(L, -2, "stream_waits");
+  lua_pushinteger(L, queue.commands);
+  lua_setfield(L, -2, "commands");
+  lua_pushinteger(L, queue.pass_changes);
+  lua_setfield(L, -2, "pass_changes");
+  return 1;
+}
+
+// ConX.set_layer(n) for the draws that follow, -128 to 127; lower layers
+// draw first
+static int lua_conx_set_layer(lua_State *L) {
+  conx_render_set_layer((int)luaL_checkinteger(L, 1));
+  return 0;
+}
+
+// ConX.load_mesh(path) returns a mesh from an .obj, .gltf or .glb file,
+// or nil; it is freed when collected
+static int lua_conx_load_mesh(lua_State *L) {
+  ConXMesh *mesh = conx_load_mesh(luaL_checkstring(L, 1));
+  if (!mesh) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  ConXMesh **userdata = (ConXMesh **)lua_newuserdata(L, sizeof(ConXMesh *));
+  *userdata = mesh;
+  luaL_getmetatable(L, "ConX.Mesh");
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+static int lua_mesh_gc(lua_State *L) {
+  ConXMesh **mesh = (ConXMesh **)luaL_checkudata(L, 1, "ConX.Mesh");
+  if (*mesh) {
+    conx_free_mesh(*mesh);
+    *mesh = NULL;
+  }
+  return 0;
+}
+
+static ConXObject3D check_mesh_object(lua_State *L) {
+  ConXObject3D object;
+  object.mesh = *(ConXMesh **)luaL_checkudata(L, 1, "ConX.Mesh");
+  object.position = vec3_create((float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3),
+                                (float)luaL_checknumber(L, 4));
+  object.rotation = vec3_create(0.0f, 0.0f, 0.0f);
+  object.scale = vec3_create((float)luaL_optnumber(L, 5, 1.0), (float)luaL_optnumber(L, 6, 1.0),
+                             (float)luaL_optnumber(L, 7, 1.0));
+  object.color.x = (float)luaL_optnumber(L, 8, 1.0);
+  object.color.y = (float)luaL_optnumber(L, 9, 1.0);
+  object.color.z = (float)luaL_optnumber(L, 10, 1.0);
+  object.color.w = (float)luaL_optnumber(L, 11, 1.0);
+  return object;
+}
+
+// ConX.draw_mesh(mesh, x, y, z, [sx, sy, sz], [r, g, b, a])
+static int lua_conx_draw_mesh(lua_State *L) {
+  ConXObject3D object = check_mesh_object(L);
+  if (!object.mesh) return 0;
+  pin_frame_resource(L, 1);
+  conx_draw_object_3d(&object);
+  return 0;
+}
+
+// ConX.set_occlusion_culling(enabled)
+static int lua_conx_set_occlusion_culling(lua_State *L) {
+  conx_3d_set_occlusion_culling(lua_toboolean(L, 1));
+  return 0;
+}
+
+// ConX.draw_occluder(mesh, x, y, z, [sx, sy, sz]) hides what is behind the
+// mesh this frame without drawing it
+static int lua_conx_draw_occluder(lua_State *L) {
+  ConXObject3D object = check_mesh_object(L);
+  if (!object.mesh) return 0;
+  pin_frame_resource(L, 1);
+  conx_draw_occluder(&object);
+  return 0;
+}
+
+// Retained scene. ConX.scene_add_cube and ConX.scene_add_sphere take the
+// same arguments as the draw calls and return a handle; the object is then
+// drawn every frame until ConX.scene_remove(handle).
+//
+// Scene objects only point at their mesh, so the registry keeps a loaded
+// mesh referenced while a handle uses it
+static void set_scene_mesh_ref(lua_State *L, int handle, int mesh_arg) {
+  lua_getfield(L, LUA_REGISTRYINDEX, "ConX.SceneMeshes");
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, "ConX.SceneMeshes");
+  }
+  lua_pushinteger(L, handle);
+  if (mesh_arg) {
+    lua_pushvalue(L, mesh_arg);
+  } else {
+    lua_pushnil(L);
+  }
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+}
+
+// ConX.scene_add_mesh(mesh, x, y, z, [sx, sy, sz], [r, g, b, a])
+static int lua_conx_scene_add_mesh(lua_State *L) {
+  ConXObject3D object = check_mesh_object(L);
+  if (!object.mesh) return luaL_error(L, "mesh was already freed");
+
+  int handle = conx_scene_add(&object);
+  if (handle >= 0) set_scene_mesh_ref(L, handle, 1);
+  lua_pushinteger(L, handle);
+  return 1;
+}
+
+static int push_scene_object(lua_State *L, ConXMesh *mesh, Vec3 scale, int color_arg) {
+  if (!mesh) return luaL_error(L, "call ConX.set_3d_mode(true) before adding scene objects");
+
+  ConXObject3D object;
+  object.position = vec3_create((float)luaL_checknumber(L, 1), (float)luaL_checknumber(L, 2),
+                                (float)luaL_checknumber(L, 3));
+  object.rotation = vec3_create(0.0f, 0.0f, 0.0f);
+  object.scale = scale;
+  object.color.x = (float)luaL_optnumber(L, color_arg, 1.0);
+  object.color.y = (float)luaL_optnumber(L, color_arg + 1, 1.0);
+  object.color.z = (float)luaL_optnumber(L, color_arg + 2, 1.0);
+  object.color.w = (float)luaL_optnumber(L, color_arg + 3, 1.0);
+  object.mesh = mesh;
+  lua_pushinteger(L, conx_scene_add(&object));
+  return 1;
+}
+
+static int lua_conx_scene_add_cube(lua_State *L) {
+  Vec3 size = {(float)luaL_optnumber(L, 4, 1.0), (float)luaL_optnumber(L, 5, 1.0),
+               (float)luaL_optnumber(L, 6, 1.0)};
+  return push_scene_object(L, conx_3d_get_cube_mesh(), size, 7);
+}
+
+static int lua_conx_scene_add_sphere(lua_State *L) {
+  // The shared mesh has unit diameter
+  float diameter = (float)luaL_checknumber(L, 4) * 2.0f;
+  return push_scene_object(L, conx_3d_get_sphere_mesh(), vec3_create(diameter, diameter, diameter),
+                           5);
+}
+
+static int lua_conx_scene_remove(lua_State *L) {
+  int handle = (int)luaL_checkinteger(L, 1);
+  conx_scene_remove(handle);
+  set_scene_mesh_ref(L, handle, 0);
+  return 0;
+}
+
+static int lua_conx_scene_is_valid(lua_State *L) {
+  lua_pushboolean(L, conx_scene_is_valid((int)luaL_checkinteger(L, 1)));
+  return 1;
+}
+
+static int lua_conx_scene_clear(lua_State *L) {
+  conx_scene_clear();
+  lua_pushnil(L);
+  lua_setfield(L, LUA_REGISTRYINDEX, "ConX.SceneMeshes");
+  return 0;
+}
+
+static int lua_conx_scene_set_position(lua_State *L) {
+  int handle = (int)luaL_checkinteger(L, 1);
+  Vec3 position = {(float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3),
+                   (float)luaL_checknumber(L, 4)};
+  conx_scene_set_position(handle, position);
+  return 0;
+}
+
+// ConX.scene_set_rotation(handle, x, y, z) in degrees, applied x, y then z
+static int lua_conx_scene_set_rotation(lua_State *L) {
+  int handle = (int)luaL_checkinteger(L, 1);
+  const ConXObject3D *object = conx_scene_get(handle);
+  if (!object) return 0;
+  Vec3 rotation = {(float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3),
+                   (float)luaL_checknumber(L, 4)};
+  conx_scene_set_transform(handle, object->position, rotation, object->scale);
+  return 0;
+}
+
+// ConX.scene_set_scale(handle, x, y, z) sets a cube's size; a sphere's
+// radius is half its scale
+static int lua_conx_scene_set_scale(lua_State *L) {
+  int handle = (int)luaL_checkinteger(L, 1);
+  const ConXObject3D *object = conx_scene_get(handle);
+  if (!object) return 0;
+  Vec3 scale = {(float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3),
+                (float)luaL_checknumber(L, 4)};
+  conx_scene_set_transform(handle, object->position, object->rotation, scale);
+  return 0;
+}
+
+static int lua_conx_scene_set_color(lua_State *L) {
+  int handle = (int)luaL_checkinteger(L, 1);
+  Vec4 color = {(float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3),
+                (float)luaL_checknumber(L, 4), (float)luaL_optnumber(L, 5, 1.0)};
+  conx_scene_set_color(handle, color);
+  return 0;
+}
+
+// ConX.scene_set_occluder(handle, occluder)
+static int lua_conx_scene_set_occluder(lua_State *L) {
+  conx_scene_set_occluder((int)luaL_checkinteger(L, 1), lua_toboolean(L, 2));
+  return 0;
+}
+
 static int lua_conx_set_camera(lua_State *L) {
   float px = (float)luaL_checknumber(L, 1);
   float py = (float)luaL_checknumber(L, 2);
@@ -220,12 +479,9 @@ static int lua_conx_set_camera(lua_State *L) {
   float ty = (float)luaL_optnumber(L, 5, 0.0);
   float tz = (float)luaL_optnumber(L, 6, 0.0);
   
-  ConXCamera camera = conx_camera_create(
-    vec3_create(px, py, pz),
-    vec3_create(tx, ty, tz),
-    45.0f
-  );
-  conx_3d_set_camera(&camera);
+  // Moves the current camera, keeping its lens and aspect
+  ConXCamera *camera = conx_3d_get_camera();
+  conx_camera_look_at(camera, vec3_create(px, py, pz), vec3_create(tx, ty, tz), camera->up);
   return 0;
 }
 
@@ -296,6 +552,8 @@ static int lua_conx_draw_texture(lua_State *L) {
   
   Vec2 pos = {x, y};
   Vec2 size = {w, h};
+  if (!*texture) return 0;
+  pin_frame_resource(L, 1);
   conx_draw_texture(*texture, pos, size);
   return 0;
 }
@@ -312,13 +570,81 @@ static int lua_texture_gc(lua_State *L) {
 // Physics functions
 static int lua_conx_physics_init(lua_State *L) {
   int max_bodies = (int)luaL_optnumber(L, 1, 100);
-  bool success = conx_physics_init(max_bodies);
+  ConXPhysicsConfig config = conx_physics_config_create(max_bodies);
+  
+  // Optional settings table:
+  // { broadphase = "sap" | "grid" | "bvh", cell_size = n, threads = n, sleep = bool,
+  //   iterations = n, history = ticks kept for physics_restore_tick }
+  int history = 0;
+  if (lua_istable(L, 2)) {
+    lua_getfield(L, 2, "broadphase");
+    if (lua_isstring(L, -1)) {
+      const char *broadphase = lua_tostring(L, -1);
+      if (strcmp(broadphase, "grid") == 0) {
+        config.broadphase = CONX_BROADPHASE_GRID;
+      } else if (strcmp(broadphase, "bvh") == 0) {
+        config.broadphase = CONX_BROADPHASE_BVH;
+      } else if (strcmp(broadphase, "sap") == 0) {
+        config.broadphase = CONX_BROADPHASE_SAP;
+      } else {
+        return luaL_error(L, "unknown broadphase '%s'", broadphase);
+      }
+    }
+    lua_pop(L, 1);
+    
+    lua_getfield(L, 2, "cell_size");
+    if (lua_isnumber(L, -1)) {
+      config.grid_cell_size = (float)lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+    
+    lua_getfield(L, 2, "threads");
+    if (lua_isnumber(L, -1)) {
+      config.thread_count = (int)lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+    
+    lua_getfield(L, 2, "sleep");
+    if (lua_isboolean(L, -1)) {
+      config.allow_sleep = lua_toboolean(L, -1);
+    }
+    lua_pop(L, 1);
+    
+    lua_getfield(L, 2, "iterations");
+    if (lua_isnumber(L, -1)) {
+      config.solver_iterations = (int)lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, 2, "history");
+    if (lua_isnumber(L, -1)) {
+      history = (int)lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+  }
+  
+  bool success = conx_physics_init_with_config(&config);
+  conx_snapshot_ring_free(&physics_history);
+  if (success && history > 0) {
+    success = conx_snapshot_ring_init(&physics_history, history);
+  }
   lua_pushboolean(L, success);
   return 1;
 }
 
+// Manual stepping. With a tick_rate set, the engine already steps the
+// world once per fixed update, so a second step here is skipped.
 static int lua_conx_physics_update(lua_State *L) {
   float dt = (float)luaL_checknumber(L, 1);
+  ConXEngine *engine = conx_get_engine();
+  if (engine && engine->fixed_delta_time > 0.0) {
+    static bool warned = false;
+    if (!warned) {
+      printf("ConX.physics_update ignored, tick_rate already steps physics\n");
+      warned = true;
+    }
+    return 0;
+  }
   conx_physics_update(dt);
   return 0;
 }
@@ -335,6 +661,18 @@ static int lua_conx_physics_create_body(lua_State *L) {
   return 1;
 }
 
+static int lua_conx_physics_destroy_body(lua_State *L) {
+  int body_id = (int)luaL_checkinteger(L, 1);
+  conx_physics_destroy_body(body_id);
+  return 0;
+}
+
+static int lua_conx_physics_is_valid(lua_State *L) {
+  int body_id = (int)luaL_checkinteger(L, 1);
+  lua_pushboolean(L, conx_physics_is_body_valid(body_id));
+  return 1;
+}
+
 static int lua_conx_physics_set_velocity(lua_State *L) {
   int body_id = (int)luaL_checkinteger(L, 1);
   float x = (float)luaL_checknumber(L, 2);
@@ -346,9 +684,20 @@ static int lua_conx_physics_set_velocity(lua_State *L) {
   return 0;
 }
 
+static int lua_conx_physics_set_position(lua_State *L) {
+  int body_id = (int)luaL_checkinteger(L, 1);
+  float x = (float)luaL_checknumber(L, 2);
+  float y = (float)luaL_checknumber(L, 3);
+  float z = (float)luaL_checknumber(L, 4);
+  
+  Vec3 pos = {x, y, z};
+  conx_physics_set_body_position(body_id, pos);
+  return 0;
+}
+
 static int lua_conx_physics_get_position(lua_State *L) {
   int body_id = (int)luaL_checkinteger(L, 1);
-  ConXRigidBody *body = conx_physics_get_body(body_id);
+  const ConXRigidBody *body = conx_physics_get_body(body_id);
   
   if (body) {
     lua_pushnumber(L, body->position.x);
@@ -359,6 +708,256 @@ static int lua_conx_physics_get_position(lua_State *L) {
   return 0;
 }
 
+// Position blended between the last two fixed steps, for drawing
+static int lua_conx_physics_get_render_position(lua_State *L) {
+  int body_id = (int)luaL_checkinteger(L, 1);
+  if (!conx_physics_get_body(body_id)) return 0;
+
+  ConXEngine *engine = conx_get_engine();
+  float alpha = engine ? engine->interpolation_alpha : 1.0f;
+  Vec3 position = conx_physics_get_interpolated_position(body_id, alpha);
+  lua_pushnumber(L, position.x);
+  lua_pushnumber(L, position.y);
+  lua_pushnumber(L, position.z);
+  return 3;
+}
+
+static int lua_conx_physics_is_sleeping(lua_State *L) {
+  int body_id = (int)luaL_checkinteger(L, 1);
+  lua_pushboolean(L, conx_physics_is_body_sleeping(body_id));
+  return 1;
+}
+
+// ConX.physics_get_contacts([out]) returns last step's contact events as
+// {a, b, nx, ny, nz, impulse, state}. Passing the previous result back in
+// reuses its tables instead of allocating new ones every step.
+static int lua_conx_physics_get_contacts(lua_State *L) {
+  static const char *const state_names[] = {"begin", "stay", "end"};
+  int count = 0;
+  const ConXContactEvent *events = conx_physics_get_contact_events(&count);
+
+  if (lua_istable(L, 1)) {
+    lua_settop(L, 1);
+  } else {
+    lua_settop(L, 0);
+    lua_createtable(L, count, 0);
+  }
+
+  for (int e = 0; e < count; e++) {
+    const ConXContactEvent *event = &events[e];
+
+    lua_rawgeti(L, 1, e + 1);
+    if (!lua_istable(L, -1)) {
+      lua_pop(L, 1);
+      lua_createtable(L, 0, 7);
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, 1, e + 1);
+    }
+    lua_pushinteger(L, event->body1_id);
+    lua_setfield(L, -2, "a");
+    lua_pushinteger(L, event->body2_id);
+    lua_setfield(L, -2, "b");
+    lua_pushnumber(L, event->normal.x);
+    lua_setfield(L, -2, "nx");
+    lua_pushnumber(L, event->normal.y);
+    lua_setfield(L, -2, "ny");
+    lua_pushnumber(L, event->normal.z);
+    lua_setfield(L, -2, "nz");
+    lua_pushnumber(L, event->impulse);
+    lua_setfield(L, -2, "impulse");
+    lua_pushstring(L, state_names[event->state]);
+    lua_setfield(L, -2, "state");
+    lua_pop(L, 1);
+  }
+
+  // Trim entries left over from a step with more contacts
+  for (int e = count + 1;; e++) {
+    lua_rawgeti(L, 1, e);
+    bool done = lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if (done) break;
+    lua_pushnil(L);
+    lua_rawseti(L, 1, e);
+  }
+  return 1;
+}
+
+// Scene queries take flat number arrays, one call per batch, and write
+// flat results. An optional out table is reused instead of allocating.
+
+static void *query_buffer(lua_State *L, size_t size) {
+  if (size > query_scratch_size) {
+    void *buffer = realloc(query_scratch, size);
+    if (!buffer) {
+      luaL_error(L, "Out of memory for physics query");
+      return NULL;
+    }
+    query_scratch = buffer;
+    query_scratch_size = size;
+  }
+  return query_scratch;
+}
+
+static float query_number(lua_State *L, int table, int index) {
+  lua_rawgeti(L, table, index);
+  float value = (float)lua_tonumber(L, -1);
+  lua_pop(L, 1);
+  return value;
+}
+
+static void set_result(lua_State *L, int table, int index, lua_Number value) {
+  lua_pushnumber(L, value);
+  lua_rawseti(L, table, index);
+}
+
+// Leave the result table at out_index on top of the stack
+static int result_table(lua_State *L, int out_index, int size) {
+  if (lua_istable(L, out_index)) {
+    lua_pushvalue(L, out_index);
+  } else {
+    lua_createtable(L, size, 0);
+  }
+  return lua_gettop(L);
+}
+
+// Clear entries a longer earlier batch left past the end
+static void trim_results(lua_State *L, int table, int size) {
+  for (int i = size + 1;; i++) {
+    lua_rawgeti(L, table, i);
+    bool done = lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if (done) break;
+    lua_pushnil(L);
+    lua_rawseti(L, table, i);
+  }
+}
+
+// ConX.physics_raycast(rays[, out]) with rays as {ox, oy, oz, dx, dy, dz,
+// max_distance, ...}. Returns {body, distance, px, py, pz, nx, ny, nz, ...},
+// body being -1 for a miss.
+static int lua_conx_physics_raycast(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  int count = (int)(lua_rawlen(L, 1) / 7);
+  ConXRay *rays = query_buffer(L, (sizeof(ConXRay) + sizeof(ConXRayHit)) * (count + 1));
+  ConXRayHit *hits = (ConXRayHit *)(rays + count);
+
+  for (int i = 0; i < count; i++) {
+    int base = i * 7;
+    rays[i].origin = vec3_create(query_number(L, 1, base + 1), query_number(L, 1, base + 2),
+                                 query_number(L, 1, base + 3));
+    rays[i].direction = vec3_create(query_number(L, 1, base + 4), query_number(L, 1, base + 5),
+                                    query_number(L, 1, base + 6));
+    rays[i].max_distance = query_number(L, 1, base + 7);
+  }
+
+  conx_physics_raycast_batch(rays, count, hits);
+
+  int out = result_table(L, 2, count * 8);
+  for (int i = 0; i < count; i++) {
+    const ConXRayHit *hit = &hits[i];
+    int base = i * 8;
+    set_result(L, out, base + 1, hit->body_id);
+    set_result(L, out, base + 2, hit->distance);
+    set_result(L, out, base + 3, hit->point.x);
+    set_result(L, out, base + 4, hit->point.y);
+    set_result(L, out, base + 5, hit->point.z);
+    set_result(L, out, base + 6, hit->normal.x);
+    set_result(L, out, base + 7, hit->normal.y);
+    set_result(L, out, base + 8, hit->normal.z);
+  }
+  trim_results(L, out, count * 8);
+  return 1;
+}
+
+// ConX.physics_overlap_spheres(spheres, max_per_query[, out]) with spheres
+// as {x, y, z, radius, ...}. Returns one list of body ids per sphere.
+static int lua_conx_physics_overlap_spheres(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  int max_per_query = (int)luaL_checkinteger(L, 2);
+  luaL_argcheck(L, max_per_query > 0, 2, "must be positive");
+  int count = (int)(lua_rawlen(L, 1) / 4);
+  size_t id_count = (size_t)count * max_per_query;
+  ConXSphereQuery *spheres = query_buffer(L, sizeof(ConXSphereQuery) * (count + 1) +
+                                                 sizeof(int) * (id_count + count));
+  int *counts = (int *)(spheres + count);
+  int *body_ids = counts + count;
+
+  for (int i = 0; i < count; i++) {
+    int base = i * 4;
+    spheres[i].center = vec3_create(query_number(L, 1, base + 1), query_number(L, 1, base + 2),
+                                    query_number(L, 1, base + 3));
+    spheres[i].radius = query_number(L, 1, base + 4);
+  }
+
+  conx_physics_overlap_sphere_batch(spheres, count, max_per_query, body_ids, counts);
+
+  int out = result_table(L, 3, count);
+  for (int i = 0; i < count; i++) {
+    lua_rawgeti(L, out, i + 1);
+    if (!lua_istable(L, -1)) {
+      lua_pop(L, 1);
+      lua_createtable(L, counts[i], 0);
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, out, i + 1);
+    }
+    int list = lua_gettop(L);
+    const int *ids = body_ids + (size_t)i * max_per_query;
+    for (int k = 0; k < counts[i]; k++) {
+      lua_pushinteger(L, ids[k]);
+      lua_rawseti(L, list, k + 1);
+    }
+    trim_results(L, list, counts[i]);
+    lua_pop(L, 1);
+  }
+  trim_results(L, out, count);
+  return 1;
+}
+
+// ConX.physics_nearest(points, max_distance[, out]) with points as
+// {x, y, z, ignore_body, ...}; pass -1 to ignore nothing. Returns
+// {body, distance, ...}, body being -1 if none is in range.
+static int lua_conx_physics_nearest(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  float max_distance = (float)luaL_checknumber(L, 2);
+  int count = (int)(lua_rawlen(L, 1) / 4);
+  ConXNearestQuery *queries = query_buffer(L, (sizeof(ConXNearestQuery) + sizeof(ConXNearestHit)) *
+                                                  (count + 1));
+  ConXNearestHit *hits = (ConXNearestHit *)(queries + count);
+
+  for (int i = 0; i < count; i++) {
+    int base = i * 4;
+    queries[i].point = vec3_create(query_number(L, 1, base + 1), query_number(L, 1, base + 2),
+                                   query_number(L, 1, base + 3));
+    queries[i].max_distance = max_distance;
+    queries[i].ignore_body = (int)query_number(L, 1, base + 4);
+  }
+
+  conx_physics_nearest_batch(queries, count, hits);
+
+  int out = result_table(L, 3, count * 2);
+  for (int i = 0; i < count; i++) {
+    set_result(L, out, i * 2 + 1, hits[i].body_id);
+    set_result(L, out, i * 2 + 2, hits[i].distance);
+  }
+  trim_results(L, out, count * 2);
+  return 1;
+}
+
+// ConX.physics_save_tick(tick) keeps the world state for a later
+// ConX.physics_restore_tick(tick), which rolls the world back to it. Only
+// the last `history` ticks are kept.
+static int lua_conx_physics_save_tick(lua_State *L) {
+  uint32_t tick = (uint32_t)luaL_checkinteger(L, 1);
+  lua_pushboolean(L, conx_snapshot_ring_save(&physics_history, conx_physics_get_world(), tick));
+  return 1;
+}
+
+static int lua_conx_physics_restore_tick(lua_State *L) {
+  uint32_t tick = (uint32_t)luaL_checkinteger(L, 1);
+  lua_pushboolean(L, conx_snapshot_ring_restore(&physics_history, conx_physics_get_world(), tick));
+  return 1;
+}
+
 static int lua_conx_physics_set_static(lua_State *L) {
   int body_id = (int)luaL_checkinteger(L, 1);
   bool is_static = lua_toboolean(L, 2);
@@ -444,6 +1043,57 @@ void conx_lua_register_api(void) {
   
   lua_pushcfunction(L, lua_conx_draw_sphere);
   lua_setfield(L, -2, "draw_sphere");
+
+  lua_pushcfunction(L, lua_conx_set_layer);
+  lua_setfield(L, -2, "set_layer");
+
+  lua_pushcfunction(L, lua_conx_load_mesh);
+  lua_setfield(L, -2, "load_mesh");
+
+  lua_pushcfunction(L, lua_conx_draw_mesh);
+  lua_setfield(L, -2, "draw_mesh");
+
+  lua_pushcfunction(L, lua_conx_scene_add_mesh);
+  lua_setfield(L, -2, "scene_add_mesh");
+
+  lua_pushcfunction(L, lua_conx_set_occlusion_culling);
+  lua_setfield(L, -2, "set_occlusion_culling");
+
+  lua_pushcfunction(L, lua_conx_draw_occluder);
+  lua_setfield(L, -2, "draw_occluder");
+
+  lua_pushcfunction(L, lua_conx_scene_add_cube);
+  lua_setfield(L, -2, "scene_add_cube");
+
+  lua_pushcfunction(L, lua_conx_scene_add_sphere);
+  lua_setfield(L, -2, "scene_add_sphere");
+
+  lua_pushcfunction(L, lua_conx_scene_remove);
+  lua_setfield(L, -2, "scene_remove");
+
+  lua_pushcfunction(L, lua_conx_scene_is_valid);
+  lua_setfield(L, -2, "scene_is_valid");
+
+  lua_pushcfunction(L, lua_conx_scene_clear);
+  lua_setfield(L, -2, "scene_clear");
+
+  lua_pushcfunction(L, lua_conx_scene_set_position);
+  lua_setfield(L, -2, "scene_set_position");
+
+  lua_pushcfunction(L, lua_conx_scene_set_rotation);
+  lua_setfield(L, -2, "scene_set_rotation");
+
+  lua_pushcfunction(L, lua_conx_scene_set_scale);
+  lua_setfield(L, -2, "scene_set_scale");
+
+  lua_pushcfunction(L, lua_conx_scene_set_color);
+  lua_setfield(L, -2, "scene_set_color");
+
+  lua_pushcfunction(L, lua_conx_scene_set_occluder);
+  lua_setfield(L, -2, "scene_set_occluder");
+  
+  lua_pushcfunction(L, lua_conx_get_render_stats);
+  lua_setfield(L, -2, "get_render_stats");
   
   lua_pushcfunction(L, lua_conx_set_camera);
   lua_setfield(L, -2, "set_camera");
@@ -478,9 +1128,40 @@ void conx_lua_register_api(void) {
   lua_pushcfunction(L, lua_conx_physics_set_velocity);
   lua_setfield(L, -2, "physics_set_velocity");
   
+  lua_pushcfunction(L, lua_conx_physics_set_position);
+  lua_setfield(L, -2, "physics_set_position");
+
+  lua_pushcfunction(L, lua_conx_physics_destroy_body);
+  lua_setfield(L, -2, "physics_destroy_body");
+
+  lua_pushcfunction(L, lua_conx_physics_is_valid);
+  lua_setfield(L, -2, "physics_is_valid");
+  
   lua_pushcfunction(L, lua_conx_physics_get_position);
   lua_setfield(L, -2, "physics_get_position");
   
+  lua_pushcfunction(L, lua_conx_physics_get_render_position);
+  lua_setfield(L, -2, "physics_get_render_position");
+  
+  lua_pushcfunction(L, lua_conx_physics_is_sleeping);
+  lua_setfield(L, -2, "physics_is_sleeping");
+
+  lua_pushcfunction(L, lua_conx_physics_get_contacts);
+  lua_setfield(L, -2, "physics_get_contacts");
+
+  lua_pushcfunction(L, lua_conx_physics_raycast);
+  lua_setfield(L, -2, "physics_raycast");
+
+  lua_pushcfunction(L, lua_conx_physics_overlap_spheres);
+  lua_setfield(L, -2, "physics_overlap_spheres");
+
+  lua_pushcfunction(L, lua_conx_physics_nearest);
+  lua_setfield(L, -2, "physics_nearest");
+  lua_pushcfunction(L, lua_conx_physics_save_tick);
+  lua_setfield(L, -2, "physics_save_tick");
+  lua_pushcfunction(L, lua_conx_physics_restore_tick);
+  lua_setfield(L, -2, "physics_restore_tick");
+  
   lua_pushcfunction(L, lua_conx_physics_set_static);
   lua_setfield(L, -2, "physics_set_static");
   
@@ -516,6 +1197,15 @@ void conx_lua_register_api(void) {
   lua_settable(L, -3);
   
   lua_pop(L, 1); // Pop metatable
+
+  // Create Mesh metatable
+  luaL_newmetatable(L, "ConX.Mesh");
+
+  lua_pushstring(L, "__gc");
+  lua_pushcfunction(L, lua_mesh_gc);
+  lua_settable(L, -3);
+
+  lua_pop(L, 1); // Pop metatable
 }
 
 bool conx_lua_init(void) {
@@ -548,6 +1238,7 @@ void conx_lua_shutdown(void) {
     lua_state.entry_file = NULL;
   }
   clear_tracked_files();
+  conx_snapshot_ring_free(&physics_history);
   lua_state.initialized = false;
 }
 
@@ -698,6 +1389,24 @@ bool conx_lua_get_config(const char *filename, ConXConfig *config) {
   }
   lua_pop(lua_state.L, 1);
   
+  lua_getfield(lua_state.L, -1, "tick_rate");
+  if (lua_isnumber(lua_state.L, -1)) {
+    config->tick_rate = (int)lua_tonumber(lua_state.L, -1);
+  }
+  lua_pop(lua_state.L, 1);
+  
+  lua_getfield(lua_state.L, -1, "max_substeps");
+  if (lua_isnumber(lua_state.L, -1)) {
+    config->max_substeps = (int)lua_tonumber(lua_state.L, -1);
+  }
+  lua_pop(lua_state.L, 1);
+  
+  lua_getfield(lua_state.L, -1, "core_profile");
+  if (lua_isboolean(lua_state.L, -1)) {
+    config->core_profile = lua_toboolean(lua_state.L, -1);
+  }
+  lua_pop(lua_state.L, 1);
+  
   lua_pop(lua_state.L, 1); // Pop config table
   return true;
 }
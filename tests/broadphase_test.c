@@ -0,0 +1,119 @@
+#include "conx_physics.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Broadphase bookkeeping seen through queries and contacts, with every
+// broadphase.
+
+#define STEPS 10
+#define DT (1.0f / 60.0f)
+
+static bool query_finds(ConXPhysicsWorld *world, Vec3 center, int body) {
+  Vec3 half = vec3_create(0.1f, 0.1f, 0.1f);
+  int ids[8];
+  int count = conx_world_query_aabb(world, vec3_subtract(center, half), vec3_add(center, half),
+                                    ids, 8);
+  for (int i = 0; i < count; i++) {
+    if (ids[i] == body) return true;
+  }
+  return false;
+}
+
+static ConXPhysicsWorld *create_world(ConXBroadphaseType type, const char *name) {
+  ConXPhysicsConfig config = conx_physics_config_create(16);
+  config.broadphase = type;
+  config.grid_cell_size = 1.0f;
+  ConXPhysicsWorld *world = conx_world_create(&config);
+  if (!world) {
+    printf("%s: failed to create world\n", name);
+    return NULL;
+  }
+  conx_world_set_gravity(world, vec3_create(0.0f, 0.0f, 0.0f));
+  return world;
+}
+
+static int create_sphere(ConXPhysicsWorld *world, Vec3 position) {
+  int body = conx_world_create_body(world, position, 1.0f);
+  conx_world_add_sphere_shape(world, body, 0.5f);
+  return body;
+}
+
+// A body moving its own width every step must be found by queries at
+// where it is now, and not where it started
+static bool test_moving_body(ConXBroadphaseType type, const char *name) {
+  ConXPhysicsWorld *world = create_world(type, name);
+  if (!world) return false;
+
+  Vec3 start = vec3_create(0.0f, 0.0f, 0.0f);
+  int body = create_sphere(world, start);
+  conx_world_set_body_velocity(world, body, vec3_create(60.0f, 0.0f, 0.0f));
+
+  bool ok = true;
+  for (int step = 0; step < STEPS && ok; step++) {
+    conx_world_update(world, DT);
+
+    Vec3 position = conx_world_get_body(world, body)->position;
+    if (!query_finds(world, position, body)) {
+      printf("%s: step %d, body missing at its new position\n", name, step);
+      ok = false;
+    }
+  }
+  // Each step moved the body a unit, so the start is far behind it
+  if (ok && query_finds(world, start, body)) {
+    printf("%s: body still found at its starting position\n", name);
+    ok = false;
+  }
+
+  conx_world_destroy(world);
+  return ok;
+}
+
+// A body created in the slot a destroyed one left behind, after the
+// compaction moved a touched body down, must get into the trees and pairs
+static bool test_reused_slot(ConXBroadphaseType type, const char *name) {
+  ConXPhysicsWorld *world = create_world(type, name);
+  if (!world) return false;
+
+  int a = create_sphere(world, vec3_create(-5.0f, 0.0f, 0.0f));
+  int b = create_sphere(world, vec3_create(5.0f, 0.0f, 0.0f));
+  conx_world_update(world, DT);
+  // A query gives both bodies tree proxies whatever the broadphase
+  query_finds(world, vec3_create(5.0f, 0.0f, 0.0f), b);
+
+  Vec3 position = vec3_create(0.0f, 0.0f, 0.0f);
+  conx_world_set_body_position(world, b, position);
+  conx_world_destroy_body(world, a);
+  conx_world_update(world, DT);
+
+  Vec3 overlapping = vec3_create(0.5f, 0.0f, 0.0f);
+  int c = create_sphere(world, overlapping);
+  bool ok = true;
+  if (!query_finds(world, overlapping, c)) {
+    printf("%s: body in a reused slot missing from queries\n", name);
+    ok = false;
+  }
+
+  conx_world_update(world, DT);
+  int event_count = 0;
+  conx_world_get_contact_events(world, &event_count);
+  if (event_count == 0) {
+    printf("%s: body in a reused slot never touched its neighbour\n", name);
+    ok = false;
+  }
+
+  conx_world_destroy(world);
+  return ok;
+}
+
+static bool run(ConXBroadphaseType type, const char *name) {
+  bool ok = test_moving_body(type, name);
+  return test_reused_slot(type, name) && ok;
+}
+
+int main(void) {
+  bool ok = run(CONX_BROADPHASE_SAP, "sap");
+  ok = run(CONX_BROADPHASE_GRID, "grid") && ok;
+  ok = run(CONX_BROADPHASE_BVH, "bvh") && ok;
+  printf(ok ? "broadphase queries ok\n" : "broadphase queries FAILED\n");
+  return ok ? 0 : 1;
+}
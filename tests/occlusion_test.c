@@ -0,0 +1,79 @@
+#include "conx_occlusion.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// A wall in front of the camera, rasterized without GL, must hide a box
+// behind it and nothing else. The camera sits at z = 10 looking down -z;
+// the wall spans 8 by 6 units at z = 0.
+
+#define WIDTH 128
+#define HEIGHT 96
+#define FOV_RADIANS 1.0471976f  // 60 degrees
+
+// Position, then normal
+static float quad_vertices[] = {
+  -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f,
+   0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f,
+   0.5f,  0.5f, 0.0f, 0.0f, 0.0f, 1.0f,
+  -0.5f,  0.5f, 0.0f, 0.0f, 0.0f, 1.0f
+};
+static unsigned int quad_indices[] = {0, 1, 2, 0, 2, 3};
+
+static bool expect(const ConXOcclusionBuffer *buffer, const char *name, Vec3 center,
+                   Vec3 half_extents, bool visible) {
+  if (conx_occlusion_box_visible(buffer, center, half_extents) == visible) return true;
+  printf("%s: reported %s\n", name, visible ? "hidden" : "visible");
+  return false;
+}
+
+int main(void) {
+  ConXOcclusionBuffer *buffer = conx_occlusion_create(WIDTH, HEIGHT, 1);
+  if (!buffer) {
+    printf("Failed to create occlusion buffer\n");
+    return 1;
+  }
+
+  ConXMesh quad = {0};
+  quad.vertices = quad_vertices;
+  quad.indices = quad_indices;
+  quad.vertex_count = 4;
+  quad.index_count = 6;
+  quad.layout = conx_vertex_layout(CONX_VERTEX_FLOAT, CONX_VERTEX_NONE);
+  ConXObject3D wall = {
+    .position = {0.0f, 0.0f, 0.0f},
+    .rotation = {0.0f, 0.0f, 0.0f},
+    .scale = {8.0f, 6.0f, 1.0f},
+    .color = {1.0f, 1.0f, 1.0f, 1.0f},
+    .mesh = &quad
+  };
+
+  Mat4 view = mat4_look_at(vec3_create(0.0f, 0.0f, 10.0f), vec3_create(0.0f, 0.0f, 0.0f),
+                           vec3_create(0.0f, 1.0f, 0.0f));
+  Mat4 projection = mat4_perspective(FOV_RADIANS, (float)WIDTH / HEIGHT, 0.1f, 100.0f);
+  conx_occlusion_begin(buffer, &view, &projection);
+  conx_occlusion_add_occluder(buffer, &wall);
+  conx_occlusion_rasterize(buffer);
+
+  bool ok = true;
+  // The wall covers the middle of the screen but not the corners
+  int width, height;
+  const float *depth = conx_occlusion_get_depth(buffer, &width, &height);
+  if (depth[(height / 2) * width + width / 2] <= 0.0f || depth[0] > 0.0f) {
+    printf("wall coverage wrong: center %f, corner %f\n",
+           depth[(height / 2) * width + width / 2], depth[0]);
+    ok = false;
+  }
+
+  Vec3 unit = vec3_create(1.0f, 1.0f, 1.0f);
+  ok = expect(buffer, "box behind the wall", vec3_create(0.0f, 0.0f, -5.0f), unit, false) && ok;
+  ok = expect(buffer, "box beside the wall", vec3_create(8.0f, 0.0f, -5.0f), unit, true) && ok;
+  ok = expect(buffer, "box in front of the wall", vec3_create(0.0f, 0.0f, 3.0f),
+              vec3_create(0.5f, 0.5f, 0.5f), true) && ok;
+  ok = expect(buffer, "box crossing the near plane", vec3_create(0.0f, 0.0f, 10.0f), unit,
+              true) && ok;
+  ok = expect(buffer, "box off screen", vec3_create(40.0f, 0.0f, -5.0f), unit, true) && ok;
+
+  conx_occlusion_destroy(buffer);
+  printf(ok ? "occlusion tests ok\n" : "occlusion tests FAILED\n");
+  return ok ? 0 : 1;
+}
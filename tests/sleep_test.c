@@ -0,0 +1,71 @@
+#include "conx_physics.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// A stack of two boxes on static ground settles, then a heavy ball lands
+// on it. Whether the stack was asleep when the ball hit must not matter:
+// the step that wakes it must also hold it up, so the top box sinks into
+// the bottom one no further than in a world that never sleeps.
+
+#define DT (1.0f / 60.0f)
+#define SETTLE_STEPS 600
+#define IMPACT_STEPS 30
+#define SINK_TOLERANCE 0.01f
+
+// Deepest the top box got into the bottom one after the impact, or a
+// negative value on failure
+static float run(bool allow_sleep, const char *name) {
+  ConXPhysicsConfig config = conx_physics_config_create(8);
+  config.allow_sleep = allow_sleep;
+  ConXPhysicsWorld *world = conx_world_create(&config);
+  if (!world) {
+    printf("%s: failed to create world\n", name);
+    return -1.0f;
+  }
+
+  int ground = conx_world_create_body(world, vec3_create(0.0f, -0.5f, 0.0f), 0.0f);
+  conx_world_add_box_shape(world, ground, vec3_create(10.0f, 0.5f, 10.0f));
+  conx_world_set_body_static(world, ground, true);
+  Vec3 half = vec3_create(0.5f, 0.5f, 0.5f);
+  int bottom = conx_world_create_body(world, vec3_create(0.0f, 0.5f, 0.0f), 1.0f);
+  conx_world_add_box_shape(world, bottom, half);
+  int top = conx_world_create_body(world, vec3_create(0.0f, 1.5f, 0.0f), 1.0f);
+  conx_world_add_box_shape(world, top, half);
+
+  for (int step = 0; step < SETTLE_STEPS; step++) {
+    conx_world_update(world, DT);
+    if (conx_world_is_body_sleeping(world, top)) break;
+  }
+  if (allow_sleep && !conx_world_is_body_sleeping(world, top)) {
+    printf("%s: stack never fell asleep\n", name);
+    conx_world_destroy(world);
+    return -1.0f;
+  }
+
+  int ball = conx_world_create_body(world, vec3_create(0.0f, 2.6f, 0.0f), 4.0f);
+  conx_world_add_sphere_shape(world, ball, 0.5f);
+  conx_world_set_body_velocity(world, ball, vec3_create(0.0f, -8.0f, 0.0f));
+
+  float sink = 0.0f;
+  for (int step = 0; step < IMPACT_STEPS; step++) {
+    conx_world_update(world, DT);
+    float gap = conx_world_get_body(world, top)->position.y -
+                conx_world_get_body(world, bottom)->position.y;
+    if (1.0f - gap > sink) sink = 1.0f - gap;
+  }
+
+  conx_world_destroy(world);
+  return sink;
+}
+
+int main(void) {
+  float awake = run(false, "awake");
+  float woken = run(true, "woken");
+  bool ok = awake >= 0.0f && woken >= 0.0f;
+  if (ok && woken > awake + SINK_TOLERANCE) {
+    printf("woken stack sank %f, awake stack %f\n", woken, awake);
+    ok = false;
+  }
+  printf(ok ? "sleep tests ok\n" : "sleep tests FAILED\n");
+  return ok ? 0 : 1;
+}
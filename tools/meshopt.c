@@ -0,0 +1,61 @@
+#include "conx_3d.h"
+#include "conx_meshopt.h"
+#include <stdio.h>
+#include <string.h>
+
+// Prepares a model for shipping: imports it, welds identical vertices,
+// orders triangles for the post-transform cache and vertices for fetch,
+// packs normals to 8 bits and texture coordinates to 16, and writes the
+// result as the model's .cxmesh, stamped so conx_load_mesh uses it while
+// the source is unchanged.
+// Usage: conx_meshopt [--float] <model> [output]
+// --float keeps full-precision attributes; output defaults to
+// <model>.cxmesh.
+
+static void print_usage(void) {
+  printf("Usage: conx_meshopt [--float] <model.obj|model.gltf|model.glb> [output.cxmesh]\n");
+}
+
+int main(int argc, char **argv) {
+  bool keep_float = false;
+  const char *paths[2] = {NULL, NULL};
+  int path_count = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--float") == 0) {
+      keep_float = true;
+    } else if (argv[i][0] != '-' && path_count < 2) {
+      paths[path_count++] = argv[i];
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+  if (path_count == 0) {
+    print_usage();
+    return 1;
+  }
+
+  ConXMesh *mesh = conx_import_mesh(paths[0]);
+  if (!mesh) return 1;
+
+  int imported_vertices = mesh->vertex_count;
+  float acmr_before = conx_meshopt_acmr(mesh, CONX_MESHOPT_CACHE_SIZE);
+  bool ok = conx_meshopt_weld(mesh) && conx_meshopt_vertex_cache(mesh) &&
+            conx_meshopt_vertex_fetch(mesh);
+  if (ok && !keep_float) {
+    ConXVertexFormat texcoord = mesh->layout.texcoord_format == CONX_VERTEX_NONE
+                                    ? CONX_VERTEX_NONE
+                                    : CONX_VERTEX_UNORM16;
+    ok = conx_mesh_set_layout(mesh, conx_vertex_layout(CONX_VERTEX_SNORM8, texcoord));
+  }
+  if (ok) {
+    printf("Vertices: %d -> %d\n", imported_vertices, mesh->vertex_count);
+    printf("ACMR (%d-entry FIFO): %.3f -> %.3f\n", CONX_MESHOPT_CACHE_SIZE, acmr_before,
+           conx_meshopt_acmr(mesh, CONX_MESHOPT_CACHE_SIZE));
+    printf("Vertex size: %d bytes\n", mesh->layout.stride);
+    ok = conx_mesh_write_cache(mesh, paths[0], paths[1]);
+  }
+
+  conx_free_mesh(mesh);
+  return ok ? 0 : 1;
+}